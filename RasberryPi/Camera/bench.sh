@@ -0,0 +1,44 @@
+#!/bin/sh
+# h264_stream 디코딩 -> 변환 -> 출력 벤치마크 (화면 없이)
+#
+# 사용법: ./bench.sh [min_fps]
+#   samples/ 에 클립이 없으면 ffmpeg 합성 소스(testsrc2)로 만들고,
+#   클립마다 h264_stream -b 를 돌려 BENCH 줄을 모음. min_fps 보다 느리면 실패 (CI 용)
+#
+# 클립은 시드 없는 합성 패턴이라 같은 ffmpeg/x264 로 만들면 항상 같은 파일이 나옴
+# 한번 만든 samples/*.mp4 를 저장소에 넣어두면 장비가 달라도 같은 입력으로 비교 가능
+
+set -e
+cd "$(dirname "$0")"
+
+MIN_FPS=${1:-0}
+SAMPLES=samples
+PROG=./h264_stream
+
+if [ ! -x $PROG ]; then
+    gcc -O2 -o h264_stream h264_stream.c display.c playclock.c framequeue.c stats.c \
+        -lavformat -lavcodec -lavutil -lswscale -lpthread
+fi
+
+# 이름 크기 fps 길이(초) 추가 x264 옵션
+make_clip() {
+    out=$SAMPLES/$1.mp4
+    [ -f "$out" ] && return
+    ffmpeg -hide_banner -loglevel error -f lavfi -i "testsrc2=size=$2:rate=$3" -t "$4" \
+        -c:v libx264 -preset medium -pix_fmt yuv420p -g 50 $5 "$out"
+}
+
+mkdir -p $SAMPLES
+make_clip vga_30      640x480   30 10 ""
+make_clip svga_25     800x600   25 10 ""
+make_clip hd_30       1280x720  30 10 ""
+make_clip hd_slices   1280x720  30 10 "-x264-params slices=4"
+make_clip fhd_bframes 1920x1080 30 10 "-bf 3"
+
+status=0
+for clip in $SAMPLES/*.mp4; do
+    # 800x600 16bpp 메모리 프레임버퍼 (라즈베리파이 화면과 같은 조건)
+    if out=$($PROG -b -m "$MIN_FPS" "$clip" mem:800x600x16); then :; else status=1; fi
+    echo "$out" | grep '^BENCH'
+done
+exit $status
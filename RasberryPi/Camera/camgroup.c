@@ -0,0 +1,294 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "camgroup.h"
+
+struct cam {
+    struct camgroup *g;
+    int index;
+    struct capture *cap;
+    struct capture_format fmt;
+    pthread_t thread;
+    int started;
+
+    // 처리를 기다리는 프레임 (캡처 버퍼를 들고 있음). 아래는 모두 g->lock 으로 보호
+    struct capture_frame *q;
+    int q_head;
+    int q_len;
+    int busy;                    // 워커 하나가 이 카메라 프레임을 처리 중
+    struct camgroup_stats st;
+    double process_total_ms;
+};
+
+struct camgroup {
+    struct camgroup_config cfg;
+    struct cam cams[CAMGROUP_MAX];
+    pthread_t *workers;
+    int n_workers;               // 시작한 워커 수
+    int next_id;                 // 워커 스레드 이름용
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;         // 처리할 프레임이 생김 / 끝
+    int stop;                    // 캡처 스레드 종료 (atomic 으로 읽음)
+    int done;                    // 워커 종료 (남은 프레임은 처리하고)
+    int next;                    // 다음에 먼저 볼 카메라 (돌아가면서)
+};
+
+void camgroup_config_default(struct camgroup_config *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    for (int i = 0; i < CAMGROUP_MAX; i++) {
+        capture_config_default(&cfg->cam[i]);
+        cfg->cpu[i] = -1;
+    }
+    cfg->queue = 2;
+}
+
+// 지금 스레드를 mask 의 코어들에만 돌게 함. 실패해도 (코어가 없거나 권한) 계속 진행
+static void pin_thread(unsigned long mask, const char *name)
+{
+    cpu_set_t set;
+    int r;
+
+    pthread_setname_np(pthread_self(), name);
+    if (!mask)
+        return;
+    CPU_ZERO(&set);
+    for (int i = 0; i < (int)sizeof(mask) * 8; i++)
+        if (mask & (1UL << i))
+            CPU_SET(i, &set);
+    r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (r)
+        fprintf(stderr, "%s: could not set CPU affinity: %s\n", name, strerror(r));
+}
+
+static void *capture_thread(void *arg)
+{
+    struct cam *c = arg;
+    struct camgroup *g = c->g;
+    char name[16];
+
+    snprintf(name, sizeof(name), "cam%d", c->index);
+    pin_thread(g->cfg.cpu[c->index] >= 0 ? 1UL << g->cfg.cpu[c->index] : 0, name);
+
+    while (!__atomic_load_n(&g->stop, __ATOMIC_RELAXED)) {
+        struct capture_frame f;
+        // 멈추라는 요청을 보려고 기다리는 시간을 짧게 잡음
+        int r = capture_read(c->cap, &f, 500);
+
+        pthread_mutex_lock(&g->lock);
+        capture_get_stats(c->cap, &c->st.capture);
+        if (r < 0) {
+            // 이 카메라만 멈춤 (뽑혔거나 드라이버 오류). 다른 카메라는 계속
+            c->st.failed = 1;
+            pthread_mutex_unlock(&g->lock);
+            fprintf(stderr, "%s: capture failed, camera stopped\n", g->cfg.cam[c->index].source);
+            break;
+        }
+        if (r == 0) {
+            c->st.timeouts++;
+            pthread_mutex_unlock(&g->lock);
+            continue;
+        }
+        if (c->q_len == g->cfg.queue) {
+            // 처리가 밀림. 기다리지 않고 버려야 드라이버 버퍼가 마르지 않음
+            c->st.skipped++;
+            pthread_mutex_unlock(&g->lock);
+            capture_release(c->cap, &f);
+            continue;
+        }
+        c->q[(c->q_head + c->q_len) % g->cfg.queue] = f;
+        c->q_len++;
+        pthread_cond_signal(&g->cond);
+        pthread_mutex_unlock(&g->lock);
+    }
+    return NULL;
+}
+
+// 처리 중이 아닌 카메라의 가장 오래된 프레임을 꺼냄 (lock 을 잡은 상태에서)
+// 매번 다른 카메라부터 봐서 한 카메라가 워커를 독차지하지 않게 함
+static struct cam *take_frame(struct camgroup *g, struct capture_frame *f)
+{
+    for (int k = 0; k < g->cfg.n_cams; k++) {
+        struct cam *c = &g->cams[(g->next + k) % g->cfg.n_cams];
+
+        if (c->q_len && !c->busy) {
+            *f = c->q[c->q_head];
+            c->q_head = (c->q_head + 1) % g->cfg.queue;
+            c->q_len--;
+            c->busy = 1;
+            g->next = (c->index + 1) % g->cfg.n_cams;
+            return c;
+        }
+    }
+    return NULL;
+}
+
+static void *worker_thread(void *arg)
+{
+    struct camgroup *g = arg;
+    struct capture_frame f;
+    char name[16];
+    int id;
+
+    pthread_mutex_lock(&g->lock);
+    id = g->next_id++;
+    pthread_mutex_unlock(&g->lock);
+    snprintf(name, sizeof(name), "camwork%d", id);
+    pin_thread(g->cfg.worker_cpus, name);
+
+    pthread_mutex_lock(&g->lock);
+    while (1) {
+        struct cam *c = take_frame(g, &f);
+        if (!c) {
+            if (g->done)
+                break;
+            pthread_cond_wait(&g->cond, &g->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&g->lock);
+
+        int64_t t0 = capture_now_us();
+        g->cfg.process(g->cfg.arg, c->index, &f);
+        double ms = (capture_now_us() - t0) / 1e3;
+        capture_release(c->cap, &f);
+
+        pthread_mutex_lock(&g->lock);
+        c->busy = 0;
+        c->st.processed++;
+        c->process_total_ms += ms;
+        if (ms > c->st.process_max_ms)
+            c->st.process_max_ms = ms;
+    }
+    pthread_mutex_unlock(&g->lock);
+    return NULL;
+}
+
+static void close_cams(struct camgroup *g)
+{
+    for (int i = 0; i < g->cfg.n_cams; i++) {
+        capture_close(g->cams[i].cap);
+        free(g->cams[i].q);
+    }
+}
+
+struct camgroup *camgroup_open(const struct camgroup_config *cfg)
+{
+    struct camgroup *g = calloc(1, sizeof(*g));
+
+    if (!g) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+    g->cfg = *cfg;
+    if (g->cfg.n_cams < 1 || g->cfg.n_cams > CAMGROUP_MAX) {
+        fprintf(stderr, "camgroup: %d cameras (1..%d)\n", g->cfg.n_cams, CAMGROUP_MAX);
+        free(g);
+        return NULL;
+    }
+
+    for (int i = 0; i < g->cfg.n_cams; i++) {
+        struct cam *c = &g->cams[i];
+        c->g = g;
+        c->index = i;
+        c->cap = capture_open(&g->cfg.cam[i]);
+        if (!c->cap) {
+            fprintf(stderr, "%s: could not open\n", g->cfg.cam[i].source);
+            close_cams(g);
+            free(g);
+            return NULL;
+        }
+        capture_get_format(c->cap, &c->fmt);
+    }
+    // 대기 칸 수는 모든 카메라가 같게 (가장 적은 버퍼 수 기준)
+    // 소스(V4L2, synth)는 쥐고 있는 버퍼를 다시 쓰지 않으므로 큐 + 처리 중 하나 + 캡처 하나만 남으면 됨
+    for (int i = 0; i < g->cfg.n_cams; i++)
+        if (g->cfg.queue > g->cams[i].fmt.buffers - 2)
+            g->cfg.queue = g->cams[i].fmt.buffers - 2;
+    if (g->cfg.queue < 1)
+        g->cfg.queue = 1;
+    for (int i = 0; i < g->cfg.n_cams; i++) {
+        g->cams[i].q = calloc(g->cfg.queue, sizeof(struct capture_frame));
+        if (!g->cams[i].q) {
+            fprintf(stderr, "Out of memory\n");
+            close_cams(g);
+            free(g);
+            return NULL;
+        }
+    }
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->cond, NULL);
+    return g;
+}
+
+int camgroup_start(struct camgroup *g)
+{
+    int workers = g->cfg.workers > 0 ? g->cfg.workers : sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (workers < 1)
+        workers = 1;
+    g->workers = calloc(workers, sizeof(pthread_t));
+    for (int i = 0; g->workers && i < workers; i++) {
+        if (pthread_create(&g->workers[i], NULL, worker_thread, g) != 0)
+            break;
+        g->n_workers++;
+    }
+    if (!g->n_workers) {
+        fprintf(stderr, "camgroup: could not start workers\n");
+        return -1;
+    }
+    // 워커가 먼저 떠 있어야 첫 프레임부터 처리됨
+    for (int i = 0; i < g->cfg.n_cams; i++) {
+        if (pthread_create(&g->cams[i].thread, NULL, capture_thread, &g->cams[i]) != 0) {
+            fprintf(stderr, "%s: could not start capture thread\n", g->cfg.cam[i].source);
+            return -1;
+        }
+        g->cams[i].started = 1;
+    }
+    return 0;
+}
+
+void camgroup_close(struct camgroup *g)
+{
+    if (!g)
+        return;
+
+    __atomic_store_n(&g->stop, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < g->cfg.n_cams; i++)
+        if (g->cams[i].started)
+            pthread_join(g->cams[i].thread, NULL);
+
+    // 캡처가 멈춘 뒤 대기 중인 프레임까지 처리하고 워커 종료
+    pthread_mutex_lock(&g->lock);
+    g->done = 1;
+    pthread_cond_broadcast(&g->cond);
+    pthread_mutex_unlock(&g->lock);
+    for (int i = 0; i < g->n_workers; i++)
+        pthread_join(g->workers[i], NULL);
+
+    close_cams(g);
+    pthread_mutex_destroy(&g->lock);
+    pthread_cond_destroy(&g->cond);
+    free(g->workers);
+    free(g);
+}
+
+void camgroup_get_format(struct camgroup *g, int cam, struct capture_format *fmt)
+{
+    *fmt = g->cams[cam].fmt;
+}
+
+void camgroup_get_stats(struct camgroup *g, int cam, struct camgroup_stats *st)
+{
+    struct cam *c = &g->cams[cam];
+
+    pthread_mutex_lock(&g->lock);
+    *st = c->st;
+    st->process_ms = c->st.processed ? c->process_total_ms / c->st.processed : 0;
+    pthread_mutex_unlock(&g->lock);
+}
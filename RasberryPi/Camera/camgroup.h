@@ -0,0 +1,61 @@
+#ifndef CAMGROUP_H
+#define CAMGROUP_H
+
+#include "capture.h"
+
+// 여러 카메라를 동시에 캡처하는 관리자
+// 카메라마다 자기 버퍼와 캡처 스레드(지정한 코어에 고정)를 갖고, 처리(변환/인코딩/전송)는
+// 모든 카메라가 같이 쓰는 워커 풀에서 함
+//
+// - 같은 카메라의 프레임은 들어온 순서대로 한 번에 하나씩만 처리 (인코더 상태를 카메라별로 둬도 됨)
+//   다른 카메라 프레임은 워커 수만큼 동시에
+// - 캡처 스레드는 절대 기다리지 않음. 그 카메라의 대기 칸(queue)이 차 있으면 프레임을 바로 돌려주고
+//   skipped 로 셈 -> 느리거나 멈춘 카메라가 다른 카메라의 캡처/처리를 막지 않음
+// - 처리 함수가 끝나면 관리자가 캡처 버퍼를 돌려줌 (처리 함수 안에서 capture_release 하지 않음)
+
+#define CAMGROUP_MAX 8
+
+// 워커에서 불림. cam 은 camgroup_config.cam 의 번호
+typedef void (*camgroup_fn)(void *arg, int cam, const struct capture_frame *f);
+
+struct camgroup_config {
+    int n_cams;
+    struct capture_config cam[CAMGROUP_MAX];
+    int cpu[CAMGROUP_MAX];       // 캡처 스레드를 고정할 코어. -1 이면 고정하지 않음
+    int workers;                 // 처리 스레드 수. 0 이면 CPU 수
+    unsigned long worker_cpus;   // 처리 스레드가 돌 코어 비트마스크. 0 이면 제한 없음
+    int queue;                   // 카메라마다 처리를 기다릴 수 있는 프레임 수
+                                 // 처리 중인 것까지 들고 있어도 드라이버에 버퍼가 하나는 남게 버퍼 수 - 2 이하로 맞춰짐
+    camgroup_fn process;
+    void *arg;
+};
+
+// 카메라 하나의 누적 값
+struct camgroup_stats {
+    struct capture_stats capture;   // 드라이버 쪽 (frames, dropped, errors)
+    unsigned long skipped;          // 처리가 밀려서 워커에 넘기지 못하고 버린 프레임
+    unsigned long timeouts;         // 프레임을 기다리다 시간이 지난 횟수 (멈춘 카메라)
+    unsigned long processed;
+    double process_ms;              // 처리 함수 평균 시간
+    double process_max_ms;
+    int failed;                     // 캡처 오류로 이 카메라만 멈춤
+};
+
+struct camgroup;
+
+void camgroup_config_default(struct camgroup_config *cfg);
+
+// 모든 카메라를 엶 (포맷 협상, 버퍼, 스트리밍 시작). 하나라도 못 열면 NULL
+// 스레드는 아직 돌지 않으므로 camgroup_get_format 으로 실제 크기를 보고 처리 쪽(인코더 등)을 준비하면 됨
+struct camgroup *camgroup_open(const struct camgroup_config *cfg);
+
+// 캡처/워커 스레드 시작. 이때부터 process 가 불림
+int camgroup_start(struct camgroup *g);
+
+// 캡처를 멈추고, 이미 받은 프레임은 처리한 뒤 모두 닫음
+void camgroup_close(struct camgroup *g);
+
+void camgroup_get_format(struct camgroup *g, int cam, struct capture_format *fmt);
+void camgroup_get_stats(struct camgroup *g, int cam, struct camgroup_stats *st);
+
+#endif // CAMGROUP_H
@@ -0,0 +1,1259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <linux/videodev2.h>
+
+#include "capture.h"
+#include "h264nal.h"
+#include "shmring.h"
+
+#define NSEC_PER_SEC 1000000000LL
+
+// V4L2 에서 mmap 으로 받은 버퍼
+struct buffer {
+    void *start;
+    size_t length;
+};
+
+struct capture {
+    struct capture_config cfg;
+    int (*read)(struct capture *c, struct capture_frame *f, int timeout_ms);
+    int (*release)(struct capture *c, const struct capture_frame *f);
+    void (*close)(struct capture *c);
+
+    struct capture_format fmt;
+
+    // 놓친 프레임 계산 (capture_read 에서 모든 백엔드 공통)
+    struct capture_stats stats;
+    unsigned int last_sequence;
+
+    // V4L2
+    int fd;
+    struct buffer *buffers;
+    unsigned int n_buffers;
+    int streaming;
+
+    // 합성 소스
+    int fast;
+    int drop_every;              // N 이면 N 프레임마다 하나를 건너뜀 (드라이버가 프레임을 놓친 상황 흉내)
+    unsigned char *bars;         // 두 화면 폭만큼의 컬러바 한 줄 (스크롤할 때 memcpy 한번으로 끝나게)
+                                 // NV12 는 Y 줄 다음에 UV 줄
+    unsigned char **frames;      // 돌려쓰는 출력 버퍼
+    int next;
+    uint32_t held;               // 내보내고 아직 돌려받지 않은 버퍼 (비트). 다시 쓰지 않음 (V4L2 처럼)
+                                 // 다른 스레드에서 돌려줄 수 있으므로 atomic 으로만 바꾸고, 모두 쥐고 있을 때 futex 로 기다림
+    unsigned int sequence;
+    struct timespec start;
+
+    // H.264 파일 소스 (합성 소스의 fast/sequence/start 도 같이 씀)
+    const uint8_t *file;         // mmap 한 Annex B 파일 전체
+    size_t file_len;
+    size_t file_pos;             // 다음 접근 단위 위치
+
+    // 공유 메모리 링 (다른 프로세스의 캡처를 나눠 받음)
+    struct shmring *shm;
+
+    // 관심 영역 (ROI)
+    int full_width, full_height; // ROI 없이 열었을 때의 크기 (ROI 좌표의 기준)
+    struct capture_format out;   // ROI 를 적용한 포맷 (capture_get_format). fmt 는 백엔드가 내보내는 그대로
+    struct capture_rect hw;      // 하드웨어가 잘라 주는 창. width 0 이면 없음
+    struct capture_rect roi;     // 지금 ROI
+    int crop;                    // 포인터 crop 중 (capture_read 에서 data/크기를 ROI 로 바꿈)
+    size_t roi_offset;           // 프레임 시작에서 ROI 왼쪽 위까지 바이트
+};
+
+void capture_config_default(struct capture_config *cfg)
+{
+    cfg->source = "/dev/video0";
+    cfg->pixelformat = 0;
+    cfg->width = 800;
+    cfg->height = 600;
+    cfg->fps = 0;
+    cfg->buffers = 4;
+    memset(&cfg->roi, 0, sizeof(cfg->roi));
+}
+
+int capture_parse_spec(struct capture_config *cfg, const char *spec)
+{
+    const char *p = spec;
+    char *end;
+
+    if (*p >= '0' && *p <= '9') {
+        long w = strtol(p, &end, 10);
+        if (*end != 'x')
+            return -1;
+        const char *hs = end + 1;
+        long h = strtol(hs, &end, 10);
+        if (end == hs)
+            return -1;
+        cfg->width = w;
+        cfg->height = h;
+        p = end;
+    }
+    if (*p == '@') {
+        cfg->fps = strtol(p + 1, &end, 10);
+        p = end;
+    }
+    if (*p == ':') {
+        p++;
+        if (strlen(p) != 4)
+            return -1;
+        cfg->pixelformat = v4l2_fourcc(p[0], p[1], p[2], p[3]);
+        p += 4;
+    }
+    return *p ? -1 : 0;
+}
+
+int capture_parse_roi(struct capture_rect *r, const char *spec)
+{
+    char *end;
+
+    r->width = strtol(spec, &end, 10);
+    if (end == spec || *end != 'x')
+        return -1;
+    spec = end + 1;
+    r->height = strtol(spec, &end, 10);
+    if (end == spec || r->width <= 0 || r->height <= 0)
+        return -1;
+    r->left = r->top = -1;
+    if (*end == '\0')
+        return 0;
+    if (*end != '+')
+        return -1;
+    spec = end + 1;
+    r->left = strtol(spec, &end, 10);
+    if (end == spec || *end != '+')
+        return -1;
+    spec = end + 1;
+    r->top = strtol(spec, &end, 10);
+    return end == spec || *end || r->left < 0 || r->top < 0 ? -1 : 0;
+}
+
+const char *capture_fourcc_str(unsigned int fourcc, char *buf)
+{
+    for (int i = 0; i < 4; i++)
+        buf[i] = (fourcc >> (8 * i)) & 0xff;
+    buf[4] = '\0';
+    return buf;
+}
+
+int capture_planes(const struct capture_frame *f, const unsigned char *plane[3], int stride[3])
+{
+    plane[0] = f->data;
+    stride[0] = f->stride;
+    plane[1] = plane[2] = NULL;
+    stride[1] = stride[2] = 0;
+
+    switch (f->pixelformat) {
+    case V4L2_PIX_FMT_NV12:
+        plane[1] = f->data + (size_t)f->stride * f->height;
+        stride[1] = f->stride;
+        return 2;
+    case V4L2_PIX_FMT_YUV420:
+        plane[1] = f->data + (size_t)f->stride * f->height;
+        plane[2] = plane[1] + (size_t)f->stride / 2 * (f->height / 2);
+        stride[1] = stride[2] = f->stride / 2;
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+// 합성/파일 소스의 캡처 시각도 이 시계 (V4L2 버퍼 타임스탬프와 같은 CLOCK_MONOTONIC)
+int64_t capture_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void capture_get_format(struct capture *c, struct capture_format *fmt)
+{
+    *fmt = c->out;
+}
+
+// 포맷별 한 줄 최소 바이트 수와 프레임 크기 (압축 포맷은 0)
+static int min_stride(unsigned int pixfmt, int width)
+{
+    switch (pixfmt) {
+    case V4L2_PIX_FMT_YUYV: return width * 2;
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_YUV420: return width;
+    default: return 0;
+    }
+}
+
+static size_t frame_bytes(unsigned int pixfmt, int stride, int height)
+{
+    switch (pixfmt) {
+    case V4L2_PIX_FMT_YUYV: return (size_t)stride * height;
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_YUV420: return (size_t)stride * height * 3 / 2;
+    default: return 0;
+    }
+}
+
+// ROI 를 base 안으로 정리. left/top 이 -1 이면 가운데, 모두 짝수로 내림 (YUYV 매크로픽셀, 4:2:0 색차)
+static int roi_resolve(const struct capture_rect *base, const struct capture_rect *in, struct capture_rect *out)
+{
+    struct capture_rect r = *in;
+
+    if (r.width <= 0 || r.height <= 0 || r.width > base->width || r.height > base->height)
+        return -1;
+    if (r.left < 0)
+        r.left = base->left + (base->width - r.width) / 2;
+    if (r.top < 0)
+        r.top = base->top + (base->height - r.height) / 2;
+    r.left &= ~1;
+    r.top &= ~1;
+    r.width &= ~1;
+    r.height &= ~1;
+    if (r.width == 0 || r.height == 0 || r.left < base->left || r.top < base->top ||
+        r.left + r.width > base->left + base->width || r.top + r.height > base->top + base->height)
+        return -1;
+    *out = r;
+    return 0;
+}
+
+static int xioctl(int fd, int request, void *arg)
+{
+    int r;
+    do r = ioctl(fd, request, arg); while (r == -1 && errno == EINTR);
+    return r;
+}
+
+/* ---------------------------------------------------------------- V4L2 */
+
+static int v4l2_read(struct capture *c, struct capture_frame *f, int timeout_ms)
+{
+    struct pollfd pfd = { c->fd, POLLIN, 0 };
+    struct v4l2_buffer buf;
+    int r;
+
+    while (1) {
+        // 카메라에 새 프레임이 들어올 때까지 기다림
+        // timeout_ms 가 0 이면 바깥 이벤트 루프(capture_fd)가 이미 기다린 것 -> fd 가 O_NONBLOCK 이라 바로 DQBUF
+        if (timeout_ms != 0) {
+            r = poll(&pfd, 1, timeout_ms);
+            if (r == -1)
+                return errno == EINTR ? 0 : (perror("poll"), -1);
+            if (r == 0)
+                return 0;
+        }
+
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(c->fd, VIDIOC_DQBUF, &buf) == -1) {
+            if (errno == EAGAIN)
+                return 0;    // 데이터가 아직 준비되지 않음
+            perror("VIDIOC_DQBUF");
+            return -1;
+        }
+        if (!(buf.flags & V4L2_BUF_FLAG_ERROR))
+            break;
+
+        // 드라이버가 깨졌다고 표시한 프레임 (전송 오류 등). 내보내지 않고 바로 돌려준 뒤 다음 프레임을 기다림
+        // 번호는 건너뛴 것으로 남으므로 다음 프레임의 dropped 에도 들어감
+        c->stats.errors++;
+        if (xioctl(c->fd, VIDIOC_QBUF, &buf) == -1) {
+            perror("VIDIOC_QBUF");
+            return -1;
+        }
+    }
+
+    f->data = c->buffers[buf.index].start;
+    f->bytesused = buf.bytesused;
+    f->pixelformat = c->fmt.pixelformat;
+    f->width = c->fmt.width;
+    f->height = c->fmt.height;
+    f->stride = c->fmt.stride;
+    f->sequence = buf.sequence;
+    // 드라이버 타임스탬프는 MONOTONIC 이라고 표시했을 때만 씀. 복사/알 수 없음(v4l2loopback, 일부 UVC)이면
+    // 다른 시계이거나 0 이므로 꺼낸 시각으로 대신함 (DQBUF 까지의 지연만큼 늦게 찍힘)
+    if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+        f->timestamp_us = (int64_t)buf.timestamp.tv_sec * 1000000 + buf.timestamp.tv_usec;
+    else
+        f->timestamp_us = capture_now_us();
+    f->index = buf.index;
+    return 1;
+}
+
+// 처리한 버퍼를 다시 큐에 넣어서 드라이버가 다음 프레임을 쓸 수 있게 함
+static int v4l2_release(struct capture *c, const struct capture_frame *f)
+{
+    struct v4l2_buffer buf;
+
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = f->index;
+    if (xioctl(c->fd, VIDIOC_QBUF, &buf) == -1) {
+        perror("VIDIOC_QBUF");
+        return -1;
+    }
+    return 0;
+}
+
+static void v4l2_close(struct capture *c)
+{
+    if (c->streaming) {
+        enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(c->fd, VIDIOC_STREAMOFF, &type);
+    }
+    for (unsigned int i = 0; i < c->n_buffers; ++i)
+        munmap(c->buffers[i].start, c->buffers[i].length);
+    free(c->buffers);
+    if (c->fd != -1)
+        close(c->fd);
+}
+
+// 카메라가 지원하는 포맷 중에서 고름. want 가 0 이면 변환 코드가 있는 포맷을 선호 순서대로
+static unsigned int pick_format(int fd, const char *dev, unsigned int want)
+{
+    static const unsigned int preferred[] = { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUV420 };
+    unsigned int have[32];
+    int n = 0;
+    char s[5];
+
+    for (struct v4l2_fmtdesc d = { .type = V4L2_BUF_TYPE_VIDEO_CAPTURE };
+         n < 32 && xioctl(fd, VIDIOC_ENUM_FMT, &d) == 0; d.index++)
+        have[n++] = d.pixelformat;
+    // ENUM_FMT 를 지원하지 않는 드라이버는 S_FMT 결과로만 판단
+    if (n == 0)
+        return want ? want : V4L2_PIX_FMT_YUYV;
+
+    if (want) {
+        for (int i = 0; i < n; i++)
+            if (have[i] == want)
+                return want;
+    } else {
+        for (size_t k = 0; k < sizeof(preferred) / sizeof(preferred[0]); k++)
+            for (int i = 0; i < n; i++)
+                if (have[i] == preferred[k])
+                    return preferred[k];
+    }
+
+    fprintf(stderr, "%s: %s not supported. device formats:", dev,
+            want ? capture_fourcc_str(want, s) : "YUYV/NV12/YU12");
+    for (int i = 0; i < n; i++)
+        fprintf(stderr, " %s", capture_fourcc_str(have[i], s));
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+// 지원하는 프레임 크기 중에서 요청에 가장 가까운 것 (0x0 이면 가장 큰 것)
+// 목록을 주지 않는 드라이버는 요청 그대로 두고 S_FMT 가 맞추게 함
+static void pick_size(int fd, unsigned int pixfmt, int *width, int *height)
+{
+    struct v4l2_frmsizeenum fs;
+    int want_w = *width, want_h = *height;
+    long best = 0;
+    int found = 0;
+
+    memset(&fs, 0, sizeof(fs));
+    fs.pixel_format = pixfmt;
+    if (xioctl(fd, VIDIOC_ENUM_FRAMESIZES, &fs) == -1)
+        return;
+
+    if (fs.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+        do {
+            int w = fs.discrete.width, h = fs.discrete.height;
+            // 크기를 안 줬으면 넓이가 클수록, 줬으면 가로/세로 차이가 작을수록 좋음
+            long cost = (want_w <= 0 || want_h <= 0) ? -(long)w * h : labs((long)w - want_w) + labs((long)h - want_h);
+            if (!found || cost < best) {
+                found = 1;
+                best = cost;
+                *width = w;
+                *height = h;
+            }
+            fs.index++;
+        } while (xioctl(fd, VIDIOC_ENUM_FRAMESIZES, &fs) == 0);
+    } else {
+        // STEPWISE / CONTINUOUS: 범위 안으로 자르고 step 에 맞춤
+        const struct v4l2_frmsize_stepwise *sw = &fs.stepwise;
+        int w = want_w > 0 ? want_w : (int)sw->max_width;
+        int h = want_h > 0 ? want_h : (int)sw->max_height;
+        if (w < (int)sw->min_width) w = sw->min_width;
+        if (w > (int)sw->max_width) w = sw->max_width;
+        if (h < (int)sw->min_height) h = sw->min_height;
+        if (h > (int)sw->max_height) h = sw->max_height;
+        if (sw->step_width > 1)
+            w = sw->min_width + (w - sw->min_width) / sw->step_width * sw->step_width;
+        if (sw->step_height > 1)
+            h = sw->min_height + (h - sw->min_height) / sw->step_height * sw->step_height;
+        *width = w;
+        *height = h;
+    }
+}
+
+// 요청한 fps 를 설정하고 실제 값을 읽어옴. 지원하지 않으면 0 (알 수 없음)
+static void set_frame_rate(struct capture *c)
+{
+    struct v4l2_streamparm parm;
+
+    memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(c->fd, VIDIOC_G_PARM, &parm) == -1)
+        return;
+    if (c->cfg.fps > 0 && (parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME)) {
+        parm.parm.capture.timeperframe.numerator = 1;
+        parm.parm.capture.timeperframe.denominator = c->cfg.fps;
+        if (xioctl(c->fd, VIDIOC_S_PARM, &parm) == -1)
+            perror("VIDIOC_S_PARM");
+    }
+    if (parm.parm.capture.timeperframe.numerator)
+        c->fmt.fps = parm.parm.capture.timeperframe.denominator / parm.parm.capture.timeperframe.numerator;
+}
+
+// S_FMT 하고 드라이버가 실제로 정한 값을 c->fmt 에
+static int v4l2_set_format(struct capture *c, unsigned int pixfmt, int width, int height)
+{
+    struct v4l2_format fmt;
+
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = width;
+    fmt.fmt.pix.height = height;
+    fmt.fmt.pix.pixelformat = pixfmt;
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if (xioctl(c->fd, VIDIOC_S_FMT, &fmt) == -1) {
+        perror("VIDIOC_S_FMT");
+        return -1;
+    }
+    if (fmt.fmt.pix.pixelformat != pixfmt) {
+        char a[5], b[5];
+        fprintf(stderr, "%s: asked for %s, driver chose %s\n", c->cfg.source,
+                capture_fourcc_str(pixfmt, a), capture_fourcc_str(fmt.fmt.pix.pixelformat, b));
+        return -1;
+    }
+
+    // 드라이버가 실제로 정한 값을 씀 (크기는 요청과 다를 수 있고, 줄 끝에 여백이 있을 수 있음)
+    c->fmt.pixelformat = pixfmt;
+    c->fmt.width = fmt.fmt.pix.width;
+    c->fmt.height = fmt.fmt.pix.height;
+    c->fmt.stride = fmt.fmt.pix.bytesperline;
+    c->fmt.sizeimage = fmt.fmt.pix.sizeimage;
+    /* Buggy driver paranoia. */
+    if (c->fmt.stride < min_stride(pixfmt, c->fmt.width))
+        c->fmt.stride = min_stride(pixfmt, c->fmt.width);
+    if (c->fmt.sizeimage < frame_bytes(pixfmt, c->fmt.stride, c->fmt.height))
+        c->fmt.sizeimage = frame_bytes(pixfmt, c->fmt.stride, c->fmt.height);
+    return 0;
+}
+
+// 전체 프레임에 해당하는 센서 쪽 영역 (하드웨어 crop 좌표의 기준)
+static int v4l2_crop_default(struct capture *c, struct v4l2_rect *def)
+{
+    struct v4l2_selection sel;
+    struct v4l2_cropcap cropcap;
+
+    memset(&sel, 0, sizeof(sel));
+    sel.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    sel.target = V4L2_SEL_TGT_CROP_DEFAULT;
+    if (xioctl(c->fd, VIDIOC_G_SELECTION, &sel) == 0) {
+        *def = sel.r;
+        return 0;
+    }
+    memset(&cropcap, 0, sizeof(cropcap));
+    cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(c->fd, VIDIOC_CROPCAP, &cropcap) == -1)
+        return -1;
+    *def = cropcap.defrect;
+    return 0;
+}
+
+// 센서에서 잘라낼 영역. VIDIOC_S_SELECTION 이 없는 예전 드라이버는 VIDIOC_S_CROP
+// 드라이버가 맞춰서 바꾼 값을 got 에 (요청과 다르면 쓰지 않음)
+static int v4l2_set_crop(struct capture *c, const struct v4l2_rect *want, struct v4l2_rect *got)
+{
+    struct v4l2_selection sel;
+    struct v4l2_crop crop;
+
+    memset(&sel, 0, sizeof(sel));
+    sel.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    sel.target = V4L2_SEL_TGT_CROP;
+    sel.r = *want;
+    if (xioctl(c->fd, VIDIOC_S_SELECTION, &sel) == 0) {
+        *got = sel.r;
+        return 0;
+    }
+    memset(&crop, 0, sizeof(crop));
+    crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    crop.c = *want;
+    if (xioctl(c->fd, VIDIOC_S_CROP, &crop) == -1 || xioctl(c->fd, VIDIOC_G_CROP, &crop) == -1)
+        return -1;
+    *got = crop.c;
+    return 0;
+}
+
+static int v4l2_get_crop(struct capture *c, struct v4l2_rect *r)
+{
+    struct v4l2_selection sel;
+    struct v4l2_crop crop;
+
+    memset(&sel, 0, sizeof(sel));
+    sel.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    sel.target = V4L2_SEL_TGT_CROP;
+    if (xioctl(c->fd, VIDIOC_G_SELECTION, &sel) == 0) {
+        *r = sel.r;
+        return 0;
+    }
+    memset(&crop, 0, sizeof(crop));
+    crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(c->fd, VIDIOC_G_CROP, &crop) == -1)
+        return -1;
+    *r = crop.c;
+    return 0;
+}
+
+static int same_rect(const struct v4l2_rect *a, const struct v4l2_rect *b)
+{
+    return a->left == b->left && a->top == b->top && a->width == b->width && a->height == b->height;
+}
+
+// 전체 프레임 좌표 -> 센서 좌표 (출력이 센서에서 축소된 것이면 같은 비율로)
+static struct v4l2_rect to_sensor(struct capture *c, const struct capture_rect *r, const struct v4l2_rect *def)
+{
+    struct v4l2_rect s;
+    s.left = def->left + (int64_t)r->left * def->width / c->full_width;
+    s.top = def->top + (int64_t)r->top * def->height / c->full_height;
+    s.width = (int64_t)r->width * def->width / c->full_width;
+    s.height = (int64_t)r->height * def->height / c->full_height;
+    return s;
+}
+
+// 열 때 ROI 를 하드웨어로 자름. crop 을 정하고 출력 크기를 ROI 크기로 다시 정했을 때
+// 드라이버가 둘 다 요청한 그대로 받아들인 경우만 씀 (배율은 ROI 없을 때와 같음)
+// 아니면 원래대로 되돌리고 capture_open 이 포인터 crop 으로 처리
+static int v4l2_crop_open(struct capture *c, unsigned int pixfmt)
+{
+    struct capture_rect full = { 0, 0, c->full_width, c->full_height };
+    struct capture_rect r;
+    struct v4l2_rect def, want, got;
+
+    if (roi_resolve(&full, &c->cfg.roi, &r) < 0 || v4l2_crop_default(c, &def) < 0)
+        return 0;
+    want = to_sensor(c, &r, &def);
+    if (v4l2_set_crop(c, &want, &got) == 0 && same_rect(&want, &got) &&
+        v4l2_set_format(c, pixfmt, r.width, r.height) == 0 && c->fmt.width == r.width && c->fmt.height == r.height &&
+        v4l2_get_crop(c, &got) == 0 && same_rect(&want, &got)) {
+        c->hw = r;
+        return 0;
+    }
+    v4l2_set_crop(c, &def, &got);
+    return v4l2_set_format(c, pixfmt, full.width, full.height);
+}
+
+// 스트리밍 중에 하드웨어 창을 같은 크기로 옮김 (출력 포맷은 그대로라 대부분 드라이버가 허용)
+static int v4l2_pan(struct capture *c, const struct capture_rect *r)
+{
+    struct v4l2_rect def, want, got;
+
+    if (v4l2_crop_default(c, &def) < 0)
+        return -1;
+    want = to_sensor(c, r, &def);
+    if (v4l2_set_crop(c, &want, &got) < 0)
+        return -1;
+    if (!same_rect(&want, &got)) {
+        // 드라이버가 다른 곳으로 맞춤. 예전 위치로 (창 크기가 바뀌면 프레임과 맞지 않음)
+        want = to_sensor(c, &c->hw, &def);
+        v4l2_set_crop(c, &want, &got);
+        return -1;
+    }
+    return 0;
+}
+
+static int v4l2_open(struct capture *c)
+{
+    const char *dev = c->cfg.source;
+    struct v4l2_capability cap;
+    struct v4l2_cropcap cropcap;
+    struct v4l2_crop crop;
+    struct v4l2_requestbuffers req;
+
+    c->fd = open(dev, O_RDWR | O_NONBLOCK, 0);
+    if (c->fd == -1) {
+        fprintf(stderr, "Cannot open '%s': %d, %s\n", dev, errno, strerror(errno));
+        return -1;
+    }
+
+    if (xioctl(c->fd, VIDIOC_QUERYCAP, &cap) == -1) {
+        fprintf(stderr, "%s is no V4L2 device\n", dev);
+        return -1;
+    }
+    // v4l2loopback 처럼 device_caps 만 제대로 채우는 드라이버가 있음
+    if (cap.capabilities & V4L2_CAP_DEVICE_CAPS)
+        cap.capabilities = cap.device_caps;
+    if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)) {
+        fprintf(stderr, "%s is no video capture device\n", dev);
+        return -1;
+    }
+    if (!(cap.capabilities & V4L2_CAP_STREAMING)) {
+        fprintf(stderr, "%s does not support streaming i/o\n", dev);
+        return -1;
+    }
+
+    // 기본 캡처 영역으로 되돌림 (지원하지 않으면 무시)
+    memset(&cropcap, 0, sizeof(cropcap));
+    cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(c->fd, VIDIOC_CROPCAP, &cropcap) == 0) {
+        crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        crop.c = cropcap.defrect;
+        xioctl(c->fd, VIDIOC_S_CROP, &crop);
+    }
+
+    // 포맷: 요청한 것이 있으면 그것, 없으면 선호 순서대로 장치가 지원하는 것
+    unsigned int pixfmt = pick_format(c->fd, dev, c->cfg.pixelformat);
+    if (!pixfmt)
+        return -1;
+    int width = c->cfg.width, height = c->cfg.height;
+    pick_size(c->fd, pixfmt, &width, &height);
+
+    if (v4l2_set_format(c, pixfmt, width, height) < 0)
+        return -1;
+    c->full_width = c->fmt.width;
+    c->full_height = c->fmt.height;
+    if (c->cfg.roi.width > 0 && v4l2_crop_open(c, pixfmt) < 0)
+        return -1;
+
+    set_frame_rate(c);
+
+    // 버퍼가 하나뿐이면 읽는 동안 드라이버가 쓸 곳이 없어서 프레임을 놓침
+    memset(&req, 0, sizeof(req));
+    req.count = c->cfg.buffers;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(c->fd, VIDIOC_REQBUFS, &req) == -1) {
+        if (errno == EINVAL)
+            fprintf(stderr, "%s does not support memory mapping\n", dev);
+        else
+            perror("VIDIOC_REQBUFS");
+        return -1;
+    }
+    if (req.count < 2) {
+        fprintf(stderr, "Insufficient buffer memory on %s\n", dev);
+        return -1;
+    }
+    c->fmt.buffers = req.count;
+
+    c->buffers = calloc(req.count, sizeof(*c->buffers));
+    if (!c->buffers) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    for (c->n_buffers = 0; c->n_buffers < req.count; ++c->n_buffers) {
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = c->n_buffers;
+        if (xioctl(c->fd, VIDIOC_QUERYBUF, &buf) == -1) {
+            perror("VIDIOC_QUERYBUF");
+            return -1;
+        }
+        c->buffers[c->n_buffers].length = buf.length;
+        c->buffers[c->n_buffers].start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED, c->fd, buf.m.offset);
+        if (c->buffers[c->n_buffers].start == MAP_FAILED) {
+            perror("mmap");
+            return -1;
+        }
+    }
+
+    for (unsigned int i = 0; i < c->n_buffers; ++i) {
+        struct capture_frame f = { .index = i };
+        if (v4l2_release(c, &f) < 0)
+            return -1;
+    }
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(c->fd, VIDIOC_STREAMON, &type) == -1) {
+        perror("VIDIOC_STREAMON");
+        return -1;
+    }
+    c->streaming = 1;
+
+    c->read = v4l2_read;
+    c->release = v4l2_release;
+    c->close = v4l2_close;
+    return 0;
+}
+
+/* ----------------------------------------------------------- 합성 소스 */
+
+// 75% 컬러바 (BT.601, Y U V)
+static const unsigned char bar_yuv[8][3] = {
+    { 180, 128, 128 }, { 162,  44, 142 }, { 131, 156,  44 }, { 112,  72,  58 },
+    {  84, 184, 198 }, {  65, 100, 212 }, {  35, 212, 114 }, {  16, 128, 128 },
+};
+
+#define BOX 64    // 튕겨다니는 흰 사각형 크기
+
+// 0..range 사이를 왕복
+static int bounce(unsigned int pos, int range)
+{
+    if (range <= 0)
+        return 0;
+    int p = pos % (2u * range);
+    return p < range ? p : 2 * range - p;
+}
+
+// 프레임 번호만으로 그림을 정함: 왼쪽으로 흐르는 컬러바 + 대각선으로 튕기는 사각형
+static void synth_render(struct capture *c, unsigned char *out, unsigned int seq)
+{
+    int w = c->fmt.width, h = c->fmt.height, stride = c->fmt.stride;
+    int off = (int)((seq * 4) % w);                // 두 픽셀 단위로 이동 (YUYV/NV12 색차 경계)
+    int bw = BOX < w ? BOX : w;
+    int bh = BOX < h ? BOX : h & ~1;
+    int bx = bounce(seq * 6, w - bw) & ~1;
+    int by = bounce(seq * 4, h - bh) & ~1;
+
+    if (c->fmt.pixelformat == V4L2_PIX_FMT_NV12) {
+        const unsigned char *ybars = c->bars, *uvbars = c->bars + 2 * w;
+        unsigned char *uv = out + (size_t)stride * h;
+
+        for (int y = 0; y < h; y++)
+            memcpy(out + (size_t)y * stride, ybars + off, w);
+        for (int y = 0; y < h / 2; y++)
+            memcpy(uv + (size_t)y * stride, uvbars + off, w);
+        for (int y = by; y < by + bh; y++)
+            memset(out + (size_t)y * stride + bx, 235, bw);
+        for (int y = by / 2; y < (by + bh) / 2; y++)
+            memset(uv + (size_t)y * stride + bx, 128, bw);
+        return;
+    }
+
+    for (int y = 0; y < h; y++)
+        memcpy(out + (size_t)y * stride, c->bars + off * 2, w * 2);
+    for (int y = by; y < by + bh; y++) {
+        unsigned char *p = out + (size_t)y * stride + bx * 2;
+        for (int x = 0; x < bw; x += 2, p += 4) {
+            p[0] = 235; p[1] = 128; p[2] = 235; p[3] = 128;
+        }
+    }
+}
+
+// 이 프레임이 나올 시각 = 시작 + sequence / fps (ns)
+static int64_t synth_due(struct capture *c)
+{
+    return (int64_t)c->start.tv_sec * NSEC_PER_SEC + c->start.tv_nsec +
+           (int64_t)c->sequence * NSEC_PER_SEC / c->fmt.fps;
+}
+
+// 캡처 시각. 실시간으로 낼 때는 정해진 시각(지터 없음), fast 는 실제로 내보낸 시각
+static int64_t synth_timestamp_us(struct capture *c)
+{
+    return c->fast ? capture_now_us() : synth_due(c) / 1000;
+}
+
+// 다음 프레임이 나올 시각까지 기다림. timeout_ms 안에 안 오면 0
+// 밀린 만큼은 바로 내보내서 따라잡음
+static int synth_pace(struct capture *c, int timeout_ms)
+{
+    if (c->fast)
+        return 1;
+
+    int64_t due = synth_due(c);
+    struct timespec now, ts;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t wait = due - ((int64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec);
+    if (timeout_ms >= 0 && wait > (int64_t)timeout_ms * 1000000) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        nanosleep(&ts, NULL);
+        return 0;
+    }
+    if (wait > 0) {
+        ts.tv_sec = due / NSEC_PER_SEC;
+        ts.tv_nsec = due % NSEC_PER_SEC;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+    }
+    return 1;
+}
+
+static uint32_t synth_all_held(const struct capture *c)
+{
+    return c->fmt.buffers >= 32 ? ~0u : (1u << c->fmt.buffers) - 1;
+}
+
+// 받는 쪽이 아직 쥐고 있지 않은 버퍼 하나를 next 부터 찾아서 잡음 (쥐고 있는 것을 덮어쓰면 처리 중인 프레임이 찢어짐)
+// held 는 다른 스레드(camgroup 워커)의 capture_release 가 동시에 지우므로 atomic 으로만 바꿈
+// 모두 쥐고 있으면 synth_release 가 깨울 때까지 최대 timeout_ms 기다림. 그래도 없으면 -1
+static int synth_take(struct capture *c, int timeout_ms)
+{
+    int64_t deadline = capture_now_us() + (int64_t)timeout_ms * 1000;
+
+    for (;;) {
+        uint32_t held = __atomic_load_n(&c->held, __ATOMIC_ACQUIRE);
+        for (int i = 0; i < c->fmt.buffers; i++) {
+            int index = (c->next + i) % c->fmt.buffers;
+            if (held & (1u << index))
+                continue;
+            // 비트를 켜는 것은 이 스레드뿐이라 본 뒤에 다른 쪽이 잡을 일은 없음
+            __atomic_fetch_or(&c->held, 1u << index, __ATOMIC_ACQ_REL);
+            c->next = (index + 1) % c->fmt.buffers;
+            return index;
+        }
+
+        struct timespec ts, *tp = NULL;
+        if (timeout_ms >= 0) {
+            int64_t left = deadline - capture_now_us();
+            if (left <= 0)
+                return -1;
+            ts.tv_sec = left / 1000000;
+            ts.tv_nsec = left % 1000000 * 1000;
+            tp = &ts;
+        }
+        // 본 뒤에 돌려받았으면 값이 달라서 바로 돌아옴 (깨움을 놓치지 않음)
+        if (syscall(SYS_futex, &c->held, FUTEX_WAIT_PRIVATE, held, tp, NULL, 0) == -1 &&
+            errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+            perror("futex");
+            return -1;
+        }
+    }
+}
+
+static int synth_read(struct capture *c, struct capture_frame *f, int timeout_ms)
+{
+    if (!synth_pace(c, timeout_ms))
+        return 0;
+    // 놓친 프레임: 번호만 하나 올리고 그 다음 프레임 시각까지 기다림
+    if (c->drop_every > 1 && c->sequence % c->drop_every == (unsigned int)c->drop_every - 1) {
+        c->sequence++;
+        if (!synth_pace(c, timeout_ms))
+            return 0;
+    }
+
+    // 모두 쥐고 있으면 V4L2 처럼 프레임이 나오지 않음. 번호는 그대로라 돌려받으면 밀린 만큼 바로 따라잡음
+    f->index = synth_take(c, timeout_ms);
+    if (f->index < 0)
+        return 0;
+    synth_render(c, c->frames[f->index], c->sequence);
+
+    f->data = c->frames[f->index];
+    f->bytesused = c->fmt.sizeimage;
+    f->pixelformat = c->fmt.pixelformat;
+    f->width = c->fmt.width;
+    f->height = c->fmt.height;
+    f->stride = c->fmt.stride;
+    f->sequence = c->sequence;
+    f->timestamp_us = synth_timestamp_us(c);
+    c->sequence++;
+    return 1;
+}
+
+static int synth_release(struct capture *c, const struct capture_frame *f)
+{
+    uint32_t old = __atomic_fetch_and(&c->held, ~(1u << f->index), __ATOMIC_RELEASE);
+    // synth_take 는 모두 쥐고 있을 때만 기다림
+    if (old == synth_all_held(c))
+        syscall(SYS_futex, &c->held, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    return 0;
+}
+
+static void synth_close(struct capture *c)
+{
+    if (c->frames)
+        for (int i = 0; i < c->fmt.buffers; i++)
+            free(c->frames[i]);
+    free(c->frames);
+    free(c->bars);
+}
+
+static int synth_open(struct capture *c, const char *opts)
+{
+    struct capture_format *fmt = &c->fmt;
+    char s[5];
+
+    // 옵션은 쉼표로: "fast", "drop=N"
+    for (const char *o = opts; *o; ) {
+        size_t n = strcspn(o, ",");
+        if (n == 4 && !strncmp(o, "fast", 4))
+            c->fast = 1;
+        else if (!strncmp(o, "drop=", 5))
+            c->drop_every = atoi(o + 5);
+        else if (n) {
+            fprintf(stderr, "synth: unknown option %.*s\n", (int)n, o);
+            return -1;
+        }
+        o += n;
+        if (*o == ',')
+            o++;
+    }
+    c->read = synth_read;
+    c->release = synth_release;
+    c->close = synth_close;
+
+    fmt->pixelformat = c->cfg.pixelformat ? c->cfg.pixelformat : V4L2_PIX_FMT_YUYV;
+    fmt->width = (c->cfg.width > 0 ? c->cfg.width : 800) & ~1;
+    fmt->height = (c->cfg.height > 0 ? c->cfg.height : 600) & ~1;
+    fmt->fps = c->cfg.fps > 0 ? c->cfg.fps : 25;
+    // held 비트마스크에 들어가도록 V4L2 와 같은 상한
+    fmt->buffers = c->cfg.buffers < 1 ? 1 : c->cfg.buffers > VIDEO_MAX_FRAME ? VIDEO_MAX_FRAME : c->cfg.buffers;
+    if (fmt->pixelformat != V4L2_PIX_FMT_YUYV && fmt->pixelformat != V4L2_PIX_FMT_NV12) {
+        fprintf(stderr, "synth: %s not supported (YUYV, NV12)\n", capture_fourcc_str(fmt->pixelformat, s));
+        return -1;
+    }
+    if (fmt->width <= 0 || fmt->height <= 0) {
+        fprintf(stderr, "synth: invalid size %dx%d\n", c->cfg.width, c->cfg.height);
+        return -1;
+    }
+    fmt->stride = min_stride(fmt->pixelformat, fmt->width);
+    fmt->sizeimage = frame_bytes(fmt->pixelformat, fmt->stride, fmt->height);
+
+    // 바 하나의 폭은 화면의 1/8. 두 화면 폭만큼 그려두면 어느 위치에서든 한 줄을 그대로 복사 가능
+    c->bars = malloc((size_t)fmt->width * 4);
+    c->frames = calloc(fmt->buffers, sizeof(*c->frames));
+    if (!c->bars || !c->frames) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    for (int x = 0; x < fmt->width * 2; x += 2) {
+        const unsigned char *yuv = bar_yuv[(x % fmt->width) * 8 / fmt->width];
+        if (fmt->pixelformat == V4L2_PIX_FMT_NV12) {
+            unsigned char *y = c->bars + x, *uv = c->bars + 2 * fmt->width + x;
+            y[0] = y[1] = yuv[0];
+            uv[0] = yuv[1]; uv[1] = yuv[2];
+        } else {
+            unsigned char *p = c->bars + x * 2;
+            p[0] = yuv[0]; p[1] = yuv[1]; p[2] = yuv[0]; p[3] = yuv[2];
+        }
+    }
+    for (int i = 0; i < fmt->buffers; i++) {
+        c->frames[i] = malloc(fmt->sizeimage);
+        if (!c->frames[i]) {
+            fprintf(stderr, "Out of memory\n");
+            return -1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &c->start);
+    return 0;
+}
+
+/* ---------------------------------------------------------------- H.264 파일 */
+
+// H.264 를 직접 내보내는 카메라 대신 쓰는 소스. Annex B 파일(.h264)을 mmap 해두고
+// 접근 단위(프레임) 하나씩 fps 에 맞춰 내보냄. 끝나면 처음부터 다시 (카메라처럼 SPS/PPS 는 파일 앞에만 있어도 됨)
+// 프레임 데이터는 mmap 된 파일을 그대로 가리키므로 V4L2 mmap 버퍼처럼 복사 없음
+
+static int file_read(struct capture *c, struct capture_frame *f, int timeout_ms)
+{
+    if (!synth_pace(c, timeout_ms))
+        return 0;
+
+    if (c->file_pos >= c->file_len)
+        c->file_pos = 0;
+    size_t n = h264nal_au_size(c->file + c->file_pos, c->file_len - c->file_pos);
+
+    f->data = c->file + c->file_pos;
+    f->bytesused = n;
+    f->pixelformat = c->fmt.pixelformat;
+    f->width = c->fmt.width;
+    f->height = c->fmt.height;
+    f->stride = 0;
+    f->sequence = c->sequence;
+    f->timestamp_us = synth_timestamp_us(c);
+    f->index = 0;
+    c->file_pos += n;
+    c->sequence++;
+    return 1;
+}
+
+// 데이터는 mmap 된 파일 그대로라 돌려받을 버퍼가 없음
+static int file_release(struct capture *c, const struct capture_frame *f)
+{
+    return 0;
+}
+
+static void file_close(struct capture *c)
+{
+    if (c->file)
+        munmap((void *)c->file, c->file_len);
+}
+
+// opts: "[fast:]path"
+static int file_open(struct capture *c, const char *opts)
+{
+    struct capture_format *fmt = &c->fmt;
+    struct h264_params params;
+    struct stat sb;
+    char s[5];
+    int fd;
+
+    c->read = file_read;
+    c->release = file_release;
+    c->close = file_close;
+    if (!strncmp(opts, "fast:", 5)) {
+        c->fast = 1;
+        opts += 5;
+    }
+
+    if (c->cfg.pixelformat && c->cfg.pixelformat != V4L2_PIX_FMT_H264) {
+        fprintf(stderr, "%s: %s not supported (H264)\n", opts, capture_fourcc_str(c->cfg.pixelformat, s));
+        return -1;
+    }
+    fd = open(opts, O_RDONLY);
+    if (fd == -1 || fstat(fd, &sb) == -1) {
+        perror(opts);
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+    if (sb.st_size == 0) {
+        fprintf(stderr, "%s: empty file\n", opts);
+        close(fd);
+        return -1;
+    }
+    c->file = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (c->file == MAP_FAILED) {
+        c->file = NULL;
+        perror("mmap");
+        return -1;
+    }
+    c->file_len = sb.st_size;
+
+    // 크기는 SPS 에서. 첫 SPS 가 나올 때까지만 훑음
+    memset(&params, 0, sizeof(params));
+    for (size_t pos = 0; pos < c->file_len && !params.sps_len; ) {
+        size_t n = h264nal_au_size(c->file + pos, c->file_len - pos);
+        h264_params_scan(&params, c->file + pos, n);
+        pos += n;
+    }
+    if (!params.sps_len) {
+        fprintf(stderr, "%s: no SPS, not an Annex B H.264 stream\n", opts);
+        return -1;
+    }
+
+    fmt->pixelformat = V4L2_PIX_FMT_H264;
+    fmt->width = params.width ? params.width : c->cfg.width;
+    fmt->height = params.height ? params.height : c->cfg.height;
+    fmt->stride = 0;
+    fmt->sizeimage = c->file_len;
+    fmt->fps = c->cfg.fps > 0 ? c->cfg.fps : 25;
+    fmt->buffers = 1;
+    clock_gettime(CLOCK_MONOTONIC, &c->start);
+    return 0;
+}
+
+/* ---------------------------------------------------------------- 공유 메모리 */
+
+// 같은 장비에서 video_server -R 등이 shmring 으로 내보내는 프레임을 받음
+// 프레임은 공유 메모리 슬롯을 그대로 가리킴 (복사 없음). 쓰는 쪽은 기다려주지 않으므로
+// 다 쓰기 전에 덮어쓰인 프레임은 release 에서 errors 로 셈
+
+static int shm_read(struct capture *c, struct capture_frame *f, int timeout_ms)
+{
+    int r = shmring_read(c->shm, f, timeout_ms);
+    if (r < 0)
+        fprintf(stderr, "shm: writer closed\n");
+    return r;
+}
+
+static int shm_release(struct capture *c, const struct capture_frame *f)
+{
+    if (!shmring_release(c->shm, f))
+        c->stats.errors++;
+    return 0;
+}
+
+static void shm_close(struct capture *c)
+{
+    shmring_close(c->shm);
+}
+
+// opts: "[latest:]name"
+static int shm_open_source(struct capture *c, const char *opts)
+{
+    int latest = 0;
+
+    c->read = shm_read;
+    c->release = shm_release;
+    c->close = shm_close;
+    if (!strncmp(opts, "latest:", 7)) {
+        latest = 1;
+        opts += 7;
+    }
+    c->shm = shmring_open(opts, latest);
+    if (!c->shm)
+        return -1;
+    // 포맷은 쓰는 쪽이 정한 그대로. 요청한 크기/포맷은 무시
+    shmring_get_format(c->shm, &c->fmt);
+    return 0;
+}
+
+/* ---------------------------------------------------------------- 공통 */
+
+struct capture *capture_open(const struct capture_config *cfg)
+{
+    struct capture *c = calloc(1, sizeof(*c));
+    int r;
+
+    if (!c) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+    c->cfg = *cfg;
+    c->fd = -1;
+    if (c->cfg.buffers < 1)
+        c->cfg.buffers = 1;
+
+    if (!strcmp(cfg->source, "synth"))
+        r = synth_open(c, "");
+    else if (!strncmp(cfg->source, "synth:", 6))
+        r = synth_open(c, cfg->source + 6);
+    else if (!strncmp(cfg->source, "file:", 5))
+        r = file_open(c, cfg->source + 5);
+    else if (!strncmp(cfg->source, "shm:", 4))
+        r = shm_open_source(c, cfg->source + 4);
+    else
+        r = v4l2_open(c);
+
+    if (r == 0) {
+        // ROI 의 기준은 ROI 없이 열었을 때의 크기 (V4L2 하드웨어 crop 은 v4l2_open 이 이미 정함)
+        c->out = c->fmt;
+        if (!c->full_width) {
+            c->full_width = c->fmt.width;
+            c->full_height = c->fmt.height;
+        }
+        c->roi = c->hw.width ? c->hw : (struct capture_rect){ 0, 0, c->full_width, c->full_height };
+        if (cfg->roi.width > 0 && !c->hw.width && capture_set_roi(c, &cfg->roi) < 0)
+            r = -1;
+    }
+    if (r < 0) {
+        if (c->close)
+            c->close(c);
+        else
+            v4l2_close(c);
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+void capture_close(struct capture *c)
+{
+    if (!c)
+        return;
+    c->close(c);
+    free(c);
+}
+
+int capture_read(struct capture *c, struct capture_frame *f, int timeout_ms)
+{
+    int r = c->read(c, f, timeout_ms);
+    if (r != 1)
+        return r;
+
+    // 포인터 crop: 복사 없이 ROI 왼쪽 위를 가리키고 stride 는 그대로
+    if (c->crop) {
+        f->data += c->roi_offset;
+        f->width = c->out.width;
+        f->height = c->out.height;
+        f->bytesused = (size_t)(f->height - 1) * f->stride + (size_t)f->width * 2;
+    }
+
+    // 드라이버는 버퍼가 모자라 못 담은 프레임에도 번호를 매김 -> 번호가 건너뛴 만큼 놓친 것
+    f->dropped = 0;
+    if (c->stats.frames && f->sequence - c->last_sequence > 1)
+        f->dropped = f->sequence - c->last_sequence - 1;
+    c->last_sequence = f->sequence;
+    c->stats.frames++;
+    c->stats.dropped += f->dropped;
+    return 1;
+}
+
+int capture_set_roi(struct capture *c, const struct capture_rect *r)
+{
+    struct capture_rect full = { 0, 0, c->full_width, c->full_height };
+    const struct capture_rect *base = c->hw.width ? &c->hw : &full;
+    struct capture_rect roi;
+    char s[5];
+
+    if (!r)
+        r = base;
+
+    // 하드웨어 창과 같은 크기면 창을 옮김 (센서에서 읽는 곳이 바뀜)
+    if (c->hw.width && r->width == c->hw.width && r->height == c->hw.height) {
+        if (roi_resolve(&full, r, &roi) < 0 ||
+            ((roi.left != c->hw.left || roi.top != c->hw.top) && v4l2_pan(c, &roi) < 0)) {
+            fprintf(stderr, "roi: driver cannot move the crop to %dx%d+%d+%d\n", r->width, r->height, r->left, r->top);
+            return -1;
+        }
+        c->hw = c->roi = roi;
+        c->out = c->fmt;
+        c->crop = 0;
+        return 1;
+    }
+
+    if (roi_resolve(base, r, &roi) < 0) {
+        fprintf(stderr, "roi: %dx%d+%d+%d is outside %dx%d+%d+%d\n", r->width, r->height, r->left, r->top,
+                base->width, base->height, base->left, base->top);
+        return -1;
+    }
+    int crop = roi.left != base->left || roi.top != base->top || roi.width != base->width || roi.height != base->height;
+    if (crop && c->fmt.pixelformat != V4L2_PIX_FMT_YUYV) {
+        fprintf(stderr, "roi: %s frames can only be cropped by the driver\n", capture_fourcc_str(c->fmt.pixelformat, s));
+        return -1;
+    }
+    c->roi = roi;
+    c->roi_offset = (size_t)(roi.top - base->top) * c->fmt.stride + (size_t)(roi.left - base->left) * 2;
+    // sizeimage 는 그대로 (버퍼 크기. ROI 를 다시 키워도 넘지 않음)
+    c->out = c->fmt;
+    c->out.width = roi.width;
+    c->out.height = roi.height;
+    c->crop = crop;
+    return 0;
+}
+
+void capture_get_roi(struct capture *c, struct capture_rect *roi, struct capture_rect *full)
+{
+    *roi = c->roi;
+    full->left = full->top = 0;
+    full->width = c->full_width;
+    full->height = c->full_height;
+}
+
+void capture_get_stats(struct capture *c, struct capture_stats *st)
+{
+    *st = c->stats;
+}
+
+int capture_fd(struct capture *c)
+{
+    return c->fd;
+}
+
+int capture_get_buffers(struct capture *c, struct iovec *iov, int max)
+{
+    int n = 0;
+
+    if (c->buffers) {
+        for (; n < (int)c->n_buffers && n < max; n++) {
+            iov[n].iov_base = c->buffers[n].start;
+            iov[n].iov_len = c->buffers[n].length;
+        }
+    } else if (c->frames) {
+        for (; n < c->fmt.buffers && n < max; n++) {
+            iov[n].iov_base = c->frames[n];
+            iov[n].iov_len = c->fmt.sizeimage;
+        }
+    }
+    return n;
+}
+
+int capture_release(struct capture *c, const struct capture_frame *f)
+{
+    return c->release(c, f);
+}
@@ -0,0 +1,129 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+// 영상 입력 추상화. 소스 이름으로 백엔드를 고름
+//   "/dev/videoN"  : V4L2 mmap 캡처 (실제 카메라, vivid / v4l2loopback 가상 장치 포함)
+//   "synth"        : 프로세스 안에서 만드는 움직이는 테스트 패턴. fps 에 맞춰 내보냄
+//   "synth:fast"   : 같은 패턴을 기다리지 않고 최대한 빨리 (실시간보다 빠른 부하 테스트용)
+//   "synth:drop=N" : N 프레임마다 하나씩 번호를 건너뜀 (놓친 프레임 처리 확인용, "synth:fast,drop=N" 도 가능)
+//   "file:x.h264"  : H.264 Annex B 파일을 프레임 단위로 fps 에 맞춰 반복 재생 (H.264 카메라 대용)
+//                    "file:fast:x.h264" 는 기다리지 않고. 크기는 파일의 SPS 에서 읽음
+//   "shm:NAME"     : 다른 프로세스가 shmring 으로 내보내는 프레임 (video_server -R NAME). 포맷은 쓰는 쪽 것
+//                    "shm:latest:NAME" 은 밀린 프레임을 건너뛰고 항상 최신만
+// 합성 소스는 프레임 번호만으로 그림을 만들기 때문에 몇 번을 돌려도 같은 영상이 나옴
+//
+// V4L2 는 열 때 VIDIOC_ENUM_FMT / VIDIOC_ENUM_FRAMESIZES 로 장치가 지원하는 것 중에서 고르고
+// VIDIOC_S_FMT 이 실제로 정한 값(크기, bytesperline, sizeimage)을 capture_get_format 으로 돌려줌
+// 변환하는 쪽은 항상 그 값을 써야 함 (드라이버는 줄 끝에 여백을 둘 수 있음)
+
+// 전체 프레임 좌표 (픽셀)
+struct capture_rect {
+    int left, top;
+    int width, height;
+};
+
+struct capture_config {
+    const char *source;
+    unsigned int pixelformat;  // V4L2 fourcc. 0 이면 YUYV, NV12, YUV420 순서로 장치가 지원하는 첫번째
+    int width, height;         // 요청 크기. 지원 목록에서 가장 가까운 크기로 맞춤. 0 이면 가장 큰 크기
+    int fps;                   // 0 이면 드라이버 기본값 (합성 소스는 25)
+    int buffers;               // V4L2 mmap 버퍼 수 / 합성 소스가 돌려쓰는 버퍼 수
+                               // 적으면 지연이 짧고, 많으면 처리가 잠깐 밀려도 프레임을 덜 놓침
+    struct capture_rect roi;   // 관심 영역. width 0 이면 전체 (capture_set_roi 참고)
+};
+
+// 실제로 정해진 캡처 포맷
+struct capture_format {
+    unsigned int pixelformat;
+    int width, height;
+    int stride;                // bytesperline. NV12/YUV420 은 Y 평면 기준 (색차 평면은 그 뒤에 이어짐)
+    size_t sizeimage;          // 프레임 하나의 최대 바이트 수
+    int fps;                   // 0 이면 알 수 없음
+    int buffers;               // 드라이버가 실제로 준 버퍼 수
+};
+
+struct capture_frame {
+    const unsigned char *data;
+    size_t bytesused;
+    unsigned int pixelformat;
+    int width, height;
+    int stride;              // 한 라인의 바이트 수 (V4L2 bytesperline)
+    unsigned int sequence;   // 드라이버(또는 합성 소스)가 붙인 프레임 번호
+    int64_t timestamp_us;    // 캡처 시각 (CLOCK_MONOTONIC. 합성/파일 소스와 타임스탬프가 MONOTONIC 이 아닌 드라이버는 꺼낸 시각)
+                             // 프레임을 놓쳐도 실제 시간을 따르므로 pts 는 번호가 아니라 이 값으로 정해야 함
+    unsigned int dropped;    // 이 프레임 바로 앞에서 놓친 프레임 수 (sequence 가 건너뛴 만큼)
+    int index;               // capture_release 에서 쓰는 버퍼 번호
+};
+
+// 열고 나서부터의 누적 값
+struct capture_stats {
+    unsigned long frames;    // 내보낸 프레임
+    unsigned long dropped;   // 드라이버 쪽에서 놓친 프레임 (건너뛴 sequence 합계)
+    unsigned long errors;    // V4L2_BUF_FLAG_ERROR 가 붙어서 버린 프레임 (dropped 에도 포함됨)
+                             // shm 소스는 다 쓰기 전에 쓰는 쪽이 덮어쓴 프레임
+};
+
+struct capture;
+
+void capture_config_default(struct capture_config *cfg);
+
+// "1920x1080", "1280x720@30", "640x480@30:NV12", "@60", ":MJPG" 처럼 주어진 부분만 cfg 에 반영
+int capture_parse_spec(struct capture_config *cfg, const char *spec);
+
+struct capture *capture_open(const struct capture_config *cfg);
+void capture_close(struct capture *c);
+
+void capture_get_format(struct capture *c, struct capture_format *fmt);
+
+// fourcc -> "YUYV" 같은 문자열 (buf 는 5바이트 이상)
+const char *capture_fourcc_str(unsigned int fourcc, char *buf);
+
+// 프레임의 평면별 시작 위치와 줄 간격 (FFmpeg 의 data/linesize 와 같은 배치). 평면 수를 돌려줌
+// 평면 포맷은 V4L2 단일 평면 버퍼라서 색차 평면이 Y 평면 바로 뒤에 이어짐
+//   YUYV   : 1 (plane[0] 에 Y/U/V 가 섞여 있음)
+//   NV12   : 2 (plane[1] 은 U/V 가 번갈아 있는 절반 높이 평면)
+//   YUV420 : 3 (U, V 는 가로/세로 절반)
+// 쓰지 않는 평면은 NULL / 0
+int capture_planes(const struct capture_frame *f, const unsigned char *plane[3], int stride[3]);
+
+// capture_frame.timestamp_us 와 같은 시계(CLOCK_MONOTONIC)의 지금 시각 (us)
+int64_t capture_now_us(void);
+
+// 다음 프레임을 꺼냄. 1 = 프레임, 0 = timeout_ms 안에 프레임 없음, -1 = 오류
+// 받은 프레임은 capture_release 로 돌려줄 때까지 유효. 드라이버가 오류로 표시한 프레임은 건너뜀
+int capture_read(struct capture *c, struct capture_frame *f, int timeout_ms);
+int capture_release(struct capture *c, const struct capture_frame *f);
+
+void capture_get_stats(struct capture *c, struct capture_stats *st);
+
+// 관심 영역(ROI, 디지털 줌). 이후 capture_read 가 내보내는 프레임은 이 영역만
+// (width/height 가 ROI 크기, data 는 ROI 왼쪽 위. 인코더/전송하는 쪽은 잘린 만큼 덜 일함)
+//   하드웨어 : V4L2 VIDIOC_S_SELECTION (안 되면 VIDIOC_S_CROP). 센서/브리지가 ROI 만 내보내므로 버스 대역폭도 줆
+//              출력 크기를 바꿔야 해서 열 때(cfg.roi)만 정함. 같은 크기로 옮기는 것(pan)은 스트리밍 중에도 됨
+//   포인터   : 하드웨어가 못 하면 data 를 ROI 시작으로 옮기고 stride 는 그대로 (복사 없음). YUYV 만
+//              (평면 포맷은 색차 평면 위치를 height 로 계산하므로 불가). 크기를 바꿔도 됨
+// 하드웨어로 잘랐으면 그 창 안에서만 포인터로 더 자를 수 있음
+// r 이 NULL 이면 열 때 정한 영역 전체로. left/top 이 -1 이면 가운데. YUYV 는 left/width 를 짝수로 내림
+// 1 = 하드웨어, 0 = 포인터, -1 = 안 됨 (영역을 벗어남, 압축/평면 포맷)
+// 크기가 바뀌면 capture_get_format 도 바뀜. 이미 꺼낸 프레임에는 영향 없음
+int capture_set_roi(struct capture *c, const struct capture_rect *r);
+
+// 지금 ROI 와 전체 프레임 {0, 0, 폭, 높이}
+void capture_get_roi(struct capture *c, struct capture_rect *roi, struct capture_rect *full);
+
+// "640x360+320+180" (크기+왼쪽+위) 또는 "640x360" (가운데)
+int capture_parse_roi(struct capture_rect *r, const char *spec);
+
+// 바깥 이벤트 루프(epoll, io_uring)에서 기다릴 fd. 프레임이 준비되면 POLLIN
+// 준비된 뒤에는 capture_read(c, f, 0) 으로 기다리지 않고 꺼냄. V4L2 만 있고 합성/파일/shm 소스는 -1
+int capture_fd(struct capture *c);
+
+// 프레임 데이터가 들어가는 버퍼들 (io_uring 고정 버퍼 등록용). frame.index 가 iov 의 번호
+// 버퍼가 캡처 동안 바뀌지 않는 V4L2 / 합성 소스만. 파일/shm 소스는 0
+int capture_get_buffers(struct capture *c, struct iovec *iov, int max);
+
+#endif // CAPTURE_H
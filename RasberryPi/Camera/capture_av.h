@@ -0,0 +1,21 @@
+#ifndef CAPTURE_AV_H
+#define CAPTURE_AV_H
+
+#include <libavutil/pixfmt.h>
+#include <linux/videodev2.h>
+
+// 캡처 프레임을 FFmpeg(swscale)에 넘길 때 쓰는 것. capture.c 는 FFmpeg 없이 빌드되므로 헤더에만 둠
+// 평면 위치는 capture_planes
+
+// V4L2 fourcc -> FFmpeg 픽셀 포맷. 변환할 수 없는 포맷(압축 등)은 AV_PIX_FMT_NONE
+static inline enum AVPixelFormat capture_av_format(unsigned int pixfmt)
+{
+    switch (pixfmt) {
+    case V4L2_PIX_FMT_YUYV: return AV_PIX_FMT_YUYV422;
+    case V4L2_PIX_FMT_NV12: return AV_PIX_FMT_NV12;
+    case V4L2_PIX_FMT_YUV420: return AV_PIX_FMT_YUV420P;
+    default: return AV_PIX_FMT_NONE;
+    }
+}
+
+#endif // CAPTURE_AV_H
@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+
+#include "display.h"
+
+/* unsigned char의 범위를 넘어가지 않도록 경계 검사를 수행다. */
+static inline int clip(int value, int min, int max)
+{
+    return(value > max ? max : value < min ? min : value);
+}
+
+/* YUV를 RGB로 전환 (두 픽셀이 U, V를 공유) */
+#define YUV2RGB(yy, u, v, r, g, b) do {                      \
+        r = clip((298 * (yy) + 409 * (v) + 128) >> 8, 0, 255);   \
+        g = clip((298 * (yy) - 100 * (u) - 208 * (v) + 128) >> 8, 0, 255); \
+        b = clip((298 * (yy) + 516 * (u) + 128) >> 8, 0, 255);   \
+    } while (0)
+
+// 포맷마다 한 줄 변환 함수를 따로 둬서 픽셀마다 포맷을 검사하지 않게 함
+static void row_rgb565(const unsigned char *in, unsigned char *out, int width)
+{
+    unsigned short *o = (unsigned short *)out;
+    int r, g, b;
+    for (int x = 0; x < width; x += 2, in += 4) {
+        int u = in[1] - 128, v = in[3] - 128;
+        YUV2RGB(in[0], u, v, r, g, b);
+        o[x] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);    /* 16비트 컬러로 전환 */
+        YUV2RGB(in[2], u, v, r, g, b);
+        o[x + 1] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    }
+}
+
+static void row_bgr565(const unsigned char *in, unsigned char *out, int width)
+{
+    unsigned short *o = (unsigned short *)out;
+    int r, g, b;
+    for (int x = 0; x < width; x += 2, in += 4) {
+        int u = in[1] - 128, v = in[3] - 128;
+        YUV2RGB(in[0], u, v, r, g, b);
+        o[x] = ((b >> 3) << 11) | ((g >> 2) << 5) | (r >> 3);
+        YUV2RGB(in[2], u, v, r, g, b);
+        o[x + 1] = ((b >> 3) << 11) | ((g >> 2) << 5) | (r >> 3);
+    }
+}
+
+static void row_xrgb8888(const unsigned char *in, unsigned char *out, int width)
+{
+    unsigned int *o = (unsigned int *)out;
+    int r, g, b;
+    for (int x = 0; x < width; x += 2, in += 4) {
+        int u = in[1] - 128, v = in[3] - 128;
+        YUV2RGB(in[0], u, v, r, g, b);
+        o[x] = 0xff000000u | (r << 16) | (g << 8) | b;
+        YUV2RGB(in[2], u, v, r, g, b);
+        o[x + 1] = 0xff000000u | (r << 16) | (g << 8) | b;
+    }
+}
+
+static void row_xbgr8888(const unsigned char *in, unsigned char *out, int width)
+{
+    unsigned int *o = (unsigned int *)out;
+    int r, g, b;
+    for (int x = 0; x < width; x += 2, in += 4) {
+        int u = in[1] - 128, v = in[3] - 128;
+        YUV2RGB(in[0], u, v, r, g, b);
+        o[x] = 0xff000000u | (b << 16) | (g << 8) | r;
+        YUV2RGB(in[2], u, v, r, g, b);
+        o[x + 1] = 0xff000000u | (b << 16) | (g << 8) | r;
+    }
+}
+
+static void row_rgb888(const unsigned char *in, unsigned char *out, int width)
+{
+    int r, g, b;
+    for (int x = 0; x < width; x += 2, in += 4, out += 6) {
+        int u = in[1] - 128, v = in[3] - 128;
+        YUV2RGB(in[0], u, v, r, g, b);
+        out[0] = b; out[1] = g; out[2] = r;
+        YUV2RGB(in[2], u, v, r, g, b);
+        out[3] = b; out[4] = g; out[5] = r;
+    }
+}
+
+static void row_bgr888(const unsigned char *in, unsigned char *out, int width)
+{
+    int r, g, b;
+    for (int x = 0; x < width; x += 2, in += 4, out += 6) {
+        int u = in[1] - 128, v = in[3] - 128;
+        YUV2RGB(in[0], u, v, r, g, b);
+        out[0] = r; out[1] = g; out[2] = b;
+        YUV2RGB(in[2], u, v, r, g, b);
+        out[3] = r; out[4] = g; out[5] = b;
+    }
+}
+
+display_row_fn display_yuyv_row(enum display_format format)
+{
+    switch (format) {
+    case DISP_RGB565: return row_rgb565;
+    case DISP_BGR565: return row_bgr565;
+    case DISP_XRGB8888: return row_xrgb8888;
+    case DISP_XBGR8888: return row_xbgr8888;
+    case DISP_RGB888: return row_rgb888;
+    case DISP_BGR888: return row_bgr888;
+    }
+    return NULL;
+}
+
+// bits_per_pixel 과 빨강/파랑 비트필드 위치로 포맷을 고르고 변환 함수를 정함
+static int pick_format(struct display *d)
+{
+    const struct fb_var_screeninfo *vi = &d->vinfo;
+
+    switch (vi->bits_per_pixel) {
+    case 16:
+        d->format = vi->blue.offset == 11 ? DISP_BGR565 : DISP_RGB565;
+        break;
+    case 24:
+        d->format = vi->red.offset == 0 ? DISP_BGR888 : DISP_RGB888;
+        break;
+    case 32:
+        d->format = vi->red.offset == 0 ? DISP_XBGR8888 : DISP_XRGB8888;
+        break;
+    default:
+        fprintf(stderr, "Unsupported framebuffer format: %d bpp\n", vi->bits_per_pixel);
+        return -1;
+    }
+    d->yuyv_row = display_yuyv_row(d->format);
+    d->bytes_pp = vi->bits_per_pixel / 8;
+    return 0;
+}
+
+// "mem:WxH" 또는 "mem:WxHxBPP" -> 실제 장치 없이 메모리에 페이지 2개를 잡음
+static int open_memory(struct display *d, const char *spec)
+{
+    int w = 800, h = 600, bpp = 16;
+
+    sscanf(spec, "%dx%dx%d", &w, &h, &bpp);
+    memset(&d->vinfo, 0, sizeof(d->vinfo));
+    memset(&d->finfo, 0, sizeof(d->finfo));
+    d->vinfo.xres = d->vinfo.xres_virtual = w;
+    d->vinfo.yres = h;
+    d->vinfo.yres_virtual = h * 2;
+    d->vinfo.bits_per_pixel = bpp;
+    // 메모리 프레임버퍼는 가장 흔한 배치를 흉내냄 (RGB565 / XRGB8888 / RGB888)
+    if (bpp == 16) {
+        d->vinfo.red.offset = 11;   d->vinfo.red.length = 5;
+        d->vinfo.green.offset = 5;  d->vinfo.green.length = 6;
+        d->vinfo.blue.offset = 0;   d->vinfo.blue.length = 5;
+    } else {
+        d->vinfo.red.offset = 16;   d->vinfo.red.length = 8;
+        d->vinfo.green.offset = 8;  d->vinfo.green.length = 8;
+        d->vinfo.blue.offset = 0;   d->vinfo.blue.length = 8;
+    }
+    d->finfo.line_length = w * bpp / 8;
+    d->finfo.smem_len = d->finfo.line_length * h * 2;
+
+    d->fd = -1;
+    d->mem_len = d->finfo.smem_len;
+    d->mem = calloc(1, d->mem_len);
+    if (!d->mem) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int open_fbdev(struct display *d, const char *path)
+{
+    d->fd = open(path, O_RDWR);
+    if (d->fd == -1) {
+        perror("open( ) : framebuffer device");
+        return -1;
+    }
+
+    if (ioctl(d->fd, FBIOGET_VSCREENINFO, &d->vinfo) == -1) {
+        perror("Error reading variable information.");
+        return -1;
+    }
+
+    // 가상 화면을 세로 2배로 요청. 실패해도 한 페이지로 계속 동작
+    d->vinfo.xres_virtual = d->vinfo.xres;
+    d->vinfo.yres_virtual = d->vinfo.yres * 2;
+    d->vinfo.xoffset = 0;
+    d->vinfo.yoffset = 0;
+    if (ioctl(d->fd, FBIOPUT_VSCREENINFO, &d->vinfo) == -1)
+        perror("FBIOPUT_VSCREENINFO (double buffering disabled)");
+    ioctl(d->fd, FBIOGET_VSCREENINFO, &d->vinfo);
+
+    if (ioctl(d->fd, FBIOGET_FSCREENINFO, &d->finfo) == -1) {
+        perror("Error reading fixed information");
+        return -1;
+    }
+
+    d->mem_len = d->finfo.smem_len;
+    d->mem = mmap(NULL, d->mem_len, PROT_READ | PROT_WRITE, MAP_SHARED, d->fd, 0);
+    if (d->mem == MAP_FAILED) {
+        perror("mmap() : framebuffer device to memory");
+        d->mem = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int display_open(struct display *d, const char *path)
+{
+    int r;
+
+    memset(d, 0, sizeof(*d));
+    if (!strncmp(path, "mem:", 4))
+        r = open_memory(d, path + 4);
+    else
+        r = open_fbdev(d, path);
+    if (r < 0) {
+        display_close(d);
+        return -1;
+    }
+
+    d->xres = d->vinfo.xres;
+    d->yres = d->vinfo.yres;
+    d->bpp = d->vinfo.bits_per_pixel;
+    d->stride = d->finfo.line_length;
+    if (pick_format(d) < 0) {
+        display_close(d);
+        return -1;
+    }
+
+    // 두 페이지가 모두 매핑되어 있어야 더블 버퍼링
+    d->pages = (d->vinfo.yres_virtual >= d->vinfo.yres * 2 &&
+                d->mem_len >= (size_t)d->stride * d->yres * 2) ? 2 : 1;
+    d->back = d->pages == 2 ? 1 : 0;
+    d->vsync = d->fd != -1;
+
+    memset(d->mem, 0, (size_t)d->stride * d->yres * d->pages);
+    return 0;
+}
+
+void display_close(struct display *d)
+{
+    if (d->fd != -1) {
+        // 다음 프로그램을 위해 첫 페이지로 되돌려 둠
+        if (d->mem && d->pages == 2 && d->vinfo.yoffset != 0) {
+            d->vinfo.yoffset = 0;
+            ioctl(d->fd, FBIOPAN_DISPLAY, &d->vinfo);
+        }
+        if (d->mem)
+            munmap(d->mem, d->mem_len);
+        close(d->fd);
+    } else {
+        free(d->mem);
+    }
+    d->mem = NULL;
+    d->fd = -1;
+    free(d->row_buf);
+    d->row_buf = NULL;
+    d->row_buf_len = 0;
+}
+
+unsigned char *display_back(struct display *d)
+{
+    return d->mem + (size_t)d->back * d->yres * d->stride;
+}
+
+unsigned char *display_rect(struct display *d, int w, int h)
+{
+    int x0 = 0, y0 = 0;
+
+    if (d->center) {
+        if (w < d->xres) x0 = (d->xres - w) / 2;
+        if (h < d->yres) y0 = (d->yres - h) / 2;
+    }
+    return display_back(d) + (size_t)y0 * d->stride + (size_t)x0 * d->bytes_pp;
+}
+
+int display_flip(struct display *d)
+{
+    d->flips++;
+    if (d->pages < 2)
+        return 0;
+
+    d->vinfo.yoffset = d->back * d->yres;
+    if (d->fd != -1) {
+        if (ioctl(d->fd, FBIOPAN_DISPLAY, &d->vinfo) == -1) {
+            perror("FBIOPAN_DISPLAY");
+            return -1;
+        }
+        // 팬이 실제로 반영될 때까지 기다려야 방금 앞이 된 페이지에 다음 그림을 덮어쓰지 않음
+        if (d->vsync) {
+            __u32 crtc = 0;
+            if (ioctl(d->fd, FBIO_WAITFORVSYNC, &crtc) == -1)
+                d->vsync = 0;    // 지원하지 않는 드라이버 (ENOTTY 등)
+        }
+    }
+    d->back ^= 1;
+    return 0;
+}
+
+void display_draw_yuyv(struct display *d, const unsigned char *yuyv, int width, int height, int stride)
+{
+    int w = width < d->xres ? width : d->xres;
+    int h = height < d->yres ? height : d->yres;
+    unsigned char *out;
+
+    w &= ~1;                         /* YUYV는 두 픽셀 단위 */
+    out = display_rect(d, w, h);
+
+    // 영상이 차지하는 사각형만 씀. 화면 나머지(여백)는 열 때 지워둔 상태 그대로
+    // 입력 줄 간격은 드라이버가 알려준 stride (줄 끝 여백이 있을 수 있음)
+    for (int y = 0; y < h; ++y)
+        d->yuyv_row(yuyv + (size_t)y * stride, out + (size_t)y * d->stride, w);
+}
+
+void display_draw_native(struct display *d, const unsigned char *pix, int width, int height, int stride)
+{
+    int w = width < d->xres ? width : d->xres;
+    int h = height < d->yres ? height : d->yres;
+    unsigned char *out = display_rect(d, w, h);
+
+    for (int y = 0; y < h; ++y)
+        memcpy(out + (size_t)y * d->stride, pix + (size_t)y * stride, (size_t)w * d->bytes_pp);
+}
+
+void display_draw_yuv420(struct display *d, const unsigned char *y, const unsigned char *u, const unsigned char *v,
+                         int width, int height, int ystride, int cstride, int cstep)
+{
+    int w = (width < d->xres ? width : d->xres) & ~1;
+    int h = height < d->yres ? height : d->yres;
+    unsigned char *out = display_rect(d, w, h);
+
+    if (d->row_buf_len < w * 2) {
+        free(d->row_buf);
+        d->row_buf = malloc(w * 2);
+        d->row_buf_len = d->row_buf ? w * 2 : 0;
+        if (!d->row_buf)
+            return;
+    }
+
+    for (int j = 0; j < h; ++j) {
+        const unsigned char *yr = y + (size_t)j * ystride;
+        const unsigned char *ur = u + (size_t)(j / 2) * cstride;
+        const unsigned char *vr = v + (size_t)(j / 2) * cstride;
+        unsigned char *p = d->row_buf;
+
+        // 두 줄이 같은 색차 줄을 씀
+        for (int x = 0; x < w; x += 2, p += 4) {
+            int c = (x / 2) * cstep;
+            p[0] = yr[x];
+            p[1] = ur[c];
+            p[2] = yr[x + 1];
+            p[3] = vr[c];
+        }
+        d->yuyv_row(d->row_buf, out + (size_t)j * d->stride, w);
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stddef.h>
+#include <linux/fb.h>
+
+// 프레임버퍼 픽셀 포맷 (bits_per_pixel + RGB 비트필드 위치로 판단)
+enum display_format {
+    DISP_RGB565,       // 16bpp, R이 상위 비트
+    DISP_BGR565,       // 16bpp, B가 상위 비트
+    DISP_XRGB8888,     // 32bpp, 메모리 순서 B G R X
+    DISP_XBGR8888,     // 32bpp, 메모리 순서 R G B X
+    DISP_RGB888,       // 24bpp, 메모리 순서 B G R
+    DISP_BGR888        // 24bpp, 메모리 순서 R G B
+};
+
+typedef void (*display_row_fn)(const unsigned char *in, unsigned char *out, int width);
+
+// 프레임버퍼 출력 (더블 버퍼링)
+// 가상 해상도를 화면 높이의 2배로 잡고, 보이지 않는 뒤 페이지에 그린 다음 FBIOPAN_DISPLAY 로 넘김
+// 경로가 "mem:800x600" 처럼 시작하면 실제 장치 대신 메모리 프레임버퍼를 사용 (테스트용)
+struct display {
+    int fd;                 // -1 이면 메모리 프레임버퍼
+    unsigned char *mem;     // 페이지 전체 (mmap 또는 malloc)
+    size_t mem_len;
+    int xres, yres;         // 보이는 화면 크기
+    int stride;             // 한 라인의 바이트 수 (fb_fix_screeninfo.line_length)
+    int bpp;                // bits per pixel
+    int bytes_pp;
+    enum display_format format;
+    display_row_fn yuyv_row;  // 포맷별 YUYV 한 줄 변환 함수
+    int center;             // 1이면 영상을 화면 가운데에 그림
+    int pages;              // 2 = 더블 버퍼, 드라이버가 지원 못하면 1
+    int back;               // 다음에 그릴 페이지
+    int vsync;              // FBIO_WAITFORVSYNC 사용 가능 여부
+    unsigned long flips;
+    unsigned char *row_buf;   // 평면 포맷(NV12/YUV420)을 한 줄씩 YUYV 로 풀어둘 곳
+    int row_buf_len;
+    struct fb_var_screeninfo vinfo;
+    struct fb_fix_screeninfo finfo;
+};
+
+int display_open(struct display *d, const char *path);
+void display_close(struct display *d);
+
+// 지금 그려야 할(보이지 않는) 페이지의 시작 주소
+unsigned char *display_back(struct display *d);
+
+// 뒤 페이지에서 w x h 영상이 들어갈 자리(center 설정시 가운데)의 시작 주소. 줄 간격은 stride
+unsigned char *display_rect(struct display *d, int w, int h);
+
+// 뒤 페이지를 화면에 보이게 하고 앞/뒤 페이지를 바꿈. vsync를 지원하면 다음 vsync까지 기다림
+int display_flip(struct display *d);
+
+// YUYV 프레임을 화면 포맷으로 바꿔 뒤 페이지에 바로 그림 (중간 버퍼 없음)
+// 화면보다 큰 부분은 잘라내고 영상 영역만 씀. stride 는 입력 한 줄의 바이트 수 (V4L2 bytesperline)
+void display_draw_yuyv(struct display *d, const unsigned char *yuyv, int width, int height, int stride);
+
+// 4:2:0 평면 포맷. NV12 는 u = UV 평면, v = u + 1, cstep = 2 / YUV420(I420) 은 cstep = 1
+// 한 줄씩 YUYV 로 풀어서 같은 변환 함수를 씀
+void display_draw_yuv420(struct display *d, const unsigned char *y, const unsigned char *u, const unsigned char *v,
+                         int width, int height, int ystride, int cstride, int cstep);
+
+// 화면 포맷으로 이미 바뀐 프레임 (서버가 RGB565 로 보내준 것 등). 한 줄씩 복사만
+// 프레임 포맷이 화면 포맷과 같아야 함. stride 는 입력 한 줄의 바이트 수
+void display_draw_native(struct display *d, const unsigned char *pix, int width, int height, int stride);
+
+// 포맷별 YUYV 한 줄 변환 함수 (화면 없이 변환만 할 때. video_server 가 클라이언트 화면 포맷으로 미리 바꿈)
+display_row_fn display_yuyv_row(enum display_format format);
+
+#endif // DISPLAY_H
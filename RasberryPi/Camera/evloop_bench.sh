@@ -0,0 +1,48 @@
+#!/bin/sh
+# video_server 전송 루프 비교 (poll + writev / io_uring)
+#
+# 사용법: ./evloop_bench.sh [source] [frames]
+#   source 기본값은 synth:fast (카메라 없이 최대 속도). 실제 카메라는 /dev/video0 (-s 로 높은 fps 설정 후)
+#   루프마다 서버를 띄우고 /dev/tcp 클라이언트로 frames 개를 받은 뒤 BENCH 줄을 모음
+#   (프레임당 CPU us, 컨텍스트 스위치, io_uring_enter 수). strace 가 있으면 프레임당 시스템 콜 수도 셈
+#
+# io_uring 의 이득은 카메라 fd 대기 + 전송을 io_uring_enter 한 번으로 묶는 데서 나오므로
+# fd 가 없는 합성 소스보다 V4L2 장치에서 차이가 큼
+
+set -e
+cd "$(dirname "$0")"
+
+SOURCE=${1:-synth:fast}
+FRAMES=${2:-1000}
+PROG=./video_server
+
+if [ ! -x $PROG ]; then
+    gcc -O2 -o video_server video_server.c capture.c h264nal.c trace.c stats.c metrics.c uring.c simulcast.c yuvscale.c gopcache.c shmring.c variant.c display.c -lavcodec -lavutil -lswscale -lpthread -lrt
+fi
+
+# 제어 요청 CTRL_SUBSCRIBE (proto.h): magic "CTL1", id 1, type 1, 인자 0 바이트
+SUBSCRIBE='CTL1\000\000\000\001\000\000\000\001\000\000\000\000'
+
+run() {
+    "$@" -m 0 -n "$FRAMES" "$SOURCE" > evloop_out.txt 2>&1 &
+    server=$!
+    sleep 1
+    bash -c "exec 3<>/dev/tcp/127.0.0.1/5100; printf '$SUBSCRIBE' >&3; cat <&3 > /dev/null" &
+    client=$!
+    # 서버는 frames 개를 보내면 끝나고 연결을 닫음
+    wait $server || true
+    kill $client 2> /dev/null || true
+    wait $client || true
+    grep '^BENCH' evloop_out.txt || cat evloop_out.txt
+}
+
+for loop in poll uring; do
+    run $PROG -e $loop
+    if command -v strace > /dev/null; then
+        # 시작/종료 시스템 콜도 들어가지만 frames 가 크면 무시할 만함
+        run strace -f -o evloop_strace.txt $PROG -e $loop > /dev/null
+        awk -v loop=$loop -v frames="$FRAMES" '!/resumed>|^[0-9]+ +(\+\+\+|---)/ { n++ }
+            END { printf "SYSCALLS loop=%s per_frame=%.2f\n", loop, n / frames }' evloop_strace.txt
+    fi
+done
+rm -f evloop_out.txt evloop_strace.txt
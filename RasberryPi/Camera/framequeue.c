@@ -0,0 +1,77 @@
+#include <stdlib.h>
+
+#include "framequeue.h"
+
+int framequeue_init(struct framequeue *q, int size, int drop_oldest)
+{
+    q->frames = calloc(size, sizeof(*q->frames));
+    if (!q->frames)
+        return -1;
+    q->size = size;
+    q->head = 0;
+    q->len = 0;
+    q->drop_oldest = drop_oldest;
+    q->eof = 0;
+    q->dropped = 0;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    return 0;
+}
+
+void framequeue_destroy(struct framequeue *q)
+{
+    while (q->len > 0) {
+        av_frame_free(&q->frames[q->head]);
+        q->head = (q->head + 1) % q->size;
+        q->len--;
+    }
+    free(q->frames);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+}
+
+void framequeue_push(struct framequeue *q, AVFrame *frame)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->len == q->size && q->drop_oldest) {
+        // 라이브: 출력이 밀리면 오래된 프레임을 버려서 지연이 쌓이지 않게 함
+        av_frame_free(&q->frames[q->head]);
+        q->head = (q->head + 1) % q->size;
+        q->len--;
+        q->dropped++;
+    }
+    // 파일 재생: 출력이 따라올 때까지 디코딩을 멈춤 (미리 디코딩은 큐 길이만큼만)
+    while (q->len == q->size)
+        pthread_cond_wait(&q->not_full, &q->lock);
+    q->frames[(q->head + q->len) % q->size] = frame;
+    q->len++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void framequeue_finish(struct framequeue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->eof = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+AVFrame *framequeue_pop(struct framequeue *q)
+{
+    AVFrame *frame = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->len == 0 && !q->eof)
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    if (q->len > 0) {
+        frame = q->frames[q->head];
+        q->head = (q->head + 1) % q->size;
+        q->len--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return frame;
+}
@@ -0,0 +1,33 @@
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include <pthread.h>
+#include <libavutil/frame.h>
+
+// 디코딩 스레드 -> 출력 스레드로 디코딩된 프레임을 넘기는 고정 길이 큐
+struct framequeue {
+    AVFrame **frames;
+    int size;
+    int head;
+    int len;
+    int drop_oldest;         // 1이면 가득 찼을 때 기다리지 않고 가장 오래된 프레임을 버림 (라이브 입력)
+    int eof;
+    unsigned long dropped;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+};
+
+int framequeue_init(struct framequeue *q, int size, int drop_oldest);
+void framequeue_destroy(struct framequeue *q);
+
+// 프레임 소유권이 큐로 넘어감
+void framequeue_push(struct framequeue *q, AVFrame *frame);
+
+// 더 이상 프레임이 없음을 알림 (디코딩 끝)
+void framequeue_finish(struct framequeue *q);
+
+// 프레임이 올 때까지 기다림. 끝났으면 NULL. 받은 프레임은 호출한 쪽이 av_frame_free
+AVFrame *framequeue_pop(struct framequeue *q);
+
+#endif // FRAMEQUEUE_H
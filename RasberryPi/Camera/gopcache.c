@@ -0,0 +1,76 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "gopcache.h"
+
+struct gopcache {
+    unsigned char *buf;
+    size_t budget;
+    size_t len;
+    unsigned int frames;
+    int valid;               // 키프레임부터 빠짐없이 들어 있음
+    unsigned long overflows;
+};
+
+struct gopcache *gopcache_create(size_t budget_bytes)
+{
+    struct gopcache *c = calloc(1, sizeof(*c));
+
+    if (!c)
+        return NULL;
+    c->buf = malloc(budget_bytes);
+    if (!c->buf) {
+        free(c);
+        return NULL;
+    }
+    c->budget = budget_bytes;
+    return c;
+}
+
+void gopcache_free(struct gopcache *c)
+{
+    if (!c)
+        return;
+    free(c->buf);
+    free(c);
+}
+
+void gopcache_add(struct gopcache *c, int key, const struct iovec *iov, int cnt)
+{
+    size_t size = 0;
+
+    if (key) {
+        c->len = 0;
+        c->frames = 0;
+        c->valid = 1;
+    }
+    if (!c->valid)
+        return;
+    for (int i = 0; i < cnt; i++)
+        size += iov[i].iov_len;
+    if (c->len + size > c->budget) {
+        // 하나라도 빠지면 그 뒤는 디코딩할 수 없으므로 다음 키프레임까지 통째로 비움
+        c->valid = 0;
+        c->len = 0;
+        c->frames = 0;
+        c->overflows++;
+        return;
+    }
+    for (int i = 0; i < cnt; i++) {
+        memcpy(c->buf + c->len, iov[i].iov_base, iov[i].iov_len);
+        c->len += iov[i].iov_len;
+    }
+    c->frames++;
+}
+
+size_t gopcache_get(struct gopcache *c, const void **data, unsigned int *frames)
+{
+    *data = c->buf;
+    *frames = c->valid ? c->frames : 0;
+    return c->valid ? c->len : 0;
+}
+
+unsigned long gopcache_overflows(struct gopcache *c)
+{
+    return c->overflows;
+}
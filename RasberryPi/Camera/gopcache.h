@@ -0,0 +1,27 @@
+#ifndef GOPCACHE_H
+#define GOPCACHE_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+// 새로 보기 시작한 클라이언트가 다음 키프레임까지 기다리지 않게 하는 캐시
+// 마지막 키프레임(SPS/PPS + IDR)부터 지금까지의 접근 단위를 보낼 모양(헤더 + 데이터) 그대로 이어 붙여 둠
+// -> 새 구독자에게는 이걸 한 번에 보내면 바로 디코딩을 시작해서 지금 프레임까지 따라잡음
+//
+// 메모리는 만들 때 한 번만 잡음. 키프레임 간격이 길어서 넘치면 다음 키프레임까지 비어 있음 (overflows)
+// 잠금이 없으므로 add/get 은 한 스레드에서만 (simulcast 는 화질별 인코더 스레드)
+
+struct gopcache;
+
+struct gopcache *gopcache_create(size_t budget_bytes);
+void gopcache_free(struct gopcache *c);
+
+// 접근 단위 하나 (iov 를 이어서 저장). key 면 앞의 것을 버리고 새로 시작
+void gopcache_add(struct gopcache *c, int key, const struct iovec *iov, int cnt);
+
+// 키프레임부터 지금까지. 비어 있으면 0
+size_t gopcache_get(struct gopcache *c, const void **data, unsigned int *frames);
+
+unsigned long gopcache_overflows(struct gopcache *c);
+
+#endif // GOPCACHE_H
@@ -1,134 +1,215 @@
+// 빌드: gcc -o h264_encoding h264_encoding.c recorder.c prebuffer.c motion.c capture.c h264nal.c shmring.c mjpeg.c uring.c camgroup.c mosaic.c yuvscale.c -lavformat -lavcodec -lavutil -lswscale -lpthread -lm -lrt
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <signal.h>
+#include <time.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
 #include <linux/videodev2.h>
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libswscale/swscale.h>
 
+#include "recorder.h"
+#include "prebuffer.h"
+#include "motion.h"
+#include "capture.h"
+#include "mjpeg.h"
+#include "h264nal.h"
+#include "camgroup.h"
+#include "mosaic.h"
+
 //카메라 디바이스 경로
 #define VIDEODEV "/dev/video0"
-#define WIDTH 800
+#define WIDTH 800     // 기본 캡처 크기 (-s 로 변경)
 #define HEIGHT 600
 
-// 비디오 데이터 저장할 메모리 버퍼 구조체
-struct buffer {
-    void *start;
-    size_t length;
-};
-
-// 버퍼 배열, 버퍼의 수, 카메라 파일 디스크립터
-static struct buffer *buffers;
-static unsigned int n_buffers;
-static int camfd = -1;
-
-// xioctl function to handle ioctl calls with retry on EINTR
-// EINTR는 시그널 인터럽트 . ioctl 반복실행하여 EINTR 오류 발생시 다시 시도
-static int xioctl(int fd, int request, void *arg) {
-    int r;
-    do r = ioctl(fd, request, arg); while (r == -1 && errno == EINTR);
-    return r;
+#define MOSAIC_WIDTH 1280   // -c 를 여러 번 줬을 때 합성 화면 크기 (-X 로 변경)
+#define MOSAIC_HEIGHT 720
+
+#define TRIGGER_PORT 5200   // 이벤트 녹화 트리거 명령("trigger")을 받는 UDP 포트 (localhost)
+
+// 캡처 소스 (카메라 또는 합성 테스트 패턴)와 실제로 협상된 포맷
+static struct capture *cap;
+static struct capture_format cap_fmt;
+
+// MJPEG 캡처일 때만 사용. 캡처 스레드는 JPEG 를 넘기기만 하고 디코딩은 워커들이 나눠서 함
+static struct mjpeg_pool *jpool = NULL;
+
+// pts 는 캡처 타임스탬프에서 (time_base 1/fps). 첫 프레임이 0
+static int64_t first_timestamp_us = -1;
+static int64_t last_pts = -1;
+
+// H.264 캡처 (카메라가 직접 인코딩)일 때만 사용. 인코더 없이 캡처 버퍼의 NAL 을 그대로 녹화
+// 카메라는 SPS/PPS 를 스트림 앞에만 보내는 경우가 많아서 캐시해뒀다가 SPS/PPS 없는 키프레임 앞에 붙임
+static struct h264_params h264_params;
+static uint8_t *au_buf = NULL;      // SPS/PPS 를 붙인 키프레임
+static size_t au_cap = 0;
+static struct capture_frame first_frame;   // 녹화 시작 전에 받아둔 첫 키프레임
+static int have_first = 0;
+
+// 모자이크 (-c 를 여러 번): 카메라마다 캡처 스레드, 타일 축소는 camgroup 워커에서
+// 메인 루프는 정해진 간격마다 합성된 화면 한 장을 인코딩
+static struct camgroup *mosaic_cams = NULL;
+static struct mosaic *mosaic = NULL;
+static struct timespec mosaic_start;
+static int64_t mosaic_tick = -1;
+
+// SIGINT/SIGTERM 을 받으면 녹화 루프 종료
+static volatile sig_atomic_t running = 1;
+
+static void stop_running(int signo) {
+    running = 0;
 }
 
-// 카메라 초기화 위한 함수. 
-//initialize V4L2 and mmap the buffers for video capture
-static int init_camera() {
-    struct v4l2_capability cap;
-    struct v4l2_format fmt;
-    struct v4l2_requestbuffers req;
-
-    // Open camera device
-    camfd = open(VIDEODEV, O_RDWR | O_NONBLOCK, 0);
-    if (camfd == -1) {
-        perror("Opening video device");
-        return -1;
+// 이벤트 녹화일 때만 사용. 인코딩된 패킷은 모두 여기로 들어가고 트리거된 구간만 녹화됨
+static struct prebuffer *prebuf = NULL;
+
+// SIGUSR1 로 트리거. 핸들러에서는 플래그만 세우고 실제 처리는 메인 루프에서
+static volatile sig_atomic_t trigger_pending = 0;
+
+static void set_trigger(int signo) {
+    trigger_pending = 1;
+}
+
+// 움직임 분석 (선택). 움직임이 있는 동안 이벤트 녹화를 연장하고 비트레이트를 올림
+static struct motion *motion = NULL;
+static struct motion_config motion_cfg;
+static int motion_wanted = 0;
+static int64_t idle_bit_rate;
+static int64_t motion_bit_rate;
+
+static void handle_motion(AVCodecContext *codec_ctx, const unsigned char *data) {
+    struct motion_event ev;
+
+    motion_analyze(motion, data, &ev);
+    if (ev.started)
+        printf("motion start (%d,%d %dx%d)\n", ev.x, ev.y, ev.w, ev.h);
+    if (ev.ended)
+        printf("motion end\n");
+
+    // 움직이는 동안 매 프레임 트리거 -> 이벤트 끝 시각이 계속 뒤로 밀림
+    if (ev.active && prebuf)
+        trigger_pending = 1;
+
+    // libx264는 bit_rate 가 바뀌면 다음 프레임부터 레이트 컨트롤을 다시 설정함
+    codec_ctx->bit_rate = ev.active ? motion_bit_rate : idle_bit_rate;
+}
+
+// 로컬 UDP 소켓으로 들어온 트리거 명령 확인 (논블로킹)
+static void poll_trigger_socket(int tsock) {
+    char cmd[64];
+    ssize_t n;
+
+    while ((n = recv(tsock, cmd, sizeof(cmd) - 1, MSG_DONTWAIT)) > 0) {
+        cmd[n] = '\0';
+        if (!strncmp(cmd, "trigger", 7))
+            trigger_pending = 1;
     }
+}
 
-    // Query device capabilities
-    // 비디오 캡쳐 장치인지 확인
-    if (xioctl(camfd, VIDIOC_QUERYCAP, &cap) == -1) {
-        perror("Querying capabilities");
+static int open_trigger_socket(void) {
+    struct sockaddr_in addr;
+    int tsock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (tsock < 0) {
+        perror("socket()");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(TRIGGER_PORT);
+    if (bind(tsock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind()");
+        close(tsock);
         return -1;
     }
+    return tsock;
+}
 
-    // Set video format
-    memset(&fmt, 0, sizeof(fmt));
-    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    fmt.fmt.pix.width = WIDTH;
-    fmt.fmt.pix.height = HEIGHT;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
-    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+// 카메라 초기화 위한 함수. 
+// 포맷 협상, mmap 버퍼 요청, 스트리밍 시작은 capture 모듈이 처리
+// 인코더 크기와 time_base 는 여기서 정해진 cap_fmt 를 따름
+static int init_camera(const struct capture_config *cfg) {
+    char fourcc[5];
 
-    if (xioctl(camfd, VIDIOC_S_FMT, &fmt) == -1) {
-        perror("Setting Pixel Format");
+    cap = capture_open(cfg);
+    if (!cap)
         return -1;
+    capture_get_format(cap, &cap_fmt);
+    printf("capture %s: %dx%d %s, %d fps, stride %d, %d buffers\n", cfg->source, cap_fmt.width, cap_fmt.height,
+           capture_fourcc_str(cap_fmt.pixelformat, fourcc), cap_fmt.fps, cap_fmt.stride, cap_fmt.buffers);
+    if (cfg->roi.width > 0) {
+        struct capture_rect roi, full;
+        capture_get_roi(cap, &roi, &full);
+        printf("roi %dx%d+%d+%d of %dx%d\n", roi.width, roi.height, roi.left, roi.top, full.width, full.height);
     }
-
-	// 4개의 버퍼 요청하여 메모리 매핑방식으로 사용
-    // Request buffers for memory mapping
-    memset(&req, 0, sizeof(req));
-    req.count = 4;
-    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req.memory = V4L2_MEMORY_MMAP;
-	
-    if (xioctl(camfd, VIDIOC_REQBUFS, &req) == -1) {
-        perror("Requesting Buffer");
+    if (cap_fmt.pixelformat != V4L2_PIX_FMT_YUYV && cap_fmt.pixelformat != V4L2_PIX_FMT_NV12 &&
+        cap_fmt.pixelformat != V4L2_PIX_FMT_YUV420 && cap_fmt.pixelformat != V4L2_PIX_FMT_MJPEG &&
+        cap_fmt.pixelformat != V4L2_PIX_FMT_H264) {
+        fprintf(stderr, "No converter for %s\n", fourcc);
         return -1;
     }
+    if (cap_fmt.fps <= 0)
+        cap_fmt.fps = 25;    // 드라이버가 알려주지 않으면 예전처럼 25fps 로 가정
+    return 0;
+}
 
-    // Memory map the buffers
-    buffers = calloc(req.count, sizeof(*buffers));
-    for (n_buffers = 0; n_buffers < req.count; ++n_buffers) {
-        struct v4l2_buffer buf;
-        memset(&buf, 0, sizeof(buf));
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = n_buffers;
 
-        if (xioctl(camfd, VIDIOC_QUERYBUF, &buf) == -1) {
-            perror("Querying Buffer");
-            return -1;
-        }
+// camgroup 워커에서 불림. 캡처 버퍼는 camgroup 이 돌려줌
+static void mosaic_frame(void *arg, int cam, const struct capture_frame *f) {
+    mosaic_put(mosaic, cam, f);
+}
 
-        buffers[n_buffers].length = buf.length;
-        buffers[n_buffers].start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, camfd, buf.m.offset);
-        if (buffers[n_buffers].start == MAP_FAILED) {
-            perror("mmap");
-            return -1;
-        }
+// 여러 카메라를 열어 모자이크 입력으로. 인코더는 합성 화면 크기/fps 를 따르도록 cap_fmt 를 채움
+static int init_mosaic(const struct capture_config *ccfg, const char **sources, int n, int width, int height) {
+    struct camgroup_config gcfg;
+    char fourcc[5];
+
+    camgroup_config_default(&gcfg);
+    gcfg.n_cams = n;
+    for (int i = 0; i < n; i++) {
+        gcfg.cam[i] = *ccfg;
+        gcfg.cam[i].source = sources[i];
     }
-		//매핑된 버퍼를 비디오 캡처 대기열에 추가
-    // Queue the buffers for capture
-    for (unsigned int i = 0; i < n_buffers; ++i) {
-        struct v4l2_buffer buf;
-        memset(&buf, 0, sizeof(buf));
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = i;
-
-        if (xioctl(camfd, VIDIOC_QBUF, &buf) == -1) {
-            perror("Queue Buffer");
+    gcfg.process = mosaic_frame;
+    mosaic_cams = camgroup_open(&gcfg);
+    if (!mosaic_cams)
+        return -1;
+    for (int i = 0; i < n; i++) {
+        struct capture_format fmt;
+        camgroup_get_format(mosaic_cams, i, &fmt);
+        printf("mosaic tile %d %s: %dx%d %s, %d fps\n", i, sources[i], fmt.width, fmt.height,
+               capture_fourcc_str(fmt.pixelformat, fourcc), fmt.fps);
+        if (fmt.pixelformat != V4L2_PIX_FMT_YUYV && fmt.pixelformat != V4L2_PIX_FMT_NV12 &&
+            fmt.pixelformat != V4L2_PIX_FMT_YUV420) {
+            fprintf(stderr, "mosaic needs YUYV, NV12 or YUV420 input\n");
             return -1;
         }
     }
-		// 비디오 스트리밍 시작
-    // Start video streaming
-    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (xioctl(camfd, VIDIOC_STREAMON, &type) == -1) {
-        perror("Stream On");
+    mosaic = mosaic_create(width, height, n);
+    if (!mosaic) {
+        fprintf(stderr, "Could not allocate mosaic\n");
         return -1;
     }
-
-    return 0;
+    cap_fmt.pixelformat = V4L2_PIX_FMT_YUV420;
+    cap_fmt.width = width & ~1;
+    cap_fmt.height = height & ~1;
+    cap_fmt.fps = ccfg->fps > 0 ? ccfg->fps : 25;
+    printf("mosaic: %dx%d, %d fps\n", cap_fmt.width, cap_fmt.height, cap_fmt.fps);
+    clock_gettime(CLOCK_MONOTONIC, &mosaic_start);
+    return camgroup_start(mosaic_cams);
 }
 
-
-void yuyv_to_yuv420p_manual(unsigned char *yuyv, AVFrame *frame, int width, int height) {
+// stride 는 입력 한 줄의 바이트 수 (드라이버가 줄 끝에 여백을 둘 수 있으므로 width * 2 로 가정하지 않음)
+void yuyv_to_yuv420p_manual(const unsigned char *yuyv, int stride, AVFrame *frame, int width, int height) {
     unsigned char *y_plane = frame->data[0];  // Y plane
     unsigned char *u_plane = frame->data[1];  // U plane
     unsigned char *v_plane = frame->data[2];  // V plane
@@ -141,10 +222,10 @@ void yuyv_to_yuv420p_manual(unsigned char *yuyv, AVFrame *frame, int width, int
     for (int j = 0; j < height; j += 2) {
         for (int i = 0; i < width; i += 2) {
             // 픽셀 4개씩 처리 (2x2 블록)
-            int y_index_00 = (j * width + i) * 2;
-            int y_index_01 = (j * width + i + 1) * 2;
-            int y_index_10 = ((j + 1) * width + i) * 2;
-            int y_index_11 = ((j + 1) * width + i + 1) * 2;
+            int y_index_00 = j * stride + i * 2;
+            int y_index_01 = j * stride + (i + 1) * 2;
+            int y_index_10 = (j + 1) * stride + i * 2;
+            int y_index_11 = (j + 1) * stride + (i + 1) * 2;
 
             // 각 채널에 값을 저장 (Y는 그대로, U와 V는 샘플링)
             y_plane[j * y_stride + i] = yuyv[y_index_00];        // Y00
@@ -159,10 +240,66 @@ void yuyv_to_yuv420p_manual(unsigned char *yuyv, AVFrame *frame, int width, int
     }
 }
 
+// NV12 (cstep 2, v = u + 1) 또는 YUV420 (cstep 1) 평면 -> 인코더 YUV420p 프레임
+// Y 는 줄 단위 복사, 색차는 NV12 일 때만 U/V 를 나눠 담음
+void yuv420_to_yuv420p(const unsigned char *y, const unsigned char *u, const unsigned char *v,
+                       int ystride, int cstride, int cstep, AVFrame *frame, int width, int height) {
+    for (int j = 0; j < height; j++)
+        memcpy(frame->data[0] + j * frame->linesize[0], y + (size_t)j * ystride, width);
+
+    for (int j = 0; j < height / 2; j++) {
+        const unsigned char *ur = u + (size_t)j * cstride;
+        const unsigned char *vr = v + (size_t)j * cstride;
+        unsigned char *uo = frame->data[1] + j * frame->linesize[1];
+        unsigned char *vo = frame->data[2] + j * frame->linesize[2];
+        if (cstep == 1) {
+            memcpy(uo, ur, width / 2);
+            memcpy(vo, vr, width / 2);
+        } else {
+            for (int i = 0; i < width / 2; i++) {
+                uo[i] = ur[i * 2];
+                vo[i] = vr[i * 2];
+            }
+        }
+    }
+}
+
+// 캡처 포맷에 맞는 변환
+static void convert_frame(const struct capture_frame *f, AVFrame *frame) {
+    const unsigned char *p[3];
+    int stride[3];
+
+    capture_planes(f, p, stride);
+    switch (f->pixelformat) {
+    case V4L2_PIX_FMT_NV12:
+        yuv420_to_yuv420p(p[0], p[1], p[1] + 1, stride[0], stride[1], 2, frame, f->width, f->height);
+        break;
+    case V4L2_PIX_FMT_YUV420:
+        yuv420_to_yuv420p(p[0], p[1], p[2], stride[0], stride[1], 1, frame, f->width, f->height);
+        break;
+    default:
+        yuyv_to_yuv420p_manual(p[0], stride[0], frame, f->width, f->height);
+        break;
+    }
+}
+
+// 캡처 시각 -> pts. 드라이버가 프레임을 놓치면 그 시간만큼 pts 가 건너뛰어서
+// 녹화 파일의 재생 시간이 실제 시간과 맞음 (프레임 번호를 쓰면 놓칠 때마다 영상이 빨라짐)
+// 타임스탬프 지터로 같은 값이 나와도 pts 는 항상 증가하게 함
+static int64_t frame_pts(int64_t timestamp_us) {
+    if (first_timestamp_us < 0)
+        first_timestamp_us = timestamp_us;
+    int64_t pts = av_rescale(timestamp_us - first_timestamp_us, cap_fmt.fps, 1000000);
+    if (pts <= last_pts)
+        pts = last_pts + 1;
+    last_pts = pts;
+    return pts;
+}
+
 // Initialize FFmpeg
 // ffmpeg을 초기화하여 h264 인코딩 설정
 // avcodec_find_encoder 함수 사용하여 h264코덱 찾음
-void initialize_ffmpeg(AVCodecContext **codec_ctx, AVFormatContext **fmt_ctx, const char *filename) {
+void initialize_ffmpeg(AVCodecContext **codec_ctx) {
     const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_H264);
     if (!codec) {
         fprintf(stderr, "Codec not found\n");
@@ -178,13 +315,13 @@ void initialize_ffmpeg(AVCodecContext **codec_ctx, AVFormatContext **fmt_ctx, co
     
 	// 초당 처리되는 비트 양 설정(400,000 bits per second 즉 400kbps)
     (*codec_ctx)->bit_rate = 400000;
-    // 인코딩할 비디오의 해상도 설정(가로 세로)
-    (*codec_ctx)->width = WIDTH;
-    (*codec_ctx)->height = HEIGHT;
+    // 인코딩할 비디오의 해상도 설정(가로 세로). 카메라와 협상된 크기
+    (*codec_ctx)->width = cap_fmt.width;
+    (*codec_ctx)->height = cap_fmt.height;
     // 비디오 프레임의 시간 단위 설정
     //AVRational 구조체는 분수형태 즉 1/25초의 시간 걸린다는의미
-    // 프레임레이트가 25fps라는 뜻 즉 1초당 25개 프레임 재생
-    (*codec_ctx)->time_base = (AVRational){1, 25};
+    // 프레임레이트가 25fps라는 뜻 즉 1초당 25개 프레임 재생 (카메라 fps 를 따름)
+    (*codec_ctx)->time_base = (AVRational){1, cap_fmt.fps};
     // I프레임과 P/B프레임간의 간격 설정 (GOP:Group of Pictures)
     // I프레임은 전체화면저장하는 완전한 프레임이고, P/B프레임은 이전 또는 다음프레임에 의존하는 차이프레임
     // gop_size = 10은 매 10프레임마다 I프레임을 삽입하는것
@@ -194,6 +331,11 @@ void initialize_ffmpeg(AVCodecContext **codec_ctx, AVFormatContext **fmt_ctx, co
     (*codec_ctx)->max_b_frames = 1;
     // 비디오의 픽셀 포맷 YUV420p 포맷 사용
     (*codec_ctx)->pix_fmt = AV_PIX_FMT_YUV420P;
+    // JPEG 는 전체 범위(0~255) YUV. 줄이지 않고 그대로 넣고 스트림에 표시
+    if (cap_fmt.pixelformat == V4L2_PIX_FMT_MJPEG)
+        (*codec_ctx)->color_range = AVCOL_RANGE_JPEG;
+    // SPS/PPS를 extradata로 따로 받아야 mp4 세그먼트마다 헤더(avcC)에 넣을 수 있음
+    (*codec_ctx)->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
 	// 코덱 열고 초기화. 실패시 에러 출력
     if (avcodec_open2(*codec_ctx, codec, NULL) < 0) {
@@ -201,43 +343,7 @@ void initialize_ffmpeg(AVCodecContext **codec_ctx, AVFormatContext **fmt_ctx, co
         exit(1);
     }
 
-	// ffmpeg에서 사용할 포맷 컨텍스트 할당
-    *fmt_ctx = avformat_alloc_context();
-    if (!*fmt_ctx) {
-        fprintf(stderr, "Could not allocate format context\n");
-        exit(1);
-    }
-		
-	// 출력파일 포맷 결정 (파일 이름에 따라 적절한 포맷 추측)
-    const AVOutputFormat *output_fmt = av_guess_format(NULL, filename, NULL);
-    (*fmt_ctx)->oformat = output_fmt;
-
-    //avio_open으로 파일 열기. 쓰기모드로 염
-    //파일입출력을위한 I/O핸들러를 여는 함수. 주어진 파일을 쓰기모드로 열고, FFmpeg이 해당파일에 데이터 쓸 수 있게함
-    // AVFormatContext구조체의 pb필드는 입출력 핸들임
-    if (avio_open(&(*fmt_ctx)->pb, filename, AVIO_FLAG_WRITE) < 0) {
-        fprintf(stderr, "Could not open file %s\n", filename);
-        exit(1);
-    }
-		
-	// ffmpeg라이브러리로 새 비디오 스트림 만들고 스트림 다양한 속성 설정 후 avformat_write_header로 파일헤더작성
-    // 새 비디오 스트림 생성(avformat_new_stream함수는 AVFormatContext(fmt_ctx)에 새로운 AVStream (오디오 등등..)추가)
-    // 두번째 인자는 사용할 코덱 명시 (NULL사용하여 기본코덱 사용하겠다는 의미)
-    AVStream *stream = avformat_new_stream(*fmt_ctx, NULL);
-	// 스트림의 시간기준 설정. 프레임속도 25fps
-    stream->time_base = (AVRational){1, 25};
-    // 스트림에 사용할 비디오코덱 설정. h264로 인코딩될것
-    stream->codecpar->codec_id = AV_CODEC_ID_H264;
-    // 스트림의 미디어타입 설정. 비디오스트림과 오디오스트림 구분시 사용
-    stream->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
-    stream->codecpar->width = WIDTH;
-    stream->codecpar->height = HEIGHT;
-    // 비디오의 픽셀 포맷 설정
-    stream->codecpar->format = AV_PIX_FMT_YUV420P;
-
-		// 비디오 파일의 헤더 작성
-    avformat_write_header(*fmt_ctx, NULL);
-    
+    // 출력 파일(포맷 컨텍스트)은 이제 recorder가 세그먼트마다 따로 만든다
     
     // 코덱 컨텍스트는 비디오나 오디오 데이터가 어떻게 압축되거나 풀리는지에 대한 정보 저장함.
     // H.264, AAC 등으로 압축할때 코덱 컨텍스트 설정하여 데이터 인코딩
@@ -246,9 +352,33 @@ void initialize_ffmpeg(AVCodecContext **codec_ctx, AVFormatContext **fmt_ctx, co
     // MP4, MKV 등등의 정보와 데이터 관리
 }
 
+// H.264 캡처: 녹화할 스트림 정보만 담은 코덱 컨텍스트 (인코더를 열지 않음)
+// recorder 가 mp4 헤더를 만들 수 있도록 크기, time_base, extradata(SPS/PPS)를 채움
+void initialize_passthrough(AVCodecContext **codec_ctx) {
+    *codec_ctx = avcodec_alloc_context3(NULL);
+    if (!*codec_ctx) {
+        fprintf(stderr, "Could not allocate video codec context\n");
+        exit(1);
+    }
+    (*codec_ctx)->codec_type = AVMEDIA_TYPE_VIDEO;
+    (*codec_ctx)->codec_id = AV_CODEC_ID_H264;
+    (*codec_ctx)->width = h264_params.width ? h264_params.width : cap_fmt.width;
+    (*codec_ctx)->height = h264_params.height ? h264_params.height : cap_fmt.height;
+    (*codec_ctx)->time_base = (AVRational){1, cap_fmt.fps};
+    (*codec_ctx)->pix_fmt = AV_PIX_FMT_YUV420P;
+
+    // 시작코드가 붙은 SPS/PPS 그대로. mp4 먹서가 avcC 로 바꿔서 넣음
+    (*codec_ctx)->extradata = av_mallocz(2 * (4 + H264_PARAM_MAX) + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!(*codec_ctx)->extradata) {
+        fprintf(stderr, "Could not allocate extradata\n");
+        exit(1);
+    }
+    (*codec_ctx)->extradata_size = h264_params_annexb(&h264_params, (*codec_ctx)->extradata);
+}
+
 // Encode a frame using FFmpeg
 // 하나의 프레임을 인코딩
-void encode_frame(AVCodecContext *codec_ctx, AVFormatContext *fmt_ctx, AVFrame *frame, AVPacket *pkt) {
+void encode_frame(AVCodecContext *codec_ctx, struct recorder *rec, AVFrame *frame, AVPacket *pkt) {
 	// avcodec_send_frame 을 사용해서 프레임을 인코더로 보냄
     int ret = avcodec_send_frame(codec_ctx, frame);
     if (ret < 0) {
@@ -264,90 +394,312 @@ void encode_frame(AVCodecContext *codec_ctx, AVFormatContext *fmt_ctx, AVFrame *
             fprintf(stderr, "Error during encoding\n");
             exit(1);
         }
-        //인코딩된 패킷을 출력파일에 기록한 후 패킷을 해제함(unref)
-        // av_interleaved_write_fraem 은 인코딩된 패킷을 출력파일에 기록하는 함수
-        // 인터리빙 방식 : 오디오 및 비디오 스트림 교차저장하는 방식(영상재생시 동시에 재생되게함)
-        // fmt_ctx(포맷컨텍스트) 출력파일과 관련된 정보 포함하고있으며, 파일에 패킷을 기록할 대상이 됨
-        // pkt : 인코딩된 비디오또는 오디오 데이터 포함하고있음. 이 데이터를 출력파일에 기록하는것
-        av_interleaved_write_frame(fmt_ctx, pkt);
-        // 패킷에 할당된 메모리를 해제. 인코딩된 데이터를 파일에 기록한 후 메모리 해제해야함
+        // 인코딩된 패킷을 녹화 스레드의 큐로 넘김 (참조만 넘기므로 복사 없음)
+        // 파일 쓰기는 녹화 스레드에서 하기 때문에 디스크가 느려도 캡처가 막히지 않음
+        // 이벤트 녹화 모드에서는 메모리 링에만 넣어두고, 트리거되면 녹화 스레드가 꺼내감
+        if (prebuf)
+            prebuffer_push(prebuf, pkt);
+        else
+            recorder_push(rec, pkt);
+        // 패킷에 할당된 메모리를 해제. 큐에는 따로 참조가 잡혀있음
         av_packet_unref(pkt);
     }
 }
 
+// 디코딩이 끝난 MJPEG 프레임을 순서대로 꺼내서 인코딩
+// timeout_ms 0 이면 이미 끝난 것만, -1 이면 풀에 남은 것을 전부
+static void encode_decoded(AVCodecContext *codec_ctx, struct recorder *rec, AVPacket *pkt, int timeout_ms) {
+    struct mjpeg_frame out;
+
+    while (mjpeg_pool_receive(jpool, &out, timeout_ms) == 1) {
+        if (out.frame->width != codec_ctx->width || out.frame->height != codec_ctx->height) {
+            fprintf(stderr, "jpeg %u: %dx%d, expected %dx%d\n", out.sequence,
+                    out.frame->width, out.frame->height, codec_ctx->width, codec_ctx->height);
+            av_frame_free(&out.frame);
+            continue;
+        }
+        // 움직임 분석은 디코딩된 Y 평면으로 (JPEG 는 압축된 채로는 볼 수 없음)
+        // 줄 간격은 디코더가 정하므로 첫 프레임을 보고 만듦
+        if (motion_wanted && !motion) {
+            motion = motion_create(out.frame->width, out.frame->height, out.frame->linesize[0], 1, &motion_cfg);
+            if (!motion) {
+                fprintf(stderr, "Could not create motion detector\n");
+                motion_wanted = 0;
+            }
+        }
+        if (motion)
+            handle_motion(codec_ctx, out.frame->data[0]);
+        // 디코더 버퍼를 그대로 인코더에 넘김 (복사/변환 없음)
+        out.frame->pts = frame_pts(out.timestamp_us);
+        out.frame->pict_type = AV_PICTURE_TYPE_NONE;
+        encode_frame(codec_ctx, rec, out.frame, pkt);
+        av_frame_free(&out.frame);
+    }
+}
+
 // 카메라로부터 프레임을 읽어 인코딩
 // Main loop to read frames and encode
-void read_frame_and_encode(int fd, AVCodecContext *codec_ctx, AVFormatContext *fmt_ctx, AVFrame *frame, AVPacket *pkt, int frame_index) {
-    struct v4l2_buffer buf;
-    fd_set fds;
-    struct timeval tv;
-    int r;
-
-    // Set up the file descriptor set.
-    // select 함수가 기다릴 파일 디스크립터를 파일디스크립터집합(fds)에 추가할수있게 집합을 초기화
-    FD_ZERO(&fds);
-    // fds(파일디스크립터집합)에 파일디스크립터(fd) 추가. 이후 select에 의해 감시가능
-    FD_SET(fd, &fds);
-
-    // Set up the timeout.
-    tv.tv_sec = 2;  // 2 seconds timeout 2초 지나도 감시중인 파일디스크립터에 이벤트 발생 x라면 타임아웃발생
-    tv.tv_usec = 0;
-
-    // Wait for the camera to be ready for reading
-    r = select(fd + 1, &fds, NULL, NULL, &tv);
-    if (r == -1) {
-        perror("select");
-        return;
-    } else if (r == 0) {
+void read_frame_and_encode(struct capture *cap, AVCodecContext *codec_ctx, struct recorder *rec, AVFrame *frame, AVPacket *pkt) {
+    struct capture_frame f;
+
+    // 2초 안에 프레임이 안 오면 이번 차례는 건너뜀
+    int r = capture_read(cap, &f, 2000);
+    if (r == 0) {
         fprintf(stderr, "select timeout\n");
         return;
+    } else if (r < 0) {
+        return;
     }
 
-    memset(&buf, 0, sizeof(buf));
-    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buf.memory = V4L2_MEMORY_MMAP;
-
-    for (int retry = 0; retry < 5; ++retry) {
-        if (xioctl(fd, VIDIOC_DQBUF, &buf) != -1) {
-            break;  // 성공적으로 읽었을 때 반복 종료
-        }
-        usleep(10000);  // 재시도 전 대기
-        printf("retry %d \n", retry);
+    // MJPEG: JPEG 를 풀에 복사해 넣고 캡처 버퍼는 바로 돌려줌
+    // 풀이 꽉 차 있으면 (디코딩이 캡처보다 느리면) 자리가 날 때까지 기다림 -> 드라이버 쪽에서 프레임이 밀림
+    if (jpool) {
+        mjpeg_pool_submit(jpool, f.data, f.bytesused, f.sequence, f.timestamp_us, -1);
+        capture_release(cap, &f);
+        encode_decoded(codec_ctx, rec, pkt, 0);
+        return;
     }
 
-    unsigned char *yuv420p_data = (unsigned char *)malloc(WIDTH * HEIGHT * 3 / 2);
-    yuyv_to_yuv420p_manual((unsigned char *)buffers[buf.index].start, frame, WIDTH, HEIGHT);
-    
-	//av_frame_make_writable로 프레임 쓸 수 있게 함
+    // 변환 전에 캡처 버퍼를 그대로 분석
+    if (motion)
+        handle_motion(codec_ctx, f.data);
+
+	//av_frame_make_writable로 프레임 쓸 수 있게 함 (인코더가 아직 참조중이면 새 버퍼를 받음)
     if (av_frame_make_writable(frame) < 0) {
         fprintf(stderr, "Frame not writable\n");
         exit(1);
     }
 
-    // PTS 설정 (프레임 인덱스를 사용하여 PTS 설정)
-    // PTS는 각 프레임이 언제 표시되어야하는지를 나타내는 시간정보. 여기서 frame_index는 인코딩중인 프레임 순서 의미
-    frame->pts = frame_index;
-    encode_frame(codec_ctx, fmt_ctx, frame, pkt);
+    convert_frame(&f, frame);
+
+    // PTS 설정 (캡처 타임스탬프 기준, frame_pts 참고)
+    // PTS는 각 프레임이 언제 표시되어야하는지를 나타내는 시간정보
+    frame->pts = frame_pts(f.timestamp_us);
+    encode_frame(codec_ctx, rec, frame, pkt);
+
+    capture_release(cap, &f);
+}
 
-    if (xioctl(fd, VIDIOC_QBUF, &buf) == -1) {
-        perror("VIDIOC_QBUF");
+// 모자이크: 정해진 간격마다 합성 화면 한 장을 인코딩. 카메라를 기다리지 않음 (늦은 타일은 이전 화면)
+// 기다리는 시각은 시작 시각 기준 절대값이라 인코딩 시간이 쌓여도 간격이 밀리지 않음
+// 인코딩이 한 간격 넘게 늦어지면 그만큼 출력 프레임을 건너뜀 (pts 가 건너뛰어 재생 시간은 맞음)
+static void compose_and_encode(AVCodecContext *codec_ctx, struct recorder *rec, AVPacket *pkt) {
+    const int64_t interval_ns = 1000000000LL / cap_fmt.fps;
+    struct timespec now, due;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t elapsed = (now.tv_sec - mosaic_start.tv_sec) * 1000000000LL + (now.tv_nsec - mosaic_start.tv_nsec);
+    mosaic_tick++;
+    if (elapsed / interval_ns > mosaic_tick)
+        mosaic_tick = elapsed / interval_ns;
+    int64_t t = mosaic_start.tv_nsec + mosaic_tick * interval_ns;
+    due.tv_sec = mosaic_start.tv_sec + t / 1000000000LL;
+    due.tv_nsec = t % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR && running)
+        ;
+
+    AVFrame *out = mosaic_compose(mosaic);
+    if (!out)
         return;
+    out->pts = mosaic_tick;
+    encode_frame(codec_ctx, rec, out, pkt);
+    av_frame_free(&out);
+}
+
+// H.264 캡처: SPS/PPS 와 키프레임이 올 때까지 버림 (그 전 프레임은 어차피 디코딩할 수 없음)
+// 받은 키프레임은 돌려주지 않고 두었다가 녹화의 첫 프레임으로 씀
+static int wait_for_keyframe(struct capture *cap) {
+    struct capture_frame f;
+    int skipped = 0;
+
+    while (running) {
+        int r = capture_read(cap, &f, 2000);
+        if (r < 0)
+            return -1;
+        if (r == 0) {
+            fprintf(stderr, "select timeout\n");
+            continue;
+        }
+        int flags = h264_params_scan(&h264_params, f.data, f.bytesused);
+        if ((flags & H264_AU_KEY) && h264_params_ready(&h264_params)) {
+            first_frame = f;
+            have_first = 1;
+            printf("h264 passthrough: %dx%d, SPS %zu PPS %zu bytes, skipped %d frames\n",
+                   h264_params.width, h264_params.height, h264_params.sps_len, h264_params.pps_len, skipped);
+            return 0;
+        }
+        capture_release(cap, &f);
+        skipped++;
+    }
+    return -1;
+}
+
+// 카메라가 인코딩한 접근 단위 하나를 그대로 녹화
+// 패킷은 캡처 버퍼를 가리키기만 하고, recorder/prebuffer 가 큐에 넣을 때 한번 복사함
+void read_frame_and_mux(struct capture *cap, struct recorder *rec, AVPacket *pkt, int frame_index) {
+    struct capture_frame f;
+
+    if (have_first) {
+        f = first_frame;
+        have_first = 0;
+    } else {
+        int r = capture_read(cap, &f, 2000);
+        if (r == 0) {
+            fprintf(stderr, "select timeout\n");
+            return;
+        } else if (r < 0) {
+            return;
+        }
+    }
+
+    int flags = h264_params_scan(&h264_params, f.data, f.bytesused);
+    if ((flags & H264_AU_CHANGED) && frame_index > 0)
+        fprintf(stderr, "h264 passthrough: SPS/PPS changed at frame %d\n", frame_index);
+
+    pkt->data = (uint8_t *)f.data;
+    pkt->size = f.bytesused;
+    // SPS/PPS 없이 온 키프레임에는 캐시한 것을 붙여서, 어느 키프레임부터 읽어도 디코딩되게 함
+    // (새 세그먼트, 이벤트 녹화 시작, 나중에 붙은 쪽)
+    if ((flags & H264_AU_KEY) && !(flags & H264_AU_PARAMS)) {
+        size_t need = 2 * (4 + H264_PARAM_MAX) + f.bytesused + AV_INPUT_BUFFER_PADDING_SIZE;
+        if (need > au_cap) {
+            uint8_t *b = realloc(au_buf, need);
+            if (!b) {
+                fprintf(stderr, "Out of memory\n");
+                exit(1);
+            }
+            au_buf = b;
+            au_cap = need;
+        }
+        size_t n = h264_params_annexb(&h264_params, au_buf);
+        memcpy(au_buf + n, f.data, f.bytesused);
+        pkt->data = au_buf;
+        pkt->size = n + f.bytesused;
     }
+    // 카메라 인코더는 B프레임을 쓰지 않으므로 dts = pts
+    pkt->pts = pkt->dts = frame_pts(f.timestamp_us);
+    pkt->duration = 1;
+    pkt->flags = (flags & H264_AU_KEY) ? AV_PKT_FLAG_KEY : 0;
+
+    if (prebuf)
+        prebuffer_push(prebuf, pkt);
+    else
+        recorder_push(rec, pkt);
+    pkt->data = NULL;
+    pkt->size = 0;
+
+    capture_release(cap, &f);
+}
 
-	//동적으로 할당한 YUV420p데이터 해제
-    free(yuv420p_data);
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-o dir] [-p prefix] [-t segment_sec] [-m max_MB] [-a max_age_sec] [-f none|segment|<MB>]\n"
+                    "          [-e pre_sec:post_sec] [-b prebuffer_MB] [-M motion_kbps] [-c /dev/videoN|synth|synth:fast|file:x.h264] [-n frames]\n"
+                    "          [-s WxH@fps:FOURCC] [-B capture_buffers] [-J jpeg_workers] [-u] [-X WxH] [-z WxH[+X+Y]]\n"
+                    "  -c more than once: record a mosaic of all sources\n", prog);
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+    struct recorder_config rcfg;
+    int pre_sec = 0, post_sec = 0;
+    int motion_kbps = 0;
+    long long pb_budget = 16 * 1024 * 1024;
+    int tsock = -1;
+    struct capture_config ccfg;
+    int max_frames = 0;
+    int jpeg_workers = 0;
+    const char *sources[CAMGROUP_MAX];
+    int n_sources = 0;
+    int mosaic_w = MOSAIC_WIDTH, mosaic_h = MOSAIC_HEIGHT;
+    int opt;
+
+    // 녹화 설정 (세그먼트 길이, 보관 정책, fsync 정책)
+    recorder_config_default(&rcfg);
+    capture_config_default(&ccfg);
+    ccfg.source = VIDEODEV;
+    ccfg.width = WIDTH;
+    ccfg.height = HEIGHT;
+    while ((opt = getopt(argc, argv, "o:p:t:m:a:f:e:b:M:c:n:s:B:J:uX:z:")) != -1) {
+        switch (opt) {
+        case 'o': rcfg.dir = optarg; break;
+        case 'p': rcfg.prefix = optarg; break;
+        case 't': rcfg.segment_sec = atoi(optarg); break;
+        case 'm': rcfg.max_total_bytes = atoll(optarg) * 1024 * 1024; break;
+        case 'a': rcfg.max_age_sec = atoi(optarg); break;
+        case 'f':
+            if (!strcmp(optarg, "none")) rcfg.fsync = FSYNC_NONE;
+            else if (!strcmp(optarg, "segment")) rcfg.fsync = FSYNC_SEGMENT;
+            else {
+                rcfg.fsync = FSYNC_INTERVAL;
+                rcfg.fsync_bytes = atoll(optarg) * 1024 * 1024;
+            }
+            break;
+        case 'e':
+            if (sscanf(optarg, "%d:%d", &pre_sec, &post_sec) != 2) {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'b': pb_budget = atoll(optarg) * 1024 * 1024; break;
+        case 'M': motion_kbps = atoi(optarg); break;
+        // -c synth:fast -n 1000 : 카메라 없이 같은 영상으로 캡처->변환->인코딩->녹화 부하 테스트
+        // -c 를 여러 번 주면 모든 소스를 한 화면(격자)에 모아서 녹화. 크기는 -X, fps 는 -s 의 @fps
+        case 'c':
+            if (n_sources == CAMGROUP_MAX) {
+                fprintf(stderr, "at most %d sources\n", CAMGROUP_MAX);
+                return -1;
+            }
+            sources[n_sources++] = optarg;
+            break;
+        case 'X':
+            if (sscanf(optarg, "%dx%d", &mosaic_w, &mosaic_h) != 2) {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'n': max_frames = atoi(optarg); break;
+        // -s 1920x1080@30:NV12 : 캡처 크기/fps/포맷. 장치가 지원하는 가장 가까운 값으로 맞춰짐
+        // -B : 캡처 버퍼 수. 적으면 지연이 짧고 많으면 인코딩이 잠깐 밀려도 프레임을 덜 놓침
+        case 's':
+            if (capture_parse_spec(&ccfg, optarg) < 0) {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'B': ccfg.buffers = atoi(optarg); break;
+        // -z 640x360+320+180 : 이 영역만 녹화 (디지털 줌). 크기만 주면 가운데. 인코딩 크기가 ROI 크기가 됨
+        case 'z':
+            if (capture_parse_roi(&ccfg.roi, optarg) < 0) {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        // -s :MJPG 일 때 JPEG 디코딩 스레드 수 (기본: CPU 수)
+        case 'J': jpeg_workers = atoi(optarg); break;
+        // -u : 세그먼트 파일을 io_uring 으로 씀 (muxer 가 다음 chunk 를 채우는 동안 이전 chunk 를 씀)
+        case 'u': rcfg.use_uring = 1; break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
     // Initialize camera
-    if (init_camera() != 0) {
-        fprintf(stderr, "Failed to initialize camera\n");
-        return -1;
+    if (n_sources > 1) {
+        if (init_mosaic(&ccfg, sources, n_sources, mosaic_w, mosaic_h) != 0) {
+            fprintf(stderr, "Failed to initialize cameras\n");
+            return -1;
+        }
+    } else {
+        if (n_sources == 1)
+            ccfg.source = sources[0];
+        if (init_camera(&ccfg) != 0) {
+            fprintf(stderr, "Failed to initialize camera\n");
+            return -1;
+        }
     }
 
     // Initialize FFmpeg
     AVCodecContext *codec_ctx;
-    AVFormatContext *fmt_ctx;
     AVPacket *pkt = av_packet_alloc();
     if (!pkt) {
         fprintf(stderr, "Could not allocate AVPacket\n");
@@ -355,8 +707,72 @@ int main() {
     }
 
     AVFrame *frame;
-    const char *output_filename = "output.h264";
-    initialize_ffmpeg(&codec_ctx, &fmt_ctx, output_filename);
+    // -s :H264 : 카메라가 인코딩한 스트림을 그대로 녹화 (libx264 를 쓰지 않음)
+    int passthrough = cap_fmt.pixelformat == V4L2_PIX_FMT_H264;
+    if (passthrough) {
+        if (wait_for_keyframe(cap) < 0) {
+            fprintf(stderr, "No H.264 keyframe from camera\n");
+            return -1;
+        }
+        initialize_passthrough(&codec_ctx);
+    } else {
+        initialize_ffmpeg(&codec_ctx);
+    }
+
+    // 이벤트 녹화: 고정 크기 메모리 링에 최근 패킷을 계속 담아두고 트리거를 기다림
+    // 인덱스 칸 수는 예산을 평균 패킷 크기(약 1KB)로 나눈 정도면 충분
+    if (pre_sec > 0 || post_sec > 0) {
+        prebuf = prebuffer_create(pb_budget, pb_budget / 1024, codec_ctx->time_base, pre_sec, post_sec);
+        if (!prebuf) {
+            fprintf(stderr, "Could not allocate prebuffer\n");
+            return -1;
+        }
+        rcfg.source = prebuf;
+        tsock = open_trigger_socket();
+        signal(SIGUSR1, set_trigger);
+    }
+
+    if (cap_fmt.pixelformat == V4L2_PIX_FMT_MJPEG) {
+        if (jpeg_workers <= 0)
+            jpeg_workers = sysconf(_SC_NPROCESSORS_ONLN);
+        // 워커마다 2프레임씩: 하나를 디코딩하는 동안 다음 JPEG 가 기다리고 있도록
+        jpool = mjpeg_pool_create(jpeg_workers, jpeg_workers * 2);
+        if (!jpool) {
+            fprintf(stderr, "Could not start MJPEG decoder\n");
+            return -1;
+        }
+        printf("mjpeg: %d decode workers\n", jpeg_workers);
+    }
+
+    if (motion_kbps > 0 && mosaic) {
+        fprintf(stderr, "motion detection is not available with a mosaic, ignoring -M\n");
+    } else if (motion_kbps > 0 && passthrough) {
+        // 디코딩하지 않으므로 분석할 화면이 없음
+        fprintf(stderr, "motion detection is not available with H.264 capture, ignoring -M\n");
+    } else if (motion_kbps > 0) {
+        motion_config_default(&motion_cfg);
+        // YUYV 는 Y 가 2바이트 간격, NV12/YUV420 의 Y 평면은 1바이트 간격
+        // MJPEG 는 첫 프레임이 디코딩되면 그때 만듦 (encode_decoded)
+        if (jpool) {
+            motion_wanted = 1;
+        } else {
+            motion = motion_create(cap_fmt.width, cap_fmt.height, cap_fmt.stride,
+                                   cap_fmt.pixelformat == V4L2_PIX_FMT_YUYV ? 2 : 1, &motion_cfg);
+            if (!motion) {
+                fprintf(stderr, "Could not create motion detector\n");
+                return -1;
+            }
+        }
+        idle_bit_rate = codec_ctx->bit_rate;
+        motion_bit_rate = (int64_t)motion_kbps * 1000;
+    }
+
+    // 세그먼트 파일 쓰기를 담당할 녹화 스레드 시작
+    struct recorder *rec = recorder_open(&rcfg, codec_ctx);
+    if (!rec) {
+        fprintf(stderr, "Could not start recorder\n");
+        return -1;
+    }
 
     frame = av_frame_alloc();
     frame->format = AV_PIX_FMT_YUV420P;
@@ -368,25 +784,78 @@ int main() {
         exit(1);  // 버퍼 할당 실패 시 프로그램 종료
     }
 
+    signal(SIGINT, stop_running);
+    signal(SIGTERM, stop_running);
+
     // Main loop for capturing frames and encoding
-    for (int frame_index = 0; frame_index < 500; ++frame_index) {
-        read_frame_and_encode(camfd, codec_ctx, fmt_ctx, frame, pkt, frame_index);
+    // 종료 시그널이 올 때까지 계속 녹화. 세그먼트 교체는 녹화 스레드가 알아서 함
+    // -n 을 주면 그만큼만 찍고 끝냄
+    for (int frame_index = 0; running && (max_frames <= 0 || frame_index < max_frames); ++frame_index) {
+        if (mosaic)
+            compose_and_encode(codec_ctx, rec, pkt);
+        else if (passthrough)
+            read_frame_and_mux(cap, rec, pkt, frame_index);
+        else
+            read_frame_and_encode(cap, codec_ctx, rec, frame, pkt);
+
+        if (prebuf) {
+            if (tsock >= 0)
+                poll_trigger_socket(tsock);
+            if (trigger_pending) {
+                trigger_pending = 0;
+                prebuffer_trigger(prebuf);
+            }
+        }
+    }
+
+    // 모자이크: 캡처를 먼저 멈춤 (워커가 타일을 그리는 중일 수 있음)
+    if (mosaic) {
+        camgroup_close(mosaic_cams);
+        for (int i = 0; i < n_sources; i++) {
+            struct mosaic_stats mst;
+            mosaic_get_stats(mosaic, i, &mst);
+            printf("mosaic tile %d %s: %lu frames, repeated %lu times\n", i, sources[i], mst.frames, mst.stale);
+        }
+    }
+
+    // 디코딩 중이던 JPEG 까지 인코딩한 뒤
+    // 인코더에 남아있는 프레임(B프레임 등)을 모두 꺼내서 녹화
+    if (jpool) {
+        encode_decoded(codec_ctx, rec, pkt, -1);
+        if (mjpeg_pool_errors(jpool))
+            fprintf(stderr, "mjpeg: %lu corrupt frames skipped\n", mjpeg_pool_errors(jpool));
+        mjpeg_pool_free(jpool);
     }
+    if (!passthrough)
+        encode_frame(codec_ctx, rec, NULL, pkt);
 
     // Finalize FFmpeg
-    av_write_trailer(fmt_ctx);
+    // recorder_close는 큐에 남은 패킷을 다 쓰고 마지막 세그먼트를 닫은 후 반환
+    if (recorder_dropped(rec))
+        fprintf(stderr, "recorder dropped %lu packets\n", recorder_dropped(rec));
+    recorder_close(rec);
+    if (prebuf) {
+        if (prebuffer_overruns(prebuf))
+            fprintf(stderr, "prebuffer overran %lu times\n", prebuffer_overruns(prebuf));
+        prebuffer_free(prebuf);
+        if (tsock >= 0)
+            close(tsock);
+    }
+    motion_free(motion);
     avcodec_close(codec_ctx);
-    avio_close(fmt_ctx->pb);
-    avformat_free_context(fmt_ctx);
+    av_frame_free(&frame);
     av_packet_free(&pkt);
+    free(au_buf);
+    mosaic_free(mosaic);
 
     // Stop camera capture and clean up
-    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    xioctl(camfd, VIDIOC_STREAMOFF, &type);
-    for (unsigned int i = 0; i < n_buffers; ++i) {
-        munmap(buffers[i].start, buffers[i].length);
+    if (cap) {
+        struct capture_stats cst;
+        capture_get_stats(cap, &cst);
+        if (cst.dropped || cst.errors)
+            fprintf(stderr, "capture: %lu frames, %lu dropped (%lu corrupt)\n", cst.frames, cst.dropped, cst.errors);
+        capture_close(cap);
     }
-    close(camfd);
 
     return 0;
 }
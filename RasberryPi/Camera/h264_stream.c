@@ -1,5 +1,8 @@
+// 빌드: gcc -o h264_stream h264_stream.c display.c playclock.c framequeue.c stats.c -lavformat -lavcodec -lavutil -lswscale -lpthread
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>  // for ioctl
 #include <unistd.h>
 #include <linux/fb.h>
@@ -9,86 +12,197 @@
 #include <libswscale/swscale.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "display.h"
+#include "playclock.h"
+#include "framequeue.h"
+#include "stats.h"
 
-#define WIDTH 800
-#define HEIGHT 600
 #define FBDEV "/dev/fb0"
+#define QUEUE_LEN 4     // 미리 디코딩해 둘 프레임 수
 
-// 프레임버퍼에 쓸 메모리 매핑 및 설정 함수
-int init_framebuffer(int *fbfd, struct fb_var_screeninfo *vinfo, struct fb_fix_screeninfo *finfo, char **fbp) {
-    *fbfd = open(FBDEV, O_RDWR);
-    if (*fbfd == -1) {
-        perror("Error opening framebuffer device");
-        return -1;
+// 프레임버퍼 포맷에 맞는 sws 출력 포맷 (little-endian 기준 메모리 바이트 순서)
+static enum AVPixelFormat display_av_format(const struct display *disp) {
+    switch (disp->format) {
+    case DISP_BGR565:   return AV_PIX_FMT_BGR565LE;
+    case DISP_XRGB8888: return AV_PIX_FMT_BGR0;    // B G R X
+    case DISP_XBGR8888: return AV_PIX_FMT_RGB0;    // R G B X
+    case DISP_RGB888:   return AV_PIX_FMT_BGR24;
+    case DISP_BGR888:   return AV_PIX_FMT_RGB24;
+    default:            return AV_PIX_FMT_RGB565LE;
     }
+}
 
-    if (ioctl(*fbfd, FBIOGET_VSCREENINFO, vinfo)) {
-        perror("Error reading variable information");
-        return -1;
-    }
+// YUV420p → 화면 포맷 변환 결과를 프레임버퍼 뒤 페이지에 바로 씀 (임시 RGB 버퍼, memcpy 없음)
+// 영상이 들어갈 사각형만 쓰고 줄 간격은 프레임버퍼의 line_length 를 따름
+// 페이지 넘기기(display_flip)는 호출한 쪽에서 (벤치마크에서 변환과 따로 재기 위해)
+void yuv420p_to_fb(AVFrame *frame, struct SwsContext *sws_ctx, struct display *disp, int out_w, int out_h) {
+    uint8_t *dst[1] = { display_rect(disp, out_w, out_h) };
+    int dst_stride[1] = { disp->stride };  // 프레임버퍼 한 라인의 실제 바이트 수
 
-    if (ioctl(*fbfd, FBIOGET_FSCREENINFO, finfo)) {
-        perror("Error reading fixed information");
-        return -1;
-    }
-
-    *fbp = (char *)mmap(0, finfo->smem_len, PROT_READ | PROT_WRITE, MAP_SHARED, *fbfd, 0);
-    if ((long)*fbp == -1) {
-        perror("Error: failed to map framebuffer device to memory");
-        return -1;
-    }
+    // 색상 공간 변환: YUV420p → 프레임버퍼 포맷
+    sws_scale(sws_ctx, (const uint8_t *const *)frame->data, frame->linesize, 0, frame->height, dst, dst_stride);
+}
 
-    return 0;
+// t0 부터 지금까지를 s 에 기록하고 지금 시각을 돌려줌. s 가 NULL 이면 (벤치마크가 아니면) 기록 안 함
+static int64_t lap(struct stats *s, int64_t t0) {
+    int64_t t = stats_now();
+    if (s)
+        stats_add(s, t - t0);
+    return t;
 }
 
-// YUV420p → RGB565 변환 후 프레임버퍼에 출력
-void yuv420p_to_rgb565(AVFrame *frame, struct SwsContext *sws_ctx, struct fb_var_screeninfo *vinfo, char *fbp, int width, int height) {
-    // RGB565 프레임을 위한 출력 버퍼
-    uint8_t *rgb_frame[1];
-    rgb_frame[0] = (uint8_t *)malloc(width * height * 2); // RGB565는 2 bytes per pixel
+// 디코딩 스레드에 넘기는 것들
+struct decoder {
+    AVFormatContext *fmt_ctx;
+    AVCodecContext *codec_ctx;
+    int stream_idx;
+    struct framequeue *queue;
+    struct stats *demux;       // 벤치마크일 때만 설정
+    struct stats *decode;
+};
 
-    int rgb_stride[1] = { width * 2 };  // RGB565는 2바이트 픽셀
+// 디코딩 스레드: 읽기 + 디코딩만 하고 결과 프레임을 큐에 넣음
+// 큐가 차 있으면 출력 스레드가 꺼낼 때까지 기다리므로 앞서가는 양은 큐 길이로 제한됨
+static void *decode_thread(void *arg) {
+    struct decoder *dec = arg;
+    AVPacket *packet = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    int eof = 0;
 
-    // 색상 공간 변환: YUV420p → RGB565
-    sws_scale(sws_ctx, (const uint8_t *const *)frame->data, frame->linesize, 0, height, rgb_frame, rgb_stride);
+    while (!eof) {
+        int64_t t = stats_now();
+        int64_t busy = 0;
+        int r;
 
-    // 프레임버퍼에 데이터 복사
-    for (int y = 0; y < height; y++) {
-        memcpy(fbp + y * vinfo->xres * 2, rgb_frame[0] + y * width * 2, width * 2);
+        // av_read_frame는 비디오파일에서 다음패킷을 읽어옴. 패킷은 압축된 비디오 데이터
+        r = av_read_frame(dec->fmt_ctx, packet);
+        t = lap(dec->demux, t);
+        if (r < 0) {
+            // 파일 끝: 빈 패킷을 보내서 디코더 안에 남은 프레임을 모두 꺼냄
+            // (프레임 스레딩은 스레드 수만큼 프레임을 붙잡고 있으므로 꼭 필요)
+            eof = 1;
+            avcodec_send_packet(dec->codec_ctx, NULL);
+        } else if (packet->stream_index != dec->stream_idx ||
+                   avcodec_send_packet(dec->codec_ctx, packet) < 0) {
+            av_packet_unref(packet);
+            continue;
+        }
+        av_packet_unref(packet);
+
+        // 디코딩 시간 = send + receive. 큐에 넣으며 기다린 시간은 빼고 잼
+        // avcodec_receive_frame은 압축된 데이터 풀어서 frame에 저장함
+        while (1) {
+            r = avcodec_receive_frame(dec->codec_ctx, frame);
+            busy += stats_now() - t;
+            if (r < 0)
+                break;
+            framequeue_push(dec->queue, frame);    // 프레임 소유권은 큐로
+            t = stats_now();
+            frame = av_frame_alloc();
+            if (!frame) {
+                eof = 1;
+                break;
+            }
+        }
+        if (dec->decode)
+            stats_add(dec->decode, busy);
     }
 
-    free(rgb_frame[0]);
+    framequeue_finish(dec->queue);
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    return NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-f] [-l] [-s] [-j threads] [-q depth] [-b [-m min_fps]] <input_file> [fbdev | mem:WxH | null]\n", prog);
+}
+
+// 벤치마크 결과: 전체 fps + 단계별 시간 분포 + 최대 RSS
+// 마지막 줄은 CI 에서 파싱하기 쉽게 key=value 한 줄로
+static void bench_report(const char *filename, unsigned long frames, int64_t wall_ns,
+                         struct stats *st, int nstats) {
+    struct rusage ru;
+    double sec = wall_ns / 1e9;
+    double fps = sec > 0 ? frames / sec : 0;
+
+    getrusage(RUSAGE_SELF, &ru);
+    printf("%s: %lu frames in %.3f s, %.1f fps, max RSS %ld KB\n", filename, frames, sec, fps, ru.ru_maxrss);
+    stats_header(stdout);
+    for (int i = 0; i < nstats; i++)
+        stats_print(&st[i], stdout);
+    printf("BENCH file=%s frames=%lu fps=%.1f", filename, frames, fps);
+    for (int i = 0; i < nstats; i++)
+        printf(" %s_p99_us=%.1f", st[i].name, stats_percentile(&st[i], 99) / 1e3);
+    printf(" maxrss_kb=%ld\n", ru.ru_maxrss);
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <input_file>\n", argv[0]);
+    int fast = 0;
+    int live = 0;
+    int slice = 0;
+    int threads = 0;
+    int queue_len = QUEUE_LEN;
+    int bench = 0;
+    double min_fps = 0;
+    int opt;
+
+    // -f : PTS를 무시하고 최대한 빨리 디코딩/출력 (디코딩 처리량 측정용)
+    // -l : 라이브 입력. 지연 최소화 (슬라이스 스레딩, 큐 1장, 밀리면 오래된 프레임을 버림)
+    // -s : 프레임 스레딩 대신 슬라이스 스레딩 (지연은 적지만 슬라이스가 여러 개인 스트림에서만 빨라짐)
+    // -j : 디코더 스레드 수 (0 = 코어 수에 맞춰 자동)
+    // -q : 미리 디코딩해 둘 프레임 수
+    // -b : 화면 없이 벤치마크. 최대 속도로 디코딩하고 단계별(demux/decode/convert/flip) 시간을 보고
+    //      출력 장치를 안 주면 영상 크기의 메모리 프레임버퍼, "null" 이면 변환/출력 없이 디코딩까지만
+    // -m : 벤치마크에서 fps 가 이보다 낮으면 종료 코드 2 (CI 회귀 검사용)
+    while ((opt = getopt(argc, argv, "flsj:q:bm:")) != -1) {
+        switch (opt) {
+        case 'f': fast = 1; break;
+        case 'l': live = 1; break;
+        case 's': slice = 1; break;
+        case 'j': threads = atoi(optarg); break;
+        case 'q': queue_len = atoi(optarg); break;
+        case 'b': bench = 1; break;
+        case 'm': min_fps = atof(optarg); break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (argc - optind != 1 && argc - optind != 2) {
+        usage(argv[0]);
         return -1;
     }
+    if (live) {
+        slice = 1;
+        queue_len = 1;
+    }
+    if (queue_len < 1)
+        queue_len = 1;
+    if (bench)
+        fast = 1;
 
-    const char *filename = argv[1];
+    const char *filename = argv[optind];
+    const char *fbdev = argc - optind == 2 ? argv[optind + 1] : bench ? NULL : FBDEV;
     AVFormatContext *fmt_ctx = NULL;
     AVCodecContext *codec_ctx = NULL;
     const AVCodec *codec = NULL;
     AVFrame *frame = NULL;
-    AVPacket *packet = av_packet_alloc();
     struct SwsContext *sws_ctx = NULL;
     int video_stream_idx = -1;
-    int fbfd;
-    struct fb_var_screeninfo vinfo;
-    struct fb_fix_screeninfo finfo;
-    char *fbp;
-
-    // 프레임버퍼 초기화
-    if (init_framebuffer(&fbfd, &vinfo, &finfo, &fbp) < 0) {
-        return -1;
-    }
+    struct display disp;
+    int sink = 1;     // 0 = null 출력 (변환/출력 안 함)
 
     // FFmpeg 초기화
     if (avformat_open_input(&fmt_ctx, filename, NULL, NULL) < 0) {
         fprintf(stderr, "Could not open file %s\n", filename);
         return -1;
     }
+    if (live)
+        fmt_ctx->flags |= AVFMT_FLAG_NOBUFFER;    // 스트림 정보 분석용으로 패킷을 쌓아두지 않음
 
     if (avformat_find_stream_info(fmt_ctx, NULL) < 0) {
         fprintf(stderr, "Could not retrieve stream info from file\n");
@@ -111,7 +225,8 @@ int main(int argc, char *argv[]) {
     // fmt_ctx는 비디오 파일의 전체적인 정보 담고있음
     // codecpar는 AVCodecParameters 구조체를 가리킴. 이 구조체는 해당스트림에서 사용된 코덱에 대한 파라미터 담음
     // codec_id 는 해당 비디오스트림이 사용중인 코덱 찾음 
-    codec = avcodec_find_decoder(fmt_ctx->streams[video_stream_idx]->codecpar->codec_id);
+    AVStream *st = fmt_ctx->streams[video_stream_idx];
+    codec = avcodec_find_decoder(st->codecpar->codec_id);
     if (!codec) {
         fprintf(stderr, "Codec not found\n");
         return -1;
@@ -123,44 +238,134 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
+    // 컨테이너의 코덱 정보(해상도, 픽셀 포맷, extradata 의 SPS/PPS)를 디코더에 넘김
+    if (avcodec_parameters_to_context(codec_ctx, st->codecpar) < 0) {
+        fprintf(stderr, "Could not copy codec parameters\n");
+        return -1;
+    }
+    codec_ctx->pkt_timebase = st->time_base;
+
+    // 프레임 스레딩: 프레임 여러 장을 동시에 디코딩. 처리량은 코어 수만큼 늘지만 스레드 수만큼 지연이 생김
+    // 슬라이스 스레딩: 한 프레임의 슬라이스를 나눠서 디코딩. 지연이 늘지 않음
+    codec_ctx->thread_count = threads;
+    codec_ctx->thread_type = slice ? FF_THREAD_SLICE : FF_THREAD_FRAME;
+    if (live)
+        codec_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+
     if (avcodec_open2(codec_ctx, codec, NULL) < 0) {
         fprintf(stderr, "Could not open codec\n");
         return -1;
     }
+    printf("decoder %s: %d thread(s), %s threading, queue %d\n", codec->name, codec_ctx->thread_count,
+           codec_ctx->active_thread_type == FF_THREAD_FRAME ? "frame" :
+           codec_ctx->active_thread_type == FF_THREAD_SLICE ? "slice" : "no", queue_len);
+
+    // 프레임버퍼 초기화 (더블 버퍼링)
+    // 벤치마크에서 장치를 안 주면 영상 크기의 메모리 프레임버퍼에 그림
+    char memdev[32];
+    if (!fbdev) {
+        snprintf(memdev, sizeof(memdev), "mem:%dx%d", codec_ctx->width > 0 ? codec_ctx->width : 800,
+                 codec_ctx->height > 0 ? codec_ctx->height : 600);
+        fbdev = memdev;
+    }
+    if (!strcmp(fbdev, "null")) {
+        sink = 0;
+    } else {
+        if (display_open(&disp, fbdev) < 0) {
+            return -1;
+        }
+        disp.center = 1;  // 화면이 영상보다 크면 가운데에 그림
+    }
+
+    // 스트림의 time_base 와 프레임레이트로 재생 시계 준비
+    // 라이브 입력은 들어오는 속도가 곧 재생 속도이므로 기다리지 않고 바로 출력
+    struct playclock pclock;
+    playclock_init(&pclock, st->time_base, st->avg_frame_rate, fast || live);
+
+    struct framequeue queue;
+    if (framequeue_init(&queue, queue_len, live) < 0) {
+        fprintf(stderr, "Could not allocate frame queue\n");
+        return -1;
+    }
+
+    // 벤치마크 단계: demux/decode 는 디코딩 스레드, wait/convert/flip 은 출력 스레드에서 잼
+    // wait 는 출력 스레드가 디코딩을 기다린 시간 (크면 디코딩이 병목)
+    enum { ST_DEMUX, ST_DECODE, ST_WAIT, ST_CONVERT, ST_FLIP, ST_COUNT };
+    struct stats times[ST_COUNT];
+    stats_init(&times[ST_DEMUX], "demux");
+    stats_init(&times[ST_DECODE], "decode");
+    stats_init(&times[ST_WAIT], "wait");
+    stats_init(&times[ST_CONVERT], "convert");
+    stats_init(&times[ST_FLIP], "flip");
+
+    struct decoder dec = { fmt_ctx, codec_ctx, video_stream_idx, &queue,
+                           bench ? &times[ST_DEMUX] : NULL, bench ? &times[ST_DECODE] : NULL };
+    unsigned long frames = 0;
+    int64_t start = stats_now();
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, decode_thread, &dec) != 0) {
+        fprintf(stderr, "Could not start decode thread\n");
+        return -1;
+    }
+
+    // 출력 스레드(메인): 큐에서 꺼내서 시각 맞추기 -> 변환 -> 페이지 넘김
+    int64_t t = stats_now();
+    while ((frame = framequeue_pop(&queue)) != NULL) {
+        t = lap(bench ? &times[ST_WAIT] : NULL, t);
+        frames++;
+        // 고정 40ms 대신 PTS 기준으로 보여줄 시각까지 기다림
+        // 디코딩이 늦어서 이미 지난 프레임은 변환/출력을 건너뛰어 따라잡음
+        if (playclock_wait(&pclock, frame->best_effort_timestamp) && sink) {
+            // 화면이 영상보다 작으면 화면에 맞춰 줄여서 그림 (뒤 페이지 밖으로 넘치지 않게)
+            int out_w = frame->width < disp.xres ? frame->width : disp.xres;
+            int out_h = frame->height < disp.yres ? frame->height : disp.yres;
 
-    frame = av_frame_alloc();
-
-    // 색상 공간 변환을 위한 SwsContext 초기화
-    sws_ctx = sws_getContext(WIDTH, HEIGHT, AV_PIX_FMT_YUV420P, WIDTH, HEIGHT, AV_PIX_FMT_RGB565LE, SWS_BILINEAR, NULL, NULL, NULL);
-
-    // av_read_frame는 비디오파일에서 다음패킷을 읽어옴. 패킷은 압축된 비디오 데이터
-    // 패킷을 packet 구조체에 저장 후, 이후 디코딩에 사용
-    while (av_read_frame(fmt_ctx, packet) >= 0) {
-        if (packet->stream_index == video_stream_idx) {
-            // avcodec_send_packet은 압축된 비디오 데이터를 디코더에 보내는 역할
-            // 즉 packet을 codec_ctx로 보내서 디코더가 해당 패킷 처리하게 함
-            // 패킷은 압축된 데이터를 포함하고 있는데, 이 데이터는 AVCodecContext에 의해 디코딩됨
-            if (avcodec_send_packet(codec_ctx, packet) >= 0) {
-                // avcodec_receive_frame은 압축된 데이터 풀어서 frame에 저장함
-                while (avcodec_receive_frame(codec_ctx, frame) >= 0) {
-                    // YUV420p를 RGB565로 변환하여 프레임버퍼에 출력
-                    yuv420p_to_rgb565(frame, sws_ctx, &vinfo, fbp, WIDTH, HEIGHT);
-                    usleep(40000);  // 40ms 딜레이 (약 25fps) ->> 이게 프레임수가 달라지면 하드코딩하면 안되니까 1초 나누기 codec_ctx->framerate.num 만큼 하면 좀더 좋은 코드로 만들수있음
-                    //즉 1초에 몇프레임 표시할거냐 이 정보 가지구 그만큼 sleep을 걸어야 우다다다 출력되지 않음
-                }
+            // 색상 공간 변환을 위한 SwsContext. 해상도/포맷이 바뀔 때만 새로 만듦
+            sws_ctx = sws_getCachedContext(sws_ctx, frame->width, frame->height, frame->format,
+                                           out_w, out_h, display_av_format(&disp), SWS_BILINEAR, NULL, NULL, NULL);
+            if (!sws_ctx) {
+                fprintf(stderr, "Could not initialize the conversion context\n");
+                av_frame_free(&frame);
+                break;
             }
+            // YUV420p를 화면 포맷으로 변환하여 프레임버퍼에 출력
+            t = stats_now();
+            yuv420p_to_fb(frame, sws_ctx, &disp, out_w, out_h);
+            t = lap(bench ? &times[ST_CONVERT] : NULL, t);
+            // 다 그린 뒤 페이지를 화면으로 넘김
+            display_flip(&disp);
+            lap(bench ? &times[ST_FLIP] : NULL, t);
         }
-        av_packet_unref(packet);
+        av_frame_free(&frame);
+        t = stats_now();
+    }
+
+    // 출력을 중간에 멈춘 경우에도 디코딩 스레드가 끝날 수 있게 큐를 비움
+    while ((frame = framequeue_pop(&queue)) != NULL)
+        av_frame_free(&frame);
+    pthread_join(tid, NULL);
+    int64_t wall = stats_now() - start;
+
+    int ret = 0;
+    if (bench) {
+        bench_report(filename, frames, wall, times, ST_COUNT);
+        if (min_fps > 0 && frames < min_fps * (wall / 1e9)) {
+            fprintf(stderr, "%s: below %.1f fps\n", filename, min_fps);
+            ret = 2;
+        }
+    } else if (fast || pclock.dropped || queue.dropped) {
+        printf("frames shown %lu, dropped %lu (late) %lu (queue)\n", pclock.shown, pclock.dropped, queue.dropped);
     }
 
     // 리소스 정리
-    munmap(fbp, finfo.smem_len);
-    close(fbfd);
+    for (int i = 0; i < ST_COUNT; i++)
+        stats_free(&times[i]);
+    framequeue_destroy(&queue);
+    if (sink)
+        display_close(&disp);
     sws_freeContext(sws_ctx);
     avcodec_free_context(&codec_ctx);
     avformat_close_input(&fmt_ctx);
-    av_frame_free(&frame);
-    av_packet_free(&packet);
 
-    return 0;
+    return ret;
 }
@@ -0,0 +1,255 @@
+#include <string.h>
+
+#include "h264nal.h"
+
+// 00 00 01 이 시작하는 위치. 없으면 end
+static const uint8_t *find_start(const uint8_t *p, const uint8_t *end)
+{
+    for (; p + 3 <= end; p++)
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+            return p;
+    return end;
+}
+
+const uint8_t *h264nal_find(const uint8_t *p, const uint8_t *end, size_t *len)
+{
+    const uint8_t *s = find_start(p, end);
+    const uint8_t *nal, *next;
+    size_t n;
+
+    if (s == end || s + 3 >= end)
+        return NULL;
+    nal = s + 3;
+    next = find_start(nal, end);
+    n = next - nal;
+    // 4바이트 시작코드(00 00 00 01)의 첫 0 은 다음 NAL 몫
+    while (next < end && n > 0 && nal[n - 1] == 0)
+        n--;
+    *len = n;
+    return nal;
+}
+
+static int starts_new_au(const uint8_t *nal, size_t n)
+{
+    int t = h264nal_type(nal);
+
+    if (t == H264_NAL_AUD || t == H264_NAL_SPS || t == H264_NAL_PPS || t == H264_NAL_SEI ||
+        (t >= 14 && t <= 18))
+        return 1;
+    // first_mb_in_slice 는 ue(v) 라서 0 이면 첫 비트가 1
+    if ((t == H264_NAL_SLICE || t == H264_NAL_IDR) && n > 1 && (nal[1] & 0x80))
+        return 1;
+    return 0;
+}
+
+size_t h264nal_au_size(const uint8_t *p, size_t len)
+{
+    const uint8_t *end = p + len, *q = p, *nal;
+    int seen_vcl = 0;
+    size_t n;
+
+    while ((nal = h264nal_find(q, end, &n))) {
+        if (seen_vcl && starts_new_au(nal, n)) {
+            const uint8_t *s = nal - 3;
+            if (s > p && s[-1] == 0)
+                s--;
+            return s - p;
+        }
+        if (h264nal_type(nal) == H264_NAL_SLICE || h264nal_type(nal) == H264_NAL_IDR)
+            seen_vcl = 1;
+        q = nal + n;
+    }
+    return len;
+}
+
+/* ---------------------------------------------------------------- SPS */
+
+// emulation prevention(00 00 03) 을 걷어낸 RBSP 를 읽는 비트 리더. 끝을 넘으면 0 을 읽음
+struct bits {
+    uint8_t buf[H264_PARAM_MAX];
+    size_t len;
+    size_t pos;              // 비트 단위
+};
+
+static unsigned int get_bit(struct bits *b)
+{
+    if (b->pos >= b->len * 8) {
+        b->pos++;
+        return 0;
+    }
+    unsigned int v = (b->buf[b->pos >> 3] >> (7 - (b->pos & 7))) & 1;
+    b->pos++;
+    return v;
+}
+
+static unsigned int get_bits(struct bits *b, int n)
+{
+    unsigned int v = 0;
+    while (n--)
+        v = (v << 1) | get_bit(b);
+    return v;
+}
+
+static unsigned int get_ue(struct bits *b)
+{
+    int zeros = 0;
+    while (!get_bit(b) && zeros < 32)
+        zeros++;
+    if (zeros >= 32)
+        return 0;
+    return (1u << zeros) - 1 + get_bits(b, zeros);
+}
+
+static int get_se(struct bits *b)
+{
+    unsigned int k = get_ue(b);
+    return k & 1 ? (int)((k + 1) / 2) : -(int)(k / 2);
+}
+
+static void skip_scaling_list(struct bits *b, int size)
+{
+    int last = 8, next = 8;
+    for (int j = 0; j < size; j++) {
+        if (next)
+            next = (last + get_se(b) + 256) % 256;
+        last = next ? next : last;
+    }
+}
+
+int h264_sps_size(const uint8_t *sps, size_t len, int *width, int *height)
+{
+    struct bits b;
+    unsigned int chroma = 1, separate = 0;
+
+    if (len < 4 || len > H264_PARAM_MAX || h264nal_type(sps) != H264_NAL_SPS)
+        return -1;
+    b.len = 0;
+    b.pos = 0;
+    for (size_t i = 1; i < len; i++) {
+        if (i >= 3 && sps[i] == 3 && sps[i - 1] == 0 && sps[i - 2] == 0)
+            continue;
+        b.buf[b.len++] = sps[i];
+    }
+
+    unsigned int profile = get_bits(&b, 8);
+    get_bits(&b, 16);        // constraint flags, level_idc
+    get_ue(&b);              // seq_parameter_set_id
+    if (profile == 100 || profile == 110 || profile == 122 || profile == 244 || profile == 44 ||
+        profile == 83 || profile == 86 || profile == 118 || profile == 128 || profile == 138 ||
+        profile == 139 || profile == 134 || profile == 135) {
+        chroma = get_ue(&b);
+        if (chroma == 3)
+            separate = get_bit(&b);
+        get_ue(&b);          // bit_depth_luma_minus8
+        get_ue(&b);          // bit_depth_chroma_minus8
+        get_bit(&b);         // qpprime_y_zero_transform_bypass_flag
+        if (get_bit(&b)) {   // seq_scaling_matrix_present_flag
+            for (int i = 0; i < (chroma == 3 ? 12 : 8); i++)
+                if (get_bit(&b))
+                    skip_scaling_list(&b, i < 6 ? 16 : 64);
+        }
+    }
+    get_ue(&b);              // log2_max_frame_num_minus4
+    unsigned int poc_type = get_ue(&b);
+    if (poc_type == 0) {
+        get_ue(&b);          // log2_max_pic_order_cnt_lsb_minus4
+    } else if (poc_type == 1) {
+        get_bit(&b);
+        get_se(&b);
+        get_se(&b);
+        unsigned int n = get_ue(&b);
+        for (unsigned int i = 0; i < n && i < 256; i++)
+            get_se(&b);
+    }
+    get_ue(&b);              // max_num_ref_frames
+    get_bit(&b);             // gaps_in_frame_num_value_allowed_flag
+    unsigned int mbs_w = get_ue(&b) + 1;
+    unsigned int map_h = get_ue(&b) + 1;
+    unsigned int frame_mbs_only = get_bit(&b);
+    if (!frame_mbs_only)
+        get_bit(&b);         // mb_adaptive_frame_field_flag
+    get_bit(&b);             // direct_8x8_inference_flag
+
+    unsigned int crop_l = 0, crop_r = 0, crop_t = 0, crop_b = 0;
+    if (get_bit(&b)) {
+        crop_l = get_ue(&b);
+        crop_r = get_ue(&b);
+        crop_t = get_ue(&b);
+        crop_b = get_ue(&b);
+    }
+    if (b.pos > b.len * 8)
+        return -1;           // 잘린 SPS
+
+    // 잘라내기 단위는 색차 샘플링과 필드 여부에 따라 다름 (H.264 7.4.2.1.1)
+    int unit_x = 1, unit_y = 2 - frame_mbs_only;
+    if (chroma != 0 && !separate) {
+        unit_x = chroma == 3 ? 1 : 2;
+        unit_y *= chroma == 1 ? 2 : 1;
+    }
+    int w = mbs_w * 16 - unit_x * (crop_l + crop_r);
+    int h = (2 - frame_mbs_only) * map_h * 16 - unit_y * (crop_t + crop_b);
+    if (w <= 0 || h <= 0)
+        return -1;
+    *width = w;
+    *height = h;
+    return 0;
+}
+
+/* ---------------------------------------------------------------- SPS/PPS 캐시 */
+
+static int update_param(uint8_t *dst, size_t *dst_len, const uint8_t *nal, size_t n)
+{
+    if (n > H264_PARAM_MAX)
+        return 0;
+    if (n == *dst_len && !memcmp(dst, nal, n))
+        return 0;
+    memcpy(dst, nal, n);
+    *dst_len = n;
+    return 1;
+}
+
+int h264_params_scan(struct h264_params *p, const uint8_t *au, size_t len)
+{
+    const uint8_t *end = au + len, *q = au, *nal;
+    int flags = 0, sps = 0, pps = 0;
+    size_t n;
+
+    while ((nal = h264nal_find(q, end, &n))) {
+        switch (h264nal_type(nal)) {
+        case H264_NAL_SPS:
+            sps = 1;
+            if (update_param(p->sps, &p->sps_len, nal, n)) {
+                flags |= H264_AU_CHANGED;
+                if (h264_sps_size(nal, n, &p->width, &p->height) < 0)
+                    p->width = p->height = 0;
+            }
+            break;
+        case H264_NAL_PPS:
+            pps = 1;
+            if (update_param(p->pps, &p->pps_len, nal, n))
+                flags |= H264_AU_CHANGED;
+            break;
+        case H264_NAL_IDR:
+            flags |= H264_AU_KEY;
+            break;
+        }
+        q = nal + n;
+    }
+    if (sps && pps)
+        flags |= H264_AU_PARAMS;
+    return flags;
+}
+
+size_t h264_params_annexb(const struct h264_params *p, uint8_t *out)
+{
+    static const uint8_t start[4] = { 0, 0, 0, 1 };
+    size_t n = 0;
+
+    memcpy(out + n, start, 4);
+    memcpy(out + n + 4, p->sps, p->sps_len);
+    n += 4 + p->sps_len;
+    memcpy(out + n, start, 4);
+    memcpy(out + n + 4, p->pps, p->pps_len);
+    n += 4 + p->pps_len;
+    return n;
+}
@@ -0,0 +1,68 @@
+#ifndef H264NAL_H
+#define H264NAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// H.264 Annex B (00 00 01 / 00 00 00 01 시작코드) 스트림을 다루는 최소한의 파서
+// 카메라가 직접 내보내는 H.264 를 재인코딩 없이 녹화할 때 필요한 것만:
+// NAL 나누기, 접근 단위(프레임 하나) 경계, SPS/PPS 캐시, SPS 의 영상 크기
+
+enum {
+    H264_NAL_SLICE = 1,
+    H264_NAL_IDR = 5,
+    H264_NAL_SEI = 6,
+    H264_NAL_SPS = 7,
+    H264_NAL_PPS = 8,
+    H264_NAL_AUD = 9,
+};
+
+#define H264_PARAM_MAX 256    // SPS/PPS 하나의 최대 크기 (보통 수십 바이트)
+
+// p..end 에서 다음 NAL 을 찾음. NAL 헤더 위치를 돌려주고 *len 은 다음 시작코드 전까지의 길이
+// 없으면 NULL. 다음 NAL 은 h264nal_find(nal + *len, end, ...) 로 이어서 찾음
+const uint8_t *h264nal_find(const uint8_t *p, const uint8_t *end, size_t *len);
+
+static inline int h264nal_type(const uint8_t *nal)
+{
+    return nal[0] & 0x1f;
+}
+
+// 맨 앞 접근 단위(한 프레임을 이루는 NAL 들)의 바이트 수. 시작코드 포함
+// 다음 프레임의 AUD/SPS/PPS/SEI 나 first_mb_in_slice == 0 인 슬라이스에서 끊음
+size_t h264nal_au_size(const uint8_t *p, size_t len);
+
+// SPS NAL (헤더 포함) 에서 잘라낸(cropping 적용) 영상 크기. 0 = 성공
+int h264_sps_size(const uint8_t *sps, size_t len, int *width, int *height);
+
+// 스트림에서 마지막으로 본 SPS/PPS
+// 카메라는 보통 첫 IDR 앞에만 SPS/PPS 를 보내므로, 중간부터 보는 쪽(새 세그먼트, 이벤트 녹화,
+// 나중에 붙은 클라이언트)에게는 여기 캐시된 것을 키프레임 앞에 붙여줘야 디코딩이 됨
+struct h264_params {
+    uint8_t sps[H264_PARAM_MAX];
+    size_t sps_len;
+    uint8_t pps[H264_PARAM_MAX];
+    size_t pps_len;
+    int width, height;       // SPS 에서 읽은 크기 (못 읽으면 0)
+};
+
+// h264_params_scan 결과 (비트 OR)
+enum {
+    H264_AU_KEY = 1,         // IDR 슬라이스가 있음
+    H264_AU_PARAMS = 2,      // SPS 와 PPS 가 둘 다 들어 있음
+    H264_AU_CHANGED = 4,     // 캐시와 다른 SPS/PPS 가 들어왔음 (처음 들어온 경우 포함)
+};
+
+// 접근 단위 하나를 훑어서 SPS/PPS 를 캐시하고 위 플래그를 돌려줌
+int h264_params_scan(struct h264_params *p, const uint8_t *au, size_t len);
+
+static inline int h264_params_ready(const struct h264_params *p)
+{
+    return p->sps_len && p->pps_len;
+}
+
+// 시작코드를 붙인 SPS+PPS 를 out 에 씀 (2 * (4 + H264_PARAM_MAX) 바이트면 충분). 쓴 바이트 수 반환
+// mp4 의 extradata 로 써도 되고 (먹서가 avcC 로 바꿈) 키프레임 앞에 그대로 붙여도 됨
+size_t h264_params_annexb(const struct h264_params *p, uint8_t *out);
+
+#endif // H264NAL_H
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "metrics.h"
+
+// 등록은 시작할 때 메인 스레드에서만 하므로 목록 자체에는 잠금이 없음
+static struct metric *metrics;
+static struct histogram *histograms;
+
+void metric_register(struct metric *m)
+{
+    m->next = metrics;
+    metrics = m;
+}
+
+void histogram_register(struct histogram *h)
+{
+    if (h->n_bounds > HISTOGRAM_MAX_BUCKETS)
+        h->n_bounds = HISTOGRAM_MAX_BUCKETS;
+    for (int i = 0; i < h->n_bounds; i++)
+        h->bounds_ns[i] = (int64_t)(h->bounds[i] * 1e9);
+    h->next = histograms;
+    histograms = h;
+}
+
+void histogram_observe_ns(struct histogram *h, int64_t ns)
+{
+    int i = 0;
+
+    while (i < h->n_bounds && ns > h->bounds_ns[i])
+        i++;
+    atomic_fetch_add_explicit(&h->buckets[i], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ns, ns, memory_order_relaxed);
+}
+
+void metrics_write(FILE *out)
+{
+    for (struct metric *m = metrics; m; m = m->next) {
+        fprintf(out, "# HELP %s %s\n# TYPE %s %s\n%s %lld\n", m->name, m->help, m->name,
+                m->type == METRIC_TYPE_COUNTER ? "counter" : "gauge", m->name,
+                (long long)atomic_load_explicit(&m->value, memory_order_relaxed));
+    }
+    for (struct histogram *h = histograms; h; h = h->next) {
+        unsigned long long cum = 0;
+
+        fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", h->name, h->help, h->name);
+        // Prometheus 구간 값은 누적
+        for (int i = 0; i < h->n_bounds; i++) {
+            cum += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+            fprintf(out, "%s_bucket{le=\"%g\"} %llu\n", h->name, h->bounds[i], cum);
+        }
+        cum += atomic_load_explicit(&h->buckets[h->n_bounds], memory_order_relaxed);
+        fprintf(out, "%s_bucket{le=\"+Inf\"} %llu\n", h->name, cum);
+        fprintf(out, "%s_sum %.9f\n%s_count %llu\n", h->name,
+                atomic_load_explicit(&h->sum_ns, memory_order_relaxed) / 1e9, h->name,
+                (unsigned long long)atomic_load_explicit(&h->count, memory_order_relaxed));
+    }
+}
+
+/* ---------------------------------------------------------------- HTTP */
+
+static void write_all(int fd, const char *p, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0)
+            return;
+        p += n;
+        len -= n;
+    }
+}
+
+static void *serve_thread(void *arg)
+{
+    int lsock = (int)(intptr_t)arg;
+
+    while (1) {
+        char req[1024];
+        char *body = NULL;
+        size_t body_len = 0;
+        FILE *out;
+
+        int c = accept(lsock, NULL, NULL);
+        if (c < 0)
+            continue;
+        // 요청 내용은 보지 않음 (어떤 경로든 메트릭을 돌려줌)
+        if (recv(c, req, sizeof(req), 0) <= 0) {
+            close(c);
+            continue;
+        }
+        out = open_memstream(&body, &body_len);
+        if (out) {
+            metrics_write(out);
+            fclose(out);
+            char hdr[128];
+            int n = snprintf(hdr, sizeof(hdr), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                               "Content-Length: %zu\r\n\r\n", body_len);
+            write_all(c, hdr, n);
+            write_all(c, body, body_len);
+            free(body);
+        }
+        close(c);
+    }
+    return NULL;
+}
+
+int metrics_serve(int port)
+{
+    struct sockaddr_in addr;
+    pthread_t thread;
+    int one = 1;
+    int lsock = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (lsock < 0) {
+        perror("socket()");
+        return -1;
+    }
+    setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(lsock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(lsock, 4) < 0) {
+        perror("metrics bind()");
+        close(lsock);
+        return -1;
+    }
+    if (pthread_create(&thread, NULL, serve_thread, (void *)(intptr_t)lsock) != 0) {
+        fprintf(stderr, "Could not start metrics thread\n");
+        close(lsock);
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// 카운터/게이지/히스토그램과 Prometheus 텍스트 형식 출력
+// 갱신은 relaxed atomic 연산 하나(히스토그램은 구간 찾기 + 세 번)라서 캡처/전송 경로에 그대로 둬도 됨
+// 읽는 쪽(HTTP 스레드)은 값을 하나씩 읽으므로 항목끼리 순간적으로 어긋날 수 있음
+//
+// 메트릭은 보통 정적 변수로 선언하고 시작할 때 한 번 등록:
+//   static struct metric frames = METRIC_COUNTER("video_frames_total", "Frames captured");
+//   metric_register(&frames);
+//   metric_add(&frames, 1);
+
+enum metric_type { METRIC_TYPE_COUNTER, METRIC_TYPE_GAUGE };
+
+struct metric {
+    const char *name;
+    const char *help;
+    enum metric_type type;
+    atomic_llong value;
+    struct metric *next;
+};
+
+#define METRIC_COUNTER(n, h) { .name = (n), .help = (h), .type = METRIC_TYPE_COUNTER }
+#define METRIC_GAUGE(n, h) { .name = (n), .help = (h), .type = METRIC_TYPE_GAUGE }
+
+#define HISTOGRAM_MAX_BUCKETS 16
+
+// 시간 히스토그램. bounds 는 구간 상한(초), 오름차순. +Inf 구간은 자동으로 붙음
+struct histogram {
+    const char *name;
+    const char *help;
+    const double *bounds;
+    int n_bounds;
+    int64_t bounds_ns[HISTOGRAM_MAX_BUCKETS];   // 등록할 때 bounds 를 ns 로 바꿔둔 것
+    atomic_ullong buckets[HISTOGRAM_MAX_BUCKETS + 1];
+    atomic_ullong count;
+    atomic_llong sum_ns;
+    struct histogram *next;
+};
+
+#define HISTOGRAM(n, h, b) { .name = (n), .help = (h), .bounds = (b), .n_bounds = sizeof(b) / sizeof((b)[0]) }
+
+void metric_register(struct metric *m);
+void histogram_register(struct histogram *h);
+
+static inline void metric_add(struct metric *m, long long v)
+{
+    atomic_fetch_add_explicit(&m->value, v, memory_order_relaxed);
+}
+
+static inline void metric_set(struct metric *m, long long v)
+{
+    atomic_store_explicit(&m->value, v, memory_order_relaxed);
+}
+
+void histogram_observe_ns(struct histogram *h, int64_t ns);
+
+// 등록된 모든 메트릭을 Prometheus 텍스트 형식(0.0.4)으로
+void metrics_write(FILE *out);
+
+// 127.0.0.1:port 에서 HTTP 로 metrics_write 결과를 내주는 스레드 시작 (경로는 보지 않음)
+int metrics_serve(int port);
+
+#endif // METRICS_H
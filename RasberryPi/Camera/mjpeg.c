@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <libavcodec/avcodec.h>
+
+#include "mjpeg.h"
+
+enum { JOB_FREE, JOB_PENDING, JOB_BUSY, JOB_DONE, JOB_FAILED };
+
+struct job {
+    int state;
+    uint8_t *data;           // JPEG 복사본 (+ AV_INPUT_BUFFER_PADDING_SIZE)
+    size_t len;
+    size_t cap;
+    unsigned int sequence;
+    int64_t timestamp_us;
+    AVFrame *frame;
+};
+
+struct worker {
+    struct mjpeg_pool *pool;
+    pthread_t thread;
+    AVCodecContext *dec;
+    AVPacket *pkt;
+};
+
+// 작업 슬롯은 링. submitted / started / returned 는 계속 증가하는 번호이고 슬롯은 번호 % depth
+// 꺼내는 쪽은 returned 슬롯이 끝날 때까지 기다리므로 결과는 항상 넣은 순서
+struct mjpeg_pool {
+    struct job *jobs;
+    int depth;
+    unsigned long submitted;
+    unsigned long started;
+    unsigned long returned;
+    unsigned long errors;
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t work;     // 새 작업
+    pthread_cond_t done;     // 작업 끝남
+    pthread_cond_t space;    // 슬롯 비었음
+
+    struct worker *workers;
+    int n_alloc;             // 만든 워커 구조체 수
+    int n_workers;           // 실제로 돌고 있는 스레드 수
+};
+
+// timeout_ms < 0 이면 계속 기다림. 시간이 다 되면 ETIMEDOUT
+static int cond_wait_ms(pthread_cond_t *cond, pthread_mutex_t *lock, int timeout_ms)
+{
+    struct timespec ts;
+
+    if (timeout_ms < 0)
+        return pthread_cond_wait(cond, lock);
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return pthread_cond_timedwait(cond, lock, &ts);
+}
+
+// 색차 평면을 제자리에서 4:2:0 으로 줄임
+// 출력 (j, i) 는 입력의 (2j.., 2i..) 만 읽으므로 앞에서부터 덮어써도 아직 안 읽은 값을 건드리지 않음
+static void chroma_to_420(uint8_t *plane, int linesize, int cw, int ch, int hsub)
+{
+    int oh = (ch + 1) / 2;
+    int ow = hsub ? (cw + 1) / 2 : cw;
+
+    for (int j = 0; j < oh; j++) {
+        const uint8_t *r0 = plane + (size_t)(2 * j) * linesize;
+        const uint8_t *r1 = 2 * j + 1 < ch ? r0 + linesize : r0;
+        uint8_t *o = plane + (size_t)j * linesize;
+        if (!hsub) {
+            for (int i = 0; i < ow; i++)
+                o[i] = (r0[i] + r1[i] + 1) >> 1;
+        } else {
+            for (int i = 0; i < ow; i++) {
+                int a = 2 * i, b = 2 * i + 1 < cw ? 2 * i + 1 : 2 * i;
+                o[i] = (r0[a] + r0[b] + r1[a] + r1[b] + 2) >> 2;
+            }
+        }
+    }
+}
+
+// 디코더 출력을 YUV420P 로 맞춤. 이미 4:2:0 이면 아무것도 안 함
+static int to_yuv420p(AVFrame *f)
+{
+    int hsub;
+
+    switch (f->format) {
+    case AV_PIX_FMT_YUVJ420P:
+    case AV_PIX_FMT_YUV420P:
+        f->format = AV_PIX_FMT_YUV420P;
+        f->color_range = AVCOL_RANGE_JPEG;
+        return 0;
+    case AV_PIX_FMT_YUVJ422P:
+    case AV_PIX_FMT_YUV422P:
+        hsub = 0;    // 가로는 이미 절반
+        break;
+    case AV_PIX_FMT_YUVJ444P:
+    case AV_PIX_FMT_YUV444P:
+        hsub = 1;
+        break;
+    default:
+        return -1;    // 흑백 등 (카메라에서는 거의 없음)
+    }
+
+    // 디코더가 아직 참조중인 버퍼면 복사본을 받아서 고침
+    if (!av_frame_is_writable(f) && av_frame_make_writable(f) < 0)
+        return -1;
+    int cw = hsub ? f->width : (f->width + 1) / 2;
+    chroma_to_420(f->data[1], f->linesize[1], cw, f->height, hsub);
+    chroma_to_420(f->data[2], f->linesize[2], cw, f->height, hsub);
+    f->format = AV_PIX_FMT_YUV420P;
+    f->color_range = AVCOL_RANGE_JPEG;
+    return 0;
+}
+
+static int decode_job(struct worker *w, struct job *j)
+{
+    // 복사해둔 버퍼를 그대로 가리킴 (참조 카운트 없는 패킷 -> 디코더가 필요하면 복사)
+    w->pkt->data = j->data;
+    w->pkt->size = j->len;
+    if (avcodec_send_packet(w->dec, w->pkt) < 0)
+        return -1;
+    if (avcodec_receive_frame(w->dec, j->frame) < 0)
+        return -1;
+    if (to_yuv420p(j->frame) < 0) {
+        av_frame_unref(j->frame);
+        return -1;
+    }
+    return 0;
+}
+
+static void *worker_thread(void *arg)
+{
+    struct worker *w = arg;
+    struct mjpeg_pool *p = w->pool;
+
+    pthread_mutex_lock(&p->lock);
+    while (1) {
+        while (!p->stop && p->started == p->submitted)
+            pthread_cond_wait(&p->work, &p->lock);
+        if (p->stop)
+            break;
+        struct job *j = &p->jobs[p->started++ % p->depth];
+        j->state = JOB_BUSY;
+        pthread_mutex_unlock(&p->lock);
+
+        int r = decode_job(w, j);
+
+        pthread_mutex_lock(&p->lock);
+        j->state = r < 0 ? JOB_FAILED : JOB_DONE;
+        pthread_cond_broadcast(&p->done);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+struct mjpeg_pool *mjpeg_pool_create(int workers, int depth)
+{
+    const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_MJPEG);
+    struct mjpeg_pool *p;
+
+    if (!codec) {
+        fprintf(stderr, "MJPEG decoder not found\n");
+        return NULL;
+    }
+    if (workers < 1)
+        workers = 1;
+    if (depth < workers)
+        depth = workers;
+
+    p = calloc(1, sizeof(*p));
+    if (!p)
+        return NULL;
+    p->depth = depth;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->done, NULL);
+    pthread_cond_init(&p->space, NULL);
+
+    p->jobs = calloc(depth, sizeof(*p->jobs));
+    p->workers = calloc(workers, sizeof(*p->workers));
+    if (!p->jobs || !p->workers)
+        goto fail;
+    p->n_alloc = workers;
+    for (int i = 0; i < depth; i++) {
+        p->jobs[i].frame = av_frame_alloc();
+        if (!p->jobs[i].frame)
+            goto fail;
+    }
+
+    // 워커마다 자기 디코더. 프레임 하나는 한 스레드에서 디코딩 (스레드끼리 나눠 가지는 상태 없음)
+    for (int i = 0; i < workers; i++) {
+        struct worker *w = &p->workers[i];
+        w->pool = p;
+        w->dec = avcodec_alloc_context3(codec);
+        w->pkt = av_packet_alloc();
+        if (!w->dec || !w->pkt)
+            goto fail;
+        w->dec->thread_count = 1;
+        if (avcodec_open2(w->dec, codec, NULL) < 0) {
+            fprintf(stderr, "Could not open MJPEG decoder\n");
+            goto fail;
+        }
+        if (pthread_create(&w->thread, NULL, worker_thread, w) != 0) {
+            fprintf(stderr, "Could not start MJPEG worker\n");
+            goto fail;
+        }
+        p->n_workers++;
+    }
+    return p;
+
+fail:
+    mjpeg_pool_free(p);
+    return NULL;
+}
+
+void mjpeg_pool_free(struct mjpeg_pool *p)
+{
+    if (!p)
+        return;
+
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 0; i < p->n_workers; i++)
+        pthread_join(p->workers[i].thread, NULL);
+
+    // 스레드를 못 띄운 워커도 디코더는 열려 있을 수 있음
+    for (int i = 0; i < p->n_alloc; i++) {
+        avcodec_free_context(&p->workers[i].dec);
+        av_packet_free(&p->workers[i].pkt);
+    }
+    if (p->jobs) {
+        for (int i = 0; i < p->depth; i++) {
+            av_frame_free(&p->jobs[i].frame);
+            free(p->jobs[i].data);
+        }
+    }
+    free(p->workers);
+    free(p->jobs);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->work);
+    pthread_cond_destroy(&p->done);
+    pthread_cond_destroy(&p->space);
+    free(p);
+}
+
+int mjpeg_pool_submit(struct mjpeg_pool *p, const void *jpeg, size_t len,
+                      unsigned int sequence, int64_t timestamp_us, int timeout_ms)
+{
+    struct job *j;
+
+    pthread_mutex_lock(&p->lock);
+    j = &p->jobs[p->submitted % p->depth];
+    while (j->state != JOB_FREE) {
+        if (timeout_ms == 0 || cond_wait_ms(&p->space, &p->lock, timeout_ms) == ETIMEDOUT) {
+            pthread_mutex_unlock(&p->lock);
+            return 0;
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    // 슬롯은 FREE 인 동안 이 스레드만 만짐. 버퍼는 가장 큰 프레임에 맞춰 한번 늘어난 뒤로는 그대로
+    if (j->cap < len + AV_INPUT_BUFFER_PADDING_SIZE) {
+        uint8_t *d = realloc(j->data, len + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!d)
+            return -1;
+        j->data = d;
+        j->cap = len + AV_INPUT_BUFFER_PADDING_SIZE;
+    }
+    memcpy(j->data, jpeg, len);
+    memset(j->data + len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    j->len = len;
+    j->sequence = sequence;
+    j->timestamp_us = timestamp_us;
+
+    pthread_mutex_lock(&p->lock);
+    j->state = JOB_PENDING;
+    p->submitted++;
+    pthread_cond_signal(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    return 1;
+}
+
+int mjpeg_pool_receive(struct mjpeg_pool *p, struct mjpeg_frame *out, int timeout_ms)
+{
+    int r = 0;
+
+    pthread_mutex_lock(&p->lock);
+    while (p->returned < p->submitted) {
+        struct job *j = &p->jobs[p->returned % p->depth];
+
+        if (j->state == JOB_DONE || j->state == JOB_FAILED) {
+            int ok = j->state == JOB_DONE;
+            if (ok) {
+                out->frame = av_frame_alloc();
+                if (out->frame)
+                    av_frame_move_ref(out->frame, j->frame);
+                else
+                    av_frame_unref(j->frame);
+                out->sequence = j->sequence;
+                out->timestamp_us = j->timestamp_us;
+                ok = out->frame != NULL;
+            }
+            if (!ok)
+                p->errors++;
+            j->state = JOB_FREE;
+            p->returned++;
+            pthread_cond_signal(&p->space);
+            if (ok) {
+                r = 1;
+                break;
+            }
+            continue;
+        }
+        // 순서상 다음 프레임이 아직 디코딩 중. 뒤의 프레임이 먼저 끝났어도 기다림
+        if (timeout_ms == 0 || cond_wait_ms(&p->done, &p->lock, timeout_ms) == ETIMEDOUT)
+            break;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return r;
+}
+
+int mjpeg_pool_pending(struct mjpeg_pool *p)
+{
+    int n;
+
+    pthread_mutex_lock(&p->lock);
+    n = p->submitted - p->returned;
+    pthread_mutex_unlock(&p->lock);
+    return n;
+}
+
+unsigned long mjpeg_pool_errors(struct mjpeg_pool *p)
+{
+    unsigned long n;
+
+    pthread_mutex_lock(&p->lock);
+    n = p->errors;
+    pthread_mutex_unlock(&p->lock);
+    return n;
+}
@@ -0,0 +1,40 @@
+#ifndef MJPEG_H
+#define MJPEG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libavutil/frame.h>
+
+// MJPEG 캡처 프레임을 여러 스레드에서 동시에 디코딩하는 풀 (libavcodec mjpeg 디코더)
+// JPEG 는 프레임마다 독립이라 워커 수만큼 빨라짐. 끝나는 순서는 제각각이지만 넣은 순서대로 꺼내줌
+// 결과는 항상 YUV420P (전체 범위) 프레임. 4:2:2 / 4:4:4 JPEG 는 디코더 버퍼 안에서 색차만 줄여서
+// RGB 변환이나 추가 복사 없이 바로 인코더에 넣을 수 있음
+
+struct mjpeg_pool;
+
+// 디코딩 결과
+struct mjpeg_frame {
+    AVFrame *frame;          // 호출한 쪽이 av_frame_free (인코더에 그대로 보내도 됨)
+    unsigned int sequence;   // submit 할 때 준 값
+    int64_t timestamp_us;
+};
+
+// workers: 디코딩 스레드 수, depth: 동시에 들고 있을 수 있는 프레임 수 (workers 이상)
+struct mjpeg_pool *mjpeg_pool_create(int workers, int depth);
+void mjpeg_pool_free(struct mjpeg_pool *p);
+
+// JPEG 데이터를 복사해서 넣음 (바로 캡처 버퍼를 돌려줘도 됨)
+// 자리가 없으면 timeout_ms 동안 기다림 (-1 = 계속). 1 = 넣음, 0 = 자리 없음, -1 = 메모리 부족
+int mjpeg_pool_submit(struct mjpeg_pool *p, const void *jpeg, size_t len,
+                      unsigned int sequence, int64_t timestamp_us, int timeout_ms);
+
+// 넣은 순서대로 다음 결과를 꺼냄. 1 = 프레임, 0 = 아직 안 끝났거나(timeout) 들어간 게 없음
+// 깨진 JPEG 는 건너뛰고 mjpeg_pool_errors 만 늘어남
+int mjpeg_pool_receive(struct mjpeg_pool *p, struct mjpeg_frame *out, int timeout_ms);
+
+// 아직 꺼내지 않은 프레임 수 (디코딩 중 포함)
+int mjpeg_pool_pending(struct mjpeg_pool *p);
+
+unsigned long mjpeg_pool_errors(struct mjpeg_pool *p);
+
+#endif // MJPEG_H
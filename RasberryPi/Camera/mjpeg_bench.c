@@ -0,0 +1,232 @@
+// 빌드: gcc -O2 -o mjpeg_bench mjpeg_bench.c mjpeg.c capture.c h264nal.c shmring.c stats.c -lavcodec -lavutil -lpthread -lrt
+// 실행: ./mjpeg_bench [-s WxH] [-n frames] [-j max_workers] [-c 420|422] [-q qscale]
+
+// MJPEG 디코딩 처리량 측정
+// 합성 테스트 패턴을 libavcodec mjpeg 인코더로 JPEG 로 만들어 메모리에 둔 뒤
+// 워커 1개부터 max_workers 개까지 mjpeg 풀에 전부 흘려보내고 fps 와 프레임별 지연(넣고 꺼낼 때까지)을 보고
+// 카메라 없이 항상 같은 JPEG 로 돌기 때문에 장비/빌드 옵션끼리 비교할 수 있음
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+#include <libavcodec/avcodec.h>
+
+#include "capture.h"
+#include "mjpeg.h"
+#include "stats.h"
+
+#define FRAMES 300
+
+// YUYV -> YUVJ422P / YUVJ420P (카메라 JPEG 와 같은 색차 구성)
+static void yuyv_to_planar(const struct capture_frame *f, AVFrame *frame, int chroma420) {
+    for (int j = 0; j < f->height; j++) {
+        const unsigned char *src = f->data + (size_t)j * f->stride;
+        unsigned char *y = frame->data[0] + j * frame->linesize[0];
+        for (int i = 0; i < f->width; i++)
+            y[i] = src[i * 2];
+    }
+    for (int j = 0; j < frame->height >> chroma420; j++) {
+        const unsigned char *src = f->data + (size_t)(j << chroma420) * f->stride;
+        unsigned char *u = frame->data[1] + j * frame->linesize[1];
+        unsigned char *v = frame->data[2] + j * frame->linesize[2];
+        for (int i = 0; i < f->width / 2; i++) {
+            u[i] = src[i * 4 + 1];
+            v[i] = src[i * 4 + 3];
+        }
+    }
+}
+
+// 합성 소스에서 n 장을 JPEG 로 인코딩해서 pkts 에 담음
+static int make_jpegs(const struct capture_config *ccfg, int chroma420, int qscale, AVPacket **pkts, int n) {
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    struct capture *cap;
+    struct capture_format fmt;
+    AVCodecContext *enc;
+    AVFrame *frame;
+    int ret = 0;
+
+    if (!codec) {
+        fprintf(stderr, "MJPEG encoder not found\n");
+        return -1;
+    }
+    cap = capture_open(ccfg);
+    if (!cap)
+        return -1;
+    capture_get_format(cap, &fmt);
+
+    enc = avcodec_alloc_context3(codec);
+    frame = av_frame_alloc();
+    if (!enc || !frame) {
+        fprintf(stderr, "Could not allocate encoder\n");
+        ret = -1;
+        goto out;
+    }
+    enc->width = fmt.width;
+    enc->height = fmt.height;
+    enc->time_base = (AVRational){1, 25};
+    enc->pix_fmt = chroma420 ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUVJ422P;
+    // 고정 화질 (카메라 JPEG 와 비슷한 크기가 나오도록)
+    enc->flags |= AV_CODEC_FLAG_QSCALE;
+    enc->global_quality = FF_QP2LAMBDA * qscale;
+    if (avcodec_open2(enc, codec, NULL) < 0) {
+        fprintf(stderr, "Could not open MJPEG encoder\n");
+        ret = -1;
+        goto out;
+    }
+
+    frame->format = enc->pix_fmt;
+    frame->width = enc->width;
+    frame->height = enc->height;
+    if (av_frame_get_buffer(frame, 32) < 0) {
+        ret = -1;
+        goto out;
+    }
+
+    for (int i = 0; i < n && ret == 0; i++) {
+        struct capture_frame f;
+        if (capture_read(cap, &f, 1000) != 1) {
+            ret = -1;
+            break;
+        }
+        if (av_frame_make_writable(frame) < 0) {
+            ret = -1;
+            break;
+        }
+        yuyv_to_planar(&f, frame, chroma420);
+        capture_release(cap, &f);
+        frame->pts = i;
+        frame->quality = enc->global_quality;
+
+        pkts[i] = av_packet_alloc();
+        if (!pkts[i] || avcodec_send_frame(enc, frame) < 0 || avcodec_receive_packet(enc, pkts[i]) < 0) {
+            fprintf(stderr, "Could not encode frame %d\n", i);
+            ret = -1;
+        }
+    }
+
+out:
+    av_frame_free(&frame);
+    avcodec_free_context(&enc);
+    capture_close(cap);
+    return ret;
+}
+
+// 워커 workers 개로 n 장을 모두 디코딩. 반환값은 fps (순서가 틀리거나 빠진 프레임이 있으면 -1)
+static double run_pool(AVPacket **pkts, int n, int workers, struct stats *lat) {
+    struct mjpeg_pool *p = mjpeg_pool_create(workers, workers * 2);
+    struct mjpeg_frame out;
+    int64_t *sent = calloc(n, sizeof(*sent));
+    unsigned int next = 0;
+    int64_t start;
+    int bad = 0;
+
+    if (!p || !sent) {
+        mjpeg_pool_free(p);
+        free(sent);
+        return -1;
+    }
+
+    start = stats_now();
+    for (int i = 0; i <= n; i++) {
+        if (i < n) {
+            sent[i] = stats_now();
+            mjpeg_pool_submit(p, pkts[i]->data, pkts[i]->size, i, 0, -1);
+        }
+        // 마지막에는 남은 것을 전부 기다려서 꺼냄
+        while (mjpeg_pool_receive(p, &out, i < n ? 0 : -1) == 1) {
+            stats_add(lat, stats_now() - sent[out.sequence]);
+            if (out.sequence != next)
+                bad = 1;
+            next = out.sequence + 1;
+            av_frame_free(&out.frame);
+        }
+    }
+    int64_t wall = stats_now() - start;
+
+    if (next != (unsigned int)n || mjpeg_pool_errors(p))
+        bad = 1;
+    mjpeg_pool_free(p);
+    free(sent);
+    return bad ? -1 : n / (wall / 1e9);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-s WxH] [-n frames] [-j max_workers] [-c 420|422] [-q qscale]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    struct capture_config ccfg;
+    int frames = FRAMES;
+    int max_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int chroma420 = 0;
+    int qscale = 4;
+    int opt;
+    AVPacket **pkts;
+    size_t total = 0;
+
+    // 기본은 1280x720 4:2:2 (UVC 카메라가 MJPEG 로 주는 가장 흔한 조합)
+    capture_config_default(&ccfg);
+    ccfg.source = "synth:fast";
+    ccfg.pixelformat = V4L2_PIX_FMT_YUYV;
+    ccfg.width = 1280;
+    ccfg.height = 720;
+    while ((opt = getopt(argc, argv, "s:n:j:c:q:")) != -1) {
+        switch (opt) {
+        case 's':
+            if (capture_parse_spec(&ccfg, optarg) < 0) {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'n': frames = atoi(optarg); break;
+        case 'j': max_workers = atoi(optarg); break;
+        case 'c': chroma420 = atoi(optarg) == 420; break;
+        case 'q': qscale = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (frames < 1 || max_workers < 1) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    pkts = calloc(frames, sizeof(*pkts));
+    if (!pkts || make_jpegs(&ccfg, chroma420, qscale, pkts, frames) < 0) {
+        fprintf(stderr, "Could not prepare JPEG frames\n");
+        return -1;
+    }
+    for (int i = 0; i < frames; i++)
+        total += pkts[i]->size;
+    printf("%d frames %dx%d 4:2:%d, average %zu KB\n", frames, ccfg.width, ccfg.height,
+           chroma420 ? 0 : 2, total / frames / 1024);
+
+    int ret = 0;
+    for (int w = 1; w <= max_workers; w++) {
+        struct stats lat;
+        char name[32];
+
+        snprintf(name, sizeof(name), "workers=%d", w);
+        stats_init(&lat, name);
+        double fps = run_pool(pkts, frames, w, &lat);
+        if (fps < 0) {
+            fprintf(stderr, "%s: frames lost or out of order\n", name);
+            ret = 1;
+        } else {
+            if (w == 1)
+                stats_header(stdout);
+            stats_print(&lat, stdout);
+            printf("BENCH mjpeg workers=%d fps=%.1f lat_p50_us=%.1f lat_p99_us=%.1f\n", w, fps,
+                   stats_percentile(&lat, 50) / 1e3, stats_percentile(&lat, 99) / 1e3);
+        }
+        stats_free(&lat);
+    }
+
+    for (int i = 0; i < frames; i++)
+        av_packet_free(&pkts[i]);
+    free(pkts);
+    return ret;
+}
@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <linux/videodev2.h>
+
+#include "mosaic.h"
+#include "yuvscale.h"
+
+#define POOL 4    // 출력 프레임 수: 지금 그리는 것, 이전 것(늦은 타일용), 인코더가 잡고 있는 것, 여유
+
+struct tile {
+    int x, y, w, h;          // 출력 프레임 안의 자리 (짝수)
+    int busy;                // mosaic_put 이 그리는 중
+    int fresh;               // 이번 출력 프레임에 새로 그려짐
+    int32_t *xt;             // yuvscale_plane 의 가로 위치 표 (w 칸, 이 타일을 그리는 스레드만 씀)
+    struct mosaic_stats st;
+};
+
+struct mosaic {
+    int width, height;
+    int n;
+    struct tile *tiles;
+    AVFrame *pool[POOL];
+    AVFrame *cur;            // 지금 그리는 출력 프레임 (pool 중 하나)
+    AVFrame *prev;           // 마지막으로 내보낸 프레임의 참조
+    pthread_mutex_t lock;
+    pthread_cond_t idle;     // 타일 하나를 다 그림
+};
+
+/* ---------------------------------------------------------------- 출력 프레임 */
+
+static AVFrame *alloc_black(int width, int height)
+{
+    AVFrame *f = av_frame_alloc();
+
+    if (!f)
+        return NULL;
+    f->format = AV_PIX_FMT_YUV420P;
+    f->width = width;
+    f->height = height;
+    if (av_frame_get_buffer(f, 32) < 0) {
+        av_frame_free(&f);
+        return NULL;
+    }
+    // 제한 범위 검은색 (Y 16, U/V 128)
+    memset(f->data[0], 16, (size_t)f->linesize[0] * height);
+    memset(f->data[1], 128, (size_t)f->linesize[1] * height / 2);
+    memset(f->data[2], 128, (size_t)f->linesize[2] * height / 2);
+    return f;
+}
+
+// 인코더나 prev 가 잡고 있지 않은 출력 프레임. 모두 잡혀 있으면 하나를 새 버퍼로 바꿈
+static AVFrame *take_free(struct mosaic *m)
+{
+    for (int i = 0; i < POOL; i++)
+        if (m->pool[i] != m->cur && av_frame_is_writable(m->pool[i]))
+            return m->pool[i];
+    for (int i = 0; i < POOL; i++)
+        if (m->pool[i] != m->cur && av_frame_make_writable(m->pool[i]) == 0)
+            return m->pool[i];
+    return NULL;
+}
+
+static void copy_tile(AVFrame *dst, const AVFrame *src, const struct tile *t)
+{
+    for (int p = 0; p < 3; p++) {
+        int s = p ? 1 : 0;    // 색차 평면은 가로/세로 절반
+        for (int y = t->y >> s; y < (t->y + t->h) >> s; y++)
+            memcpy(dst->data[p] + (size_t)y * dst->linesize[p] + (t->x >> s),
+                   src->data[p] + (size_t)y * src->linesize[p] + (t->x >> s), t->w >> s);
+    }
+}
+
+struct mosaic *mosaic_create(int width, int height, int n)
+{
+    struct mosaic *m = calloc(1, sizeof(*m));
+    int cols, rows;
+
+    if (!m)
+        return NULL;
+    if (n < 1)
+        n = 1;
+    cols = (int)ceil(sqrt(n));
+    rows = (n + cols - 1) / cols;
+    m->width = width & ~1;
+    m->height = height & ~1;
+    m->n = n;
+    m->tiles = calloc(n, sizeof(*m->tiles));
+    if (!m->tiles)
+        goto fail;
+    for (int i = 0; i < n; i++) {
+        struct tile *t = &m->tiles[i];
+        t->w = (m->width / cols) & ~1;
+        t->h = (m->height / rows) & ~1;
+        t->x = (i % cols) * t->w;
+        t->y = (i / cols) * t->h;
+        t->xt = malloc(t->w * sizeof(*t->xt));
+        if (!t->xt)
+            goto fail;
+    }
+    for (int i = 0; i < POOL; i++) {
+        m->pool[i] = alloc_black(m->width, m->height);
+        if (!m->pool[i])
+            goto fail;
+    }
+    m->cur = m->pool[0];
+    m->prev = av_frame_alloc();
+    if (!m->prev || av_frame_ref(m->prev, m->pool[1]) < 0)
+        goto fail;
+    pthread_mutex_init(&m->lock, NULL);
+    pthread_cond_init(&m->idle, NULL);
+    return m;
+
+fail:
+    mosaic_free(m);
+    return NULL;
+}
+
+void mosaic_free(struct mosaic *m)
+{
+    if (!m)
+        return;
+    if (m->tiles)
+        for (int i = 0; i < m->n; i++)
+            free(m->tiles[i].xt);
+    free(m->tiles);
+    for (int i = 0; i < POOL; i++)
+        av_frame_free(&m->pool[i]);
+    av_frame_free(&m->prev);
+    free(m);
+}
+
+int mosaic_put(struct mosaic *m, int tile, const struct capture_frame *f)
+{
+    struct tile *t = &m->tiles[tile];
+    const uint8_t *plane[3], *y, *u, *v;
+    int stride[3], ystep, cstride, cstep, ch;
+    AVFrame *dst;
+
+    capture_planes(f, plane, stride);
+    y = plane[0];
+    switch (f->pixelformat) {
+    case V4L2_PIX_FMT_YUV420:
+        ystep = 1;
+        u = plane[1];
+        v = plane[2];
+        cstride = stride[1];
+        cstep = 1;
+        ch = f->height / 2;
+        break;
+    case V4L2_PIX_FMT_NV12:
+        ystep = 1;
+        u = plane[1];
+        v = plane[1] + 1;
+        cstride = stride[1];
+        cstep = 2;
+        ch = f->height / 2;
+        break;
+    case V4L2_PIX_FMT_YUYV:
+        // 색차는 가로만 절반 (4:2:2) -> 세로는 scale_plane 이 줄임
+        ystep = 2;
+        u = y + 1;
+        v = y + 3;
+        cstride = stride[0];
+        cstep = 4;
+        ch = f->height;
+        break;
+    default:
+        return -1;
+    }
+
+    // 다른 타일과는 출력 프레임의 겹치지 않는 자리에 쓰므로 잠금 없이 그림
+    // mosaic_compose 는 그리는 중인 타일이 끝날 때까지 기다렸다가 출력 프레임을 바꿈
+    pthread_mutex_lock(&m->lock);
+    while (t->busy)
+        pthread_cond_wait(&m->idle, &m->lock);
+    t->busy = 1;
+    dst = m->cur;
+    pthread_mutex_unlock(&m->lock);
+
+    yuvscale_plane(y, stride[0], ystep, f->width, f->height,
+                dst->data[0] + (size_t)t->y * dst->linesize[0] + t->x, dst->linesize[0], t->w, t->h, t->xt);
+    yuvscale_plane(u, cstride, cstep, f->width / 2, ch,
+                dst->data[1] + (size_t)t->y / 2 * dst->linesize[1] + t->x / 2, dst->linesize[1],
+                t->w / 2, t->h / 2, t->xt);
+    yuvscale_plane(v, cstride, cstep, f->width / 2, ch,
+                dst->data[2] + (size_t)t->y / 2 * dst->linesize[2] + t->x / 2, dst->linesize[2],
+                t->w / 2, t->h / 2, t->xt);
+
+    pthread_mutex_lock(&m->lock);
+    t->busy = 0;
+    t->fresh = 1;
+    t->st.frames++;
+    t->st.last_us = f->timestamp_us;
+    pthread_cond_broadcast(&m->idle);
+    pthread_mutex_unlock(&m->lock);
+    return 0;
+}
+
+AVFrame *mosaic_compose(struct mosaic *m)
+{
+    AVFrame *out, *next;
+
+    pthread_mutex_lock(&m->lock);
+    for (int i = 0; i < m->n; i++)
+        while (m->tiles[i].busy)
+            pthread_cond_wait(&m->idle, &m->lock);
+
+    // 이번 간격에 새 프레임이 없던 타일만 이전 출력에서 복사 (보통은 거의 없음)
+    for (int i = 0; i < m->n; i++) {
+        struct tile *t = &m->tiles[i];
+        if (!t->fresh) {
+            copy_tile(m->cur, m->prev, t);
+            t->st.stale++;
+        }
+        t->fresh = 0;
+    }
+
+    out = av_frame_clone(m->cur);
+    next = out ? take_free(m) : NULL;
+    if (!next) {
+        // 메모리 부족: 같은 프레임에 계속 그림 (다음 출력에서 다시 시도)
+        pthread_mutex_unlock(&m->lock);
+        av_frame_free(&out);
+        return NULL;
+    }
+    av_frame_unref(m->prev);
+    av_frame_ref(m->prev, m->cur);
+    m->cur = next;
+    pthread_mutex_unlock(&m->lock);
+    return out;
+}
+
+void mosaic_get_stats(struct mosaic *m, int tile, struct mosaic_stats *st)
+{
+    pthread_mutex_lock(&m->lock);
+    *st = m->tiles[tile].st;
+    pthread_mutex_unlock(&m->lock);
+}
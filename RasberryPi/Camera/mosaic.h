@@ -0,0 +1,37 @@
+#ifndef MOSAIC_H
+#define MOSAIC_H
+
+#include <libavutil/frame.h>
+
+#include "capture.h"
+
+// 여러 카메라 영상을 한 화면(격자)에 모아 YUV420P 출력 프레임 하나로 만드는 합성 단계
+// 캡처 프레임(YUYV, NV12, YUV420)을 타일 크기로 줄여서 출력 프레임의 타일 자리에 바로 씀 (RGB 나 중간 버퍼 없음)
+// 딱 2배로 줄일 때는 2x2 상자 필터(NEON/SSE2), 그 외에는 쌍선형(bilinear)
+//
+// 출력은 mosaic_compose 를 부르는 쪽이 정한 일정한 간격으로 나감. 그 사이에 새 프레임이 오지 않은
+// 타일(늦거나 멈춘 카메라)은 마지막 화면을 그대로 보여줌. 한 번도 안 온 타일은 검은색
+// mosaic_put 은 여러 스레드에서 동시에 불러도 됨 (타일이 다르면 서로 기다리지 않음)
+
+struct mosaic;
+
+struct mosaic_stats {
+    unsigned long frames;    // 받은 프레임
+    unsigned long stale;     // 새 프레임 없이 이전 화면으로 내보낸 횟수
+    int64_t last_us;         // 마지막으로 받은 프레임의 캡처 시각 (0 이면 아직 없음)
+};
+
+// n 개 타일을 거의 정사각 격자로 (4 -> 2x2, 6 -> 3x2). width, height 는 짝수
+struct mosaic *mosaic_create(int width, int height, int n);
+void mosaic_free(struct mosaic *m);
+
+// 캡처 프레임을 tile 자리에 그림. 지원하지 않는 포맷이면 -1
+int mosaic_put(struct mosaic *m, int tile, const struct capture_frame *f);
+
+// 지금까지 그린 화면을 출력 프레임으로 내주고 다음 프레임을 준비
+// 돌려준 프레임은 호출한 쪽이 av_frame_free (인코더에 그대로 보내도 됨). 메모리가 없으면 NULL
+AVFrame *mosaic_compose(struct mosaic *m);
+
+void mosaic_get_stats(struct mosaic *m, int tile, struct mosaic_stats *st);
+
+#endif // MOSAIC_H
@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "motion.h"
+
+#define BLK 8    // 블록 크기 (줄인 평면 기준 8x8 샘플)
+
+struct motion {
+    struct motion_config cfg;
+    int width, height, stride;
+    int pix_bytes;           // 이웃한 Y 샘플 간격 (YUYV 2, 평면 1)
+    int dw, dh;              // 줄인 Y 평면 크기 (한 줄 dw 바이트로 붙여 저장. dw 는 정렬하지 않고 SIMD 루프의 나머지는 스칼라로)
+    int bx, by;              // 블록 개수
+    uint8_t *cur;
+    uint8_t *prev;
+    int have_prev;
+    int hold;
+};
+
+void motion_config_default(struct motion_config *cfg)
+{
+    cfg->step = 4;
+    cfg->threshold = 12;
+    cfg->min_blocks = 3;
+    cfg->hold_frames = 15;
+}
+
+struct motion *motion_create(int width, int height, int stride, int pix_bytes, const struct motion_config *cfg)
+{
+    struct motion *m = calloc(1, sizeof(*m));
+    if (!m) return NULL;
+
+    m->cfg = *cfg;
+    if (m->cfg.step < 1) m->cfg.step = 1;
+    m->width = width;
+    m->height = height;
+    m->stride = stride;
+    m->pix_bytes = pix_bytes;
+    m->dw = width / m->cfg.step;
+    m->dh = height / m->cfg.step;
+    m->bx = m->dw / BLK;
+    m->by = m->dh / BLK;
+
+    // 16바이트 단위로 읽어도 넘치지 않도록 여유를 둠
+    m->cur = calloc((size_t)(m->dw + 16) * m->dh, 1);
+    m->prev = calloc((size_t)(m->dw + 16) * m->dh, 1);
+    if (!m->cur || !m->prev || m->bx == 0 || m->by == 0) {
+        motion_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+void motion_free(struct motion *m)
+{
+    if (!m) return;
+    free(m->cur);
+    free(m->prev);
+    free(m);
+}
+
+// 평면 포맷(NV12/YUV420)의 Y 평면에서 step 픽셀마다 하나씩
+static void extract_luma_planar(const uint8_t *src, int stride, uint8_t *dst, int dw, int dh, int step)
+{
+    for (int y = 0; y < dh; y++) {
+        const uint8_t *in = src + (size_t)y * step * stride;
+        uint8_t *out = dst + (size_t)y * dw;
+        if (step == 1) {
+            memcpy(out, in, dw);
+            continue;
+        }
+        for (int x = 0; x < dw; x++)
+            out[x] = in[x * step];
+    }
+}
+
+// YUYV(Y0 U Y1 V)에서 step 픽셀마다 Y 하나씩 꺼내 작은 평면을 만듦
+static void extract_luma(const uint8_t *yuyv, int stride, uint8_t *dst, int dw, int dh, int step)
+{
+    for (int y = 0; y < dh; y++) {
+        const uint8_t *in = yuyv + (size_t)y * step * stride;
+        uint8_t *out = dst + (size_t)y * dw;
+        int x = 0;
+#if defined(__ARM_NEON)
+        if (step == 4) {
+            // 16비트 단위 4-way 디인터리브: val[0] 의 하위 바이트가 4픽셀마다의 Y
+            for (; x + 16 <= dw; x += 16) {
+                uint16x8x4_t a = vld4q_u16((const uint16_t *)(in + x * 8));
+                uint16x8x4_t b = vld4q_u16((const uint16_t *)(in + x * 8 + 64));
+                vst1q_u8(out + x, vcombine_u8(vmovn_u16(a.val[0]), vmovn_u16(b.val[0])));
+            }
+        } else if (step == 2) {
+            // 바이트 단위 4-way 디인터리브: val[0] 이 짝수 픽셀의 Y
+            for (; x + 16 <= dw; x += 16) {
+                uint8x16x4_t a = vld4q_u8(in + x * 4);
+                vst1q_u8(out + x, a.val[0]);
+            }
+        }
+#elif defined(__SSE2__)
+        if (step == 2) {
+            // 32비트마다 하위 바이트(Y0)만 남기고 두 번 pack
+            const __m128i mask = _mm_set1_epi32(0xff);
+            for (; x + 16 <= dw; x += 16) {
+                const __m128i *p = (const __m128i *)(in + x * 4);
+                __m128i a = _mm_packs_epi32(_mm_and_si128(_mm_loadu_si128(p), mask),
+                                            _mm_and_si128(_mm_loadu_si128(p + 1), mask));
+                __m128i b = _mm_packs_epi32(_mm_and_si128(_mm_loadu_si128(p + 2), mask),
+                                            _mm_and_si128(_mm_loadu_si128(p + 3), mask));
+                _mm_storeu_si128((__m128i *)(out + x), _mm_packus_epi16(a, b));
+            }
+        } else if (step == 4) {
+            // 64비트마다 하위 바이트만 남긴 뒤 32비트 레인 0,2 를 모아서 pack
+            const __m128i mask = _mm_set_epi32(0, 0xff, 0, 0xff);
+            for (; x + 16 <= dw; x += 16) {
+                const __m128i *p = (const __m128i *)(in + x * 8);
+                __m128i q[4];
+                for (int k = 0; k < 4; k++) {
+                    __m128i lo = _mm_shuffle_epi32(_mm_and_si128(_mm_loadu_si128(p + 2 * k), mask), 0x08);
+                    __m128i hi = _mm_shuffle_epi32(_mm_and_si128(_mm_loadu_si128(p + 2 * k + 1), mask), 0x08);
+                    q[k] = _mm_unpacklo_epi64(lo, hi);
+                }
+                _mm_storeu_si128((__m128i *)(out + x),
+                                 _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3])));
+            }
+        }
+#endif
+        for (; x < dw; x++)
+            out[x] = in[x * step * 2];
+    }
+}
+
+// 가로로 붙어있는 8x8 블록 두 개의 SAD를 한번에 (16바이트 x 8줄)
+static void sad_16x8(const uint8_t *a, const uint8_t *b, int stride, uint32_t out[2])
+{
+#if defined(__ARM_NEON)
+    uint16x8_t acc = vdupq_n_u16(0);
+    for (int r = 0; r < BLK; r++)
+        acc = vpadalq_u8(acc, vabdq_u8(vld1q_u8(a + r * stride), vld1q_u8(b + r * stride)));
+    uint64x2_t s = vpaddlq_u32(vpaddlq_u16(acc));
+    out[0] = (uint32_t)vgetq_lane_u64(s, 0);
+    out[1] = (uint32_t)vgetq_lane_u64(s, 1);
+#elif defined(__SSE2__)
+    // psadbw 는 앞 8바이트, 뒤 8바이트 합을 각각 64비트 레인에 돌려줌 -> 블록 두 개
+    __m128i acc = _mm_setzero_si128();
+    for (int r = 0; r < BLK; r++)
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(a + r * stride)),
+                                              _mm_loadu_si128((const __m128i *)(b + r * stride))));
+    out[0] = (uint32_t)_mm_cvtsi128_si32(acc);
+    out[1] = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#else
+    out[0] = out[1] = 0;
+    for (int r = 0; r < BLK; r++)
+        for (int c = 0; c < 16; c++)
+            out[c >> 3] += abs(a[r * stride + c] - b[r * stride + c]);
+#endif
+}
+
+static uint32_t sad_8x8(const uint8_t *a, const uint8_t *b, int stride)
+{
+    uint32_t s = 0;
+    for (int r = 0; r < BLK; r++)
+        for (int c = 0; c < BLK; c++)
+            s += abs(a[r * stride + c] - b[r * stride + c]);
+    return s;
+}
+
+int motion_analyze(struct motion *m, const unsigned char *frame, struct motion_event *ev)
+{
+    const uint32_t limit = (uint32_t)m->cfg.threshold * BLK * BLK;
+    int x0 = m->bx, y0 = m->by, x1 = -1, y1 = -1;
+    int moved = 0;
+    uint8_t *t;
+
+    if (m->pix_bytes == 2)
+        extract_luma(frame, m->stride, m->cur, m->dw, m->dh, m->cfg.step);
+    else
+        extract_luma_planar(frame, m->stride, m->cur, m->dw, m->dh, m->cfg.step);
+
+    if (m->have_prev) {
+        for (int by = 0; by < m->by; by++) {
+            const uint8_t *a = m->cur + (size_t)by * BLK * m->dw;
+            const uint8_t *b = m->prev + (size_t)by * BLK * m->dw;
+            for (int bx = 0; bx < m->bx; bx += 2) {
+                uint32_t sad[2];
+                if (bx + 1 < m->bx) {
+                    sad_16x8(a + bx * BLK, b + bx * BLK, m->dw, sad);
+                } else {
+                    sad[0] = sad_8x8(a + bx * BLK, b + bx * BLK, m->dw);
+                    sad[1] = 0;
+                }
+                for (int k = 0; k < 2; k++) {
+                    if (sad[k] <= limit) continue;
+                    moved++;
+                    if (bx + k < x0) x0 = bx + k;
+                    if (bx + k > x1) x1 = bx + k;
+                    if (by < y0) y0 = by;
+                    if (by > y1) y1 = by;
+                }
+            }
+        }
+    }
+
+    // 다음 프레임과 비교하기 위해 평면을 바꿔둠 (복사 없음)
+    t = m->prev;
+    m->prev = m->cur;
+    m->cur = t;
+    m->have_prev = 1;
+
+    memset(ev, 0, sizeof(*ev));
+    ev->blocks = moved;
+    if (moved >= m->cfg.min_blocks) {
+        int scale = BLK * m->cfg.step;
+        ev->started = m->hold == 0;
+        m->hold = m->cfg.hold_frames > 0 ? m->cfg.hold_frames : 1;
+        ev->x = x0 * scale;
+        ev->y = y0 * scale;
+        ev->w = (x1 - x0 + 1) * scale;
+        ev->h = (y1 - y0 + 1) * scale;
+    } else if (m->hold > 0 && --m->hold == 0) {
+        ev->ended = 1;
+    }
+    ev->active = m->hold > 0;
+    return moved >= m->cfg.min_blocks;
+}
@@ -0,0 +1,34 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+// YUYV 프레임의 휘도(Y)만 성기게 뽑아서 이전 프레임과 블록 단위 SAD로 움직임을 찾는 분석 단계
+// 800x600, step 4 기준 200x150 샘플만 보므로 캡처 루프에서 바로 불러도 부담이 거의 없음
+
+struct motion_config {
+    int step;          // 가로/세로 몇 픽셀마다 하나씩 볼지 (2 또는 4면 SIMD 경로)
+    int threshold;     // 블록 평균 픽셀 차이가 이 값을 넘으면 움직인 블록
+    int min_blocks;    // 움직인 블록이 이만큼 이상이어야 움직임으로 판단 (노이즈 제거)
+    int hold_frames;   // 움직임이 멈춘 뒤에도 이만큼은 이벤트를 유지
+};
+
+struct motion_event {
+    int active;        // 현재 움직임 이벤트 중인지
+    int started;       // 이번 프레임에서 이벤트가 시작됨
+    int ended;         // 이번 프레임에서 이벤트가 끝남
+    int blocks;        // 움직인 블록 수
+    int x, y, w, h;    // 움직인 영역 (원본 해상도 기준 픽셀)
+};
+
+struct motion;
+
+void motion_config_default(struct motion_config *cfg);
+
+// stride: 한 라인의 바이트 수 (YUYV 는 보통 width * 2, NV12/YUV420 은 Y 평면 기준)
+// pix_bytes: 가로로 이웃한 Y 샘플 사이의 바이트 수 (YUYV 2, 평면 포맷 1)
+struct motion *motion_create(int width, int height, int stride, int pix_bytes, const struct motion_config *cfg);
+void motion_free(struct motion *m);
+
+// 캡처 버퍼를 그대로 받아 분석 (평면 포맷은 Y 평면 시작 주소). 움직임이 있으면 1
+int motion_analyze(struct motion *m, const unsigned char *frame, struct motion_event *ev);
+
+#endif // MOTION_H
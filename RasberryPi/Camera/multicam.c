@@ -0,0 +1,265 @@
+// 빌드: gcc -O2 -o multicam multicam.c camgroup.c capture.c h264nal.c shmring.c recorder.c prebuffer.c uring.c -lavformat -lavcodec -lavutil -lswscale -lpthread -lrt
+// 실행: ./multicam [-s WxH@fps:FOURCC] [-B buffers] [-j workers] [-W worker_cpu_mask] [-k kbps] [-o dir] [-t segment_sec]
+//                  [-n seconds] source[@cpu] ...
+// 예:   ./multicam -s 1280x720@30 /dev/video0@0 /dev/video1@1 /dev/video2@2 /dev/video3@3
+
+// 여러 카메라를 동시에 H.264 로 녹화 (카메라마다 cam<N>-날짜.mp4 세그먼트)
+// 캡처는 카메라마다 스레드 하나(@cpu 로 코어 고정), 변환/인코딩은 공용 워커 풀(camgroup)
+// 인코더는 카메라마다 하나씩이고 스레드를 쓰지 않음 -> 여러 카메라가 워커 수만큼 병렬로 인코딩됨
+// 한 카메라가 멈추거나 인코딩이 밀려도 그 카메라 프레임만 버려지고 나머지는 그대로 녹화
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+
+#include "camgroup.h"
+#include "capture_av.h"
+#include "recorder.h"
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define STATS_SEC 5
+
+// 카메라 하나의 변환/인코딩/녹화 상태. 워커에서 쓰지만 같은 카메라는 동시에 처리되지 않으므로 잠금 없음
+struct cam_out {
+    const char *source;
+    struct capture_format fmt;
+    struct SwsContext *sws;
+    AVCodecContext *enc;
+    AVFrame *frame;
+    AVPacket *pkt;
+    struct recorder *rec;
+    int64_t first_us;
+    int64_t last_pts;
+    char prefix[16];
+};
+
+static struct cam_out outs[CAMGROUP_MAX];
+
+static volatile sig_atomic_t running = 1;
+
+static void stop_running(int signo) {
+    running = 0;
+}
+
+static void encode(struct cam_out *o, AVFrame *frame) {
+    int ret = avcodec_send_frame(o->enc, frame);
+    if (ret < 0) {
+        fprintf(stderr, "%s: error sending frame for encoding\n", o->source);
+        return;
+    }
+    while ((ret = avcodec_receive_packet(o->enc, o->pkt)) >= 0) {
+        recorder_push(o->rec, o->pkt);
+        av_packet_unref(o->pkt);
+    }
+    if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+        fprintf(stderr, "%s: error during encoding\n", o->source);
+}
+
+// camgroup 워커에서 불림. 캡처 버퍼는 돌아간 뒤 camgroup 이 돌려줌
+static void process_frame(void *arg, int cam, const struct capture_frame *f) {
+    struct cam_out *o = &outs[cam];
+    const uint8_t *src[3];
+    int src_stride[3];
+
+    capture_planes(f, src, src_stride);
+
+    if (av_frame_make_writable(o->frame) < 0) {
+        fprintf(stderr, "%s: frame not writable\n", o->source);
+        return;
+    }
+    sws_scale(o->sws, src, src_stride, 0, f->height, o->frame->data, o->frame->linesize);
+
+    // pts 는 캡처 시각에서 (놓친 프레임만큼 건너뜀). 항상 증가하게
+    if (o->first_us < 0)
+        o->first_us = f->timestamp_us;
+    int64_t pts = av_rescale(f->timestamp_us - o->first_us, o->fmt.fps, 1000000);
+    if (pts <= o->last_pts)
+        pts = o->last_pts + 1;
+    o->last_pts = pts;
+    o->frame->pts = pts;
+    encode(o, o->frame);
+}
+
+static int open_output(struct cam_out *o, const struct recorder_config *rcfg, int kbps, int cam) {
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    struct recorder_config cfg = *rcfg;
+
+    if (!codec) {
+        fprintf(stderr, "Codec not found\n");
+        return -1;
+    }
+    if (capture_av_format(o->fmt.pixelformat) == AV_PIX_FMT_NONE) {
+        char s[5];
+        fprintf(stderr, "%s: no converter for %s\n", o->source, capture_fourcc_str(o->fmt.pixelformat, s));
+        return -1;
+    }
+    o->enc = avcodec_alloc_context3(codec);
+    if (!o->enc)
+        return -1;
+    o->enc->bit_rate = (int64_t)kbps * 1000;
+    o->enc->width = o->fmt.width;
+    o->enc->height = o->fmt.height;
+    o->enc->time_base = (AVRational){1, o->fmt.fps};
+    o->enc->gop_size = o->fmt.fps;
+    o->enc->max_b_frames = 0;
+    o->enc->pix_fmt = AV_PIX_FMT_YUV420P;
+    o->enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    // 카메라끼리 병렬로 돌리므로 인코더 하나는 스레드 하나. 720p@30 을 코어 하나로 하려면 ultrafast
+    o->enc->thread_count = 1;
+    av_opt_set(o->enc->priv_data, "preset", "ultrafast", 0);
+    if (avcodec_open2(o->enc, codec, NULL) < 0) {
+        fprintf(stderr, "%s: could not open codec\n", o->source);
+        return -1;
+    }
+
+    o->sws = sws_getContext(o->fmt.width, o->fmt.height, capture_av_format(o->fmt.pixelformat),
+                            o->fmt.width, o->fmt.height, AV_PIX_FMT_YUV420P, SWS_POINT, NULL, NULL, NULL);
+    o->frame = av_frame_alloc();
+    o->pkt = av_packet_alloc();
+    if (!o->sws || !o->frame || !o->pkt)
+        return -1;
+    o->frame->format = AV_PIX_FMT_YUV420P;
+    o->frame->width = o->fmt.width;
+    o->frame->height = o->fmt.height;
+    if (av_frame_get_buffer(o->frame, 32) < 0)
+        return -1;
+    o->first_us = -1;
+    o->last_pts = -1;
+
+    snprintf(o->prefix, sizeof(o->prefix), "cam%d", cam);
+    cfg.prefix = o->prefix;
+    o->rec = recorder_open(&cfg, o->enc);
+    if (!o->rec) {
+        fprintf(stderr, "%s: could not start recorder\n", o->source);
+        return -1;
+    }
+    return 0;
+}
+
+static void close_output(struct cam_out *o) {
+    if (o->enc && o->rec)
+        encode(o, NULL);    // 인코더에 남은 프레임
+    if (o->rec) {
+        if (recorder_dropped(o->rec))
+            fprintf(stderr, "%s: recorder dropped %lu packets\n", o->source, recorder_dropped(o->rec));
+        recorder_close(o->rec);
+    }
+    avcodec_free_context(&o->enc);
+    sws_freeContext(o->sws);
+    av_frame_free(&o->frame);
+    av_packet_free(&o->pkt);
+}
+
+static void print_stats(struct camgroup *g, int n, unsigned long *last, double sec) {
+    for (int i = 0; i < n; i++) {
+        struct camgroup_stats st;
+        camgroup_get_stats(g, i, &st);
+        printf("%-14s %5.1f fps  captured %lu  dropped %lu  skipped %lu  timeouts %lu  encode %.1f ms (max %.1f)%s\n",
+               outs[i].source, (st.processed - last[i]) / sec, st.capture.frames, st.capture.dropped, st.skipped,
+               st.timeouts, st.process_ms, st.process_max_ms, st.failed ? "  FAILED" : "");
+        last[i] = st.processed;
+    }
+    fflush(stdout);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-s WxH@fps:FOURCC] [-B buffers] [-j workers] [-W worker_cpu_mask] [-k kbps] [-o dir]\n"
+                    "          [-t segment_sec] [-n seconds] source[@cpu] ...\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    struct camgroup_config cfg;
+    struct capture_config ccfg;
+    struct recorder_config rcfg;
+    unsigned long last[CAMGROUP_MAX] = { 0 };
+    int kbps = 2000;
+    int seconds = 0;
+    int opt;
+
+    camgroup_config_default(&cfg);
+    recorder_config_default(&rcfg);
+    capture_config_default(&ccfg);
+    ccfg.width = WIDTH;
+    ccfg.height = HEIGHT;
+    while ((opt = getopt(argc, argv, "s:B:j:W:k:o:t:n:")) != -1) {
+        switch (opt) {
+        // -s 는 모든 카메라에 같이 적용
+        case 's':
+            if (capture_parse_spec(&ccfg, optarg) < 0) {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'B': ccfg.buffers = atoi(optarg); break;
+        case 'j': cfg.workers = atoi(optarg); break;
+        // -W 0xc : 워커는 코어 2, 3 에서만 (캡처 스레드와 떨어뜨리고 싶을 때)
+        case 'W': cfg.worker_cpus = strtoul(optarg, NULL, 0); break;
+        case 'k': kbps = atoi(optarg); break;
+        case 'o': rcfg.dir = optarg; break;
+        case 't': rcfg.segment_sec = atoi(optarg); break;
+        case 'n': seconds = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (optind >= argc || argc - optind > CAMGROUP_MAX) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    // "/dev/video0@2" : 캡처 스레드를 코어 2 에 고정
+    for (int i = optind; i < argc; i++) {
+        int n = cfg.n_cams++;
+        char *at = strrchr(argv[i], '@');
+
+        cfg.cam[n] = ccfg;
+        if (at && at[1] && strspn(at + 1, "0123456789") == strlen(at + 1)) {
+            cfg.cpu[n] = atoi(at + 1);
+            *at = '\0';
+        }
+        cfg.cam[n].source = argv[i];
+        outs[n].source = argv[i];
+    }
+    cfg.process = process_frame;
+
+    // 카메라를 모두 연 뒤 실제 크기/fps 로 인코더와 녹화를 준비하고 나서 캡처 시작
+    struct camgroup *g = camgroup_open(&cfg);
+    if (!g)
+        return -1;
+    for (int i = 0; i < cfg.n_cams; i++) {
+        char s[5];
+
+        camgroup_get_format(g, i, &outs[i].fmt);
+        if (outs[i].fmt.fps <= 0)
+            outs[i].fmt.fps = 25;
+        if (open_output(&outs[i], &rcfg, kbps, i) < 0)
+            return -1;
+        printf("cam%d %s: %dx%d %s %d fps, capture cpu %d\n", i, outs[i].source, outs[i].fmt.width, outs[i].fmt.height,
+               capture_fourcc_str(outs[i].fmt.pixelformat, s), outs[i].fmt.fps, cfg.cpu[i]);
+    }
+    if (camgroup_start(g) < 0) {
+        camgroup_close(g);
+        return -1;
+    }
+
+    signal(SIGINT, stop_running);
+    signal(SIGTERM, stop_running);
+    for (int t = 0; running && (seconds <= 0 || t < seconds); t++) {
+        sleep(1);
+        if ((t + 1) % STATS_SEC == 0)
+            print_stats(g, cfg.n_cams, last, STATS_SEC);
+    }
+
+    // 캡처를 멈추고 대기 중이던 프레임까지 인코딩한 뒤 인코더/녹화를 닫음
+    camgroup_close(g);
+    for (int i = 0; i < cfg.n_cams; i++)
+        close_output(&outs[i]);
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <errno.h>
+
+#include "playclock.h"
+
+#define NSEC_PER_SEC 1000000000LL
+
+static int64_t ts_to_ns(const struct timespec *ts)
+{
+    return (int64_t)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static struct timespec ns_to_ts(int64_t ns)
+{
+    struct timespec ts = { ns / NSEC_PER_SEC, ns % NSEC_PER_SEC };
+    return ts;
+}
+
+void playclock_init(struct playclock *c, AVRational tb, AVRational frame_rate, int fast)
+{
+    c->tb = tb;
+    c->fast = fast;
+    c->late_ns = 40 * 1000000LL;
+    c->max_drops = 8;
+    // 프레임레이트를 모르면 25fps로 가정 (예전 usleep(40000) 과 같은 값)
+    if (frame_rate.num > 0 && frame_rate.den > 0)
+        c->frame_dur = av_rescale_q(1, (AVRational){frame_rate.den, frame_rate.num}, tb);
+    else
+        c->frame_dur = av_rescale_q(40000, (AVRational){1, 1000000}, tb);
+    if (c->frame_dur <= 0)
+        c->frame_dur = 1;
+    c->started = 0;
+    c->last_pts = AV_NOPTS_VALUE;
+    c->drops_in_row = 0;
+    c->shown = 0;
+    c->dropped = 0;
+}
+
+// 지금 프레임을 기준으로 시계를 다시 맞춤 (처음, 또는 PTS가 튀었을 때)
+static void rebase(struct playclock *c, int64_t pts, const struct timespec *now)
+{
+    c->base_pts = pts;
+    c->base = *now;
+    c->started = 1;
+}
+
+int playclock_wait(struct playclock *c, int64_t pts)
+{
+    struct timespec now;
+    int64_t due, now_ns;
+
+    if (pts == AV_NOPTS_VALUE)
+        pts = c->last_pts == AV_NOPTS_VALUE ? 0 : c->last_pts + c->frame_dur;
+    c->last_pts = pts;
+
+    if (c->fast) {
+        c->shown++;
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    now_ns = ts_to_ns(&now);
+    if (!c->started)
+        rebase(c, pts, &now);
+
+    due = ts_to_ns(&c->base) + av_rescale_q(pts - c->base_pts, c->tb, (AVRational){1, NSEC_PER_SEC});
+
+    // PTS가 뒤로 가거나 2초 이상 앞으로 튀면(반복 재생, 스트림 재시작) 시계를 새로 맞춤
+    if (due < now_ns - 2 * NSEC_PER_SEC || due > now_ns + 2 * NSEC_PER_SEC) {
+        rebase(c, pts, &now);
+        due = now_ns;
+    }
+
+    if (now_ns > due + c->late_ns && c->drops_in_row < c->max_drops) {
+        c->drops_in_row++;
+        c->dropped++;
+        return 0;
+    }
+
+    if (due > now_ns) {
+        struct timespec t = ns_to_ts(due);
+        // 절대 시각으로 잠들기 때문에 시그널로 깨어나도 오차가 쌓이지 않음
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR)
+            ;
+    }
+    c->drops_in_row = 0;
+    c->shown++;
+    return 1;
+}
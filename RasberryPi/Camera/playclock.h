@@ -0,0 +1,33 @@
+#ifndef PLAYCLOCK_H
+#define PLAYCLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+#include <libavutil/avutil.h>
+
+// 프레임 PTS를 스트림 time_base 로 환산해서 monotonic 시계에 맞춰 재생하는 스케줄러
+// 고정 usleep 대신 "이 프레임은 언제 보여야 하나"를 계산해서 그 시각까지만 잠듦
+struct playclock {
+    AVRational tb;           // 스트림 time_base
+    int64_t frame_dur;       // PTS가 없을 때 쓸 한 프레임 길이 (tb 단위)
+    int fast;                // 1이면 기다리지 않고 최대한 빨리 (디코딩 성능 측정용)
+    int64_t late_ns;         // 예정 시각보다 이만큼 늦으면 버림
+    int max_drops;           // 연속으로 이만큼 버렸으면 늦어도 한 장은 보여줌
+
+    int started;
+    int64_t base_pts;        // 기준 프레임의 PTS
+    struct timespec base;    // 기준 프레임을 보여준 시각 (CLOCK_MONOTONIC)
+    int64_t last_pts;
+    int drops_in_row;
+
+    unsigned long shown;
+    unsigned long dropped;
+};
+
+// frame_rate 는 PTS가 없는 프레임에만 사용 (모르면 {0, 1})
+void playclock_init(struct playclock *c, AVRational tb, AVRational frame_rate, int fast);
+
+// pts 프레임이 보여질 시각까지 기다림. 1이면 보여주고, 0이면 너무 늦었으니 버림
+int playclock_wait(struct playclock *c, int64_t pts);
+
+#endif // PLAYCLOCK_H
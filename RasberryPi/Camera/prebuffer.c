@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "prebuffer.h"
+
+// 인덱스 한 칸 = 패킷 하나. 데이터는 arena 안의 [off, off+size)
+struct pb_entry {
+    uint64_t seq;
+    size_t off;
+    size_t size;
+    int64_t pts;
+    int64_t dts;
+    int64_t duration;
+    int key;
+};
+
+struct prebuffer {
+    unsigned char *arena;
+    size_t budget;
+    size_t head;             // 다음 패킷을 쓸 위치
+
+    struct pb_entry *index;  // 오래된 순서의 링
+    int max_packets;
+    int first;
+    int count;
+    uint64_t next_seq;
+
+    AVRational tb;
+    int64_t pre;             // tb 단위로 바꾼 pre_sec / post_sec
+    int64_t post;
+
+    // 이벤트 상태 (녹화 스레드가 읽어가는 위치)
+    int active;
+    uint64_t cursor;
+    int64_t end_pts;
+    int resync;              // 다음 키프레임까지 건너뛰는 중
+
+    unsigned long overruns;  // 녹화 스레드가 못 따라와서 건너뛴 횟수
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+struct prebuffer *prebuffer_create(size_t budget_bytes, int max_packets, AVRational tb,
+                                   int pre_sec, int post_sec)
+{
+    struct prebuffer *pb = calloc(1, sizeof(*pb));
+    if (!pb) return NULL;
+
+    pb->arena = malloc(budget_bytes);
+    pb->index = calloc(max_packets, sizeof(*pb->index));
+    if (!pb->arena || !pb->index) {
+        free(pb->arena);
+        free(pb->index);
+        free(pb);
+        return NULL;
+    }
+    pb->budget = budget_bytes;
+    pb->max_packets = max_packets;
+    pb->tb = tb;
+    pb->pre = av_rescale_q(pre_sec, (AVRational){1, 1}, tb);
+    pb->post = av_rescale_q(post_sec, (AVRational){1, 1}, tb);
+
+    pthread_mutex_init(&pb->lock, NULL);
+    pthread_cond_init(&pb->cond, NULL);
+    return pb;
+}
+
+void prebuffer_free(struct prebuffer *pb)
+{
+    if (!pb) return;
+    pthread_mutex_destroy(&pb->lock);
+    pthread_cond_destroy(&pb->cond);
+    free(pb->arena);
+    free(pb->index);
+    free(pb);
+}
+
+static struct pb_entry *entry_at(struct prebuffer *pb, int i)
+{
+    return &pb->index[(pb->first + i) % pb->max_packets];
+}
+
+static struct pb_entry *entry_seq(struct prebuffer *pb, uint64_t seq)
+{
+    return entry_at(pb, (int)(seq - pb->index[pb->first].seq));
+}
+
+// size 바이트를 연속으로 쓸 수 있는 위치를 찾음. 자리가 없으면 0
+static int find_room(struct prebuffer *pb, size_t size, size_t *pos)
+{
+    size_t tail;
+
+    if (pb->count == 0) {
+        *pos = 0;
+        return size <= pb->budget;
+    }
+    tail = pb->index[pb->first].off;
+    if (pb->head > tail) {
+        // 사용중 영역: [tail, head)
+        if (pb->head + size <= pb->budget) { *pos = pb->head; return 1; }
+        if (size < tail) { *pos = 0; return 1; }   // 앞으로 감아서 씀
+        return 0;
+    }
+    // 사용중 영역: [tail, 끝) + [0, head). head == tail 이면 가득 찬 상태
+    if (pb->head + size < tail) { *pos = pb->head; return 1; }
+    return 0;
+}
+
+void prebuffer_push(struct prebuffer *pb, const AVPacket *pkt)
+{
+    size_t size = pkt->size;
+    size_t pos;
+    struct pb_entry *e;
+
+    if (size > pb->budget / 2)   // 버퍼 절반보다 큰 패킷은 담지 않음
+        return;
+
+    pthread_mutex_lock(&pb->lock);
+    // 공간 또는 인덱스가 모자라면 가장 오래된 패킷부터 버림 (메모리 사용량은 항상 일정)
+    while (pb->count == pb->max_packets || !find_room(pb, size, &pos)) {
+        pb->first = (pb->first + 1) % pb->max_packets;
+        pb->count--;
+    }
+
+    memcpy(pb->arena + pos, pkt->data, size);
+    pb->head = pos + size;
+
+    e = entry_at(pb, pb->count);
+    e->seq = pb->next_seq++;
+    e->off = pos;
+    e->size = size;
+    e->pts = pkt->pts;
+    e->dts = pkt->dts;
+    e->duration = pkt->duration;
+    e->key = !!(pkt->flags & AV_PKT_FLAG_KEY);
+    pb->count++;
+
+    if (pb->active)
+        pthread_cond_signal(&pb->cond);
+    pthread_mutex_unlock(&pb->lock);
+}
+
+// 가장 최근 패킷보다 pre 만큼 이전이면서 그 시점에 가장 가까운 키프레임
+// 버퍼에 그만큼 오래된 키프레임이 없으면 남아있는 것 중 가장 오래된 키프레임
+static int find_preroll(struct prebuffer *pb, uint64_t *seq)
+{
+    int64_t target = entry_at(pb, pb->count - 1)->pts - pb->pre;
+    int found = 0;
+
+    for (int i = pb->count - 1; i >= 0; i--) {
+        struct pb_entry *e = entry_at(pb, i);
+        if (!e->key) continue;
+        *seq = e->seq;
+        found = 1;
+        if (e->pts <= target) break;
+    }
+    return found;
+}
+
+void prebuffer_trigger(struct prebuffer *pb)
+{
+    pthread_mutex_lock(&pb->lock);
+    if (pb->count > 0) {
+        int64_t now = entry_at(pb, pb->count - 1)->pts;
+        if (!pb->active) {
+            if (find_preroll(pb, &pb->cursor)) {
+                pb->active = 1;
+                pb->resync = 0;
+            }
+        }
+        // 이벤트 중에 다시 트리거되면 끝나는 시각만 뒤로 미룸
+        pb->end_pts = now + pb->post;
+        pthread_cond_signal(&pb->cond);
+    }
+    pthread_mutex_unlock(&pb->lock);
+}
+
+static void deadline_after(struct timespec *ts, int timeout_ms)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+int prebuffer_next(struct prebuffer *pb, AVPacket *out, int timeout_ms)
+{
+    struct timespec deadline;
+    struct pb_entry *e;
+    uint64_t oldest;
+    int ret = PB_TIMEOUT;
+
+    deadline_after(&deadline, timeout_ms);
+    pthread_mutex_lock(&pb->lock);
+    for (;;) {
+        if (pb->active && pb->count > 0) {
+            oldest = pb->index[pb->first].seq;
+            if (pb->cursor < oldest) {
+                // 읽기 전에 덮어써짐. 디코딩이 깨지지 않도록 다음 키프레임으로 건너뜀
+                pb->overruns++;
+                pb->cursor = oldest;
+                pb->resync = 1;
+            }
+            while (pb->resync && pb->cursor < pb->next_seq && !entry_seq(pb, pb->cursor)->key)
+                pb->cursor++;
+            if (pb->cursor < pb->next_seq) {
+                pb->resync = 0;
+                break;
+            }
+        }
+        if (pthread_cond_timedwait(&pb->cond, &pb->lock, &deadline) != 0) {
+            pthread_mutex_unlock(&pb->lock);
+            return PB_TIMEOUT;
+        }
+    }
+
+    e = entry_seq(pb, pb->cursor);
+    if (e->pts > pb->end_pts) {
+        pb->active = 0;
+        ret = PB_EVENT_END;
+    } else if (av_new_packet(out, e->size) == 0) {
+        // 패킷 하나 복사하는 동안만 잠금. 캡처 스레드가 오래 기다리지 않음
+        memcpy(out->data, pb->arena + e->off, e->size);
+        out->pts = e->pts;
+        out->dts = e->dts;
+        out->duration = e->duration;
+        out->flags = e->key ? AV_PKT_FLAG_KEY : 0;
+        pb->cursor++;
+        ret = PB_PACKET;
+    }
+    pthread_mutex_unlock(&pb->lock);
+    return ret;
+}
+
+unsigned long prebuffer_overruns(struct prebuffer *pb)
+{
+    unsigned long n;
+    pthread_mutex_lock(&pb->lock);
+    n = pb->overruns;
+    pthread_mutex_unlock(&pb->lock);
+    return n;
+}
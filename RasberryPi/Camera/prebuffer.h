@@ -0,0 +1,34 @@
+#ifndef PREBUFFER_H
+#define PREBUFFER_H
+
+#include <stddef.h>
+#include <libavcodec/avcodec.h>
+
+// 이벤트 이전 N초를 메모리에 들고있는 인코딩 패킷 링 버퍼
+// 메모리는 생성할 때 한번만 잡고(byte budget + 인덱스) 이후로는 늘어나지 않음
+struct prebuffer;
+
+// prebuffer_next 반환값
+enum {
+    PB_TIMEOUT = 0,     // 이벤트가 없거나 아직 새 패킷이 없음
+    PB_PACKET = 1,      // out 에 패킷 하나를 복사함
+    PB_EVENT_END = 2    // 이벤트 구간(post_sec)이 끝남. 파일을 닫으면 됨
+};
+
+// tb: 패킷 타임스탬프의 time_base. pre_sec/post_sec는 트리거 전후로 남길 길이
+struct prebuffer *prebuffer_create(size_t budget_bytes, int max_packets, AVRational tb,
+                                   int pre_sec, int post_sec);
+void prebuffer_free(struct prebuffer *pb);
+
+// 캡처(인코딩) 스레드. 메모리 할당 없이 복사만 하고 가장 오래된 패킷부터 밀어냄
+void prebuffer_push(struct prebuffer *pb, const AVPacket *pkt);
+
+// 이벤트 시작(또는 진행중인 이벤트 연장). 시그널 핸들러에서는 부르지 말 것 (mutex 사용)
+void prebuffer_trigger(struct prebuffer *pb);
+
+// 녹화 스레드. 이벤트 중이면 pre_sec 이전의 가장 가까운 키프레임부터 순서대로 패킷을 꺼냄
+int prebuffer_next(struct prebuffer *pb, AVPacket *out, int timeout_ms);
+
+unsigned long prebuffer_overruns(struct prebuffer *pb);
+
+#endif // PREBUFFER_H
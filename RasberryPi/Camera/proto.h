@@ -0,0 +1,171 @@
+#ifndef PROTO_H
+#define PROTO_H
+
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+// video_server -> video_client 프레임 전송 형식
+// 프레임마다 고정 크기 헤더 뒤에 size 바이트의 데이터가 이어짐. 숫자는 모두 네트워크 바이트 순서
+// 데이터 종류는 magic 으로 구분
+//   FRAME_MAGIC : YUYV 원본 프레임 (width * 2 * height 바이트)
+//   H264_MAGIC  : H.264 Annex B 접근 단위 하나 (simulcast 화질을 구독했을 때. SPS/PPS 는 키프레임 앞에 붙어 옴)
+//   RGB565_MAGIC: RGB565 (width * 2 * height 바이트). SET_FORMAT 으로 RGB565 를 골랐을 때. 화면에 그대로 복사
+//   REPLY_MAGIC : 제어 요청에 대한 응답 (struct ctrl_reply. 아래 참고)
+//
+// YUYV/RGB565 의 크기는 헤더의 width/height (ROI 나 SET_FORMAT 으로 요청한 크기일 수 있음)
+//
+// capture_us 는 V4L2 버퍼 타임스탬프(CLOCK_MONOTONIC)를 CLOCK_REALTIME 으로 옮긴 값
+// 클라이언트는 화면에 띄운 시각과 비교해서 캡처 -> 화면(glass) 지연을 구함
+// 서버와 클라이언트가 다른 장비면 시계가 NTP/PTP 로 맞춰져 있어야 의미가 있음
+
+#define FRAME_MAGIC 0x46524d31    // "FRM1"
+#define H264_MAGIC  0x48323634    // "H264"
+#define RGB565_MAGIC 0x52353635   // "R565"
+#define REPLY_MAGIC 0x52504c31    // "RPL1"
+
+struct frame_header {
+    uint32_t magic;
+    uint32_t sequence;            // 캡처 프레임 번호 (v4l2_buffer.sequence)
+    uint32_t width, height;
+    uint32_t size;                // 뒤따르는 데이터 바이트 수
+    uint32_t capture_hi, capture_lo;   // capture_us (64비트를 둘로 나눔)
+};
+
+static inline void frame_header_pack_magic(struct frame_header *h, uint32_t magic, uint32_t seq, uint32_t width,
+                                           uint32_t height, uint32_t size, int64_t capture_us)
+{
+    h->magic = htonl(magic);
+    h->sequence = htonl(seq);
+    h->width = htonl(width);
+    h->height = htonl(height);
+    h->size = htonl(size);
+    h->capture_hi = htonl((uint64_t)capture_us >> 32);
+    h->capture_lo = htonl((uint32_t)capture_us);
+}
+
+static inline void frame_header_pack(struct frame_header *h, uint32_t seq, uint32_t width, uint32_t height,
+                                     uint32_t size, int64_t capture_us)
+{
+    frame_header_pack_magic(h, FRAME_MAGIC, seq, width, height, size, capture_us);
+}
+
+// 받은 헤더를 호스트 순서로 바꿈 (magic 포함). 모르는 magic 이면 -1
+static inline int frame_header_unpack(struct frame_header *h, int64_t *capture_us)
+{
+    h->magic = ntohl(h->magic);
+    if (h->magic != FRAME_MAGIC && h->magic != H264_MAGIC && h->magic != RGB565_MAGIC)
+        return -1;
+    h->sequence = ntohl(h->sequence);
+    h->width = ntohl(h->width);
+    h->height = ntohl(h->height);
+    h->size = ntohl(h->size);
+    *capture_us = (int64_t)(((uint64_t)ntohl(h->capture_hi) << 32) | ntohl(h->capture_lo));
+    return 0;
+}
+
+// video_client -> video_server 제어 요청 (같은 연결)
+// 고정 크기 헤더 뒤에 size 바이트의 인자. 서버는 프레임 사이에 이벤트 루프에서 읽고 요청마다 응답을 하나 보냄
+// 응답은 프레임 사이에 끼어서 오므로 받는 쪽은 헤더를 읽은 뒤 magic 으로 구분 (id 는 요청의 id 그대로)
+// 설정(화질, 모양, 구독 여부, 통계)은 연결마다 따로. ROI 는 캡처 자체를 자르므로 모든 연결에 적용
+#define CTRL_MAGIC 0x43544c31     // "CTL1"
+
+enum ctrl_type {
+    CTRL_SUBSCRIBE = 1,           // 인자 없음. 지금 정한 형식으로 프레임을 보내기 시작
+    CTRL_UNSUBSCRIBE,             // 인자 없음. 보내기를 멈춤 (연결은 그대로)
+    CTRL_SET_FORMAT,              // struct ctrl_format. 구독 중에 바꿔도 됨
+    CTRL_SET_ROI,                 // struct ctrl_rect
+    CTRL_REQUEST_KEYFRAME,        // 인자 없음. 구독한 simulcast 화질의 다음 프레임을 키프레임으로
+    CTRL_GET_STATS,               // 인자 없음. 응답에 struct ctrl_stats
+};
+
+#define CTRL_MAX_PAYLOAD 64       // 이보다 큰 인자는 잘못된 요청 (연결을 끊음)
+
+struct ctrl_request {
+    uint32_t magic;               // CTRL_MAGIC
+    uint32_t id;                  // 보내는 쪽이 정하는 번호. 응답에 그대로
+    uint32_t type;                // enum ctrl_type
+    uint32_t size;                // 뒤따르는 인자 바이트 수
+};
+
+// frame_header 와 같은 크기. status 는 0 이면 성공, 아니면 -errno (EINVAL: 잘못된 인자, ENOTSUP: 모르는 요청 ...)
+struct ctrl_reply {
+    uint32_t magic;               // REPLY_MAGIC
+    uint32_t id;
+    uint32_t type;
+    int32_t status;
+    uint32_t size;                // 뒤따르는 데이터 바이트 수 (frame_header.size 와 같은 위치)
+    uint32_t reserved[2];
+};
+
+// level < 0 이면 원본을 width x height (0 이면 캡처 크기, 캡처보다 크면 캡처 크기, 폭은 짝수로 내림해서 1 은 -EINVAL), pixelformat
+// level < 0 이면 원본을 width x height (0 이면 캡처 크기, 캡처보다 크면 캡처 크기), pixelformat
+// (V4L2 fourcc: YUYV 또는 RGBP = RGB565, 0 이면 YUYV) 로 바꿔서. 같은 모양의 연결끼리는 서버가 한 번만 변환
+struct ctrl_format {
+    int32_t level;
+    uint32_t width, height;
+    uint32_t pixelformat;
+};
+
+// SET_ROI. capture_rect 와 같음. left/top 이 -1 이면 가운데
+struct ctrl_rect {
+    int32_t left, top;
+    uint32_t width, height;
+};
+
+// GET_STATS 응답. 보낸 수는 이 연결, 캡처 수는 서버 전체
+struct ctrl_stats {
+    uint32_t frames_sent;
+    uint32_t bytes_hi, bytes_lo;  // 헤더 포함 보낸 바이트 (64비트를 둘로 나눔)
+    uint32_t send_errors;
+    uint32_t captured;            // 캡처한 프레임
+    uint32_t dropped;             // 캡처에서 놓친 프레임
+    uint32_t clients;             // 연결된 클라이언트 수
+    uint32_t streaming;           // 그중 받고 있는 수
+};
+
+_Static_assert(sizeof(struct ctrl_reply) == sizeof(struct frame_header), "reply must look like a frame header");
+
+static inline void ctrl_request_pack(struct ctrl_request *r, uint32_t id, uint32_t type, uint32_t size)
+{
+    r->magic = htonl(CTRL_MAGIC);
+    r->id = htonl(id);
+    r->type = htonl(type);
+    r->size = htonl(size);
+}
+
+// 받은 요청을 호스트 순서로. magic 이 틀리거나 인자가 너무 크면 -1 (스트림이 어긋난 것)
+static inline int ctrl_request_unpack(struct ctrl_request *r)
+{
+    r->magic = ntohl(r->magic);
+    r->id = ntohl(r->id);
+    r->type = ntohl(r->type);
+    r->size = ntohl(r->size);
+    return r->magic == CTRL_MAGIC && r->size <= CTRL_MAX_PAYLOAD ? 0 : -1;
+}
+
+static inline void ctrl_reply_pack(struct ctrl_reply *r, uint32_t id, uint32_t type, int32_t status, uint32_t size)
+{
+    r->magic = htonl(REPLY_MAGIC);
+    r->id = htonl(id);
+    r->type = htonl(type);
+    r->status = (int32_t)htonl((uint32_t)status);
+    r->size = htonl(size);
+    r->reserved[0] = r->reserved[1] = 0;
+}
+
+// frame_header 로 읽은 것이 응답이면 호스트 순서로 바꿔서 0, 아니면 -1 (h 는 그대로)
+static inline int ctrl_reply_unpack(const struct frame_header *h, struct ctrl_reply *r)
+{
+    if (ntohl(h->magic) != REPLY_MAGIC)
+        return -1;
+    memcpy(r, h, sizeof(*r));
+    r->magic = REPLY_MAGIC;
+    r->id = ntohl(r->id);
+    r->type = ntohl(r->type);
+    r->status = (int32_t)ntohl((uint32_t)r->status);
+    r->size = ntohl(r->size);
+    return 0;
+}
+
+#endif // PROTO_H
@@ -0,0 +1,548 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <libavformat/avformat.h>
+
+#include "recorder.h"
+#include "prebuffer.h"
+#include "uring.h"
+
+#define AVIO_BUF_SIZE (64 * 1024)    // muxer -> write 콜백 사이의 작은 버퍼
+#define WRITE_ALIGN   4096           // 쓰기 버퍼 정렬 단위 (페이지 크기)
+
+// 디스크에 남아있는 세그먼트 (보관 정책 적용용)
+struct segment {
+    char path[PATH_MAX];
+    long long size;
+    time_t created;
+};
+
+// 지금 쓰고 있는 세그먼트 파일
+struct seg_writer {
+    AVFormatContext *oc;
+    AVIOContext *avio;
+    int fd;
+    unsigned char *chunk;    // 정렬된 큰 쓰기 버퍼. 가득 차야 write() 한번
+    size_t chunk_len;
+    unsigned char *spare;    // io_uring 일 때 쓰는 중인 이전 chunk (끝나면 chunk 와 바꿈)
+    size_t inflight;         // spare 에서 아직 쓰고 있는 바이트 수 (0 이면 없음)
+    long long inflight_off;
+    long long written;
+    long long since_sync;
+    int64_t first_dts;       // 세그먼트마다 타임스탬프를 0부터 시작하게 만들기 위함
+    int64_t start_pts;
+    char path[PATH_MAX];
+    time_t created;
+};
+
+struct recorder {
+    struct recorder_config cfg;
+    AVCodecParameters *par;
+    AVRational tb;
+
+    // 캡처 스레드 -> I/O 스레드 패킷 링 큐
+    AVPacket **queue;
+    int q_head;
+    int q_len;
+    int need_key;            // 패킷을 버린 뒤에는 다음 키프레임부터 다시 받음
+    int stop;
+    unsigned long dropped;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+
+    struct seg_writer seg;
+    int seg_open;
+    struct uring *u;         // use_uring 이고 커널이 지원할 때만. I/O 스레드만 씀
+    unsigned char *bufs[2];  // 고정 버퍼로 등록한 chunk/spare (번호 찾기용)
+
+    struct segment *segs;    // 오래된 순서
+    int n_segs;
+    int cap_segs;
+    long long segs_total;
+};
+
+void recorder_config_default(struct recorder_config *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->dir = ".";
+    cfg->prefix = "record";
+    cfg->segment_sec = 60;
+    cfg->fsync = FSYNC_SEGMENT;
+    cfg->fsync_bytes = 8 * 1024 * 1024;
+    cfg->queue_len = 256;            // 25fps 기준 10초 분량. 디스크가 잠깐 멈춰도 캡처는 계속
+    cfg->write_chunk = 1024 * 1024;
+}
+
+static int add_segment(struct recorder *rec, const char *path, long long size, time_t created)
+{
+    if (rec->n_segs == rec->cap_segs) {
+        int cap = rec->cap_segs ? rec->cap_segs * 2 : 64;
+        struct segment *s = realloc(rec->segs, cap * sizeof(*s));
+        if (!s) return -1;
+        rec->segs = s;
+        rec->cap_segs = cap;
+    }
+    struct segment *s = &rec->segs[rec->n_segs++];
+    snprintf(s->path, sizeof(s->path), "%s", path);
+    s->size = size;
+    s->created = created;
+    rec->segs_total += size;
+    return 0;
+}
+
+static int cmp_segment(const void *a, const void *b)
+{
+    return strcmp(((const struct segment *)a)->path, ((const struct segment *)b)->path);
+}
+
+// 이전 실행에서 남긴 세그먼트도 보관 정책에 포함시키기 위해 디렉터리를 한번 훑음
+// 파일 이름에 시각이 들어가 있으므로 이름순 정렬 == 시간순 정렬
+static void scan_segments(struct recorder *rec)
+{
+    DIR *d = opendir(rec->cfg.dir);
+    struct dirent *de;
+    size_t plen = strlen(rec->cfg.prefix);
+
+    if (!d) return;
+    while ((de = readdir(d)) != NULL) {
+        size_t len = strlen(de->d_name);
+        char path[PATH_MAX];
+        struct stat st;
+
+        if (len < plen + 4 || strncmp(de->d_name, rec->cfg.prefix, plen) != 0 ||
+            strcmp(de->d_name + len - 4, ".mp4") != 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", rec->cfg.dir, de->d_name);
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+            add_segment(rec, path, st.st_size, st.st_mtime);
+    }
+    closedir(d);
+    qsort(rec->segs, rec->n_segs, sizeof(*rec->segs), cmp_segment);
+}
+
+// 용량/기간 제한을 넘은 가장 오래된 세그먼트부터 삭제. 방금 닫은 것은 남김
+static void apply_retention(struct recorder *rec)
+{
+    time_t now = time(NULL);
+    int drop = 0;
+
+    while (rec->n_segs - drop > 1) {
+        struct segment *s = &rec->segs[drop];
+        int over_size = rec->cfg.max_total_bytes > 0 && rec->segs_total > rec->cfg.max_total_bytes;
+        int over_age = rec->cfg.max_age_sec > 0 && now - s->created > rec->cfg.max_age_sec;
+        if (!over_size && !over_age)
+            break;
+        if (unlink(s->path) == -1 && errno != ENOENT)
+            perror("unlink segment");
+        rec->segs_total -= s->size;
+        drop++;
+    }
+    if (drop) {
+        memmove(rec->segs, rec->segs + drop, (rec->n_segs - drop) * sizeof(*rec->segs));
+        rec->n_segs -= drop;
+    }
+}
+
+// io_uring 으로 보낸 이전 chunk 쓰기가 끝날 때까지 기다림. 덜 써졌으면 나머지는 pwrite()
+static int chunk_wait(struct recorder *rec, struct seg_writer *w)
+{
+    uint64_t tag;
+    int res;
+
+    if (!w->inflight)
+        return 0;
+    while (!uring_peek(rec->u, &tag, &res))
+        if (uring_submit(rec->u, 1, -1) < 0)
+            return -1;
+
+    size_t len = w->inflight;
+    w->inflight = 0;
+    if (res < 0) {
+        errno = -res;
+        perror("write segment");
+        return -1;
+    }
+    for (size_t off = res; off < len;) {
+        ssize_t n = pwrite(w->fd, w->spare + off, len - off, w->inflight_off + off);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("write segment");
+            return -1;
+        }
+        off += n;
+    }
+    return 0;
+}
+
+static int chunk_flush(struct recorder *rec, struct seg_writer *w)
+{
+    size_t off = 0;
+
+    if (rec->u) {
+        // 이전 chunk 가 끝나야 그 버퍼를 다시 채울 수 있음. 보통은 muxer 가 chunk 하나를 채우는 동안 끝나 있음
+        if (chunk_wait(rec, w) < 0)
+            return -1;
+        if (w->chunk_len) {
+            int index = w->chunk == rec->bufs[0] ? 0 : 1;
+            unsigned char *t;
+
+            if (uring_write_fixed(rec->u, w->fd, w->chunk, w->chunk_len, w->written, index, 0, 0) < 0 ||
+                uring_submit(rec->u, 0, 0) < 0)
+                return -1;
+            w->inflight = w->chunk_len;
+            w->inflight_off = w->written;
+            t = w->chunk;
+            w->chunk = w->spare;
+            w->spare = t;
+        }
+    } else {
+        while (off < w->chunk_len) {
+            ssize_t n = write(w->fd, w->chunk + off, w->chunk_len - off);
+            if (n == -1) {
+                if (errno == EINTR) continue;
+                perror("write segment");
+                return -1;
+            }
+            off += n;
+        }
+    }
+    w->written += w->chunk_len;
+    w->since_sync += w->chunk_len;
+    w->chunk_len = 0;
+
+    if (rec->cfg.fsync == FSYNC_INTERVAL && w->since_sync >= rec->cfg.fsync_bytes) {
+        if (rec->u && chunk_wait(rec, w) < 0)
+            return -1;
+        fdatasync(w->fd);
+        w->since_sync = 0;
+    }
+    return 0;
+}
+
+// muxer가 만든 바이트를 큰 정렬 버퍼에 모았다가 write_chunk 단위로만 write()
+static int seg_write_cb(void *opaque, uint8_t *buf, int size)
+{
+    struct recorder *rec = opaque;
+    struct seg_writer *w = &rec->seg;
+    int left = size;
+
+    while (left > 0) {
+        size_t room = rec->cfg.write_chunk - w->chunk_len;
+        size_t n = (size_t)left < room ? (size_t)left : room;
+        memcpy(w->chunk + w->chunk_len, buf, n);
+        w->chunk_len += n;
+        buf += n;
+        left -= n;
+        if (w->chunk_len == rec->cfg.write_chunk && chunk_flush(rec, w) < 0)
+            return AVERROR(EIO);
+    }
+    return size;
+}
+
+static int seg_open(struct recorder *rec, const AVPacket *first)
+{
+    struct seg_writer *w = &rec->seg;
+    AVDictionary *opts = NULL;
+    unsigned char *avio_buf;
+    AVStream *st;
+    char stamp[32];
+    struct tm tm;
+
+    w->created = time(NULL);
+    localtime_r(&w->created, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    // 같은 초에 세그먼트가 또 열리면 (fast 소스 + 짧은 -t, 재시작) 덮어쓰지 않고 "_001" 부터 붙임
+    // '_' 는 '.' 보다 뒤라서 이름순 정렬이 그대로 시간순
+    for (int n = 0; ; n++) {
+        if (n == 0)
+            snprintf(w->path, sizeof(w->path), "%s/%s-%s.mp4", rec->cfg.dir, rec->cfg.prefix, stamp);
+        else
+            snprintf(w->path, sizeof(w->path), "%s/%s-%s_%03d.mp4", rec->cfg.dir, rec->cfg.prefix, stamp, n);
+        w->fd = open(w->path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (w->fd != -1)
+            break;
+        if (errno != EEXIST || n == 999) {
+            perror(w->path);
+            return -1;
+        }
+    }
+
+    if (avformat_alloc_output_context2(&w->oc, NULL, "mp4", w->path) < 0) {
+        fprintf(stderr, "Could not allocate mp4 muxer\n");
+        goto fail;
+    }
+
+    st = avformat_new_stream(w->oc, NULL);
+    if (!st || avcodec_parameters_copy(st->codecpar, rec->par) < 0)
+        goto fail;
+    st->time_base = rec->tb;
+
+    avio_buf = av_malloc(AVIO_BUF_SIZE);
+    w->avio = avio_alloc_context(avio_buf, AVIO_BUF_SIZE, 1, rec, NULL, seg_write_cb, NULL);
+    if (!w->avio) {
+        av_free(avio_buf);
+        goto fail;
+    }
+    w->oc->pb = w->avio;
+    w->oc->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    // 조각(fragmented) MP4: moov를 먼저 쓰고 키프레임마다 moof+mdat를 붙임
+    // 녹화 도중 전원이 나가도 마지막 조각까지는 재생 가능하고, 끝에서 seek도 필요 없음
+    av_dict_set(&opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+    if (avformat_write_header(w->oc, &opts) < 0) {
+        fprintf(stderr, "Could not write header for %s\n", w->path);
+        av_dict_free(&opts);
+        goto fail;
+    }
+    av_dict_free(&opts);
+
+    w->first_dts = first->dts != AV_NOPTS_VALUE ? first->dts : first->pts;
+    w->start_pts = first->pts;
+    w->written = 0;
+    w->since_sync = 0;
+    w->chunk_len = 0;
+    rec->seg_open = 1;
+    return 0;
+
+fail:
+    if (w->avio) {
+        av_freep(&w->avio->buffer);
+        avio_context_free(&w->avio);
+    }
+    avformat_free_context(w->oc);
+    w->oc = NULL;
+    close(w->fd);
+    unlink(w->path);
+    return -1;
+}
+
+static void seg_close(struct recorder *rec)
+{
+    struct seg_writer *w = &rec->seg;
+
+    av_write_trailer(w->oc);
+    avio_flush(w->avio);
+    chunk_flush(rec, w);        // 마지막 덜 찬 버퍼
+    if (rec->u)
+        chunk_wait(rec, w);
+    if (rec->cfg.fsync != FSYNC_NONE)
+        fdatasync(w->fd);
+    close(w->fd);
+
+    av_freep(&w->avio->buffer);
+    avio_context_free(&w->avio);
+    avformat_free_context(w->oc);
+    w->oc = NULL;
+    rec->seg_open = 0;
+
+    add_segment(rec, w->path, w->written, w->created);
+    apply_retention(rec);
+}
+
+static void write_packet(struct recorder *rec, AVPacket *pkt)
+{
+    int key = pkt->flags & AV_PKT_FLAG_KEY;
+
+    // 세그먼트 길이를 넘긴 뒤 첫 키프레임에서 파일을 바꿈 -> 모든 파일이 키프레임으로 시작
+    if (key && rec->seg_open &&
+        av_compare_ts(pkt->pts - rec->seg.start_pts, rec->tb, rec->cfg.segment_sec, (AVRational){1, 1}) >= 0)
+        seg_close(rec);
+
+    if (!rec->seg_open) {
+        if (!key) return;
+        if (seg_open(rec, pkt) < 0) return;
+    }
+
+    if (pkt->pts != AV_NOPTS_VALUE) pkt->pts -= rec->seg.first_dts;
+    if (pkt->dts != AV_NOPTS_VALUE) pkt->dts -= rec->seg.first_dts;
+    pkt->stream_index = 0;
+    av_packet_rescale_ts(pkt, rec->tb, rec->seg.oc->streams[0]->time_base);
+
+    // 스트림이 하나뿐이라 interleave 버퍼링이 필요 없음
+    if (av_write_frame(rec->seg.oc, pkt) < 0)
+        fprintf(stderr, "Error writing packet to %s\n", rec->seg.path);
+}
+
+static void *recorder_thread(void *arg)
+{
+    struct recorder *rec = arg;
+
+    for (;;) {
+        AVPacket *pkt;
+
+        pthread_mutex_lock(&rec->lock);
+        while (rec->q_len == 0 && !rec->stop)
+            pthread_cond_wait(&rec->cond, &rec->lock);
+        if (rec->q_len == 0) {
+            pthread_mutex_unlock(&rec->lock);
+            break;
+        }
+        pkt = rec->queue[rec->q_head];
+        rec->q_head = (rec->q_head + 1) % rec->cfg.queue_len;
+        rec->q_len--;
+        pthread_mutex_unlock(&rec->lock);
+
+        // 파일 열기/닫기, fsync 등 느린 작업은 모두 이 스레드에서만 일어남
+        write_packet(rec, pkt);
+        av_packet_free(&pkt);
+    }
+
+    if (rec->seg_open)
+        seg_close(rec);
+    return NULL;
+}
+
+// 이벤트 녹화: 트리거가 오면 prebuffer 에 남아있는 이벤트 이전 구간부터 읽어서 씀
+// 이벤트 하나(연장 포함)가 끝나면 그 파일을 닫음
+static void *event_thread(void *arg)
+{
+    struct recorder *rec = arg;
+    AVPacket *pkt = av_packet_alloc();
+    int stop = 0;
+
+    while (!stop && pkt) {
+        switch (prebuffer_next(rec->cfg.source, pkt, 200)) {
+        case PB_PACKET:
+            write_packet(rec, pkt);
+            av_packet_unref(pkt);
+            break;
+        case PB_EVENT_END:
+            if (rec->seg_open)
+                seg_close(rec);
+            break;
+        default:
+            break;
+        }
+        pthread_mutex_lock(&rec->lock);
+        stop = rec->stop;
+        pthread_mutex_unlock(&rec->lock);
+    }
+
+    av_packet_free(&pkt);
+    if (rec->seg_open)
+        seg_close(rec);
+    return NULL;
+}
+
+struct recorder *recorder_open(const struct recorder_config *cfg, const AVCodecContext *enc)
+{
+    struct recorder *rec = calloc(1, sizeof(*rec));
+    if (!rec) return NULL;
+
+    rec->cfg = *cfg;
+    if (rec->cfg.write_chunk < WRITE_ALIGN)
+        rec->cfg.write_chunk = WRITE_ALIGN;
+    rec->cfg.write_chunk &= ~(size_t)(WRITE_ALIGN - 1);
+    if (rec->cfg.queue_len < 2)
+        rec->cfg.queue_len = 2;
+
+    rec->tb = enc->time_base;
+    rec->par = avcodec_parameters_alloc();
+    rec->queue = calloc(rec->cfg.queue_len, sizeof(*rec->queue));
+    if (!rec->par || !rec->queue || avcodec_parameters_from_context(rec->par, enc) < 0)
+        goto fail;
+
+    if (posix_memalign((void **)&rec->seg.chunk, WRITE_ALIGN, rec->cfg.write_chunk) != 0)
+        goto fail;
+    if (rec->cfg.use_uring) {
+        if (posix_memalign((void **)&rec->seg.spare, WRITE_ALIGN, rec->cfg.write_chunk) != 0)
+            goto fail;
+        // 두 버퍼를 고정 버퍼로 등록해두면 쓸 때마다 페이지를 고정/해제하지 않음
+        struct iovec iov[2] = { { rec->seg.chunk, rec->cfg.write_chunk }, { rec->seg.spare, rec->cfg.write_chunk } };
+        rec->u = uring_create(4);
+        if (rec->u && uring_register_buffers(rec->u, iov, 2) < 0) {
+            uring_free(rec->u);
+            rec->u = NULL;
+        }
+        if (!rec->u)
+            fprintf(stderr, "io_uring not available, recording with write()\n");
+        rec->bufs[0] = rec->seg.chunk;
+        rec->bufs[1] = rec->seg.spare;
+    }
+
+    if (mkdir(rec->cfg.dir, 0755) == -1 && errno != EEXIST) {
+        perror(rec->cfg.dir);
+        goto fail;
+    }
+    scan_segments(rec);
+
+    pthread_mutex_init(&rec->lock, NULL);
+    pthread_cond_init(&rec->cond, NULL);
+    if (pthread_create(&rec->thread, NULL, rec->cfg.source ? event_thread : recorder_thread, rec) != 0) {
+        fprintf(stderr, "Could not start recorder thread\n");
+        goto fail;
+    }
+    return rec;
+
+fail:
+    uring_free(rec->u);
+    free(rec->seg.chunk);
+    free(rec->seg.spare);
+    free(rec->queue);
+    avcodec_parameters_free(&rec->par);
+    free(rec->segs);
+    free(rec);
+    return NULL;
+}
+
+int recorder_push(struct recorder *rec, const AVPacket *pkt)
+{
+    // 인코더 패킷은 참조 카운트 버퍼라서 clone은 데이터 복사 없이 참조만 늘림
+    AVPacket *ref = av_packet_clone(pkt);
+    int key = pkt->flags & AV_PKT_FLAG_KEY;
+
+    pthread_mutex_lock(&rec->lock);
+    if (!ref || rec->q_len == rec->cfg.queue_len || (rec->need_key && !key)) {
+        // 디스크가 못 따라오는 경우 캡처를 멈추는 대신 녹화 쪽에서 버림
+        rec->dropped++;
+        rec->need_key = 1;
+        pthread_mutex_unlock(&rec->lock);
+        av_packet_free(&ref);
+        return -1;
+    }
+    rec->need_key = 0;
+    rec->queue[(rec->q_head + rec->q_len) % rec->cfg.queue_len] = ref;
+    rec->q_len++;
+    pthread_cond_signal(&rec->cond);
+    pthread_mutex_unlock(&rec->lock);
+    return 0;
+}
+
+unsigned long recorder_dropped(struct recorder *rec)
+{
+    unsigned long n;
+    pthread_mutex_lock(&rec->lock);
+    n = rec->dropped;
+    pthread_mutex_unlock(&rec->lock);
+    return n;
+}
+
+void recorder_close(struct recorder *rec)
+{
+    if (!rec) return;
+
+    pthread_mutex_lock(&rec->lock);
+    rec->stop = 1;
+    pthread_cond_signal(&rec->cond);
+    pthread_mutex_unlock(&rec->lock);
+    pthread_join(rec->thread, NULL);
+
+    pthread_mutex_destroy(&rec->lock);
+    pthread_cond_destroy(&rec->cond);
+    uring_free(rec->u);
+    free(rec->seg.chunk);
+    free(rec->seg.spare);
+    free(rec->queue);
+    avcodec_parameters_free(&rec->par);
+    free(rec->segs);
+    free(rec);
+}
@@ -0,0 +1,47 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stddef.h>
+#include <libavcodec/avcodec.h>
+
+// 세그먼트 파일을 디스크에 언제 동기화(fsync)할지
+enum fsync_policy {
+    FSYNC_NONE,       // 커널에 맡김
+    FSYNC_SEGMENT,    // 세그먼트를 닫을 때마다 한번
+    FSYNC_INTERVAL    // fsync_bytes 만큼 쓸 때마다
+};
+
+struct prebuffer;
+
+struct recorder_config {
+    const char *dir;             // 세그먼트 저장 디렉터리
+    const char *prefix;          // 파일 이름 접두사 (prefix-YYYYmmdd-HHMMSS.mp4)
+    int segment_sec;             // 세그먼트 길이(초). 실제 경계는 그 이후 첫 키프레임
+    long long max_total_bytes;   // 보관 용량 제한 (0이면 제한 없음)
+    int max_age_sec;             // 보관 기간 제한 (0이면 제한 없음)
+    enum fsync_policy fsync;
+    long long fsync_bytes;       // FSYNC_INTERVAL 일때의 간격
+    int queue_len;               // 캡처 스레드와 I/O 스레드 사이의 패킷 큐 길이
+    size_t write_chunk;          // 한번에 write() 할 크기 (4096의 배수)
+    int use_uring;               // 1 이면 io_uring 으로 chunk 를 비동기로 씀 (버퍼 두 개를 번갈아 씀)
+                                 // 커널이 지원하지 않으면 write() 로
+    struct prebuffer *source;    // 설정하면 이벤트 녹화: 트리거된 구간만 prebuffer 에서 읽어서 씀
+};
+
+struct recorder;
+
+void recorder_config_default(struct recorder_config *cfg);
+
+// enc는 이미 열린 인코더. AV_CODEC_FLAG_GLOBAL_HEADER 로 열어야 extradata(SPS/PPS)가 mp4 헤더에 들어간다
+struct recorder *recorder_open(const struct recorder_config *cfg, const AVCodecContext *enc);
+
+// 캡처(인코딩) 스레드에서 호출. 절대 블록되지 않으며 큐가 가득 차면 패킷을 버리고 -1 반환
+// 이벤트 녹화(source 설정)일 때는 쓰지 않고 prebuffer_push 를 사용
+int recorder_push(struct recorder *rec, const AVPacket *pkt);
+
+// 큐를 모두 비우고 현재 세그먼트를 닫은 뒤 I/O 스레드를 종료
+void recorder_close(struct recorder *rec);
+
+unsigned long recorder_dropped(struct recorder *rec);
+
+#endif // RECORDER_H
@@ -0,0 +1,329 @@
+// 빌드: gcc -O2 -o shm_bench shm_bench.c shmring.c capture.c h264nal.c stats.c -lrt
+// 실행: ./shm_bench [-s WxH] [-n frames] [-r readers] [-f fps]
+
+// 같은 장비의 여러 프로세스에 프레임을 나눠주는 두 방법 비교
+//   shm : shmring 에 한 번 복사, 읽는 프로세스는 capture "shm:" 소스로 공유 메모리를 바로 읽음
+//   tcp : 127.0.0.1 로 읽는 프로세스마다 writev (video_server 처럼). 커널이 보낼 때/받을 때 복사
+// 읽는 쪽은 두 경우 모두 프레임 전체를 한 번 훑음 (실제 소비자처럼 데이터를 읽는 비용 포함)
+// 쓰는 쪽 CPU(프레임당), 읽는 쪽 CPU, 쓰기 -> 받기 지연을 BENCH 줄로 출력
+// -f 0 이면 기다리지 않고 최대한 빨리 (tcp 는 가장 느린 읽는 쪽에 맞춰지고 shm 은 느린 쪽이 건너뜀)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "capture.h"
+#include "shmring.h"
+#include "proto.h"
+#include "stats.h"
+
+#define RING_NAME "shm_bench"
+#define RING_SLOTS 4
+#define MAX_READERS 16
+
+// 읽는 프로세스가 끝에 파이프로 돌려주는 결과
+struct result {
+    unsigned long frames;
+    unsigned long dropped;
+    unsigned long torn;          // 다 읽기 전에 덮어쓰인 프레임 (shm)
+    int64_t p50, p99;            // 지연 ns
+    uint64_t sum;                // 데이터를 실제로 읽었다는 표시 (최적화로 없어지지 않게)
+};
+
+static uint64_t touch(const unsigned char *p, size_t n)
+{
+    const uint64_t *w = (const uint64_t *)p;
+    uint64_t s = 0;
+    for (size_t i = 0; i < n / 8; i++)
+        s += w[i];
+    return s;
+}
+
+static void send_result(int fd, struct stats *lat, struct result *res)
+{
+    res->p50 = stats_percentile(lat, 50);
+    res->p99 = stats_percentile(lat, 99);
+    if (write(fd, res, sizeof(*res)) != sizeof(*res))
+        perror("write result");
+}
+
+static void shm_reader(int ready, int out)
+{
+    struct capture_config cfg;
+    struct capture *cap;
+    struct capture_frame f;
+    struct capture_stats st;
+    struct stats lat;
+    struct result res;
+    int r;
+
+    memset(&res, 0, sizeof(res));
+    stats_init(&lat, "shm");
+    capture_config_default(&cfg);
+    cfg.source = "shm:" RING_NAME;
+    cap = capture_open(&cfg);
+    if (write(ready, "r", 1) != 1 || !cap)
+        exit(EXIT_FAILURE);
+
+    while ((r = capture_read(cap, &f, 5000)) == 1) {
+        stats_add(&lat, stats_now() - f.timestamp_us * 1000);
+        res.sum += touch(f.data, f.bytesused);
+        capture_release(cap, &f);
+    }
+    capture_get_stats(cap, &st);
+    res.frames = st.frames;
+    res.dropped = st.dropped;
+    res.torn = st.errors;
+    capture_close(cap);
+    send_result(out, &lat, &res);
+    stats_free(&lat);
+}
+
+static void tcp_reader(int port, int ready, int out)
+{
+    struct sockaddr_in addr;
+    struct stats lat;
+    struct result res;
+    unsigned char *buf = NULL;
+    size_t cap = 0;
+    unsigned int last = 0;
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&res, 0, sizeof(res));
+    stats_init(&lat, "tcp");
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        exit(EXIT_FAILURE);
+    }
+    if (write(ready, "r", 1) != 1)
+        exit(EXIT_FAILURE);
+
+    while (1) {
+        struct frame_header h;
+        int64_t us;
+        if (recv(s, &h, sizeof(h), MSG_WAITALL) != sizeof(h) || frame_header_unpack(&h, &us) < 0)
+            break;
+        if (h.size > cap) {
+            cap = h.size;
+            buf = realloc(buf, cap);
+        }
+        if (recv(s, buf, h.size, MSG_WAITALL) != (ssize_t)h.size)
+            break;
+        // 헤더의 시각은 CLOCK_MONOTONIC 그대로 (같은 장비)
+        stats_add(&lat, stats_now() - us * 1000);
+        res.sum += touch(buf, h.size);
+        if (res.frames && h.sequence - last > 1)
+            res.dropped += h.sequence - last - 1;
+        last = h.sequence;
+        res.frames++;
+    }
+    close(s);
+    free(buf);
+    send_result(out, &lat, &res);
+    stats_free(&lat);
+}
+
+static int listen_loopback(int *port)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (s < 0 || bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(s, MAX_READERS) < 0 ||
+        getsockname(s, (struct sockaddr *)&addr, &len) < 0) {
+        perror("listen");
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return s;
+}
+
+static double cpu_us(const struct rusage *a, const struct rusage *b)
+{
+    return (b->ru_utime.tv_sec - a->ru_utime.tv_sec) * 1e6 + (b->ru_utime.tv_usec - a->ru_utime.tv_usec) +
+           (b->ru_stime.tv_sec - a->ru_stime.tv_sec) * 1e6 + (b->ru_stime.tv_usec - a->ru_stime.tv_usec);
+}
+
+// 한 방법으로 frames 장을 readers 개 프로세스에 나눠줌
+static int run(const char *mode, const struct capture_config *ccfg, int frames, int readers)
+{
+    struct capture *cap = capture_open(ccfg);
+    struct capture_format fmt;
+    struct shmring *ring = NULL;
+    struct rusage w0, w1, c0, c1;
+    int tcp = !strcmp(mode, "tcp");
+    int lsock = -1, port = 0;
+    int socks[MAX_READERS];
+    int ready[2], out[2];
+    pid_t pids[MAX_READERS];
+    char c;
+
+    if (!cap)
+        return -1;
+    capture_get_format(cap, &fmt);
+    if (tcp) {
+        lsock = listen_loopback(&port);
+        if (lsock < 0)
+            return -1;
+    } else {
+        ring = shmring_create(RING_NAME, &fmt, RING_SLOTS);
+        if (!ring)
+            return -1;
+    }
+    if (pipe(ready) < 0 || pipe(out) < 0) {
+        perror("pipe");
+        return -1;
+    }
+    getrusage(RUSAGE_CHILDREN, &c0);
+
+    for (int i = 0; i < readers; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            close(ready[0]);
+            close(out[0]);
+            if (tcp)
+                tcp_reader(port, ready[1], out[1]);
+            else
+                shm_reader(ready[1], out[1]);
+            _exit(EXIT_SUCCESS);
+        }
+    }
+    close(ready[1]);
+    close(out[1]);
+    // 모든 읽는 쪽이 준비된 뒤부터 (shm 은 연 뒤에 발행된 프레임부터 받음)
+    for (int i = 0; i < readers; i++) {
+        if (read(ready[0], &c, 1) != 1) {
+            fprintf(stderr, "%s: reader failed to start\n", mode);
+            return -1;
+        }
+        if (tcp)
+            socks[i] = accept(lsock, NULL, NULL);
+    }
+
+    getrusage(RUSAGE_SELF, &w0);
+    int64_t start = stats_now();
+    for (int n = 0; n < frames; ) {
+        struct capture_frame f;
+        int r = capture_read(cap, &f, 2000);
+        if (r < 0)
+            break;
+        if (r == 0)
+            continue;
+        // 지연은 나눠주기 시작한 시각부터
+        f.timestamp_us = stats_now() / 1000;
+        if (tcp) {
+            struct frame_header h;
+            struct iovec iov[2] = { { &h, sizeof(h) }, { (void *)f.data, f.bytesused } };
+            frame_header_pack(&h, f.sequence, f.width, f.height, f.bytesused, f.timestamp_us);
+            for (int i = 0; i < readers; i++) {
+                size_t want = sizeof(h) + f.bytesused;
+                // 블로킹 소켓이라 다 보낼 때까지 기다림 (느린 읽는 쪽이 쓰는 쪽을 붙잡음)
+                if (writev(socks[i], iov, 2) != (ssize_t)want) {
+                    perror("writev");
+                    return -1;
+                }
+            }
+        } else {
+            shmring_publish(ring, &f);
+        }
+        capture_release(cap, &f);
+        n++;
+    }
+    int64_t wall = stats_now() - start;
+    getrusage(RUSAGE_SELF, &w1);
+
+    if (tcp) {
+        for (int i = 0; i < readers; i++)
+            close(socks[i]);
+        close(lsock);
+    } else {
+        shmring_close(ring);
+    }
+
+    struct result sum;
+    int64_t p50 = 0, p99 = 0;
+    memset(&sum, 0, sizeof(sum));
+    for (int i = 0; i < readers; i++) {
+        struct result res;
+        if (read(out[0], &res, sizeof(res)) != sizeof(res))
+            break;
+        sum.frames += res.frames;
+        sum.dropped += res.dropped;
+        sum.torn += res.torn;
+        p50 += res.p50 / readers;
+        if (res.p99 > p99)
+            p99 = res.p99;
+    }
+    for (int i = 0; i < readers; i++)
+        waitpid(pids[i], NULL, 0);
+    getrusage(RUSAGE_CHILDREN, &c1);
+    close(ready[0]);
+    close(out[0]);
+    capture_close(cap);
+
+    printf("BENCH shm mode=%s readers=%d size=%dx%d fps=%.1f writer_cpu_us=%.1f reader_cpu_us=%.1f"
+           " lat_p50_us=%.1f lat_p99_us=%.1f received=%lu dropped=%lu torn=%lu\n",
+           mode, readers, fmt.width, fmt.height, frames * 1e9 / wall, cpu_us(&w0, &w1) / frames,
+           cpu_us(&c0, &c1) / frames / readers, p50 / 1e3, p99 / 1e3, sum.frames, sum.dropped, sum.torn);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct capture_config ccfg;
+    int frames = 300;
+    int readers = 3;
+    int fps = 30;
+    int opt;
+
+    capture_config_default(&ccfg);
+    ccfg.width = 1280;
+    ccfg.height = 720;
+    ccfg.buffers = 4;
+
+    // -s : 프레임 크기 (YUYV)
+    // -n : 나눠줄 프레임 수
+    // -r : 읽는 프로세스 수
+    // -f : 보내는 속도. 0 이면 최대한 빨리
+    while ((opt = getopt(argc, argv, "s:n:r:f:")) != -1) {
+        if (opt == 's') {
+            if (capture_parse_spec(&ccfg, optarg) < 0)
+                return EXIT_FAILURE;
+        } else if (opt == 'n') {
+            frames = atoi(optarg);
+        } else if (opt == 'r') {
+            readers = atoi(optarg);
+        } else if (opt == 'f') {
+            fps = atoi(optarg);
+        } else {
+            fprintf(stderr, "Usage: %s [-s WxH] [-n frames] [-r readers] [-f fps]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (readers < 1 || readers > MAX_READERS || frames < 1) {
+        fprintf(stderr, "readers 1..%d, frames > 0\n", MAX_READERS);
+        return EXIT_FAILURE;
+    }
+    ccfg.source = fps > 0 ? "synth" : "synth:fast";
+    ccfg.fps = fps;
+    signal(SIGPIPE, SIG_IGN);
+
+    if (run("shm", &ccfg, frames, readers) < 0 || run("tcp", &ccfg, frames, readers) < 0)
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "shmring.h"
+
+#define SHMRING_MAGIC 0x53484d31    // "SHM1"
+#define ALIGN 64                    // 슬롯 헤더와 데이터를 캐시 라인에 맞춤
+
+// 공유 메모리 맨 앞. 쓰는 쪽만 씀
+struct shm_header {
+    uint32_t magic;                 // 초기화가 끝난 뒤에 씀 (읽는 쪽이 반쯤 만든 것을 보지 않게)
+    uint32_t slots;
+    uint64_t slot_bytes;            // 슬롯 간격 (슬롯 헤더 + 데이터)
+    uint64_t sizeimage;             // 슬롯 하나에 들어가는 데이터 최대 크기
+    uint32_t pixelformat, width, height, stride, fps;
+    uint32_t closed;                // 쓰는 쪽이 끝남
+    uint32_t futex;                 // 발행할 때마다 +1. 읽는 쪽은 이 값이 바뀌기를 FUTEX_WAIT
+    uint64_t head;                  // 지금까지 발행한 프레임 수. 프레임 n 은 슬롯 n % slots
+};
+
+// 슬롯마다 데이터 앞에 붙는 헤더
+struct shm_slot {
+    uint64_t seq;                   // seqlock. 쓰는 동안 홀수
+    uint64_t frame;                 // 들어 있는 프레임의 발행 번호
+    uint64_t bytesused;
+    int64_t timestamp_us;
+    uint32_t sequence;
+    uint32_t pixelformat, width, height, stride;
+};
+
+struct shmring {
+    int writer;
+    int latest;
+    char path[NAME_MAX];
+    unsigned char *mem;
+    size_t len;
+    struct shm_header *hdr;
+    uint64_t next;                  // 읽는 쪽: 다음에 읽을 발행 번호
+    uint64_t *taken;                // 읽는 쪽: 슬롯별로 읽을 때 본 seq (release 에서 비교)
+};
+
+static size_t align_up(size_t n)
+{
+    return (n + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+}
+
+static struct shm_slot *slot_at(struct shmring *r, unsigned int i)
+{
+    return (struct shm_slot *)(r->mem + align_up(sizeof(struct shm_header)) + i * r->hdr->slot_bytes);
+}
+
+static unsigned char *slot_data(struct shm_slot *s)
+{
+    return (unsigned char *)s + align_up(sizeof(*s));
+}
+
+static void set_path(struct shmring *r, const char *name)
+{
+    snprintf(r->path, sizeof(r->path), "/%s", name[0] == '/' ? name + 1 : name);
+}
+
+struct shmring *shmring_create(const char *name, const struct capture_format *fmt, int slots)
+{
+    struct shmring *r = calloc(1, sizeof(*r));
+    size_t slot_bytes = align_up(sizeof(struct shm_slot)) + align_up(fmt->sizeimage);
+    int fd;
+
+    if (!r) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+    if (slots < 2)
+        slots = 2;
+    r->writer = 1;
+    set_path(r, name);
+    r->len = align_up(sizeof(struct shm_header)) + slots * slot_bytes;
+
+    // 이전에 죽은 쓰는 쪽이 남긴 것은 지움 (열어둔 읽는 쪽은 옛 메모리를 계속 봄)
+    shm_unlink(r->path);
+    fd = shm_open(r->path, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd == -1) {
+        perror(r->path);
+        free(r);
+        return NULL;
+    }
+    if (ftruncate(fd, r->len) == -1) {
+        perror("ftruncate");
+        close(fd);
+        shm_unlink(r->path);
+        free(r);
+        return NULL;
+    }
+    r->mem = mmap(NULL, r->len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (r->mem == MAP_FAILED) {
+        perror("mmap");
+        shm_unlink(r->path);
+        free(r);
+        return NULL;
+    }
+
+    r->hdr = (struct shm_header *)r->mem;
+    r->hdr->slots = slots;
+    r->hdr->slot_bytes = slot_bytes;
+    r->hdr->sizeimage = fmt->sizeimage;
+    r->hdr->pixelformat = fmt->pixelformat;
+    r->hdr->width = fmt->width;
+    r->hdr->height = fmt->height;
+    r->hdr->stride = fmt->stride;
+    r->hdr->fps = fmt->fps;
+    __atomic_store_n(&r->hdr->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+    return r;
+}
+
+void shmring_publish(struct shmring *r, const struct capture_frame *f)
+{
+    struct shm_header *h = r->hdr;
+    uint64_t n = h->head;
+    struct shm_slot *s = slot_at(r, n % h->slots);
+    uint64_t seq = s->seq;
+    size_t size = f->bytesused < h->sizeimage ? f->bytesused : h->sizeimage;
+
+    // 홀수로 바꾼 것이 데이터보다 먼저 보이게 (읽는 쪽이 쓰는 중인 슬롯을 알아봄)
+    __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(slot_data(s), f->data, size);
+    s->frame = n;
+    s->bytesused = size;
+    s->timestamp_us = f->timestamp_us;
+    s->sequence = f->sequence;
+    s->pixelformat = f->pixelformat;
+    s->width = f->width;
+    s->height = f->height;
+    s->stride = f->stride;
+
+    __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&h->head, n + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&h->futex, 1, __ATOMIC_RELEASE);
+    // 기다리는 쪽이 없으면 커널은 바로 돌아옴 (프레임당 시스템 콜 한 번)
+    syscall(SYS_futex, &h->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+struct shmring *shmring_open(const char *name, int latest)
+{
+    struct shmring *r = calloc(1, sizeof(*r));
+    struct stat sb;
+    int fd;
+
+    if (!r) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+    r->latest = latest;
+    set_path(r, name);
+    fd = shm_open(r->path, O_RDONLY, 0);
+    if (fd == -1 || fstat(fd, &sb) == -1) {
+        perror(r->path);
+        if (fd != -1)
+            close(fd);
+        free(r);
+        return NULL;
+    }
+    // 읽는 쪽은 읽기 전용. 잘못 써서 다른 프로세스의 프레임을 망가뜨릴 일이 없음
+    r->len = sb.st_size;
+    r->mem = r->len >= sizeof(struct shm_header) ? mmap(NULL, r->len, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (r->mem == MAP_FAILED) {
+        fprintf(stderr, "%s: could not map\n", r->path);
+        free(r);
+        return NULL;
+    }
+    r->hdr = (struct shm_header *)r->mem;
+    if (__atomic_load_n(&r->hdr->magic, __ATOMIC_ACQUIRE) != SHMRING_MAGIC ||
+        align_up(sizeof(struct shm_header)) + r->hdr->slots * r->hdr->slot_bytes > r->len) {
+        fprintf(stderr, "%s: not a frame ring (or writer still starting)\n", r->path);
+        munmap(r->mem, r->len);
+        free(r);
+        return NULL;
+    }
+    r->taken = calloc(r->hdr->slots, sizeof(*r->taken));
+    if (!r->taken) {
+        munmap(r->mem, r->len);
+        free(r);
+        return NULL;
+    }
+    // 연 뒤에 발행되는 프레임부터
+    r->next = __atomic_load_n(&r->hdr->head, __ATOMIC_ACQUIRE);
+    return r;
+}
+
+void shmring_get_format(struct shmring *r, struct capture_format *fmt)
+{
+    fmt->pixelformat = r->hdr->pixelformat;
+    fmt->width = r->hdr->width;
+    fmt->height = r->hdr->height;
+    fmt->stride = r->hdr->stride;
+    fmt->sizeimage = r->hdr->sizeimage;
+    fmt->fps = r->hdr->fps;
+    fmt->buffers = r->hdr->slots;
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int shmring_read(struct shmring *r, struct capture_frame *f, int timeout_ms)
+{
+    struct shm_header *h = r->hdr;
+    int64_t deadline = now_ms() + timeout_ms;
+
+    while (1) {
+        // futex 값을 먼저 읽어야 head 를 본 뒤에 발행된 프레임의 깨움을 놓치지 않음
+        uint32_t wake = __atomic_load_n(&h->futex, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+
+        if (head > r->next) {
+            // 슬롯 수만큼 밀렸으면 남은 것도 곧 덮어써지므로 최신으로 건너뜀
+            if (r->latest || head - r->next >= h->slots)
+                r->next = head - 1;
+            unsigned int i = r->next % h->slots;
+            struct shm_slot *s = slot_at(r, i);
+            uint64_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+            if ((seq & 1) || s->frame != r->next)
+                continue;    // 그새 쓰는 쪽이 한 바퀴 돌아옴. head 를 다시 봄
+
+            f->data = slot_data(s);
+            f->bytesused = s->bytesused;
+            f->pixelformat = s->pixelformat;
+            f->width = s->width;
+            f->height = s->height;
+            f->stride = s->stride;
+            f->sequence = s->sequence;
+            f->timestamp_us = s->timestamp_us;
+            f->index = i;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq)
+                continue;
+            r->taken[i] = seq;
+            r->next++;
+            return 1;
+        }
+        if (__atomic_load_n(&h->closed, __ATOMIC_ACQUIRE))
+            return -1;
+
+        int64_t left = deadline - now_ms();
+        if (left <= 0)
+            return 0;
+        struct timespec ts = { left / 1000, (left % 1000) * 1000000 };
+        if (syscall(SYS_futex, &h->futex, FUTEX_WAIT, wake, &ts, NULL, 0) == -1 &&
+            errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+            perror("futex");
+            return -1;
+        }
+    }
+}
+
+int shmring_release(struct shmring *r, const struct capture_frame *f)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot_at(r, f->index)->seq, __ATOMIC_RELAXED) == r->taken[f->index];
+}
+
+void shmring_close(struct shmring *r)
+{
+    if (!r)
+        return;
+    if (r->writer) {
+        __atomic_store_n(&r->hdr->closed, 1, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&r->hdr->futex, 1, __ATOMIC_RELEASE);
+        syscall(SYS_futex, &r->hdr->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+        shm_unlink(r->path);
+    }
+    munmap(r->mem, r->len);
+    free(r->taken);
+    free(r);
+}
@@ -0,0 +1,43 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include "capture.h"
+
+// 같은 장비의 여러 프로세스(녹화, 움직임 감지, 로컬 화면)에 프레임을 나눠주는 POSIX 공유 메모리 링
+// 쓰는 쪽 하나가 프레임을 슬롯에 한 번 복사하고, 읽는 쪽은 슬롯을 그대로 가리켜서 씀 (읽는 쪽 복사 없음)
+// TCP 로 나눠주면 받는 프로세스마다 커널 복사(보내기 + 받기)가 생김
+//
+// - 슬롯마다 seqlock: 쓰는 동안 번호가 홀수. 읽는 쪽은 다 쓴 뒤에 번호가 그대로인지로 덮어쓰였는지 확인
+// - 쓰는 쪽은 읽는 쪽을 절대 기다리지 않음. 가장 오래된 슬롯을 덮어씀
+//   읽는 쪽이 슬롯 수만큼 밀리면 최신 프레임으로 건너뜀 (capture_frame.dropped 로 보임)
+// - 새 프레임 알림은 futex (공유 메모리 안의 카운터). 읽는 쪽은 메모리를 읽기 전용으로만 엶
+//
+// 읽는 쪽은 capture 의 "shm:NAME" 소스로 쓰면 됨 (capture_read / capture_release)
+
+struct shmring;
+
+// 쓰는 쪽. name 은 "video0" 처럼 (/dev/shm/video0). 같은 이름이 있으면 새로 만듦
+// fmt 의 sizeimage 가 슬롯 하나의 크기. slots 는 2 이상
+struct shmring *shmring_create(const char *name, const struct capture_format *fmt, int slots);
+
+// 프레임을 다음 슬롯에 복사하고 기다리는 읽는 쪽을 깨움
+void shmring_publish(struct shmring *r, const struct capture_frame *f);
+
+// 읽는 쪽. 쓰는 쪽이 아직 없으면 NULL
+// latest 가 1 이면 항상 가장 최신 프레임만 (화면 출력처럼 밀린 프레임이 필요 없을 때)
+struct shmring *shmring_open(const char *name, int latest);
+
+void shmring_get_format(struct shmring *r, struct capture_format *fmt);
+
+// 1 = 프레임, 0 = timeout_ms 안에 새 프레임 없음, -1 = 쓰는 쪽이 끝남
+// f->data 는 공유 메모리 안을 바로 가리킴. 쓰는 쪽이 슬롯 수만큼 앞서가면 덮어써질 수 있으므로
+// 다 쓴 뒤 shmring_release 로 확인
+int shmring_read(struct shmring *r, struct capture_frame *f, int timeout_ms);
+
+// 1 = 읽는 동안 덮어쓰이지 않음, 0 = 덮어쓰임 (그 프레임으로 만든 결과는 버려야 함)
+int shmring_release(struct shmring *r, const struct capture_frame *f);
+
+// 쓰는 쪽이면 이름도 지움 (이미 열어둔 읽는 쪽은 계속 쓸 수 있고 -1 을 받음)
+void shmring_close(struct shmring *r);
+
+#endif // SHMRING_H
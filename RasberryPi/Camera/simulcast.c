@@ -0,0 +1,357 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+
+#include "simulcast.h"
+#include "capture_av.h"
+#include "yuvscale.h"
+
+#define POOL 3    // 화질마다 피라미드 프레임: 만드는 중, 인코더를 기다리는 것, 인코딩 중
+#define MIN_SIZE 16
+
+struct level {
+    struct simulcast *s;
+    int index;
+    int width, height;
+    AVFrame *pool[POOL];
+    AVCodecContext *enc;
+    AVPacket *pkt;
+    pthread_t thread;
+    int started;
+    pthread_cond_t cond;         // next 가 생김 / 끝
+
+    // 아래는 s->lock 으로 보호
+    AVFrame *next;               // 인코딩을 기다리는 프레임 (pool 의 참조). 하나만 두고 밀리면 새 것으로 바꿈
+    unsigned int next_seq;
+    int64_t next_us;
+    int keyframe;                // 다음 프레임을 IDR 로
+    struct simulcast_stats st;
+    double encode_total_ms;
+};
+
+struct simulcast {
+    struct simulcast_config cfg;
+    struct capture_format fmt;
+    struct SwsContext *sws;      // 캡처 포맷 -> level 0 YUV420P
+    int32_t *xt;                 // yuvscale_plane 작업 공간 (캡처 스레드만 씀)
+    struct level lv[SIMULCAST_MAX];
+    int64_t first_us;
+    int64_t last_pts;
+
+    pthread_mutex_t lock;
+    int done;
+};
+
+void simulcast_config_default(struct simulcast_config *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->levels = 3;
+    cfg->kbps[0] = 2000;
+    cfg->kbps[1] = 700;
+    cfg->kbps[2] = 250;
+    cfg->kbps[3] = 100;
+}
+
+// 인코더나 next 가 잡고 있지 않은 피라미드 프레임. 모두 잡혀 있으면 하나를 새 버퍼로 바꿈
+static AVFrame *take_free(struct level *l)
+{
+    for (int i = 0; i < POOL; i++)
+        if (av_frame_is_writable(l->pool[i]))
+            return l->pool[i];
+    if (av_frame_make_writable(l->pool[0]) == 0)
+        return l->pool[0];
+    return NULL;
+}
+
+// 캡처 시각 -> pts (h264_encoding 과 같은 방식). 모든 화질이 같은 pts 를 씀
+static int64_t frame_pts(struct simulcast *s, int64_t timestamp_us)
+{
+    if (s->first_us < 0)
+        s->first_us = timestamp_us;
+    int64_t pts = av_rescale(timestamp_us - s->first_us, s->cfg.fps, 1000000);
+    if (pts <= s->last_pts)
+        pts = s->last_pts + 1;
+    s->last_pts = pts;
+    return pts;
+}
+
+// 프레임 하나(NULL 이면 남은 것)를 인코딩해서 나온 패킷을 내보냄. 내보낸 바이트 수
+static size_t encode(struct level *l, AVFrame *frame, unsigned int seq, int64_t timestamp_us)
+{
+    struct simulcast *s = l->s;
+    struct simulcast_packet p = { l->index, l->pkt, seq, timestamp_us };
+    size_t bytes = 0;
+    int ret;
+
+    ret = avcodec_send_frame(l->enc, frame);
+    if (ret < 0) {
+        fprintf(stderr, "simulcast %dx%d: error sending frame for encoding\n", l->width, l->height);
+        return 0;
+    }
+    while ((ret = avcodec_receive_packet(l->enc, l->pkt)) >= 0) {
+        s->cfg.out(s->cfg.arg, &p);
+        bytes += l->pkt->size;
+        av_packet_unref(l->pkt);
+    }
+    if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+        fprintf(stderr, "simulcast %dx%d: error during encoding\n", l->width, l->height);
+    return bytes;
+}
+
+static void *encode_thread(void *arg)
+{
+    struct level *l = arg;
+    struct simulcast *s = l->s;
+    unsigned int seq = 0;
+    int64_t us = 0;
+    char name[16];
+
+    snprintf(name, sizeof(name), "simulcast%d", l->index);
+    pthread_setname_np(pthread_self(), name);
+
+    pthread_mutex_lock(&s->lock);
+    while (1) {
+        AVFrame *f = l->next;
+        if (!f) {
+            if (s->done)
+                break;
+            pthread_cond_wait(&l->cond, &s->lock);
+            continue;
+        }
+        l->next = NULL;
+        seq = l->next_seq;
+        us = l->next_us;
+        f->pict_type = l->keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+        l->keyframe = 0;
+        pthread_mutex_unlock(&s->lock);
+
+        int64_t t0 = capture_now_us();
+        size_t bytes = encode(l, f, seq, us);
+        double ms = (capture_now_us() - t0) / 1e3;
+        av_frame_free(&f);
+
+        pthread_mutex_lock(&s->lock);
+        l->st.frames++;
+        l->st.bytes += bytes;
+        l->encode_total_ms += ms;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    // 인코더 안에 남은 프레임 (zerolatency 라 보통 없음)
+    encode(l, NULL, seq, us);
+    return NULL;
+}
+
+static int open_level(struct simulcast *s, struct level *l)
+{
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+
+    if (!codec) {
+        fprintf(stderr, "Codec not found\n");
+        return -1;
+    }
+    for (int i = 0; i < POOL; i++) {
+        l->pool[i] = av_frame_alloc();
+        if (!l->pool[i])
+            return -1;
+        l->pool[i]->format = AV_PIX_FMT_YUV420P;
+        l->pool[i]->width = l->width;
+        l->pool[i]->height = l->height;
+        if (av_frame_get_buffer(l->pool[i], 32) < 0)
+            return -1;
+    }
+    l->pkt = av_packet_alloc();
+    l->enc = avcodec_alloc_context3(codec);
+    if (!l->pkt || !l->enc)
+        return -1;
+    l->enc->bit_rate = (int64_t)s->cfg.kbps[l->index] * 1000;
+    l->enc->width = l->width;
+    l->enc->height = l->height;
+    l->enc->time_base = (AVRational){1, s->cfg.fps};
+    l->enc->gop_size = s->cfg.gop;
+    l->enc->max_b_frames = 0;
+    l->enc->pix_fmt = AV_PIX_FMT_YUV420P;
+    // 화질마다 스레드가 따로 있으므로 인코더 하나는 스레드 하나
+    // zerolatency: lookahead 와 프레임 스레드가 없어서 넣은 프레임이 바로 패킷으로 나옴 (실시간 전송용)
+    // GLOBAL_HEADER 를 켜지 않아서 SPS/PPS 가 키프레임마다 스트림 안에 들어감
+    l->enc->thread_count = 1;
+    av_opt_set(l->enc->priv_data, "preset", "ultrafast", 0);
+    av_opt_set(l->enc->priv_data, "tune", "zerolatency", 0);
+    if (avcodec_open2(l->enc, codec, NULL) < 0) {
+        fprintf(stderr, "simulcast: could not open codec for %dx%d\n", l->width, l->height);
+        return -1;
+    }
+    return 0;
+}
+
+struct simulcast *simulcast_open(const struct simulcast_config *cfg, const struct capture_format *fmt)
+{
+    struct simulcast *s = calloc(1, sizeof(*s));
+
+    if (!s) {
+        fprintf(stderr, "Out of memory\n");
+        return NULL;
+    }
+    s->cfg = *cfg;
+    s->fmt = *fmt;
+    s->first_us = -1;
+    s->last_pts = -1;
+    pthread_mutex_init(&s->lock, NULL);
+    for (int i = 0; i < SIMULCAST_MAX; i++) {
+        s->lv[i].s = s;
+        s->lv[i].index = i;
+        pthread_cond_init(&s->lv[i].cond, NULL);
+    }
+    if (s->cfg.levels < 1 || s->cfg.levels > SIMULCAST_MAX) {
+        fprintf(stderr, "simulcast: %d levels (1..%d)\n", s->cfg.levels, SIMULCAST_MAX);
+        goto fail;
+    }
+    if (capture_av_format(fmt->pixelformat) == AV_PIX_FMT_NONE) {
+        char fourcc[5];
+        fprintf(stderr, "simulcast: no converter for %s\n", capture_fourcc_str(fmt->pixelformat, fourcc));
+        goto fail;
+    }
+    if (s->cfg.fps <= 0)
+        s->cfg.fps = fmt->fps > 0 ? fmt->fps : 25;
+    if (s->cfg.gop <= 0)
+        s->cfg.gop = s->cfg.fps;
+
+    for (int i = 0; i < s->cfg.levels; i++) {
+        struct level *l = &s->lv[i];
+        l->width = i ? (s->lv[i - 1].width / 2) & ~1 : fmt->width & ~1;
+        l->height = i ? (s->lv[i - 1].height / 2) & ~1 : fmt->height & ~1;
+        if (l->width < MIN_SIZE || l->height < MIN_SIZE) {
+            fprintf(stderr, "simulcast: level %d is only %dx%d\n", i, l->width, l->height);
+            goto fail;
+        }
+        if (open_level(s, l) < 0)
+            goto fail;
+    }
+    s->sws = sws_getContext(fmt->width, fmt->height, capture_av_format(fmt->pixelformat), s->lv[0].width, s->lv[0].height,
+                            AV_PIX_FMT_YUV420P, SWS_POINT, NULL, NULL, NULL);
+    s->xt = malloc(fmt->width * sizeof(*s->xt));
+    if (!s->sws || !s->xt)
+        goto fail;
+
+    for (int i = 0; i < s->cfg.levels; i++) {
+        if (pthread_create(&s->lv[i].thread, NULL, encode_thread, &s->lv[i]) != 0) {
+            fprintf(stderr, "simulcast: could not start encoder thread\n");
+            goto fail;
+        }
+        s->lv[i].started = 1;
+    }
+    return s;
+
+fail:
+    simulcast_close(s);
+    return NULL;
+}
+
+void simulcast_close(struct simulcast *s)
+{
+    if (!s)
+        return;
+
+    pthread_mutex_lock(&s->lock);
+    s->done = 1;
+    for (int i = 0; i < SIMULCAST_MAX; i++)
+        pthread_cond_signal(&s->lv[i].cond);
+    pthread_mutex_unlock(&s->lock);
+
+    for (int i = 0; i < SIMULCAST_MAX; i++) {
+        struct level *l = &s->lv[i];
+        if (l->started)
+            pthread_join(l->thread, NULL);
+        av_frame_free(&l->next);
+        for (int k = 0; k < POOL; k++)
+            av_frame_free(&l->pool[k]);
+        avcodec_free_context(&l->enc);
+        av_packet_free(&l->pkt);
+        pthread_cond_destroy(&l->cond);
+    }
+    sws_freeContext(s->sws);
+    free(s->xt);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+int simulcast_push(struct simulcast *s, const struct capture_frame *f)
+{
+    AVFrame *fr[SIMULCAST_MAX];
+    const uint8_t *src[3];
+    int src_stride[3];
+
+    for (int i = 0; i < s->cfg.levels; i++) {
+        fr[i] = take_free(&s->lv[i]);
+        if (!fr[i]) {
+            fprintf(stderr, "simulcast: out of memory\n");
+            return -1;
+        }
+    }
+
+    // level 0: 캡처 포맷 -> YUV420P 변환 한 번
+    capture_planes(f, src, src_stride);
+    sws_scale(s->sws, src, src_stride, 0, f->height, fr[0]->data, fr[0]->linesize);
+
+    // 그 아래는 바로 위 level 을 2:1 로 (입력이 절반씩 줄어서 전체 비용은 level 0 축소의 4/3 이하)
+    for (int i = 1; i < s->cfg.levels; i++) {
+        struct level *up = &s->lv[i - 1], *l = &s->lv[i];
+        for (int p = 0; p < 3; p++) {
+            int sh = p ? 1 : 0;    // 색차 평면은 가로/세로 절반
+            yuvscale_plane(fr[i - 1]->data[p], fr[i - 1]->linesize[p], 1, up->width >> sh, up->height >> sh,
+                           fr[i]->data[p], fr[i]->linesize[p], l->width >> sh, l->height >> sh, s->xt);
+        }
+    }
+
+    int64_t pts = frame_pts(s, f->timestamp_us);
+    pthread_mutex_lock(&s->lock);
+    for (int i = 0; i < s->cfg.levels; i++) {
+        struct level *l = &s->lv[i];
+        if (l->next) {
+            // 인코더가 앞 프레임을 아직 못 가져감: 이 화질만 한 프레임 건너뜀
+            av_frame_free(&l->next);
+            l->st.skipped++;
+        }
+        fr[i]->pts = pts;
+        l->next = av_frame_clone(fr[i]);
+        l->next_seq = f->sequence;
+        l->next_us = f->timestamp_us;
+        pthread_cond_signal(&l->cond);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
+
+void simulcast_request_keyframe(struct simulcast *s, int level)
+{
+    if (level < 0 || level >= s->cfg.levels)
+        return;
+    pthread_mutex_lock(&s->lock);
+    s->lv[level].keyframe = 1;
+    pthread_mutex_unlock(&s->lock);
+}
+
+int simulcast_levels(struct simulcast *s)
+{
+    return s->cfg.levels;
+}
+
+void simulcast_get_size(struct simulcast *s, int level, int *width, int *height)
+{
+    *width = s->lv[level].width;
+    *height = s->lv[level].height;
+}
+
+void simulcast_get_stats(struct simulcast *s, int level, struct simulcast_stats *st)
+{
+    struct level *l = &s->lv[level];
+
+    pthread_mutex_lock(&s->lock);
+    *st = l->st;
+    st->encode_ms = l->st.frames ? l->encode_total_ms / l->st.frames : 0;
+    pthread_mutex_unlock(&s->lock);
+}
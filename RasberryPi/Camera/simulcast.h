@@ -0,0 +1,64 @@
+#ifndef SIMULCAST_H
+#define SIMULCAST_H
+
+#include <libavcodec/avcodec.h>
+
+#include "capture.h"
+
+// 캡처 하나를 여러 화질(해상도/비트레이트)의 H.264 로 동시에 인코딩
+// level 0 은 캡처 크기, level i 는 가로/세로 1/2^i (전체, 절반, 1/4 ...)
+//
+// 캡처 스레드의 simulcast_push 가 피라미드를 한 번에 만듦: 캡처 포맷 -> YUV420P 변환은 level 0 에서 한 번,
+// 그 아래는 바로 위 level 을 2:1 상자 필터(yuvscale)로 줄임. 화질마다 따로 변환/축소하지 않음
+// 인코더는 화질마다 스레드 하나 (libx264 ultrafast/zerolatency, 인코더 안의 스레드는 쓰지 않음)
+// 인코더가 밀리면 그 화질만 기다리던 프레임을 새 것으로 바꿈 (skipped). 캡처는 기다리지 않음
+// SPS/PPS 는 키프레임마다 스트림 안에 붙어서 나감 (중간에 받기 시작해도 키프레임부터 디코딩 가능)
+
+#define SIMULCAST_MAX 4
+
+// 인코더 스레드에서 불림. pkt 는 돌아간 뒤 재사용되므로 필요하면 복사
+struct simulcast_packet {
+    int level;
+    const AVPacket *pkt;       // Annex B
+    unsigned int sequence;     // 이 패킷이 된 캡처 프레임 번호
+    int64_t timestamp_us;      // 그 프레임의 캡처 시각 (CLOCK_MONOTONIC)
+};
+
+typedef void (*simulcast_fn)(void *arg, const struct simulcast_packet *p);
+
+struct simulcast_config {
+    int levels;                   // 1..SIMULCAST_MAX
+    int kbps[SIMULCAST_MAX];      // 화질별 비트레이트
+    int fps;                      // 0 이면 캡처 fps (그것도 모르면 25)
+    int gop;                      // 키프레임 간격 (프레임). 0 이면 1초
+    simulcast_fn out;
+    void *arg;
+};
+
+struct simulcast_stats {
+    unsigned long frames;         // 인코딩한 프레임
+    unsigned long skipped;        // 인코더가 밀려서 건너뛴 프레임
+    unsigned long bytes;
+    double encode_ms;             // 프레임당 평균 인코딩 시간
+};
+
+// 전체 / 절반 / 1/4 : 2000, 700, 250 kbps
+void simulcast_config_default(struct simulcast_config *cfg);
+
+// fmt 는 capture_get_format 값 (YUYV, NV12, YUV420). 인코더를 모두 열고 스레드 시작. 실패하면 NULL
+struct simulcast *simulcast_open(const struct simulcast_config *cfg, const struct capture_format *fmt);
+
+// 남은 프레임을 인코딩해서 내보낸 뒤 닫음
+void simulcast_close(struct simulcast *s);
+
+// 캡처 스레드에서. 피라미드를 만들고 인코더에 넘긴 뒤 바로 돌아옴 (프레임은 복사되므로 바로 release 해도 됨)
+int simulcast_push(struct simulcast *s, const struct capture_frame *f);
+
+// 다음 프레임을 IDR 로 (새로 구독한 클라이언트용)
+void simulcast_request_keyframe(struct simulcast *s, int level);
+
+int simulcast_levels(struct simulcast *s);
+void simulcast_get_size(struct simulcast *s, int level, int *width, int *height);
+void simulcast_get_stats(struct simulcast *s, int level, struct simulcast_stats *st);
+
+#endif // SIMULCAST_H
@@ -0,0 +1,82 @@
+#include <stdlib.h>
+#include <time.h>
+
+#include "stats.h"
+
+void stats_init(struct stats *s, const char *name)
+{
+    s->name = name;
+    s->samples = NULL;
+    s->count = 0;
+    s->cap = 0;
+    s->total = 0;
+    s->max = 0;
+}
+
+void stats_free(struct stats *s)
+{
+    free(s->samples);
+    s->samples = NULL;
+    s->count = s->cap = 0;
+}
+
+int64_t stats_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void stats_add(struct stats *s, int64_t ns)
+{
+    if (s->count == s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 4096;
+        int64_t *p = realloc(s->samples, cap * sizeof(*p));
+        if (!p)
+            return;    // 메모리가 모자라면 샘플만 빠짐. 합계는 계속
+        s->samples = p;
+        s->cap = cap;
+    }
+    s->samples[s->count++] = ns;
+    s->total += ns;
+    if (ns > s->max)
+        s->max = ns;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+int64_t stats_percentile(struct stats *s, double p)
+{
+    size_t i;
+
+    if (s->count == 0)
+        return 0;
+    qsort(s->samples, s->count, sizeof(*s->samples), cmp_i64);
+    // nearest-rank
+    i = (size_t)(p / 100.0 * s->count + 0.5);
+    if (i > 0)
+        i--;
+    if (i >= s->count)
+        i = s->count - 1;
+    return s->samples[i];
+}
+
+void stats_header(FILE *out)
+{
+    fprintf(out, "%-8s %8s %10s %9s %9s %9s %9s %9s\n",
+            "stage", "calls", "total ms", "mean us", "p50 us", "p90 us", "p99 us", "max us");
+}
+
+void stats_print(struct stats *s, FILE *out)
+{
+    double mean = s->count ? (double)s->total / s->count : 0;
+
+    fprintf(out, "%-8s %8zu %10.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+            s->name, s->count, s->total / 1e6, mean / 1e3,
+            stats_percentile(s, 50) / 1e3, stats_percentile(s, 90) / 1e3,
+            stats_percentile(s, 99) / 1e3, s->max / 1e3);
+}
@@ -0,0 +1,33 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// 단계별 소요 시간 기록 (벤치마크용)
+// 호출마다 걸린 시간을 모아뒀다가 끝에 합계/평균/백분위수로 정리
+struct stats {
+    const char *name;
+    int64_t *samples;        // ns
+    size_t count;
+    size_t cap;
+    int64_t total;
+    int64_t max;
+};
+
+void stats_init(struct stats *s, const char *name);
+void stats_free(struct stats *s);
+
+// CLOCK_MONOTONIC 현재 시각 (ns)
+int64_t stats_now(void);
+
+// 한 번 호출에 걸린 시간 (ns)
+void stats_add(struct stats *s, int64_t ns);
+
+// 0 <= p <= 100. 샘플을 정렬하므로 다 모은 뒤에 호출
+int64_t stats_percentile(struct stats *s, double p);
+
+void stats_header(FILE *out);
+void stats_print(struct stats *s, FILE *out);
+
+#endif // STATS_H
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+#include "stats.h"
+
+#define MAX_STAGES 32
+
+struct trace_ev {
+    const char *stage;
+    unsigned int seq;
+    int64_t start;
+    int64_t dur;
+};
+
+// 스레드 하나의 링. 주인 스레드만 쓰고, 내보낼 때만 다른 스레드가 읽음
+struct ring {
+    struct ring *next;
+    int tid;
+    size_t mask;
+    atomic_size_t head;      // 지금까지 기록한 수 (칸 번호는 head & mask)
+    struct trace_ev ev[];
+};
+
+static size_t ring_size;                  // 0 이면 꺼짐
+static _Atomic(struct ring *) rings;      // 모든 스레드의 링. 앞에 붙이기만 함
+static __thread struct ring *mine;
+
+void trace_init(size_t events_per_thread)
+{
+    size_t n = 1;
+
+    while (n < events_per_thread)
+        n <<= 1;
+    ring_size = n;
+}
+
+int64_t trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// 스레드가 처음 기록할 때 한 번만. 목록에 붙이는 것도 CAS 라서 잠금 없음
+static struct ring *new_ring(void)
+{
+    struct ring *r = calloc(1, sizeof(*r) + ring_size * sizeof(r->ev[0]));
+
+    if (!r)
+        return NULL;
+    r->tid = syscall(SYS_gettid);
+    r->mask = ring_size - 1;
+    r->next = atomic_load(&rings);
+    while (!atomic_compare_exchange_weak(&rings, &r->next, r))
+        ;
+    return r;
+}
+
+void trace_event(const char *stage, unsigned int seq, int64_t start_ns, int64_t end_ns)
+{
+    struct ring *r = mine;
+
+    if (!r) {
+        if (!ring_size)
+            return;
+        r = mine = new_ring();
+        if (!r)
+            return;
+    }
+    size_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    struct trace_ev *e = &r->ev[h & r->mask];
+    e->stage = stage;
+    e->seq = seq;
+    e->start = start_ns;
+    e->dur = end_ns - start_ns;
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+// 링에 남아 있는 기록을 오래된 것부터 차례로 넘김
+static void for_each_event(void (*fn)(const struct ring *r, const struct trace_ev *e, void *arg), void *arg)
+{
+    for (struct ring *r = atomic_load(&rings); r; r = r->next) {
+        size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+        size_t n = head < r->mask + 1 ? head : r->mask + 1;
+        for (size_t i = head - n; i < head; i++)
+            fn(r, &r->ev[i & r->mask], arg);
+    }
+}
+
+struct chrome_out {
+    FILE *fp;
+    int pid;
+    int first;
+};
+
+static void write_chrome_event(const struct ring *r, const struct trace_ev *e, void *arg)
+{
+    struct chrome_out *o = arg;
+
+    // 완료 이벤트("X"). ts/dur 단위는 us
+    fprintf(o->fp, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"seq\":%u}}",
+            o->first ? "" : ",", e->stage, o->pid, r->tid, e->start / 1e3, e->dur / 1e3, e->seq);
+    o->first = 0;
+}
+
+int trace_write_chrome(const char *path)
+{
+    struct chrome_out o;
+
+    o.fp = fopen(path, "w");
+    if (!o.fp) {
+        perror(path);
+        return -1;
+    }
+    o.pid = getpid();
+    o.first = 1;
+    fprintf(o.fp, "{\"traceEvents\":[");
+    for_each_event(write_chrome_event, &o);
+    fprintf(o.fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    if (fclose(o.fp) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+struct summary {
+    struct stats st[MAX_STAGES];
+    int n;
+};
+
+static void add_to_summary(const struct ring *r, const struct trace_ev *e, void *arg)
+{
+    struct summary *s = arg;
+    int i;
+
+    for (i = 0; i < s->n; i++)
+        if (s->st[i].name == e->stage || !strcmp(s->st[i].name, e->stage))
+            break;
+    if (i == s->n) {
+        if (s->n == MAX_STAGES)
+            return;
+        stats_init(&s->st[s->n++], e->stage);
+    }
+    stats_add(&s->st[i], e->dur);
+}
+
+void trace_summary(FILE *out)
+{
+    struct summary s;
+
+    s.n = 0;
+    for_each_event(add_to_summary, &s);
+
+    fprintf(out, "%-10s %8s %9s %9s %9s %9s %9s\n",
+            "stage", "events", "mean us", "p50 us", "p95 us", "p99 us", "max us");
+    for (int i = 0; i < s.n; i++) {
+        struct stats *st = &s.st[i];
+        fprintf(out, "%-10s %8zu %9.1f %9.1f %9.1f %9.1f %9.1f\n", st->name, st->count,
+                st->count ? (double)st->total / st->count / 1e3 : 0,
+                stats_percentile(st, 50) / 1e3, stats_percentile(st, 95) / 1e3,
+                stats_percentile(st, 99) / 1e3, st->max / 1e3);
+        stats_free(st);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// 프레임 단위 지연 추적
+// 각 단계(dqbuf, send, recv, draw ...)가 언제 시작해서 얼마나 걸렸는지를 프레임 번호와 함께 기록
+// 스레드마다 고정 크기 링에 쓰기 때문에 잠금이 없고, 한 번 기록에 시계 읽기 + 구조체 한 칸 쓰기뿐
+// 링이 차면 오래된 것부터 덮어씀 (최근 events_per_thread 개만 남음)
+//
+// 끝날 때 Chrome trace 형식(chrome://tracing, ui.perfetto.dev 에서 열림)으로 내보내고
+// 단계별 p50/p95/p99 요약을 출력
+
+// events_per_thread 를 2의 거듭제곱으로 올려서 씀. 부르지 않으면 기록은 아무것도 안 함
+void trace_init(size_t events_per_thread);
+
+// CLOCK_MONOTONIC (ns). V4L2 버퍼 타임스탬프와 같은 시계
+int64_t trace_now(void);
+
+// stage 는 문자열 상수 (포인터만 저장). start/end 는 trace_now() 값
+void trace_event(const char *stage, unsigned int seq, int64_t start_ns, int64_t end_ns);
+
+// Chrome trace JSON 으로 저장. 기록이 모두 끝난 뒤에 호출 (도는 중이면 링 끝부분이 섞일 수 있음)
+int trace_write_chrome(const char *path);
+
+// 단계별 호출 수, 평균, p50/p95/p99, 최대
+void trace_summary(FILE *out);
+
+#endif // TRACE_H
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "uring.h"
+
+struct uring {
+    int fd;
+    unsigned int features;
+
+    // 제출 큐 (SQ). head 는 커널이, tail 은 우리가 올림
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned int sq_entries;
+    unsigned int sq_local;       // 채워둔 SQE 의 끝 (uring_submit 에서 sq_tail 에 반영)
+    struct io_uring_sqe *sqes;
+
+    // 완료 큐 (CQ). tail 은 커널이, head 는 우리가 올림
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned long enters;
+};
+
+struct uring *uring_create(unsigned int entries)
+{
+    struct io_uring_params p;
+    struct uring *u = calloc(1, sizeof(*u));
+
+    if (!u)
+        return NULL;
+    memset(&p, 0, sizeof(p));
+    u->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (u->fd < 0) {
+        free(u);
+        return NULL;
+    }
+    u->features = p.features;
+    u->sq_entries = p.sq_entries;
+
+    u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    u->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    // 5.4 이후 커널은 두 링을 한 번에 매핑
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_ring_size > u->sq_ring_size)
+            u->sq_ring_size = u->cq_ring_size;
+        u->cq_ring_size = u->sq_ring_size;
+    }
+    u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED)
+        goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_ring = u->sq_ring;
+    } else {
+        u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          u->fd, IORING_OFF_CQ_RING);
+        if (u->cq_ring == MAP_FAILED)
+            goto fail;
+    }
+    u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED)
+        goto fail;
+
+    u->sq_head = (unsigned int *)((char *)u->sq_ring + p.sq_off.head);
+    u->sq_tail = (unsigned int *)((char *)u->sq_ring + p.sq_off.tail);
+    u->sq_mask = (unsigned int *)((char *)u->sq_ring + p.sq_off.ring_mask);
+    u->sq_array = (unsigned int *)((char *)u->sq_ring + p.sq_off.array);
+    u->cq_head = (unsigned int *)((char *)u->cq_ring + p.cq_off.head);
+    u->cq_tail = (unsigned int *)((char *)u->cq_ring + p.cq_off.tail);
+    u->cq_mask = (unsigned int *)((char *)u->cq_ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)((char *)u->cq_ring + p.cq_off.cqes);
+    u->sq_local = *u->sq_tail;
+    return u;
+
+fail:
+    uring_free(u);
+    return NULL;
+}
+
+void uring_free(struct uring *u)
+{
+    if (!u)
+        return;
+    if (u->sqes && u->sqes != MAP_FAILED)
+        munmap(u->sqes, u->sqes_size);
+    if (u->cq_ring && u->cq_ring != MAP_FAILED && u->cq_ring != u->sq_ring)
+        munmap(u->cq_ring, u->cq_ring_size);
+    if (u->sq_ring && u->sq_ring != MAP_FAILED)
+        munmap(u->sq_ring, u->sq_ring_size);
+    close(u->fd);
+    free(u);
+}
+
+int uring_register_buffers(struct uring *u, const struct iovec *iov, unsigned int n)
+{
+    if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_BUFFERS, iov, n) < 0)
+        return -1;
+    return 0;
+}
+
+static struct io_uring_sqe *get_sqe(struct uring *u, int opcode, int fd, uint64_t tag)
+{
+    unsigned int head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    struct io_uring_sqe *sqe;
+
+    if (u->sq_local - head >= u->sq_entries)
+        return NULL;
+    unsigned int i = u->sq_local & *u->sq_mask;
+    sqe = &u->sqes[i];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = tag;
+    u->sq_array[i] = i;
+    u->sq_local++;
+    return sqe;
+}
+
+int uring_poll(struct uring *u, int fd, short events, uint64_t tag)
+{
+    struct io_uring_sqe *sqe = get_sqe(u, IORING_OP_POLL_ADD, fd, tag);
+
+    if (!sqe)
+        return -1;
+    sqe->poll32_events = (unsigned short)events;
+    return 0;
+}
+
+int uring_writev(struct uring *u, int fd, const struct iovec *iov, int iovcnt, off_t off, int flags, uint64_t tag)
+{
+    struct io_uring_sqe *sqe = get_sqe(u, IORING_OP_WRITEV, fd, tag);
+
+    if (!sqe)
+        return -1;
+    sqe->addr = (uintptr_t)iov;
+    sqe->len = iovcnt;
+    sqe->off = off;
+    if (flags & URING_LINK)
+        sqe->flags |= IOSQE_IO_LINK;
+    return 0;
+}
+
+int uring_write_fixed(struct uring *u, int fd, const void *buf, size_t len, off_t off, int buf_index,
+                      int flags, uint64_t tag)
+{
+    struct io_uring_sqe *sqe = get_sqe(u, IORING_OP_WRITE_FIXED, fd, tag);
+
+    if (!sqe)
+        return -1;
+    sqe->addr = (uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = off;
+    sqe->buf_index = buf_index;
+    if (flags & URING_LINK)
+        sqe->flags |= IOSQE_IO_LINK;
+    return 0;
+}
+
+int uring_fsync(struct uring *u, int fd, int datasync, uint64_t tag)
+{
+    struct io_uring_sqe *sqe = get_sqe(u, IORING_OP_FSYNC, fd, tag);
+
+    if (!sqe)
+        return -1;
+    if (datasync)
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    return 0;
+}
+
+int uring_submit(struct uring *u, unsigned int wait_nr, int timeout_ms)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned int flags = 0;
+    void *argp = NULL;
+    size_t argsz = 0;
+    unsigned int to_submit;
+    int r;
+
+    to_submit = u->sq_local - *u->sq_tail;
+    __atomic_store_n(u->sq_tail, u->sq_local, __ATOMIC_RELEASE);
+    if (wait_nr) {
+        flags |= IORING_ENTER_GETEVENTS;
+        // 제한 시간은 5.11 이후 커널만 (그 전에는 완료될 때까지 기다림)
+        if (timeout_ms >= 0 && (u->features & IORING_FEAT_EXT_ARG)) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+            memset(&arg, 0, sizeof(arg));
+            arg.ts = (uintptr_t)&ts;
+            argp = &arg;
+            argsz = sizeof(arg);
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+    }
+    if (!to_submit && !wait_nr)
+        return 0;
+
+    u->enters++;
+    r = syscall(__NR_io_uring_enter, u->fd, to_submit, wait_nr, flags, argp, argsz);
+    if (r < 0) {
+        if (errno == EINTR || errno == ETIME)
+            return 0;
+        perror("io_uring_enter");
+        return -1;
+    }
+    return r;
+}
+
+int uring_peek(struct uring *u, uint64_t *tag, int *res)
+{
+    unsigned int head = *u->cq_head;
+
+    if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+        return 0;
+    struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+    *tag = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int uring_has_timeout(struct uring *u)
+{
+    return (u->features & IORING_FEAT_EXT_ARG) != 0;
+}
+
+unsigned long uring_enters(struct uring *u)
+{
+    return u->enters;
+}
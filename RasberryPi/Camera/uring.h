@@ -0,0 +1,46 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// io_uring 을 직접(시스템 콜로) 쓰는 얇은 래퍼. liburing 없이 커널 헤더만 있으면 됨
+// 여러 작업(fd 준비 대기, 소켓 전송, 파일 쓰기)을 큐에 쌓았다가 io_uring_enter 한 번으로 제출하고
+// 같은 호출에서 완료까지 기다릴 수 있어서 프레임당 시스템 콜 수가 줄어듦
+//
+// 커널이 io_uring 을 지원하지 않거나 막혀 있으면(seccomp, sysctl) uring_create 가 NULL 을 돌려주므로
+// 쓰는 쪽은 기존 poll/write 경로로 돌아가면 됨
+
+struct uring;
+
+#define URING_LINK 1    // 다음 작업은 이 작업이 성공해야 실행 (실패/짧은 쓰기면 -ECANCELED)
+
+struct uring *uring_create(unsigned int entries);
+void uring_free(struct uring *u);
+
+// 고정 버퍼 등록. 등록된 버퍼에서 쓰는 uring_write_fixed 는 매번 페이지를 고정하지 않음
+int uring_register_buffers(struct uring *u, const struct iovec *iov, unsigned int n);
+
+// 작업을 큐에 추가 (아직 제출 안 함). 큐가 꽉 차면 -1. tag 는 완료 때 그대로 돌려받음
+int uring_poll(struct uring *u, int fd, short events, uint64_t tag);
+int uring_writev(struct uring *u, int fd, const struct iovec *iov, int iovcnt, off_t off, int flags, uint64_t tag);
+int uring_write_fixed(struct uring *u, int fd, const void *buf, size_t len, off_t off, int buf_index,
+                      int flags, uint64_t tag);
+int uring_fsync(struct uring *u, int fd, int datasync, uint64_t tag);
+
+// 쌓인 작업을 제출하고 완료가 wait_nr 개 쌓일 때까지 (최대 timeout_ms, -1 = 무한) 기다림
+// 제출한 작업 수 또는 -1. 제한 시간은 uring_has_timeout 일 때만 지켜짐 (아니면 완료될 때까지 기다림)
+int uring_submit(struct uring *u, unsigned int wait_nr, int timeout_ms);
+
+// uring_submit 의 timeout_ms 를 지킬 수 있음 (IORING_FEAT_EXT_ARG, 5.11 이후 커널)
+// 기다리는 동안 다른 일(다른 fd, 주기 작업)도 봐야 하는 쪽은 0 이면 io_uring 을 쓰지 말 것
+int uring_has_timeout(struct uring *u);
+
+// 완료 하나를 꺼냄 (기다리지 않음). 1 = 꺼냄, 0 = 없음. res 는 해당 시스템 콜의 반환값 (오류는 -errno)
+int uring_peek(struct uring *u, uint64_t *tag, int *res);
+
+// 지금까지 부른 io_uring_enter 수
+unsigned long uring_enters(struct uring *u);
+
+#endif // URING_H
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/videodev2.h>
+
+#include "variant.h"
+#include "yuvscale.h"
+#include "display.h"
+
+struct variant {
+    struct variant_key key;
+    int users;                  // 0 이면 빈 슬롯
+    int width, height;          // 마지막으로 만든 크기 (key 가 0 이거나 캡처보다 크면 캡처 크기)
+    unsigned char *buf;         // 변환 결과
+    size_t buf_len;
+    unsigned char *planes;      // 크기를 바꿀 때 Y, U, V 를 따로 줄여 둘 곳
+    size_t planes_len;
+    unsigned char *row;         // 줄인 평면을 한 줄씩 YUYV 로 묶어 둘 곳 (RGB565 변환 입력)
+    int32_t *xt;                // yuvscale 작업 공간
+    int xt_len;
+    const unsigned char *out;   // 이번 프레임 결과 (buf 또는 캡처 버퍼)
+    int have;                   // out 이 아래 프레임의 것
+    unsigned int sequence;
+    int64_t timestamp_us;
+};
+
+struct variant_cache {
+    struct variant v[VARIANT_MAX];
+    struct variant_stats stats;
+};
+
+struct variant_cache *variant_cache_create(void)
+{
+    return calloc(1, sizeof(struct variant_cache));
+}
+
+static void variant_free_buffers(struct variant *v)
+{
+    free(v->buf);
+    free(v->planes);
+    free(v->row);
+    free(v->xt);
+    memset(v, 0, sizeof(*v));
+}
+
+void variant_cache_free(struct variant_cache *vc)
+{
+    if (!vc)
+        return;
+    for (int i = 0; i < VARIANT_MAX; i++)
+        variant_free_buffers(&vc->v[i]);
+    free(vc);
+}
+
+int variant_acquire(struct variant_cache *vc, const struct variant_key *key)
+{
+    int free_slot = -1;
+
+    if (key->pixelformat != V4L2_PIX_FMT_YUYV && key->pixelformat != V4L2_PIX_FMT_RGB565)
+        return -1;
+    for (int i = 0; i < VARIANT_MAX; i++) {
+        struct variant *v = &vc->v[i];
+        if (!v->users) {
+            if (free_slot < 0)
+                free_slot = i;
+            continue;
+        }
+        if (v->key.width == key->width && v->key.height == key->height && v->key.pixelformat == key->pixelformat) {
+            v->users++;
+            return i;
+        }
+    }
+    if (free_slot >= 0) {
+        vc->v[free_slot].key = *key;
+        vc->v[free_slot].users = 1;
+        vc->v[free_slot].have = 0;
+    }
+    return free_slot;
+}
+
+void variant_release(struct variant_cache *vc, int id)
+{
+    if (id < 0 || id >= VARIANT_MAX || !vc->v[id].users)
+        return;
+    // 버퍼는 두고 (다음 구독자가 같은 크기일 가능성이 높음) 구독 수만
+    if (--vc->v[id].users == 0)
+        vc->v[id].have = 0;
+}
+
+// 필요한 만큼 늘림. 줄어들 때는 그대로
+static int grow(unsigned char **p, size_t *len, size_t need)
+{
+    if (*len >= need)
+        return 0;
+    unsigned char *n = realloc(*p, need);
+    if (!n) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    *p = n;
+    *len = need;
+    return 0;
+}
+
+static int convert(struct variant *v, const struct capture_frame *f)
+{
+    int w = v->width, h = v->height;
+    int rgb = v->key.pixelformat == V4L2_PIX_FMT_RGB565;
+    int scale = w != f->width || h != f->height;
+    size_t line = (size_t)w * 2;
+    display_row_fn to_rgb = display_yuyv_row(DISP_RGB565);
+
+    if (grow(&v->buf, &v->buf_len, line * h) < 0)
+        return -1;
+
+    if (!scale) {
+        // 크기는 그대로: 줄 끝 여백을 빼거나 RGB565 로 한 줄씩
+        for (int y = 0; y < h; y++) {
+            const unsigned char *in = f->data + (size_t)y * f->stride;
+            if (rgb)
+                to_rgb(in, v->buf + y * line, w);
+            else
+                memcpy(v->buf + y * line, in, line);
+        }
+        return 0;
+    }
+
+    // YUYV 를 풀지 않고 Y(간격 2), U/V(간격 4)를 바로 읽어 평면별로 줄임
+    size_t ysize = (size_t)w * h, csize = (size_t)(w / 2) * h;
+    if (grow(&v->planes, &v->planes_len, ysize + 2 * csize) < 0)
+        return -1;
+    if (v->xt_len < w) {
+        free(v->xt);
+        v->xt = malloc(w * sizeof(*v->xt));
+        v->xt_len = v->xt ? w : 0;
+        if (!v->xt)
+            return -1;
+    }
+    unsigned char *py = v->planes, *pu = py + ysize, *pv = pu + csize;
+    yuvscale_plane(f->data, f->stride, 2, f->width, f->height, py, w, w, h, v->xt);
+    yuvscale_plane(f->data + 1, f->stride, 4, f->width / 2, f->height, pu, w / 2, w / 2, h, v->xt);
+    yuvscale_plane(f->data + 3, f->stride, 4, f->width / 2, f->height, pv, w / 2, w / 2, h, v->xt);
+
+    if (rgb && !v->row) {
+        v->row = malloc(line);
+        if (!v->row)
+            return -1;
+    }
+    for (int y = 0; y < h; y++) {
+        const unsigned char *yr = py + (size_t)y * w, *ur = pu + (size_t)y * (w / 2), *vr = pv + (size_t)y * (w / 2);
+        unsigned char *o = rgb ? v->row : v->buf + y * line;
+        for (int x = 0; x < w / 2; x++) {
+            o[4 * x] = yr[2 * x];
+            o[4 * x + 1] = ur[x];
+            o[4 * x + 2] = yr[2 * x + 1];
+            o[4 * x + 3] = vr[x];
+        }
+        if (rgb)
+            to_rgb(v->row, v->buf + y * line, w);
+    }
+    return 0;
+}
+
+const unsigned char *variant_get(struct variant_cache *vc, int id, const struct capture_frame *f,
+                                 int *width, int *height, size_t *size)
+{
+    struct variant *v;
+
+    if (id < 0 || id >= VARIANT_MAX || !vc->v[id].users || f->pixelformat != V4L2_PIX_FMT_YUYV)
+        return NULL;
+    v = &vc->v[id];
+
+    if (v->have && v->sequence == f->sequence && v->timestamp_us == f->timestamp_us) {
+        vc->stats.shared++;
+    } else {
+        // 0 이거나 캡처보다 크면 캡처 크기. 두 픽셀 단위 (1 을 내림해서 0 이 되면 변환할 것이 없으므로 2)
+        v->width = (v->key.width > 0 && v->key.width < f->width ? v->key.width : f->width) & ~1;
+        if (v->width < 2)
+            v->width = 2;
+        v->height = v->key.height > 0 && v->key.height < f->height ? v->key.height : f->height;
+        if (v->key.pixelformat == V4L2_PIX_FMT_YUYV && v->width == f->width && v->height == f->height &&
+            f->stride == f->width * 2) {
+            v->out = f->data;
+            vc->stats.passthrough++;
+        } else {
+            if (convert(v, f) < 0)
+                return NULL;
+            v->out = v->buf;
+            vc->stats.converted++;
+        }
+        v->have = 1;
+        v->sequence = f->sequence;
+        v->timestamp_us = f->timestamp_us;
+    }
+    *width = v->width;
+    *height = v->height;
+    *size = (size_t)v->width * 2 * v->height;
+    return v->out;
+}
+
+void variant_get_stats(struct variant_cache *vc, struct variant_stats *st)
+{
+    *st = vc->stats;
+}
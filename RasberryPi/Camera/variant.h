@@ -0,0 +1,46 @@
+#ifndef VARIANT_H
+#define VARIANT_H
+
+#include <stddef.h>
+#include "capture.h"
+
+// 클라이언트마다 원하는 크기/픽셀 포맷으로 바꾼 프레임 캐시
+// 같은 모양(variant)을 원하는 클라이언트는 슬롯 하나를 같이 씀 -> 프레임마다 모양 수만큼만 변환
+// (클라이언트 수가 늘어도 모양이 몇 개뿐이면 변환 비용은 그대로)
+//
+// 입력은 YUYV 캡처 프레임. 크기는 Y/U/V 를 따로 줄인 뒤(yuvscale) 다시 묶고,
+// RGB565 는 video_client 화면(display)과 같은 변환으로 바꿔서 받는 쪽이 그대로 복사만 하면 되게 함
+// 잠금이 없으므로 한 스레드에서만 (video_server 캡처 루프)
+
+#define VARIANT_MAX 8
+
+struct variant_key {
+    int width, height;          // 0 이면 캡처 크기 그대로. 캡처보다 크면 캡처 크기로 (키우지 않음). 폭은 짝수로 내림 (최소 2)
+    unsigned int pixelformat;   // V4L2_PIX_FMT_YUYV 또는 V4L2_PIX_FMT_RGB565
+};
+
+struct variant_stats {
+    unsigned long converted;    // 변환한 횟수
+    unsigned long shared;       // 같은 프레임을 이미 변환해 둔 것을 다시 쓴 횟수
+    unsigned long passthrough;  // 변환 없이 캡처 버퍼를 그대로 준 횟수
+};
+
+struct variant_cache;
+
+struct variant_cache *variant_cache_create(void);
+void variant_cache_free(struct variant_cache *vc);
+
+// 모양을 구독. 같은 모양이 이미 있으면 그 슬롯 번호 (구독 수만 늘림). -1 = 슬롯이 모자라거나 지원 안 하는 포맷
+int variant_acquire(struct variant_cache *vc, const struct variant_key *key);
+void variant_release(struct variant_cache *vc, int id);
+
+// f 를 id 의 모양으로 (줄 끝 여백 없이 width * 2 * height 바이트). 지원하지 않는 입력이면 NULL
+// 같은 프레임(sequence, timestamp)을 두 번째로 부르면 변환하지 않고 처음 결과를 돌려줌
+// 크기와 포맷이 그대로이고 줄 끝 여백이 없으면 f->data 를 그대로 (복사 없음)
+// 결과는 같은 슬롯으로 다음 프레임을 부를 때까지 유효
+const unsigned char *variant_get(struct variant_cache *vc, int id, const struct capture_frame *f,
+                                 int *width, int *height, size_t *size);
+
+void variant_get_stats(struct variant_cache *vc, struct variant_stats *st);
+
+#endif // VARIANT_H
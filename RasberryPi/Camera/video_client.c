@@ -1,3 +1,6 @@
+// 빌드: gcc -o video_client video_client.c display.c trace.c stats.c -lavcodec -lavutil -lpthread
+// 실행: ./video_client [-t trace.json] [-r level] [-s WxH|screen] [-p yuyv|rgb565] [-b rcvbuf]
+
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -10,6 +13,16 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <linux/videodev2.h>
+#include <libavcodec/avcodec.h>
+
+#include "display.h"
+#include "proto.h"
+#include "trace.h"
 
 #define TCP_PORT 5100
 #define SERVER_IP "127.0.0.1"
@@ -19,96 +32,67 @@
 
 #define FBDEV "/dev/fb0" /* 프레임 버퍼를 위한 디바이스 파일 */
 
-static struct fb_var_screeninfo vinfo; /* 프레임버퍼의 정보 저장을 위한 구조체 */
-long screensize;
-int fbfd = -1; /* 프레임버퍼의 파일 디스크립터 */
-static short* fbp = NULL; /* 프레임버퍼의 MMAP를 위한 변수 */
+static struct display disp; /* 프레임버퍼 (더블 버퍼링) */
 
-char buffer[WIDTH * HEIGHT * 2] = { 0 }; // 프레임 버퍼 크기
+#define FRAME_MAX (WIDTH * HEIGHT * 2) // 받을 수 있는 가장 큰 프레임
 
 int sock;
 struct sockaddr_in servaddr;
 char msg[BUFSIZ];
 int pid;
+static uint32_t request_id = 0;  // 제어 요청 번호 (응답을 맞춰볼 때)
 
-static void mesg_exit(const char* s)
-{
-    fprintf(stderr, "%s error %d, %s\n", s, errno, strerror(errno));
-    exit(EXIT_FAILURE);
-}
+// -r : 서버의 simulcast 화질을 구독 (0 = 전체, 1 = 절반 ...). H.264 를 받아서 디코딩
+static int level = -1;
+static AVCodecContext* dec = NULL;
+static AVPacket* dec_pkt = NULL;
+static AVFrame* dec_frame = NULL;
+static int64_t start_ns;        // 구독을 보낸 시각 (첫 화면까지 걸린 시간용)
+static int keyframe_requested = 0;
 
-/* unsigned char의 범위를 넘어가지 않도록 경계 검사를 수행다. */
-extern inline int clip(int value, int min, int max)
-{
-    return(value > max ? max : value < min ? min : value);
-}
+// -s, -p : 서버에게 이 크기/포맷으로 바꿔 보내달라고 함 (CTRL_SET_FORMAT)
+// 작은 화면이면 받는 양이 줄고, rgb565 면 변환 없이 화면에 복사만 함 (같은 모양의 클라이언트끼리는 서버가 한 번만 변환)
+static int want_width = 0, want_height = 0;
+static int want_rgb565 = 0;
+static int shown = 0;
 
-static void process_image(const void* p)
-{
-    unsigned char* in = (unsigned char*)p;
-    int width = WIDTH;
-    int height = HEIGHT;
-    int istride = WIDTH * 2; /* 이미지의 폭을 넘어가면 다음 라인으로 내려가도록 설정 */
-    int x, y, j;
-    int y0, u, y1, v, r, g, b;
-    unsigned short pixel;
-    long location = 0;
-    for (y = 0; y < height; ++y) {
-        for (j = 0, x = 0; j < vinfo.xres * 2; j += 4, x += 2) {
-            if (j >= width * 2) { /* 현재의 화면에서 이미지를 넘어서는 빈 공간을 처리 */
-                location++; location++;
-                continue;
-            }
-            /* YUYV 성분을 분리 */
-            y0 = in[j];
-            u = in[j + 1] - 128;
-            y1 = in[j + 2];
-            v = in[j + 3] - 128;
-
-            /* YUV를 RGB로 전환 */
-            r = clip((298 * y0 + 409 * v + 128) >> 8, 0, 255);
-            g = clip((298 * y0 - 100 * u - 208 * v + 128) >> 8, 0, 255);
-            b = clip((298 * y0 + 516 * u + 128) >> 8, 0, 255);
-            pixel = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3); /* 16비트 컬러로 전환 */
-            fbp[location++] = pixel;
-
-            /* YUV를 RGB로 전환 */
-            r = clip((298 * y1 + 409 * v + 128) >> 8, 0, 255);
-            g = clip((298 * y1 - 100 * u - 208 * v + 128) >> 8, 0, 255);
-            b = clip((298 * y1 + 516 * u + 128) >> 8, 0, 255);
-            pixel = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3); /* 16비트 컬러로 전환 */
-            fbp[location++] = pixel;
-        };
-        in += istride;
-    };
-}
-
-static int set_framebuffer()
-{
-    /* 프레임버퍼 열기 */
-    fbfd = open(FBDEV, O_RDWR);
-    if (-1 == fbfd) {
-        perror("open( ) : framebuffer device");
-        return EXIT_FAILURE;
-    }
+// 받기 / 그리기 파이프라인 (원본 YUYV, RGB565)
+// 받는 스레드가 버퍼를 채우는 동안 그리는 스레드는 가장 최근에 다 받은 프레임만 그림
+// 버퍼 세 개를 돌려 씀: 받는 중(filling), 다 받고 기다리는 것(middle), 그리는 중(drawing)
+// 그리는 쪽이 느리면 middle 을 새 프레임으로 바꿔치기 -> 소켓에 쌓이지 않고 받는 속도는 네트워크 속도
+#define POOL_SIZE 3
 
-    /* 프레임버퍼의 정보 가져오기 */
-    if (-1 == ioctl(fbfd, FBIOGET_VSCREENINFO, &vinfo)) {
-        perror("Error reading variable information.");
-        return EXIT_FAILURE;
-    }
+struct pooled_frame {
+    unsigned char* data;
+    struct frame_header hdr;
+    int64_t capture_us;
+    int64_t recv_ns;            // 다 받은 시각
+};
 
-    /* mmap( ) : 프레임버퍼를 위한 메모리 공간 확보 */
-    screensize = vinfo.xres * vinfo.yres * 2;
-    fbp = (short*)mmap(NULL, screensize, PROT_READ | PROT_WRITE, MAP_SHARED, fbfd, 0);
-    if (fbp == (short*)-1) {
-        perror("mmap() : framebuffer device to memory");
-        return EXIT_FAILURE;
-    }
+static struct pooled_frame pool[POOL_SIZE];
+static int filling = 0, middle = 1, drawing = 2;
+static int fresh = 0;           // middle 에 아직 그리지 않은 프레임이 있음
+static int recv_done = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long frames_received, frames_drawn, frames_skipped;
 
-    memset(fbp, 0, screensize);
+// -b : 소켓 받기 버퍼 크기 (0 이면 커널 기본값). 그리는 동안 도착하는 프레임이 창(window)을 막지 않게 넉넉히
+static int rcvbuf = 0;
 
-    return 1;
+// -t 를 주면 수신 프로세스가 끝날 때 추적 기록을 저장
+static const char* trace_path = NULL;
+static volatile sig_atomic_t stop_recv = 0;
+
+static void stop_receiving(int signo)
+{
+    stop_recv = 1;
+}
+
+static void mesg_exit(const char* s)
+{
+    fprintf(stderr, "%s error %d, %s\n", s, errno, strerror(errno));
+    exit(EXIT_FAILURE);
 }
 
 static int connect_server(char* server_ip)
@@ -119,6 +103,15 @@ static int connect_server(char* server_ip)
         return -1;
     }
 
+    // 연결 전에 정해야 TCP 창 크기 조정(window scaling)에 반영됨
+    if (rcvbuf > 0) {
+        socklen_t len = sizeof(rcvbuf);
+        if (setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0)
+            perror("SO_RCVBUF");
+        else if (getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &len) == 0)
+            printf("receive buffer %d bytes\n", rcvbuf); // 커널이 관리용으로 두 배를 잡음
+    }
+
     memset(&servaddr, 0, sizeof(servaddr));
     servaddr.sin_family = AF_INET;
     servaddr.sin_port = htons(TCP_PORT);
@@ -137,6 +130,305 @@ static int connect_server(char* server_ip)
     return 1;
 }
 
+// len 바이트를 다 받을 때까지. 연결이 끊기거나 멈추라는 신호를 받으면 -1
+// MSG_WAITALL 이라 보통 프레임 하나에 recv 한 번 (신호에 끊겼을 때만 나머지를 다시)
+static int recv_all(int s, void* buf, size_t len)
+{
+    size_t total_received = 0;
+    while (total_received < len) {
+        ssize_t received = recv(s, (char*)buf + total_received, len - total_received, MSG_WAITALL);
+        if (received <= 0) {
+            if (received == -1 && errno == EINTR && !stop_recv)
+                continue;
+            if (!stop_recv)
+                perror("recv failed");
+            return -1;
+        }
+        total_received += received;
+    }
+    return 0;
+}
+
+// 제어 요청 하나를 보냄 (헤더와 인자를 한 번에). 응답은 수신 프로세스가 프레임 사이에서 받아서 출력
+// 부모(키보드)와 수신 프로세스가 같은 소켓에 쓰지만 요청 하나가 작아서 send 한 번에 통째로 나감
+static int send_request(uint32_t type, const void* arg, size_t size)
+{
+    struct ctrl_request rq;
+    struct iovec iov[2] = { { &rq, sizeof(rq) }, { (void*)arg, size } };
+
+    ctrl_request_pack(&rq, ++request_id, type, size);
+    if (writev(sock, iov, size ? 2 : 1) != (ssize_t)(sizeof(rq) + size)) {
+        perror("send request");
+        return -1;
+    }
+    return 0;
+}
+
+static const char* request_name(uint32_t type)
+{
+    static const char* names[] = { "?", "subscribe", "unsubscribe", "set format", "set roi", "keyframe", "stats" };
+    return type < sizeof(names) / sizeof(names[0]) ? names[type] : "?";
+}
+
+// 응답을 받아서 출력. 통계는 표로, 실패는 이유를
+// UNSUBSCRIBE 가 받아들여졌으면 1: 서버는 그 뒤로 프레임을 보내지 않으므로 소켓이 프레임 경계에서 멈춤
+static int receive_reply(const struct ctrl_reply* rep)
+{
+    unsigned char data[CTRL_MAX_PAYLOAD];
+
+    if (rep->size > sizeof(data)) {
+        fprintf(stderr, "bad reply\n");
+        return -1;
+    }
+    if (recv_all(sock, data, rep->size) < 0)
+        return -1;
+    if (rep->status < 0) {
+        fprintf(stderr, "server: %s failed: %s\n", request_name(rep->type), strerror(-rep->status));
+        return 0;
+    }
+    if (rep->type == CTRL_UNSUBSCRIBE)
+        return 1;
+    if (rep->type == CTRL_GET_STATS && rep->size == sizeof(struct ctrl_stats)) {
+        struct ctrl_stats st;
+        memcpy(&st, data, sizeof(st));
+        printf("server: sent %u frames, %llu bytes, %u errors / captured %u, dropped %u / clients %u, streaming %u\n",
+               ntohl(st.frames_sent), (unsigned long long)ntohl(st.bytes_hi) << 32 | ntohl(st.bytes_lo),
+               ntohl(st.send_errors), ntohl(st.captured), ntohl(st.dropped), ntohl(st.clients), ntohl(st.streaming));
+    }
+    return 0;
+}
+
+static int64_t real_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int open_decoder(void)
+{
+    const AVCodec* codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+
+    if (!codec) {
+        fprintf(stderr, "Codec not found\n");
+        return -1;
+    }
+    dec = avcodec_alloc_context3(codec);
+    dec_pkt = av_packet_alloc();
+    dec_frame = av_frame_alloc();
+    if (!dec || !dec_pkt || !dec_frame)
+        return -1;
+    // 받는 대로 바로 보여줌 (프레임 스레딩은 스레드 수만큼 늦어짐)
+    dec->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    dec->thread_type = FF_THREAD_SLICE;
+    if (avcodec_open2(dec, codec, NULL) < 0) {
+        fprintf(stderr, "Could not open codec\n");
+        return -1;
+    }
+    return 0;
+}
+
+// 뒤에 받을 프레임이 이미 소켓에 와 있음 (구독 직후 키프레임 캐시를 한꺼번에 받는 중)
+static int more_pending(void)
+{
+    int n = 0;
+    return ioctl(sock, FIONREAD, &n) == 0 && n >= (int)sizeof(struct frame_header);
+}
+
+// H.264 접근 단위 하나를 받아서 디코딩하고 나온 프레임을 그림
+// 구독하면 서버가 마지막 키프레임부터 지금까지를 한꺼번에 보냄. 모두 디코딩은 하되 그리는 것은
+// 뒤에 더 올 것이 없을 때만 (밀린 프레임을 하나씩 그리면 화면 넘김마다 vsync 를 기다려서 늦어짐)
+static int receive_h264(const struct frame_header* hdr, int64_t capture_us, int64_t t0)
+{
+    if (av_new_packet(dec_pkt, hdr->size) < 0)
+        return -1;
+    if (recv_all(sock, dec_pkt->data, hdr->size) < 0) {
+        av_packet_unref(dec_pkt);
+        return -1;
+    }
+    int64_t t1 = trace_now();
+    trace_event("recv", hdr->sequence, t0, t1);
+
+    int r = avcodec_send_packet(dec, dec_pkt);
+    av_packet_unref(dec_pkt);
+    if (r < 0) {
+        // 깨진 패킷은 건너뛰고, 다음 키프레임까지 기다리지 않도록 한 번만 요청 (화면이 나오면 다시)
+        if (!keyframe_requested)
+            keyframe_requested = send_request(CTRL_REQUEST_KEYFRAME, NULL, 0) == 0;
+        return 0;
+    }
+    while (avcodec_receive_frame(dec, dec_frame) >= 0) {
+        int64_t t2 = trace_now();
+        trace_event("decode", hdr->sequence, t1, t2);
+        if (more_pending()) {
+            av_frame_unref(dec_frame);
+            t1 = t2;
+            continue;
+        }
+        display_draw_yuv420(&disp, dec_frame->data[0], dec_frame->data[1], dec_frame->data[2], dec_frame->width,
+                            dec_frame->height, dec_frame->linesize[0], dec_frame->linesize[1], 1);
+        int64_t t3 = trace_now();
+        trace_event("draw", hdr->sequence, t2, t3);
+        display_flip(&disp);
+        int64_t t4 = trace_now();
+        trace_event("flip", hdr->sequence, t3, t4);
+        trace_event("glass", hdr->sequence, t4 - (real_now_us() - capture_us) * 1000, t4);
+        keyframe_requested = 0;
+        if (!shown++)
+            printf("first frame %dx%d in %.1f ms\n", dec_frame->width, dec_frame->height, (t4 - start_ns) / 1e6);
+        av_frame_unref(dec_frame);
+        t1 = t4;
+    }
+    return 0;
+}
+
+// 그리는 스레드: 새 프레임이 올 때까지 기다렸다가 가장 최근 것만 그림
+static void* draw_thread(void* arg)
+{
+    while (1) {
+        pthread_mutex_lock(&pool_lock);
+        while (!fresh && !recv_done)
+            pthread_cond_wait(&pool_cond, &pool_lock);
+        if (!fresh) {
+            pthread_mutex_unlock(&pool_lock);
+            break;
+        }
+        int t = drawing;
+        drawing = middle;
+        middle = t;
+        fresh = 0;
+        pthread_mutex_unlock(&pool_lock);
+
+        struct pooled_frame* pf = &pool[drawing];
+        struct frame_header* hdr = &pf->hdr;
+        int64_t t1 = trace_now();
+        // 다 받고 나서 그리기 시작할 때까지 기다린 시간
+        trace_event("queue", hdr->sequence, pf->recv_ns, t1);
+
+        // 받은 데이터를 처리 (프레임버퍼에 출력)
+        // 뒤 페이지에 그린 뒤 화면을 넘김
+        if (hdr->magic == RGB565_MAGIC)
+            display_draw_native(&disp, pf->data, hdr->width, hdr->height, hdr->width * 2);
+        else
+            display_draw_yuyv(&disp, pf->data, hdr->width, hdr->height, hdr->width * 2);
+        int64_t t2 = trace_now();
+        trace_event("draw", hdr->sequence, t1, t2);
+        display_flip(&disp);
+        int64_t t3 = trace_now();
+        trace_event("flip", hdr->sequence, t2, t3);
+
+        // 캡처 -> 화면. 서버의 캡처 시각(REALTIME)과의 차이를 이 프로세스의 MONOTONIC 축으로 옮겨 기록
+        trace_event("glass", hdr->sequence, t3 - (real_now_us() - pf->capture_us) * 1000, t3);
+        frames_drawn++;
+    }
+    return NULL;
+}
+
+// 받는 스레드 (수신 프로세스의 주 스레드)
+static void receive_frames(void)
+{
+    struct sigaction sa;
+    sigset_t block, old;
+    pthread_t drawer;
+
+    // 부모가 SIGTERM 으로 멈추게 함. recv 가 다시 시작되지 않도록 SA_RESTART 없이
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_receiving;
+    sigaction(SIGTERM, &sa, NULL);
+
+    for (int i = 0; i < POOL_SIZE; i++) {
+        pool[i].data = malloc(FRAME_MAX);
+        if (!pool[i].data) {
+            fprintf(stderr, "Out of memory\n");
+            close(sock);
+            return;
+        }
+    }
+    // SIGTERM 은 recv 에서 기다리는 이 스레드가 받아야 recv 가 EINTR 로 끊김
+    sigemptyset(&block);
+    sigaddset(&block, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    if (pthread_create(&drawer, NULL, draw_thread, NULL) != 0) {
+        fprintf(stderr, "Could not start draw thread\n");
+        close(sock);
+        return;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    while (!stop_recv) {
+        struct pooled_frame* pf = &pool[filling];
+        struct frame_header* hdr = &pf->hdr;
+
+        // 헤더(프레임 번호, 캡처 시각) 다음에 YUYV 데이터 (또는 H.264)
+        if (recv_all(sock, hdr, sizeof(*hdr)) < 0)
+            break;
+        int64_t t0 = trace_now();
+        // 제어 요청에 대한 응답이 프레임 사이에 섞여 옴
+        struct ctrl_reply rep;
+        if (ctrl_reply_unpack(hdr, &rep) == 0) {
+            if (receive_reply(&rep) != 0)
+                break;
+            continue;
+        }
+        // H.264 는 모든 패킷을 디코더에 넣어야 해서 받는 스레드에서 바로 (밀린 것은 more_pending 으로 그리지 않음)
+        if (frame_header_unpack(hdr, &pf->capture_us) == 0 && hdr->magic == H264_MAGIC && dec) {
+            if (receive_h264(hdr, pf->capture_us, t0) < 0)
+                break;
+            continue;
+        }
+        // 서버가 ROI 만 보내거나 요청한 크기로 줄이면 전체(WIDTH x HEIGHT)보다 작음
+        if ((hdr->magic != FRAME_MAGIC && hdr->magic != RGB565_MAGIC) || hdr->size > FRAME_MAX ||
+            hdr->size != hdr->width * 2 * hdr->height) {
+            fprintf(stderr, "bad frame header\n");
+            break;
+        }
+        if (recv_all(sock, pf->data, hdr->size) < 0)
+            break;
+        pf->recv_ns = trace_now();
+        trace_event("recv", hdr->sequence, t0, pf->recv_ns);
+
+        // 다 받은 버퍼를 middle 과 바꿈. 그리는 쪽이 아직 가져가지 않은 것은 건너뛴 프레임
+        pthread_mutex_lock(&pool_lock);
+        int t = middle;
+        middle = filling;
+        filling = t;
+        if (fresh)
+            frames_skipped++;
+        fresh = 1;
+        frames_received++;
+        pthread_cond_signal(&pool_cond);
+        pthread_mutex_unlock(&pool_lock);
+    }
+    close(sock);
+
+    // 마지막으로 받은 프레임까지 그리고 끝남
+    pthread_mutex_lock(&pool_lock);
+    recv_done = 1;
+    pthread_cond_signal(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+    pthread_join(drawer, NULL);
+    for (int i = 0; i < POOL_SIZE; i++)
+        free(pool[i].data);
+    if (frames_received)
+        printf("frames: received %lu, drawn %lu, skipped %lu\n", frames_received, frames_drawn, frames_skipped);
+
+    if (trace_path) {
+        trace_write_chrome(trace_path);
+        trace_summary(stdout);
+    }
+}
+
+// 수신 프로세스가 끝날 때까지 최대 timeout_ms. 끝났으면 1
+static int wait_receiver(int timeout_ms)
+{
+    for (int waited = 0; waited < timeout_ms; waited += 10) {
+        if (waitpid(pid, NULL, WNOHANG) == pid)
+            return 1;
+        usleep(10000);
+    }
+    return 0;
+}
+
 static int stream_start()
 {
     if ((pid = fork()) < 0) {
@@ -145,31 +437,42 @@ static int stream_start()
     }
     else if (pid == 0) { // 자식프로세스 처리 (데이터 수신/프레임버퍼에 그리는 역할)
         // 자식 프로세스는 프레임버퍼 접근만 처리
-        while (1) {
-            // 데이터 수신
-            ssize_t total_received = 0;
-            ssize_t frame_size = WIDTH * HEIGHT * 2;
-
-            while (total_received < frame_size) {
-                ssize_t received = recv(sock, buffer + total_received, frame_size - total_received, 0);
-                if (received == -1) {
-                    perror("recv failed");
-                    close(sock);
-                    return -1;
-                }
-                total_received += received;
-            }
-            // 받은 데이터를 처리 (프레임버퍼에 출력)
-            process_image(buffer);  // 수신한 데이터를 프레임버퍼에 출력
-        }
+        receive_frames();
+        exit(0);
     }
     else {
         while (1) {
+            struct ctrl_rect r;
+            int w, h, x = -1, y = -1;
+
             memset(msg, 0, BUFSIZ);
-            printf("enter 1 to stream, enter 2 to quit.\n");
-            scanf("%s", msg);
-            if (!strcmp(msg, "2")) {
-                kill(pid, SIGKILL);
+            printf("enter z:WxH[+X+Y] to zoom, s for stats, k for keyframe, enter 2 to quit.\n");
+            if (scanf("%s", msg) != 1)
+                strcpy(msg, "2");
+            // 서버에서 이 영역만 잘라 보냄 (디지털 줌). 위치를 빼면 가운데
+            if (sscanf(msg, "z:%dx%d+%d+%d", &w, &h, &x, &y) >= 2) {
+                r.left = htonl(x);
+                r.top = htonl(y);
+                r.width = htonl(w);
+                r.height = htonl(h);
+                send_request(CTRL_SET_ROI, &r, sizeof(r));
+            }
+            else if (!strcmp(msg, "s"))
+                send_request(CTRL_GET_STATS, NULL, 0);
+            else if (!strcmp(msg, "k"))
+                send_request(CTRL_REQUEST_KEYFRAME, NULL, 0);
+            else if (!strcmp(msg, "2")) {
+                // 서버가 보내기를 멈추게 하고, 수신 프로세스가 보내던 프레임과 응답까지 다 읽고 끝나길 기다림
+                // (중간에 끊으면 남은 프레임이 소켓에 있어서 다시 구독했을 때 프레임 중간부터 읽게 됨)
+                int done = send_request(CTRL_UNSUBSCRIBE, NULL, 0) == 0 && wait_receiver(2000);
+                if (!done) {
+                    // 응답이 오지 않음. 멈추게 하고 소켓에 남은 것은 버리도록 다시 연결
+                    kill(pid, SIGTERM);
+                    waitpid(pid, NULL, 0);
+                    close(sock);
+                    if (connect_server(SERVER_IP) != 1)
+                        return -1;
+                }
                 break;
             }
         }
@@ -177,10 +480,48 @@ static int stream_start()
     return 1;
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    int opt;
+
+    // -t : 프레임별 단계 시간(recv, draw, flip)과 캡처 -> 화면 지연(glass)을 Chrome trace 로 저장
+    // -r : simulcast 화질 번호 (서버를 -S 로 띄웠을 때). 주지 않으면 원본 YUYV
+    // -s : 받을 크기 (서버에서 줄여서 보냄). "screen" 이면 화면 크기
+    // -p : rgb565 면 서버가 화면 포맷으로 바꿔서 보냄 (화면이 RGB565 일 때만)
+    // -b : 소켓 받기 버퍼 크기 (바이트)
+    while ((opt = getopt(argc, argv, "t:r:s:p:b:")) != -1) {
+        if (opt == 't') {
+            trace_path = optarg;
+            trace_init(65536);
+        } else if (opt == 'r') {
+            level = atoi(optarg);
+        } else if (opt == 's' && (!strcmp(optarg, "screen") || sscanf(optarg, "%dx%d", &want_width, &want_height) == 2)) {
+            if (!strcmp(optarg, "screen"))
+                want_width = -1;
+        } else if (opt == 'p' && (!strcmp(optarg, "rgb565") || !strcmp(optarg, "yuyv"))) {
+            want_rgb565 = !strcmp(optarg, "rgb565");
+        } else if (opt == 'b') {
+            rcvbuf = atoi(optarg);
+        } else {
+            fprintf(stderr, "Usage: %s [-t trace.json] [-r level] [-s WxH|screen] [-p yuyv|rgb565] [-b rcvbuf]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (level >= 0 && open_decoder() < 0)
+        return EXIT_FAILURE;
+
     // 프레임버퍼 설정
-    set_framebuffer();
+    if (display_open(&disp, FBDEV) == -1)
+        return EXIT_FAILURE;
+    if (want_width < 0) {
+        want_width = disp.xres;
+        want_height = disp.yres;
+    }
+    if (want_rgb565 && disp.format != DISP_RGB565) {
+        fprintf(stderr, "-p rgb565: display is not RGB565\n");
+        return EXIT_FAILURE;
+    }
     // 서버 연결
     if (connect_server(SERVER_IP) != 1) {
         return 0;
@@ -191,19 +532,27 @@ int main()
         printf("enter 1 to stream, enter 2 to quit.\n");
         scanf("%s", msg);
         if (!strcmp(msg, "1")) {
-            send(sock, msg, strlen(msg), MSG_DONTWAIT);
-            stream_start();
+            // 형식(simulcast 화질 또는 크기/포맷)을 정한 뒤 구독. 실패하면 수신 프로세스가 응답을 출력
+            struct ctrl_format fm;
+            fm.level = htonl(level);
+            fm.width = htonl(want_width > 0 ? want_width : 0);
+            fm.height = htonl(want_width > 0 ? want_height : 0);
+            fm.pixelformat = htonl(want_rgb565 ? V4L2_PIX_FMT_RGB565 : V4L2_PIX_FMT_YUYV);
+            start_ns = trace_now();
+            if (send_request(CTRL_SET_FORMAT, &fm, sizeof(fm)) < 0 || send_request(CTRL_SUBSCRIBE, NULL, 0) < 0)
+                break;
+            if (stream_start() < 0)
+                break;
         }
         else if (!strcmp(msg, "2"))
             break;
     }
 
     // 종료 시 프레임버퍼 정리
-    munmap(fbp, screensize);
-
-    /* 장치 닫기 */
-    if (-1 == close(fbfd))
-        mesg_exit("close");
+    display_close(&disp);
+    avcodec_free_context(&dec);
+    av_packet_free(&dec_pkt);
+    av_frame_free(&dec_frame);
 
     return EXIT_SUCCESS;
 }
@@ -1,3 +1,8 @@
+// 빌드: gcc -o video_server video_server.c capture.c h264nal.c trace.c stats.c metrics.c uring.c simulcast.c yuvscale.c gopcache.c shmring.c variant.c display.c -lavcodec -lavutil -lswscale -lpthread -lrt
+// 실행: ./video_server [-b buffers] [-t trace.json] [-m metrics_port] [-e legacy|poll|uring] [-n frames] [-S kbps,kbps,...] [-R name[:slots]] [-z WxH[+X+Y]]
+//                      [/dev/videoN | synth]
+// 메트릭: curl http://127.0.0.1:9110/metrics
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,12 +10,17 @@
 #include <unistd.h>
 #include <errno.h>
 #include <malloc.h>
+#include <time.h>
 
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <pthread.h>
 
 #include <linux/fb.h>
 #include <signal.h>
@@ -21,6 +31,16 @@
 #include <arpa/inet.h> // tcp 
 #include <sys/socket.h>
 
+#include "capture.h"
+#include "proto.h"
+#include "trace.h"
+#include "metrics.h"
+#include "uring.h"
+#include "simulcast.h"
+#include "gopcache.h"
+#include "shmring.h"
+#include "variant.h"
+
 #define FBDEV        "/dev/fb0"      /* 프레임 버퍼를 위한 디바이스 파일 */
 #define VIDEODEV    "/dev/video0"
 #define WIDTH       800               /* 캡쳐받을 영상의 크기 */
@@ -29,39 +49,110 @@
 
 
 #define TCP_PORT 5100 // 서버의 포트 번호
+#define METRICS_PORT 9110 // Prometheus 메트릭 (localhost)
 
-int camfd = -1;		/* 카메라의 파일 디스크립터 */
+static struct capture* cap = NULL;	/* 캡처 소스 (카메라 또는 합성 테스트 패턴) */
 
 // tcp 통신 변수
 int ssock;
 socklen_t clen;
-int n;
 struct sockaddr_in servaddr, cliaddr;
-pid_t pid;
-char msg[BUFSIZ];
 
-int send_data = 0; // 카메라 데이터 전송 플래그
+// -S : 캡처 하나를 여러 화질의 H.264 로 인코딩 (simulcast). 클라이언트는 SET_FORMAT 의 level 로 화질을 고름
+// 인코더 스레드가 패킷을 바로 보내므로 같은 소켓에 쓰는 것과 클라이언트 목록을 바꾸는 것은 send_lock 으로 묶음
+// send_lock 을 잡고는 막히는 쓰기를 하지 않음: MSG_DONTWAIT 로 보내고 못 보낸 것은 클라이언트 큐에 (client_queue)
+// -> 받지 않는 클라이언트 하나가 다른 화질이나 이벤트 루프(accept, 제어 요청)를 멈추지 않음
+static struct simulcast* sc = NULL;
+static pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 같은 장비의 다른 프로세스(녹화, 움직임 감지 등)에 캡처 프레임을 나눠주는 공유 메모리 링 (-R)
+static struct shmring* ring = NULL;
+
+// 연결한 클라이언트. 제어 요청(proto.h)은 이벤트 루프가 프레임 사이에 읽어서 처리
+// (명령을 읽는 자식 프로세스와 시그널은 없음 -> 요청이 캡처/전송 시스템 콜을 끊지 않고, 설정은 연결마다 따로)
+#define CLIENT_MAX 8
+#define CLIENT_INBUF 256            // 덜 받은 요청을 모아 둘 곳 (요청 하나는 헤더 + CTRL_MAX_PAYLOAD 이하)
+#define CLIENT_SEND_TIMEOUT 2       // 초. 원본 전송이 받지 않는 클라이언트 하나 때문에 이보다 오래 멈추면 그 연결을 끊음
+#define CLIENT_OUTQ_MAX (8 << 20)   // 클라이언트 큐 (못 보낸 H.264 패킷/응답) 한도. 넘치면 다음 키프레임까지 건너뜀
+
+struct client {
+    int sock;                       // -1 이면 빈 칸
+    int streaming;                  // SUBSCRIBE 로 받는 중
+    int level;                      // simulcast 화질. -1 이면 원본 (variant)
+    int want_burst;                 // 화질을 새로 구독함. 인코더 스레드가 다음 패킷 때 키프레임 캐시를 통째로 보냄
+    int dead;                       // 읽기/쓰기가 실패함. 보내는 중인 프레임이 끝난 뒤 정리
+    int wait_key;                   // 큐가 넘쳐서 패킷을 버림. 다음 키프레임부터 다시 보냄
+    struct variant_key variant;     // SET_FORMAT 으로 정한 모양. 기본은 캡처 크기 그대로 YUYV
+    int variant_id;                 // variant 캐시 슬롯
+    unsigned char in[CLIENT_INBUF];
+    size_t in_len;
+
+    // 소켓이 받지 못한 메시지 (out + out_off 부터 out_len 바이트). send_lock 을 잡고 씀
+    // 메시지는 통째로만 넣으므로 남은 것을 다 보내면 메시지 경계
+    unsigned char* out;
+    size_t out_off, out_len, out_cap;
+
+    unsigned long frames_sent, send_errors;
+    unsigned long long bytes_sent;
 
-/* Video4Linux에서 사용할 영상 저장을 위한 버퍼 */
-struct buffer {
-    void* start;
-    size_t length;
+    // io_uring 으로 보내는 중인 프레임 (헤더와 데이터를 연결해서 보냄)
+    struct frame_header hdr;
+    struct iovec iov[2];
+    int pending;
+    int hdr_res, data_res;
 };
+static struct client clients[CLIENT_MAX];
+static int streaming_clients = 0;   // 받는 중인 클라이언트 수 (이벤트 루프만 씀)
+
+// 클라이언트가 원하는 크기/포맷으로 바꾼 프레임. 같은 모양은 프레임마다 한 번만 변환
+static struct variant_cache* vc = NULL;
+
+// SIGINT 로 종료. -t 를 줬으면 끝날 때 추적 기록을 저장
+static volatile sig_atomic_t running = 1;
+static const char* trace_path = NULL;
+
+// 캡처/전송 경로의 메트릭. 갱신은 atomic 더하기뿐
+static struct metric m_frames = METRIC_COUNTER("video_capture_frames_total", "Frames dequeued from the capture source");
+static struct metric m_dropped = METRIC_COUNTER("video_capture_dropped_frames_total",
+                                                "Frames lost before dequeue (gaps in v4l2_buffer.sequence)");
+static struct metric m_timeouts = METRIC_COUNTER("video_capture_timeouts_total", "Capture waits that timed out");
+static struct metric m_sent = METRIC_COUNTER("video_frames_sent_total", "Frames sent to the client");
+static struct metric m_bytes = METRIC_COUNTER("video_bytes_sent_total", "Bytes sent to the client, headers included");
+static struct metric m_send_errors = METRIC_COUNTER("video_send_errors_total", "Failed sends");
+static struct metric m_skipped = METRIC_COUNTER("video_packets_skipped_total",
+                                                "H.264 packets dropped because the client's send queue was full");
+static struct metric m_clients = METRIC_GAUGE("video_clients_connected", "Connected clients");
+static struct metric m_streaming = METRIC_GAUGE("video_streaming", "Clients currently receiving frames");
+static struct metric m_lag = METRIC_GAUGE("video_client_lag_microseconds",
+                                          "Capture timestamp to end of send for the last frame");
+static const double send_bounds[] = { 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1 };
+static struct histogram h_send = HISTOGRAM("video_send_seconds", "Time to send one frame", send_bounds);
+static struct histogram h_lag = HISTOGRAM("video_capture_to_send_seconds",
+                                          "Capture timestamp to end of send", send_bounds);
+
+static void register_metrics(void)
+{
+    metric_register(&m_lag);
+    metric_register(&m_streaming);
+    metric_register(&m_clients);
+    metric_register(&m_send_errors);
+    metric_register(&m_skipped);
+    metric_register(&m_bytes);
+    metric_register(&m_sent);
+    metric_register(&m_timeouts);
+    metric_register(&m_dropped);
+    metric_register(&m_frames);
+    histogram_register(&h_lag);
+    histogram_register(&h_send);
+}
 
 static short* fbp = NULL;         /* 프레임버퍼의 MMAP를 위한 변수 */
-struct buffer* buffers = NULL;
-static unsigned int n_buffers = 0;
 static struct fb_var_screeninfo vinfo;                   /* 프레임버퍼의 정보 저장을 위한 구조체 */
 
-static int csock; // 클라이언트 소켓
-
 //int one_flag = 1; 나중에 한번만보내는거 테스트하고싶을때 쓰기
 
-static void setFlag(int signo) {
-    if (signo == SIGUSR1)
-        send_data = 1;
-    if (signo == SIGUSR2)
-        send_data = 0;
+static void stop_running(int signo) {
+    running = 0;
 }
 
 static void mesg_exit(const char* s)
@@ -70,19 +161,12 @@ static void mesg_exit(const char* s)
     exit(EXIT_FAILURE);
 }
 
-static int xioctl(int fd, int request, void* arg)
-{
-    int r;
-    do r = ioctl(fd, request, arg); while (-1 == r && EINTR == errno);
-    return r;
-}
-
 extern inline int clip(int value, int min, int max)
 {
     return(value > max ? max : value < min ? min : value);
 }
 
-void send_camera_data(int client_socket, const void* image_data, size_t image_size) {
+int send_camera_data(int client_socket, const void* image_data, size_t image_size) {
     // 데이터를 클라이언트로 전송
     ssize_t total_sent = 0;
     while (total_sent < image_size) {
@@ -92,210 +176,917 @@ void send_camera_data(int client_socket, const void* image_data, size_t image_si
         ssize_t sent = send(client_socket, image_data + total_sent, image_size - total_sent, 0);
         if (sent == -1) {
             perror("send failed");
-            close(client_socket);
-            return;
+            return -1;
         }
         total_sent += sent;
 
         usleep(20000);
     }
+    return 0;
 }
 
-static int read_frame(int fd)
+// V4L2 타임스탬프(CLOCK_MONOTONIC) -> CLOCK_REALTIME. 다른 장비의 클라이언트와 비교할 수 있게
+static int64_t mono_to_real_us(int64_t mono_us)
 {
-    struct v4l2_buffer buf;
-    memset(&buf, 0, sizeof(buf));
-    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    buf.memory = V4L2_MEMORY_MMAP;
-    if (-1 == xioctl(fd, VIDIOC_DQBUF, &buf)) {
-        switch (errno) {
-        case EAGAIN: return 0;
-        case EIO:
-            /* Could ignore EIO, see spec. */
-        default: mesg_exit("VIDIOC_DQBUF");
-        }
+    struct timespec mono, real;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(CLOCK_REALTIME, &real);
+    return mono_us + ((int64_t)real.tv_sec - mono.tv_sec) * 1000000 + (real.tv_nsec - mono.tv_nsec) / 1000;
+}
+
+// 요청받은 ROI 를 캡처에 적용. 이후 프레임은 ROI 만 보내짐 (헤더의 크기가 바뀜). 모든 클라이언트에 적용
+static int apply_roi(const struct capture_rect* r)
+{
+    struct capture_rect roi, full;
+    struct capture_format fmt;
+
+    // simulcast 인코더는 열 때 크기로 고정이므로 같은 크기로 옮기는 것만
+    capture_get_format(cap, &fmt);
+    if (sc && (r->width != fmt.width || r->height != fmt.height)) {
+        fprintf(stderr, "roi: simulcast encodes %dx%d, only moving the region is allowed\n", fmt.width, fmt.height);
+        return -1;
     }
+    if (capture_set_roi(cap, r) < 0)
+        return -1;
+    capture_get_roi(cap, &roi, &full);
+    printf("roi %dx%d+%d+%d of %dx%d\n", roi.width, roi.height, roi.left, roi.top, full.width, full.height);
+    return 0;
+}
+
+// 원본 경로로 c 에게 보낼 데이터와 헤더 값 (variant 캐시에서. 기본 모양이고 줄 끝 여백이 없으면 캡처 버퍼 그대로)
+static const unsigned char* raw_payload(const struct client* c, const struct capture_frame* f, uint32_t* magic,
+                                        int* width, int* height, size_t* size, int64_t* t)
+{
+    const unsigned char* data = variant_get(vc, c->variant_id, f, width, height, size);
 
-    if (send_data) {
-        // 카메라에서 얻은 데이터를 클라이언트에게 전송
-        size_t image_size = buffers[buf.index].length;
-        send_camera_data(csock, buffers[buf.index].start, image_size);
+    if (!data)
+        return NULL;
+    *magic = c->variant.pixelformat == V4L2_PIX_FMT_RGB565 ? RGB565_MAGIC : FRAME_MAGIC;
+    int64_t t1 = trace_now();
+    trace_event("convert", f->sequence, *t, t1);
+    *t = t1;
+    return data;
+}
+
+// 원본 프레임을 받을 클라이언트 (구독 중이고 simulcast 화질을 고르지 않음)
+// 큐에 못 보낸 응답이나 패킷이 남아 있으면 그 뒤에 섞이지 않게 이번 프레임은 건너뜀
+// (원본은 이 스레드만 보내고, 화질을 고르지 않은 클라이언트의 큐는 인코더 스레드가 건드리지 않음)
+static int wants_raw(const struct client* c)
+{
+    return c->sock >= 0 && !c->dead && c->streaming && c->level < 0 && !c->out_len;
+}
+
+// 한 클라이언트에게 프레임 하나를 보낸 결과를 메트릭과 클라이언트 통계에 남김. 실패하면 그 연결은 정리 대상
+static void client_sent(struct client* c, int ok, size_t bytes, int64_t capture_us, int64_t t_send)
+{
+    int64_t t1 = trace_now();
+
+    if (!ok) {
+        metric_add(&m_send_errors, 1);
+        c->send_errors++;
+        c->dead = 1;
+        return;
     }
+    metric_add(&m_sent, 1);
+    metric_add(&m_bytes, bytes);
+    histogram_observe_ns(&h_send, t1 - t_send);
+    histogram_observe_ns(&h_lag, t1 - capture_us * 1000);
+    metric_set(&m_lag, t1 / 1000 - capture_us);
+    c->frames_sent++;
+    c->bytes_sent += bytes;
+}
 
-    if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
-        mesg_exit("VIDIOC_QBUF");
+static int read_frame(struct capture* cap)
+{
+    struct capture_frame f;
+    int r = capture_read(cap, &f, 2000);
+    if (-1 == r)
+        mesg_exit("capture_read");
+    if (0 == r) {
+        fprintf(stderr, "select timeout\n");
+        metric_add(&m_timeouts, 1);
+        return 0;
+    }
+    // 드라이버가 프레임을 채운 시각부터 DQBUF 로 꺼낼 때까지
+    int64_t t = trace_now();
+    trace_event("dqbuf", f.sequence, f.timestamp_us * 1000, t);
+
+    // 놓친 프레임은 capture 가 sequence 가 건너뛴 것으로 계산해줌
+    metric_add(&m_frames, 1);
+    if (f.dropped)
+        metric_add(&m_dropped, f.dropped);
+    if (ring)
+        shmring_publish(ring, &f);
+
+    for (int i = 0; i < CLIENT_MAX; i++) {
+        struct client* c = &clients[i];
+        struct frame_header hdr;
+        uint32_t magic;
+        int width, height;
+        size_t size;
+        const unsigned char* data;
+
+        if (!wants_raw(c) || !(data = raw_payload(c, &f, &magic, &width, &height, &size, &t)))
+            continue;
+        // 프레임 번호와 캡처 시각을 담은 헤더 뒤에 데이터 (헤더는 데이터와 한 세그먼트로 나가도록 MSG_MORE)
+        frame_header_pack_magic(&hdr, magic, f.sequence, width, height, size, mono_to_real_us(f.timestamp_us));
+        if (send(c->sock, &hdr, sizeof(hdr), MSG_MORE) != sizeof(hdr)) {
+            perror("send header");
+            client_sent(c, 0, 0, f.timestamp_us, t);
+        } else {
+            client_sent(c, send_camera_data(c->sock, data, size) == 0, sizeof(hdr) + size, f.timestamp_us, t);
+        }
+        trace_event("send", f.sequence, t, trace_now());
+    }
+
+    if (-1 == capture_release(cap, &f))
+        mesg_exit("capture_release");
 
     return 1;
 }
 
-static void mainloop(int fd)
+/* ---------------------------------------------------------------- 이벤트 루프 (-e poll | uring) */
+
+// 기존 루프는 전송 조각마다 20ms, 프레임마다 50ms 를 쉬어서 카메라 fps 를 못 따라감
+// 이벤트 루프는 카메라 프레임에 맞춰 돌고, 헤더와 데이터를 한 번에 보냄
+//   poll  : 카메라 fd 와 클라이언트 소켓을 poll() 하나로 기다림 + DQBUF/QBUF + writev()
+//   uring : 카메라 fd 대기와 전송을 io_uring 에 쌓아서 프레임당 io_uring_enter 한 번
+//           캡처 버퍼를 고정 버퍼로 등록해서 전송할 때 페이지 고정을 생략
+// V4L2 DQBUF/QBUF 는 io_uring 으로 보낼 수 없는 ioctl 이라 어느 쪽이든 직접 부름
+
+enum { LOOP_LEGACY, LOOP_POLL, LOOP_URING };
+
+// 전송 작업의 tag 는 TAG_SEND + 클라이언트 번호 * 2 (+1 이면 데이터, 아니면 헤더)
+#define TAG_POLL 1
+#define TAG_SEND 16
+
+struct sender {
+    struct uring* u;                 // NULL 이면 writev
+    int n_fixed;                     // 등록한 고정 버퍼 수 (0 이면 writev 로 보냄)
+    int armed;                       // 카메라 fd POLL_ADD 가 걸려 있음
+
+    // 보내는 중인 프레임. 모든 클라이언트에게 io_uring 전송이 끝날 때까지 캡처 버퍼를 돌려주지 않음
+    int busy;
+    int pending;                     // 완료를 기다리는 전송 작업 수 (클라이언트마다 헤더 + 데이터)
+    struct capture_frame f;
+    int64_t t_send;                  // 전송을 시작한 시각 (trace_now)
+};
+
+// 남은 iov 를 끝까지 씀 (짧은 쓰기 처리). skip 바이트는 이미 보낸 것
+static int writev_all(int fd, struct iovec* iov, int cnt, size_t skip)
 {
-    fd_set fds;
-    struct timeval tv;
-    int r;
-
-    while (1) {
-        // 카메라 데이터 계속 읽기 및 갱신
-        while (1) {
-            FD_ZERO(&fds);
-            FD_SET(fd, &fds);
-
-            tv.tv_sec = 2;
-            tv.tv_usec = 0;
-
-            r = select(fd + 1, &fds, NULL, NULL, &tv);
-            if (-1 == r) {
-                if (EINTR == errno) continue;
-                mesg_exit("select");
-            }
-            else if (0 == r) {
-                fprintf(stderr, "select timeout\n");
+    while (cnt > 0) {
+        if (skip >= iov->iov_len) {
+            skip -= iov->iov_len;
+            iov++;
+            cnt--;
+            continue;
+        }
+        iov->iov_base = (char*)iov->iov_base + skip;
+        iov->iov_len -= skip;
+        ssize_t n = writev(fd, iov, cnt);
+        if (n == -1) {
+            if (errno == EINTR) { skip = 0; continue; }
+            perror("writev");
+            return -1;
+        }
+        skip = n;
+    }
+    return 0;
+}
+
+// 큐에 남은 것을 소켓이 받는 만큼 보냄. send_lock 을 잡은 채로 불리고 막히지 않음
+static void client_flush(struct client* c)
+{
+    while (c->out_len) {
+        ssize_t n = send(c->sock, c->out + c->out_off, c->out_len, MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR)
                 continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("send");
+                client_sent(c, 0, 0, 0, 0);
             }
+            return;
+        }
+        c->out_off += n;
+        c->out_len -= n;
+    }
+    c->out_off = 0;
+}
 
-            // 카메라 데이터 읽기 및 처리
-            if (read_frame(fd)) {
-                usleep(50000); // 50ms대기 (전송속도 조절)
-                break;
-            }
+// 메시지 하나(iov)를 보냄. 큐가 비어 있으면 바로 보내고 소켓이 받지 못한 나머지만 큐에 넣음
+// send_lock 을 잡은 채로 불리고 막히지 않음. 0 이면 보냈거나 큐에 넣음, 1 이면 큐가 넘쳐서 아무것도 안 보냄, 실패하면 -1
+static int client_queue(struct client* c, const struct iovec* iov, int cnt)
+{
+    size_t len = 0, done = 0;
+
+    for (int i = 0; i < cnt; i++)
+        len += iov[i].iov_len;
+    client_flush(c);
+    if (c->dead)
+        return -1;
+    if (len > CLIENT_OUTQ_MAX - c->out_len)
+        return 1;
+
+    if (!c->out_len) {
+        struct msghdr msg;
+        ssize_t n;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = (struct iovec*)iov;
+        msg.msg_iovlen = cnt;
+        do
+            n = sendmsg(c->sock, &msg, MSG_DONTWAIT);
+        while (n < 0 && errno == EINTR);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            perror("sendmsg");
+            return -1;
+        }
+        if (n > 0)
+            done = n;
+        if (done == len)
+            return 0;
+    }
+
+    // 나머지를 큐 끝에 붙임. 자리가 모자라면 앞으로 당기고, 그래도 모자라면 늘림
+    if (c->out_off && c->out_off + c->out_len + len - done > c->out_cap) {
+        memmove(c->out, c->out + c->out_off, c->out_len);
+        c->out_off = 0;
+    }
+    if (c->out_len + len - done > c->out_cap) {
+        size_t cap = c->out_cap ? c->out_cap : 64 * 1024;
+        while (cap < c->out_len + len - done)
+            cap *= 2;
+        unsigned char* out = realloc(c->out, cap);
+        if (!out) {
+            perror("realloc");
+            return -1;
         }
+        c->out = out;
+        c->out_cap = cap;
+    }
+    for (int i = 0; i < cnt; i++) {
+        size_t skip = done < iov[i].iov_len ? done : iov[i].iov_len;
+        memcpy(c->out + c->out_off + c->out_len, (const char*)iov[i].iov_base + skip, iov[i].iov_len - skip);
+        c->out_len += iov[i].iov_len - skip;
+        done -= skip;
+    }
+    return 0;
+}
+
+// 모든 클라이언트에게 전송이 끝난 프레임의 추적을 남기고 캡처 버퍼를 돌려줌
+static void send_done(struct sender* s)
+{
+    trace_event("send", s->f.sequence, s->t_send, trace_now());
+    if (-1 == capture_release(cap, &s->f))
+        mesg_exit("capture_release");
+    s->busy = 0;
+}
+
+// 마지막 키프레임부터 보낸 모양 그대로 모아 둔 것 (화질별, 그 화질 인코더 스레드만 씀)
+// 화질을 새로 구독하면 그 클라이언트의 want_burst 가 켜지고, 인코더 스레드가 다음 패킷 때 캐시를 통째로 보냄
+// -> 클라이언트는 키프레임을 기다리지 않고 바로 디코딩을 시작 (첫 화면까지 한 프레임 간격 + 전송 시간)
+static struct gopcache* gop[SIMULCAST_MAX];
+
+// 큐가 넘침: 이 패킷은 버리고 다음 키프레임부터 다시 보냄 (중간 패킷이 빠지면 다음 키프레임까지 디코딩이 깨지므로)
+static void client_skip(struct client* c, int level)
+{
+    metric_add(&m_skipped, 1);
+    if (!c->wait_key)
+        simulcast_request_keyframe(sc, level);
+    c->wait_key = 1;
+}
+
+// 새 구독자에게 캐시를 보냄. 캐시가 비어 있으면 (첫 키프레임 전이거나 넘침) 키프레임을 요청하고 0
+// send_lock 을 잡은 채로 불림. 큐에 다 들어가지 않으면 다음 키프레임부터 보냄
+static int send_burst(struct client* c, int level)
+{
+    const void* data;
+    unsigned int frames;
+    size_t len = gopcache_get(gop[level], &data, &frames);
+
+    if (!len) {
+        simulcast_request_keyframe(sc, level);
+        return 0;
+    }
+    struct iovec iov = { (void*)data, len };
+    int64_t t = trace_now();
+    int r = client_queue(c, &iov, 1);
+    trace_event("burst", frames, t, trace_now());
+    if (r == 0) {
+        metric_add(&m_sent, frames);
+        metric_add(&m_bytes, len);
+        c->frames_sent += frames;
+        c->bytes_sent += len;
+        c->wait_key = 0;
+    } else if (r > 0) {
+        client_skip(c, level);
+    } else {
+        client_sent(c, 0, 0, 0, t);
     }
+    return 1;
 }
 
-static void start_capturing(int fd)
+// simulcast 인코더 스레드에서 불림. 캐시에 넣고, 이 화질을 구독한 클라이언트에게 보냄
+static void send_packet(void* arg, const struct simulcast_packet* p)
 {
-    for (int i = 0; i < n_buffers; ++i) {
-        struct v4l2_buffer buf;
-        memset(&buf, 0, sizeof(buf));
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = i;
-        if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
-            mesg_exit("VIDIOC_QBUF");
+    struct frame_header hdr;
+    struct iovec iov[2];
+    int width, height;
+
+    simulcast_get_size(sc, p->level, &width, &height);
+    frame_header_pack_magic(&hdr, H264_MAGIC, p->sequence, width, height, p->pkt->size,
+                            mono_to_real_us(p->timestamp_us));
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = p->pkt->data;
+    iov[1].iov_len = p->pkt->size;
+    gopcache_add(gop[p->level], p->pkt->flags & AV_PKT_FLAG_KEY, iov, 2);
+
+    pthread_mutex_lock(&send_lock);
+    for (int i = 0; i < CLIENT_MAX; i++) {
+        struct client* c = &clients[i];
+        if (c->sock < 0 || c->dead || !c->streaming || c->level != p->level)
+            continue;
+        // 캐시에는 이 패킷까지 들어 있음. 캐시가 비어 있으면 키프레임이 올 때까지 보내지 않고 기다림
+        if (c->want_burst) {
+            if (send_burst(c, p->level))
+                c->want_burst = 0;
+            continue;
+        }
+        if (c->wait_key && !(p->pkt->flags & AV_PKT_FLAG_KEY)) {
+            metric_add(&m_skipped, 1);
+            continue;
+        }
+        c->wait_key = 0;
+        int64_t t = trace_now();
+        int r = client_queue(c, iov, 2);
+        if (r > 0)
+            client_skip(c, p->level);
+        else
+            client_sent(c, r == 0, sizeof(hdr) + p->pkt->size, p->timestamp_us, t);
+        trace_event("send", p->sequence, t, trace_now());
     }
+    pthread_mutex_unlock(&send_lock);
+}
 
-    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    // VIDIOC_STREAMON : V4L2장치에서 스트리밍을 시작하는 명령
-    // 이 명령 호출시 장치가 지속적으로 프레임을 캡쳐하여 VIDIOC_QBUF 으로 큐에 있는 버퍼에 데이터저장
-    // 이후 VIDIOC_DQBUF 시 큐에서 사용가능한 버퍼 꺼내 프레임데이터 처리가능
-    if (-1 == xioctl(fd, VIDIOC_STREAMON, &type))
-        mesg_exit("VIDIOC_STREAMON");
+// 와 있는 완료를 모두 처리 (시스템 콜 없음). 처리한 수
+static int sender_reap(struct sender* s)
+{
+    uint64_t tag;
+    int res, n = 0;
+
+    while (uring_peek(s->u, &tag, &res)) {
+        n++;
+        if (tag == TAG_POLL) {
+            s->armed = 0;
+            continue;
+        }
+        struct client* c = &clients[(tag - TAG_SEND) / 2];
+        if ((tag - TAG_SEND) % 2 == 0)
+            c->hdr_res = res;
+        else
+            c->data_res = res;
+        s->pending--;
+        if (--c->pending == 0) {
+            // 헤더가 덜 나가면 연결된 데이터 전송은 -ECANCELED. 남은 부분은 직접 보냄
+            int ok = 1;
+            size_t bytes = c->iov[0].iov_len + c->iov[1].iov_len;
+            if (c->hdr_res < 0 || (c->data_res < 0 && c->data_res != -ECANCELED)) {
+                errno = -(c->hdr_res < 0 ? c->hdr_res : c->data_res);
+                perror("io_uring send");
+                ok = 0;
+            } else {
+                size_t done = c->hdr_res + (c->data_res > 0 ? c->data_res : 0);
+                struct iovec iov[2] = { c->iov[0], c->iov[1] };
+                if (done < bytes && writev_all(c->sock, iov, 2, done) < 0)
+                    ok = 0;
+            }
+            client_sent(c, ok, bytes, s->f.timestamp_us, s->t_send);
+        }
+        if (s->pending == 0 && s->busy)
+            send_done(s);
+    }
+    return n;
 }
 
-static void init_mmap(int fd)
+// 보내는 중인 프레임이 있으면 끝날 때까지 기다림
+static void sender_wait(struct sender* s)
 {
-    struct v4l2_requestbuffers req;
-    memset(&req, 0, sizeof(req));
-    req.count = 4;
-    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    req.memory = V4L2_MEMORY_MMAP;
-    if (-1 == xioctl(fd, VIDIOC_REQBUFS, &req)) {
-        if (EINVAL == errno) {
-            fprintf(stderr, "%s does not support memory mapping\n", VIDEODEV);
-            exit(EXIT_FAILURE);
+    while (s->busy) {
+        if (uring_submit(s->u, 1, 2000) < 0)
+            mesg_exit("io_uring_enter");
+        sender_reap(s);
+    }
+}
+
+// 원본을 받는 클라이언트 모두에게 f 를 (각자 고른 모양으로) 보냄
+// writev 면 여기서 다 보내고 캡처 버퍼를 돌려줌. io_uring 이면 큐에 넣기만 하고 완료는 sender_reap 에서
+static void sender_start(struct sender* s, const struct capture_frame* f, int64_t t)
+{
+    s->f = *f;
+    s->busy = 1;
+    s->pending = 0;
+
+    for (int i = 0; i < CLIENT_MAX; i++) {
+        struct client* c = &clients[i];
+        uint32_t magic;
+        int width, height;
+        size_t size;
+        const unsigned char* data;
+
+        if (!wants_raw(c) || !(data = raw_payload(c, f, &magic, &width, &height, &size, &t)))
+            continue;
+        frame_header_pack_magic(&c->hdr, magic, f->sequence, width, height, size, mono_to_real_us(f->timestamp_us));
+        c->iov[0].iov_base = &c->hdr;
+        c->iov[0].iov_len = sizeof(c->hdr);
+        c->iov[1].iov_base = (void*)data;
+        c->iov[1].iov_len = size;
+
+        if (!s->u) {
+            // 헤더와 데이터를 writev 한 번으로 (보통 한 번에 다 나감)
+            struct iovec iov[2] = { c->iov[0], c->iov[1] };
+            client_sent(c, writev_all(c->sock, iov, 2, 0) == 0, sizeof(c->hdr) + size, f->timestamp_us, t);
+            continue;
         }
-        else {
-            mesg_exit("VIDIOC_REQBUFS");
+
+        // 헤더 다음에 데이터가 나가도록 연결(LINK). 고정 버퍼(캡처 버퍼)에 있는 데이터는 WRITE_FIXED
+        // variant 캐시가 변환한 버퍼는 등록하지 않았으므로 그냥 writev. 소켓은 파일 위치가 없으므로 off 는 0
+        int index = data == f->data ? f->index : -1;
+        c->hdr_res = c->data_res = 0;
+        c->pending = 2;
+        s->pending += 2;
+        if (uring_writev(s->u, c->sock, &c->iov[0], 1, 0, URING_LINK, TAG_SEND + i * 2) < 0 ||
+            (s->n_fixed && index >= 0 ? uring_write_fixed(s->u, c->sock, data, size, 0, index, 0, TAG_SEND + i * 2 + 1)
+                        : uring_writev(s->u, c->sock, &c->iov[1], 1, 0, 0, TAG_SEND + i * 2 + 1)) < 0) {
+            fprintf(stderr, "io_uring queue full\n");
+            exit(EXIT_FAILURE);
         }
     }
+    s->t_send = t;
+    if (!s->pending)
+        send_done(s);
+}
+
+static struct uring* setup_uring(struct sender* s)
+{
+    struct iovec iov[VIDEO_MAX_FRAME];
+    struct uring* u = uring_create(2 * CLIENT_MAX + 16);
+    int n;
 
-    if (req.count < 2) {
-        fprintf(stderr, "Insufficient buffer memory on %s\n", VIDEODEV);
-        exit(EXIT_FAILURE);
+    if (!u)
+        return NULL;
+    // 카메라가 멈추면 제한 시간 없이 io_uring_enter 에 잡혀서 새 연결과 제어 요청을 못 봄
+    if (!uring_has_timeout(u)) {
+        fprintf(stderr, "io_uring: kernel cannot time out waits (needs 5.11+)\n");
+        uring_free(u);
+        return NULL;
     }
+    // 버퍼 등록은 RLIMIT_MEMLOCK 에 걸릴 수 있음. 실패하면 등록 없이 writev
+    n = capture_get_buffers(cap, iov, VIDEO_MAX_FRAME);
+    if (n > 0) {
+        if (uring_register_buffers(u, iov, n) == 0)
+            s->n_fixed = n;
+        else
+            perror("io_uring register buffers");
+    }
+    return u;
+}
+
+static void print_cpu_usage(const char* loop, long frames, const struct rusage* r0, unsigned long enters)
+{
+    struct rusage r1;
+    getrusage(RUSAGE_SELF, &r1);
+    double user = (r1.ru_utime.tv_sec - r0->ru_utime.tv_sec) * 1e6 + (r1.ru_utime.tv_usec - r0->ru_utime.tv_usec);
+    double sys = (r1.ru_stime.tv_sec - r0->ru_stime.tv_sec) * 1e6 + (r1.ru_stime.tv_usec - r0->ru_stime.tv_usec);
+    long csw = (r1.ru_nvcsw - r0->ru_nvcsw) + (r1.ru_nivcsw - r0->ru_nivcsw);
+
+    if (frames <= 0)
+        return;
+    printf("BENCH loop=%s frames=%ld cpu_us_per_frame=%.1f user_us=%.1f sys_us=%.1f ctxsw_per_frame=%.2f"
+           " uring_enter_per_frame=%.2f\n", loop, frames, (user + sys) / frames, user / frames, sys / frames,
+           (double)csw / frames, (double)enters / frames);
+}
+
+/* ---------------------------------------------------------------- 클라이언트 연결과 제어 요청 */
 
-    buffers = calloc(req.count, sizeof(*buffers));
-    if (!buffers) {
-        fprintf(stderr, "Out of memory\n");
-        exit(EXIT_FAILURE);
+static void client_accept(void)
+{
+    struct variant_key key = { 0, 0, V4L2_PIX_FMT_YUYV };
+    struct timeval tv = { CLIENT_SEND_TIMEOUT, 0 };
+    struct client* c = NULL;
+    int sock, id;
+
+    sock = accept(ssock, (struct sockaddr*)&cliaddr, &clen);
+    if (sock < 0) {
+        perror("accept()");
+        return;
+    }
+    for (int i = 0; i < CLIENT_MAX && !c; i++)
+        if (clients[i].sock < 0)
+            c = &clients[i];
+    // 모양은 연결마다 하나씩 잡아 두므로 슬롯이 모자랄 일은 없지만 혹시 몰라서
+    id = c ? variant_acquire(vc, &key) : -1;
+    if (id < 0) {
+        fprintf(stderr, "%s: too many clients\n", inet_ntoa(cliaddr.sin_addr));
+        close(sock);
+        return;
     }
+    // 원본은 모든 클라이언트에게 이벤트 루프에서 차례로 (막히는 쓰기로) 보내므로
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
 
-    for (n_buffers = 0; n_buffers < req.count; ++n_buffers) {
-        struct v4l2_buffer buf;
-        memset(&buf, 0, sizeof(buf));
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        buf.index = n_buffers;
-        if (-1 == xioctl(fd, VIDIOC_QUERYBUF, &buf))
-            mesg_exit("VIDIOC_QUERYBUF");
+    pthread_mutex_lock(&send_lock);
+    memset(c, 0, sizeof(*c));
+    c->level = -1;
+    c->variant = key;
+    c->variant_id = id;
+    c->sock = sock;
+    pthread_mutex_unlock(&send_lock);
+    metric_add(&m_clients, 1);
+    printf("client %s connected\n", inet_ntoa(cliaddr.sin_addr));
+}
+
+static void client_close(struct sender* s, struct client* c)
+{
+    // io_uring 으로 이 소켓에 보내는 중일 수 있음
+    if (s && s->busy)
+        sender_wait(s);
+    pthread_mutex_lock(&send_lock);
+    close(c->sock);
+    c->sock = -1;
+    c->streaming = 0;
+    free(c->out);
+    c->out = NULL;
+    c->out_off = c->out_len = c->out_cap = 0;
+    pthread_mutex_unlock(&send_lock);
+    variant_release(vc, c->variant_id);
+    metric_add(&m_clients, -1);
+    printf("client disconnected (%lu frames sent)\n", c->frames_sent);
+}
+
+// 응답 하나를 보냄. 보내는 중인 프레임과 섞이지 않게 io_uring 전송이 끝나길 기다리고, 인코더 스레드와는 send_lock
+// 소켓이 받지 못한 것은 큐에 남기고 control_poll 이 마저 보냄. 큐가 넘칠 만큼 안 받는 연결은 끊음
+static void client_reply(struct sender* s, struct client* c, const struct ctrl_request* rq, int status,
+                         const void* data, size_t size)
+{
+    struct ctrl_reply r;
+    struct iovec iov[2] = { { &r, sizeof(r) }, { (void*)data, size } };
 
-        buffers[n_buffers].length = buf.length;
-        buffers[n_buffers].start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
-            MAP_SHARED, fd, buf.m.offset);
-        if (MAP_FAILED == buffers[n_buffers].start)
-            mesg_exit("mmap");
+    if (s && s->busy)
+        sender_wait(s);
+    ctrl_reply_pack(&r, rq->id, rq->type, status, size);
+    pthread_mutex_lock(&send_lock);
+    if (client_queue(c, iov, size ? 2 : 1) != 0)
+        c->dead = 1;
+    pthread_mutex_unlock(&send_lock);
+}
+
+// SET_FORMAT: simulcast 화질 또는 원본의 모양. 실패하면 -errno 이고 이전 형식 그대로
+static int set_format(struct client* c, const struct ctrl_format* fm)
+{
+    int level = (int32_t)ntohl(fm->level);
+
+    if (level >= 0) {
+        if (!sc || level >= simulcast_levels(sc))
+            return -EINVAL;
+        pthread_mutex_lock(&send_lock);
+        if (c->level != level)
+            c->want_burst = 1;
+        c->level = level;
+        pthread_mutex_unlock(&send_lock);
+        return 0;
     }
+
+    struct variant_key key = { ntohl(fm->width), ntohl(fm->height), ntohl(fm->pixelformat) };
+    if (!key.pixelformat)
+        key.pixelformat = V4L2_PIX_FMT_YUYV;
+    // 폭은 두 픽셀 단위로 내림하므로 1 은 0 (보낼 것이 없음)
+    if (key.width < 0 || key.height < 0 || key.width == 1 ||
+        (key.pixelformat != V4L2_PIX_FMT_YUYV && key.pixelformat != V4L2_PIX_FMT_RGB565))
+        return -EINVAL;
+    // 새 모양을 먼저 잡고 이전 것을 놓음 (같은 모양이면 구독 수만 올랐다 내려감)
+    int id = variant_acquire(vc, &key);
+    if (id < 0)
+        return -ENOSPC;
+    variant_release(vc, c->variant_id);
+    pthread_mutex_lock(&send_lock);
+    c->variant = key;
+    c->variant_id = id;
+    c->level = -1;
+    pthread_mutex_unlock(&send_lock);
+    return 0;
 }
 
-static void init_device(int fd)
+static void handle_request(struct sender* s, struct client* c, const struct ctrl_request* rq, const unsigned char* arg)
 {
-    struct v4l2_capability cap;
-    struct v4l2_cropcap cropcap;
-    struct v4l2_crop crop;
-    struct v4l2_format fmt;
-    unsigned int min;
-
-    if (-1 == xioctl(fd, VIDIOC_QUERYCAP, &cap)) {
-        if (EINVAL == errno) {
-            fprintf(stderr, "%s is no V4L2 device\n", VIDEODEV);
-            exit(EXIT_FAILURE);
+    int status = 0;
+
+    switch (rq->type) {
+    case CTRL_SUBSCRIBE:
+        pthread_mutex_lock(&send_lock);
+        if (!c->streaming && c->level >= 0)
+            c->want_burst = 1;
+        c->streaming = 1;
+        pthread_mutex_unlock(&send_lock);
+        break;
+    case CTRL_UNSUBSCRIBE:
+        pthread_mutex_lock(&send_lock);
+        c->streaming = 0;
+        pthread_mutex_unlock(&send_lock);
+        break;
+    case CTRL_SET_FORMAT: {
+        struct ctrl_format fm;
+        if (rq->size != sizeof(fm)) {
+            status = -EINVAL;
+            break;
         }
-        else {
-            mesg_exit("VIDIOC_QUERYCAP");
+        memcpy(&fm, arg, sizeof(fm));
+        status = set_format(c, &fm);
+        break;
+    }
+    case CTRL_SET_ROI: {
+        struct ctrl_rect cr;
+        if (rq->size != sizeof(cr)) {
+            status = -EINVAL;
+            break;
         }
+        memcpy(&cr, arg, sizeof(cr));
+        struct capture_rect r = { (int32_t)ntohl(cr.left), (int32_t)ntohl(cr.top), ntohl(cr.width), ntohl(cr.height) };
+        // io_uring 으로 보내는 중인 캡처 버퍼가 있으면 ROI 를 바꾸기 전에 끝냄
+        if (s && s->busy)
+            sender_wait(s);
+        status = apply_roi(&r) < 0 ? -EINVAL : 0;
+        break;
+    }
+    case CTRL_REQUEST_KEYFRAME:
+        if (!sc || c->level < 0)
+            status = -EINVAL;
+        else
+            simulcast_request_keyframe(sc, c->level);
+        break;
+    case CTRL_GET_STATS: {
+        struct capture_stats cst;
+        struct ctrl_stats st;
+        int connected = 0;
+        for (int i = 0; i < CLIENT_MAX; i++)
+            connected += clients[i].sock >= 0;
+        capture_get_stats(cap, &cst);
+        st.frames_sent = htonl(c->frames_sent);
+        st.bytes_hi = htonl(c->bytes_sent >> 32);
+        st.bytes_lo = htonl((uint32_t)c->bytes_sent);
+        st.send_errors = htonl(c->send_errors);
+        st.captured = htonl(cst.frames);
+        st.dropped = htonl(cst.dropped);
+        st.clients = htonl(connected);
+        st.streaming = htonl(streaming_clients);
+        client_reply(s, c, rq, 0, &st, sizeof(st));
+        return;
+    }
+    default:
+        status = -ENOTSUP;
+        break;
     }
+    client_reply(s, c, rq, status, NULL, 0);
+}
+
+// 소켓에 와 있는 것을 읽고 다 받은 요청을 모두 처리
+static void client_input(struct sender* s, struct client* c)
+{
+    ssize_t n = recv(c->sock, c->in + c->in_len, sizeof(c->in) - c->in_len, MSG_DONTWAIT);
 
-    if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)) {
-        fprintf(stderr, "%s is no video capture device\n",
-            VIDEODEV);
-        exit(EXIT_FAILURE);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (n <= 0) {
+        if (n < 0)
+            perror("recv()");
+        c->dead = 1;
+        return;
     }
+    c->in_len += n;
+    while (c->in_len >= sizeof(struct ctrl_request)) {
+        struct ctrl_request rq;
+        memcpy(&rq, c->in, sizeof(rq));
+        if (ctrl_request_unpack(&rq) < 0) {
+            fprintf(stderr, "%s: bad control request, closing\n", inet_ntoa(cliaddr.sin_addr));
+            c->dead = 1;
+            return;
+        }
+        size_t len = sizeof(rq) + rq.size;
+        if (c->in_len < len)
+            break;
+        handle_request(s, c, &rq, c->in + sizeof(rq));
+        memmove(c->in, c->in + len, c->in_len - len);
+        c->in_len -= len;
+    }
+}
+
+// 새 연결과 제어 요청을 처리. 캡처 시스템 콜 사이에서만 불리므로 요청이 DQBUF/전송을 끊는 일이 없음
+// cap_fd 가 0 이상이면 카메라 fd 도 같이 기다리고 프레임이 왔으면 *cam_ready = 1 (poll 루프)
+// 돌려주는 값은 poll 과 같음 (0 이면 timeout_ms 동안 아무 일도 없음)
+static int control_poll(struct sender* s, int cap_fd, int timeout_ms, int* cam_ready)
+{
+    struct pollfd pfd[CLIENT_MAX + 2];
+    struct client* who[CLIENT_MAX + 2];
+    int n = 0, cam = -1, r;
 
-    if (!(cap.capabilities & V4L2_CAP_STREAMING)) {
-        fprintf(stderr, "%s does not support streaming i/o\n", VIDEODEV);
-        exit(EXIT_FAILURE);
+    if (cap_fd >= 0) {
+        cam = n;
+        pfd[n].fd = cap_fd;
+        pfd[n++].events = POLLIN;
     }
+    pfd[n].fd = ssock;
+    pfd[n].events = POLLIN;
+    who[n++] = NULL;
+    // 큐에 못 보낸 것이 있으면 소켓이 받을 수 있을 때도 깨어남
+    pthread_mutex_lock(&send_lock);
+    for (int i = 0; i < CLIENT_MAX; i++) {
+        if (clients[i].sock < 0 || clients[i].dead)
+            continue;
+        pfd[n].fd = clients[i].sock;
+        pfd[n].events = POLLIN | (clients[i].out_len ? POLLOUT : 0);
+        who[n++] = &clients[i];
+    }
+    pthread_mutex_unlock(&send_lock);
 
-    /* Select video input, video standard and tune here. */
-    memset(&cropcap, 0, sizeof(cropcap));
-    cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (0 == xioctl(fd, VIDIOC_CROPCAP, &cropcap)) {
-        crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        crop.c = cropcap.defrect; /* reset to default */
-        xioctl(fd, VIDIOC_S_CROP, &crop);
+    r = poll(pfd, n, timeout_ms);
+    if (r < 0 && errno != EINTR)
+        perror("poll");
+    for (int i = 0; r > 0 && i < n; i++) {
+        if (i == cam || !pfd[i].revents)
+            continue;
+        if (!who[i]) {
+            client_accept();
+            continue;
+        }
+        if (pfd[i].revents & POLLOUT) {
+            pthread_mutex_lock(&send_lock);
+            client_flush(who[i]);
+            pthread_mutex_unlock(&send_lock);
+        }
+        if (pfd[i].revents & ~POLLOUT)
+            client_input(s, who[i]);
     }
+    if (cam_ready)
+        *cam_ready = r > 0 && cam >= 0 && pfd[cam].revents;
 
-    memset(&fmt, 0, sizeof(fmt));
-    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    fmt.fmt.pix.width = WIDTH;
-    fmt.fmt.pix.height = HEIGHT;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
-    fmt.fmt.pix.field = V4L2_FIELD_NONE;
-    if (-1 == xioctl(fd, VIDIOC_S_FMT, &fmt))
-        mesg_exit("VIDIOC_S_FMT");
+    // 끊긴 연결 정리 (인코더 스레드에서 보내다 실패한 것도)
+    streaming_clients = 0;
+    for (int i = 0; i < CLIENT_MAX; i++) {
+        if (clients[i].sock >= 0 && clients[i].dead)
+            client_close(s, &clients[i]);
+        streaming_clients += clients[i].sock >= 0 && clients[i].streaming;
+    }
+    metric_set(&m_streaming, streaming_clients);
+    return r;
+}
 
-    /* Buggy driver paranoia. */
-    min = fmt.fmt.pix.width * 2;
-    if (fmt.fmt.pix.bytesperline < min)
-        fmt.fmt.pix.bytesperline = min;
-    min = fmt.fmt.pix.bytesperline * fmt.fmt.pix.height;
-    if (fmt.fmt.pix.sizeimage < min)
-        fmt.fmt.pix.sizeimage = min;
+static void mainloop(struct capture* cap)
+{
+    while (running) {
+        control_poll(NULL, -1, 0, NULL);
+        // 카메라 데이터 읽기 및 처리
+        if (read_frame(cap))
+            usleep(50000); // 50ms대기 (전송속도 조절)
+    }
+}
 
-    init_mmap(fd);
+static void event_loop(struct capture* cap, int loop, long max_frames)
+{
+    struct sender s;
+    struct rusage r0;
+    int fd = capture_fd(cap);
+    long frames = 0;
+    unsigned long enters0 = 0;
+
+    memset(&s, 0, sizeof(s));
+    if (loop == LOOP_URING) {
+        s.u = setup_uring(&s);
+        if (!s.u) {
+            fprintf(stderr, "io_uring not available, using poll\n");
+            loop = LOOP_POLL;
+        }
+    }
+    memset(&r0, 0, sizeof(r0));
+
+    while (running && (!max_frames || frames < max_frames)) {
+        struct capture_frame f;
+        int r;
+
+        if (s.u && fd >= 0) {
+            // 카메라 fd 대기 + 이전 프레임 전송을 제출하고, 새 프레임과 전송 완료를 같이 기다림
+            // -> 프레임당 io_uring_enter 한 번. 대신 전송 완료 시각(메트릭)은 다음 프레임이 올 때 찍힘
+            // 클라이언트 소켓은 링에 넣지 않고 깨어날 때마다 기다리지 않는 poll 로 확인 (요청은 늦어도 한 프레임)
+            if (!s.armed && uring_poll(s.u, fd, POLLIN, TAG_POLL) == 0)
+                s.armed = 1;
+            if (uring_submit(s.u, s.armed + s.pending, 2000) < 0)
+                mesg_exit("io_uring_enter");
+            if (!sender_reap(&s))
+                metric_add(&m_timeouts, 1);
+            control_poll(&s, -1, 0, NULL);
+            if (s.armed)
+                continue;
+            r = capture_read(cap, &f, 0);
+        } else if (fd >= 0) {
+            // 카메라 fd 와 클라이언트 소켓을 poll 하나로 기다림. 요청만 왔으면 처리하고 다시 기다림
+            int ready;
+            if (control_poll(&s, fd, 2000, &ready) == 0)
+                metric_add(&m_timeouts, 1);
+            if (!ready)
+                continue;
+            r = capture_read(cap, &f, 0);
+        } else {
+            // fd 가 없는 소스(합성/파일)는 프레임을 기다린 뒤에 요청을 확인
+            r = capture_read(cap, &f, 2000);
+            if (s.u)
+                sender_reap(&s);
+            control_poll(&s, -1, 0, NULL);
+        }
+        if (-1 == r)
+            mesg_exit("capture_read");
+        if (0 == r) {
+            if (fd < 0)
+                metric_add(&m_timeouts, 1);
+            continue;
+        }
+        int64_t t = trace_now();
+        trace_event("dqbuf", f.sequence, f.timestamp_us * 1000, t);
+        metric_add(&m_frames, 1);
+        if (f.dropped)
+            metric_add(&m_dropped, f.dropped);
+        if (ring) {
+            shmring_publish(ring, &f);
+            int64_t t1 = trace_now();
+            trace_event("shm", f.sequence, t, t1);
+            t = t1;
+        }
+
+        // CPU 사용량은 클라이언트가 받기 시작한 뒤부터 (받는 클라이언트가 있을 때의 프레임 기준)
+        if (streaming_clients && frames++ == 0) {
+            getrusage(RUSAGE_SELF, &r0);
+            enters0 = s.u ? uring_enters(s.u) : 0;
+        }
+
+        // 보는 화질이 없어도 계속 인코딩 (키프레임 캐시가 항상 최신이도록)
+        // 피라미드는 여기서 만들고 인코딩/전송은 화질별 스레드에서
+        if (sc && simulcast_push(sc, &f) == 0) {
+            int64_t t1 = trace_now();
+            trace_event("pyramid", f.sequence, t, t1);
+            t = t1;
+        }
+
+        int raw = 0;
+        for (int i = 0; i < CLIENT_MAX; i++)
+            raw += wants_raw(&clients[i]);
+        if (!raw) {
+            if (-1 == capture_release(cap, &f))
+                mesg_exit("capture_release");
+            continue;
+        }
+
+        // 같은 소켓에 두 프레임이 섞이지 않게, 그리고 variant 버퍼를 덮어쓰기 전에 이전 전송을 끝냄
+        // 인코더 스레드는 화질을 고른 클라이언트에만 쓰고, 화질은 이 스레드가 send_lock 을 잡고 바꾸므로 잠그지 않음
+        if (s.u)
+            sender_wait(&s);
+        sender_start(&s, &f, t);
+        // 카메라 fd 를 기다리지 않는 소스(합성/파일)는 바로 제출 (완료는 다음 capture_read 동안)
+        if (s.u && fd < 0 && uring_submit(s.u, 0, 0) < 0)
+            mesg_exit("io_uring_enter");
+    }
+
+    if (s.u) {
+        sender_wait(&s);
+        print_cpu_usage("uring", frames, &r0, uring_enters(s.u) - enters0);
+        uring_free(s.u);
+    } else {
+        print_cpu_usage("poll", frames, &r0, 0);
+    }
 }
 
-static int set_camera() {
-    /* 카메라 장치 열기 */
-    camfd = open(VIDEODEV, O_RDWR | O_NONBLOCK, 0);
-    if (-1 == camfd) {
-        fprintf(stderr, "Cannot open '%s': %d, %s\n",
-            VIDEODEV, errno, strerror(errno));
+static int set_camera(const char* source, int buffers, const struct capture_rect* roi) {
+    struct capture_config cfg;
+    struct capture_rect cur, full;
+
+    /* 카메라 장치 열기 (포맷 협상, mmap, 스트리밍 시작까지) */
+    /* 클라이언트가 크기/포맷을 모르므로 YUYV 800x600 으로 고정 */
+    capture_config_default(&cfg);
+    cfg.source = source;
+    cfg.pixelformat = V4L2_PIX_FMT_YUYV;
+    cfg.width = WIDTH;
+    cfg.height = HEIGHT;
+    cfg.buffers = buffers;
+    cfg.roi = *roi;
+    cap = capture_open(&cfg);
+    if (!cap)
         return EXIT_FAILURE;
-    }
 
-    init_device(camfd);
-    start_capturing(camfd);
+    // ROI 는 이 안에서만 (클라이언트 버퍼 크기)
+    capture_get_roi(cap, &cur, &full);
+    if (full.width != WIDTH || full.height != HEIGHT) {
+        fprintf(stderr, "%s: got %dx%d, client needs %dx%d\n", source, full.width, full.height, WIDTH, HEIGHT);
+        return EXIT_FAILURE;
+    }
+    if (roi->width > 0)
+        printf("roi %dx%d+%d+%d of %dx%d\n", cur.width, cur.height, cur.left, cur.top, full.width, full.height);
 
     return 1;
 }
@@ -306,6 +1097,9 @@ static int open_server() {
         perror("socket()");
         return -1;
     }
+    // 재시작할 때 이전 연결이 TIME_WAIT 이어도 바로 bind
+    int one = 1;
+    setsockopt(ssock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
     memset(&servaddr, 0, sizeof(servaddr));
     servaddr.sin_family = AF_INET;
     servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
@@ -324,55 +1118,157 @@ static int open_server() {
 
 int main(int argc, char** argv)
 {
-    if (set_camera() != 1) return 0;
-    if (open_server() != 1) return 0;
+    int buffers = 4;
+    int metrics_port = METRICS_PORT;
+    int loop = LOOP_LEGACY;
+    long max_frames = 0;
+    const char* ring_name = NULL;
+    int ring_slots = 4;
+    struct capture_rect roi = { 0 };
+    struct simulcast_config scfg;
+    int opt;
 
-    clen = sizeof(cliaddr);
-    while (1) {
-        csock = accept(ssock, (struct sockaddr*)&cliaddr, &clen);
+    simulcast_config_default(&scfg);
+    scfg.levels = 0;
 
-        if ((pid = fork()) < 0) {
-            perror("fork()");
-        }
-        else if (pid == 0) {
-            while (1) {
-                memset(msg, 0, BUFSIZ);
-                if ((n = read(csock, msg, BUFSIZ)) <= 0) {
-                    perror("read()");
-                    close(csock);
-                    break;
-                }
-                // 클라이언트 요청에 따라 전송 플래그 설정
-                if (!strcmp(msg, "1")) {
-                    kill(getppid(), SIGUSR1);
-                }
-                else if (!strcmp(msg, "2")) {
-                    kill(getppid(), SIGUSR2);
-                }
+    // -b : 캡처 버퍼 수
+    // -t : 프레임별 단계 시간(dqbuf, pack, send)을 기록해서 종료(Ctrl+C) 때 Chrome trace 로 저장
+    // -m : 메트릭 HTTP 포트 (127.0.0.1 에서만). 0 이면 끔
+    // -e : 전송 루프. legacy (기본, 고정 대기), poll, uring (지원 안 하면 poll)
+    // -n : 이벤트 루프에서 이 수만큼 보내면 종료하고 프레임당 CPU 사용량을 출력 (벤치마크용)
+    // -S : simulcast. 화질별 kbps (앞에서부터 전체, 절반, 1/4 ... 크기). "-S 2000,700,250"
+    // -R : 캡처 프레임을 공유 메모리 링 /dev/shm/name 으로도 내보냄 (슬롯 수 기본 4)
+    //      다른 프로세스는 capture 소스 "shm:name" 으로 받음
+    // -z : 이 영역(ROI)만 보냄. "640x360+80+120", 크기만 주면 가운데. 클라이언트가 CTRL_SET_ROI 로 바꿀 수 있음
+    //      장치가 지원하면 센서에서 자르고(VIDIOC_S_SELECTION), 아니면 복사 없이 포인터로 자름
+    while ((opt = getopt(argc, argv, "b:t:m:e:n:S:R:z:")) != -1) {
+        if (opt == 'b') {
+            buffers = atoi(optarg);
+        } else if (opt == 't') {
+            trace_path = optarg;
+            trace_init(65536);
+        } else if (opt == 'm') {
+            metrics_port = atoi(optarg);
+        } else if (opt == 'e' && !strcmp(optarg, "legacy")) {
+            loop = LOOP_LEGACY;
+        } else if (opt == 'e' && !strcmp(optarg, "poll")) {
+            loop = LOOP_POLL;
+        } else if (opt == 'e' && !strcmp(optarg, "uring")) {
+            loop = LOOP_URING;
+        } else if (opt == 'n') {
+            max_frames = atol(optarg);
+        } else if (opt == 'S') {
+            char* p = optarg;
+            for (scfg.levels = 0; scfg.levels < SIMULCAST_MAX && *p; scfg.levels++) {
+                scfg.kbps[scfg.levels] = strtol(p, &p, 10);
+                if (*p == ',')
+                    p++;
+            }
+        } else if (opt == 'R') {
+            char* colon = strchr(optarg, ':');
+            if (colon) {
+                *colon = '\0';
+                ring_slots = atoi(colon + 1);
             }
+            ring_name = optarg;
+        } else if (opt == 'z') {
+            if (capture_parse_roi(&roi, optarg) < 0) {
+                fprintf(stderr, "bad roi %s (WxH or WxH+X+Y)\n", optarg);
+                return EXIT_FAILURE;
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [-b buffers] [-t trace.json] [-m metrics_port] [-e legacy|poll|uring] [-n frames]"
+                            " [-S kbps,kbps,...] [-R name[:slots]] [-z WxH[+X+Y]] [/dev/videoN | synth]\n", argv[0]);
+            return EXIT_FAILURE;
         }
-        else {
-            signal(SIGUSR1, setFlag);
-            signal(SIGUSR2, setFlag);
-            mainloop(camfd);
+    }
+
+    // 캡처 소스: 기본은 카메라. "synth" 를 주면 카메라 없이 테스트 패턴을 보냄
+    if (set_camera(optind < argc ? argv[optind] : VIDEODEV, buffers, &roi) != 1) return 0;
+    if (open_server() != 1) return 0;
+
+    if (ring_name) {
+        struct capture_format fmt;
+        capture_get_format(cap, &fmt);
+        ring = shmring_create(ring_name, &fmt, ring_slots);
+        if (!ring)
+            return EXIT_FAILURE;
+    }
+
+    if (scfg.levels > 0) {
+        struct capture_format fmt;
+        capture_get_format(cap, &fmt);
+        scfg.out = send_packet;
+        sc = simulcast_open(&scfg, &fmt);
+        if (!sc)
+            return EXIT_FAILURE;
+        for (int i = 0; i < scfg.levels; i++) {
+            int w, h;
+            simulcast_get_size(sc, i, &w, &h);
+            printf("simulcast %d: %dx%d %d kbps\n", i, w, h, scfg.kbps[i]);
+            // 키프레임 간격(1초)의 두 배 + 여유. 키프레임이 평균보다 크고 비트레이트도 흔들리므로
+            gop[i] = gopcache_create((size_t)scfg.kbps[i] * 1000 / 8 * 2 + 256 * 1024);
+            if (!gop[i])
+                return EXIT_FAILURE;
+        }
+        // 인코더 스레드와 전송을 나눠 써야 하므로 기존 루프(고정 대기)와 io_uring 전송은 쓰지 않음
+        if (loop != LOOP_POLL) {
+            fprintf(stderr, "simulcast uses the poll loop\n");
+            loop = LOOP_POLL;
         }
     }
 
-    /* 캡쳐 중단 */
-    enum v4l2_buf_type type;
-    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (-1 == xioctl(camfd, VIDIOC_STREAMOFF, &type))
-        mesg_exit("VIDIOC_STREAMOFF");
+    register_metrics();
+    if (metrics_port > 0 && metrics_serve(metrics_port) < 0)
+        fprintf(stderr, "metrics disabled\n");
+
+    vc = variant_cache_create();
+    if (!vc)
+        return EXIT_FAILURE;
+    signal(SIGINT, stop_running);
+    // 끊긴 클라이언트에 쓰면 죽지 않고 EPIPE (그 연결만 정리)
+    signal(SIGPIPE, SIG_IGN);
+
+    // 연결은 루프 안에서 받음. 클라이언트가 없어도 캡처는 계속 (공유 메모리 링, 키프레임 캐시가 최신이도록)
+    for (int i = 0; i < CLIENT_MAX; i++)
+        clients[i].sock = -1;
+    clen = sizeof(cliaddr);
+    if (loop == LOOP_LEGACY)
+        mainloop(cap);
+    else
+        event_loop(cap, loop, max_frames);
+    for (int i = 0; i < CLIENT_MAX; i++)
+        if (clients[i].sock >= 0)
+            client_close(NULL, &clients[i]);
+
+    if (trace_path) {
+        trace_write_chrome(trace_path);
+        trace_summary(stdout);
+    }
+
+    if (sc) {
+        for (int i = 0; i < simulcast_levels(sc); i++) {
+            struct simulcast_stats st;
+            simulcast_get_stats(sc, i, &st);
+            printf("simulcast %d: %lu frames, %lu skipped, %lu bytes, encode %.2f ms, cache overflows %lu\n", i,
+                   st.frames, st.skipped, st.bytes, st.encode_ms, gopcache_overflows(gop[i]));
+        }
+        simulcast_close(sc);
+        for (int i = 0; i < SIMULCAST_MAX; i++)
+            gopcache_free(gop[i]);
+    }
 
-    /* 메모리 정리 */
-    for (int i = 0; i < n_buffers; ++i)
-        if (-1 == munmap(buffers[i].start, buffers[i].length))
-            mesg_exit("munmap");
-    free(buffers);
+    if (vc) {
+        struct variant_stats vs;
+        variant_get_stats(vc, &vs);
+        if (vs.converted || vs.passthrough)
+            printf("variants: %lu converted, %lu shared, %lu passthrough\n", vs.converted, vs.shared, vs.passthrough);
+        variant_cache_free(vc);
+    }
 
-    /* 장치 닫기 */
-    if (-1 == close(camfd))
-        mesg_exit("close");
+    /* 캡쳐 중단, 메모리 정리, 장치 닫기 */
+    shmring_close(ring);
+    capture_close(cap);
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,120 @@
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "yuvscale.h"
+
+void yuvscale_box2_row(const uint8_t *r0, const uint8_t *r1, uint8_t *out, int n, int step)
+{
+    int x = 0;
+#if defined(__ARM_NEON)
+    if (step == 1) {
+        // 가로 쌍 합(vpaddl) 에 아랫줄 쌍 합을 더하고(vpadal) 반올림해서 /4
+        for (; x + 16 <= n; x += 16) {
+            uint16x8_t lo = vpadalq_u8(vpaddlq_u8(vld1q_u8(r0 + 2 * x)), vld1q_u8(r1 + 2 * x));
+            uint16x8_t hi = vpadalq_u8(vpaddlq_u8(vld1q_u8(r0 + 2 * x + 16)), vld1q_u8(r1 + 2 * x + 16));
+            vst1q_u8(out + x, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+        }
+    } else if (step == 2) {
+        // vld2 로 짝수 바이트만 (val[0]). NV12 의 V 는 r0 + 1 에서 시작하므로 마지막 한 칸은 아래 스칼라로
+        for (; x + 16 < n; x += 16) {
+            uint8x16x2_t a0 = vld2q_u8(r0 + 4 * x), a1 = vld2q_u8(r0 + 4 * x + 32);
+            uint8x16x2_t b0 = vld2q_u8(r1 + 4 * x), b1 = vld2q_u8(r1 + 4 * x + 32);
+            uint16x8_t lo = vpadalq_u8(vpaddlq_u8(a0.val[0]), b0.val[0]);
+            uint16x8_t hi = vpadalq_u8(vpaddlq_u8(a1.val[0]), b1.val[0]);
+            vst1q_u8(out + x, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i lo8 = _mm_set1_epi16(0xff);
+    const __m128i two16 = _mm_set1_epi16(2);
+    if (step == 1) {
+        // 짝수/홀수 바이트를 16비트로 나눠서 더함 -> 가로 두 개 합, 두 줄을 더하고 /4
+        for (; x + 8 <= n; x += 8) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(r0 + 2 * x));
+            __m128i b = _mm_loadu_si128((const __m128i *)(r1 + 2 * x));
+            __m128i s = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, lo8), _mm_srli_epi16(a, 8)),
+                                      _mm_add_epi16(_mm_and_si128(b, lo8), _mm_srli_epi16(b, 8)));
+            s = _mm_srli_epi16(_mm_add_epi16(s, two16), 2);
+            _mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(s, s));
+        }
+    } else if (step == 2) {
+        // 16비트마다 하위 바이트가 샘플. 두 줄을 더한 뒤 32비트마다 이웃한 두 샘플을 더함
+        // NV12 의 V 는 r0 + 1 에서 시작하므로 마지막 한 칸은 아래 스칼라로
+        const __m128i lo16 = _mm_set1_epi32(0xffff);
+        const __m128i two32 = _mm_set1_epi32(2);
+        for (; x + 8 < n; x += 8) {
+            __m128i s[2];
+            for (int k = 0; k < 2; k++) {
+                __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i *)(r0 + 4 * x + 16 * k)), lo8);
+                __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i *)(r1 + 4 * x + 16 * k)), lo8);
+                __m128i v = _mm_add_epi16(a, b);
+                v = _mm_add_epi32(_mm_and_si128(v, lo16), _mm_srli_epi32(v, 16));
+                s[k] = _mm_srli_epi32(_mm_add_epi32(v, two32), 2);
+            }
+            __m128i p = _mm_packs_epi32(s[0], s[1]);
+            _mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(p, p));
+        }
+    }
+#endif
+    for (; x < n; x++) {
+        const uint8_t *a = r0 + 2 * x * step;
+        const uint8_t *b = r1 + 2 * x * step;
+        out[x] = (a[0] + a[step] + b[0] + b[step] + 2) >> 2;
+    }
+}
+
+// 출력 칸 i 의 중심에 해당하는 입력 위치 (16.16 고정소수점, 가장자리에서 자름)
+static int32_t src_pos(int i, int src, int dst)
+{
+    int64_t p = ((int64_t)(2 * i + 1) * src << 16) / (2 * dst) - 32768;
+    if (p < 0)
+        p = 0;
+    if (p > (int64_t)(src - 1) << 16)
+        p = (int64_t)(src - 1) << 16;
+    return (int32_t)p;
+}
+
+void yuvscale_plane(const uint8_t *src, int sstride, int sstep, int sw, int sh,
+                    uint8_t *dst, int dstride, int dw, int dh, int32_t *xt)
+{
+    if (sw == 2 * dw && sh == 2 * dh) {
+        for (int y = 0; y < dh; y++)
+            yuvscale_box2_row(src + (size_t)2 * y * sstride, src + (size_t)(2 * y + 1) * sstride,
+                              dst + (size_t)y * dstride, dw, sstep);
+        return;
+    }
+    if (sw == dw && sh == dh && sstep == 1) {
+        for (int y = 0; y < dh; y++)
+            memcpy(dst + (size_t)y * dstride, src + (size_t)y * sstride, dw);
+        return;
+    }
+
+    // 쌍선형. 가중치는 8비트
+    for (int x = 0; x < dw; x++)
+        xt[x] = src_pos(x, sw, dw);
+    for (int y = 0; y < dh; y++) {
+        int32_t fy = src_pos(y, sh, dh);
+        int y0 = fy >> 16;
+        int y1 = y0 + 1 < sh ? y0 + 1 : y0;
+        int wy = (fy >> 8) & 0xff;
+        const uint8_t *a = src + (size_t)y0 * sstride;
+        const uint8_t *b = src + (size_t)y1 * sstride;
+        uint8_t *out = dst + (size_t)y * dstride;
+
+        for (int x = 0; x < dw; x++) {
+            int x0 = xt[x] >> 16;
+            int x1 = (x0 + 1 < sw ? x0 + 1 : x0) * sstep;
+            int wx = (xt[x] >> 8) & 0xff;
+            x0 *= sstep;
+            int top = a[x0] * (256 - wx) + a[x1] * wx;
+            int bot = b[x0] * (256 - wx) + b[x1] * wx;
+            out[x] = (top * (256 - wy) + bot * wy + 32768) >> 16;
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef YUVSCALE_H
+#define YUVSCALE_H
+
+#include <stdint.h>
+
+// 8비트 영상 평면 하나를 줄이는 함수들 (mosaic, simulcast 가 같이 씀)
+// 입력 샘플 간격(step)을 받아서 YUYV 나 NV12 처럼 섞여 있는 평면도 따로 풀지 않고 바로 읽음
+//   평면 1, YUYV 의 Y 와 NV12 의 U/V 2, YUYV 의 U/V 4
+
+// 2:1 상자 필터 한 줄: 입력 두 줄(r0, r1)에서 2x2 평균을 n 개. NEON/SSE2 가 있으면 SIMD
+void yuvscale_box2_row(const uint8_t *r0, const uint8_t *r1, uint8_t *out, int n, int step);
+
+// sw x sh -> dw x dh. 딱 2배면 상자 필터, 크기가 같고 step 1 이면 복사, 그 외에는 쌍선형 (가중치 8비트)
+// xt 는 dw 칸짜리 작업 공간 (스레드마다 따로)
+void yuvscale_plane(const uint8_t *src, int sstride, int sstep, int sw, int sh,
+                    uint8_t *dst, int dstride, int dw, int dh, int32_t *xt);
+
+#endif // YUVSCALE_H